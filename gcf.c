@@ -19,131 +19,158 @@
 #include "u_bstream.h"
 #include "u_strlen.h"
 #include "u_mem.h"
+#include "u_slab.h"
 #include "buffer_helper.h"
-#include "gcf.h"
-#include "protocol.h"
+#include "gcf_private.h"
+#include "gcf_metrics.h"
+#include "gcf_profile.h"
+#include "gcf_bench.h"
+#include "gcf_library.h"
+#include "gcf_station.h"
 #include "net.h"
 
 #define UI_MAX_LINE_LENGTH 255
 #define UI_MAX_LINES 32
 
-#define MAX_DEVICES 4
-
-#define GCF_HEADER_SIZE 14
-#define GCF_MAGIC 0xCAFEFEED
-
-#define FLASH_TYPE_APP_ENCRYPTED             60
-#define FLASH_TYPE_APP_COMPRESSED_ENCRYPTED  70
-#define FLASH_TYPE_BTL_ENCRYPTED             80
-
-#define FW_VERSION_PLATFORM_MASK 0x0000FF00
-#define FW_VERSION_PLATFORM_R21  0x00000700 /* 0x26120700*/
-#define FW_VERSION_PLATFORM_AVR  0x00000500 /* 0x26390500*/
+#define GCF_DEVICE_CACHE_TIME 3000
+#define GCF_ASCII_SIZE 512
 
+/* Sessions holding working buffers at once, see gcfSessionAttach(). */
+#ifndef GCF_MAX_ACTIVE_SESSIONS
+  #define GCF_MAX_ACTIVE_SESSIONS 16
+#endif
 
-/* Bootloader V3.x serial protocol */
-#define BTL_MAGIC              0x81
-#define BTL_ID_REQUEST         0x02
-#define BTL_ID_RESPONSE        0x82
-#define BTL_FW_UPDATE_REQUEST  0x03
-#define BTL_FW_UPDATE_RESPONSE 0x83
-#define BTL_FW_DATA_REQUEST    0x04
-#define BTL_FW_DATA_RESPONSE   0x84
+/* Firmware images in memory at once, shared by the sessions flashing them.
+   One suffices for a single flash, station, batch and daemon builds raise it. */
+#ifndef GCF_FIRMWARE_BUFFERS
+  #define GCF_FIRMWARE_BUFFERS 1
+#endif
 
-/* Bootloader V1 */
-#define V1_PAGESIZE 256
+/* Frames staged per event handler, up to what the platform writes at once. */
+#define GCF_TX_STAGE_SIZE 512
 
-typedef void (*state_handler_t)(GCF*, Event);
+#ifdef USE_NET
+/* Remote flash protocol over UDP, all values little-endian.
+
+   Each datagram starts with the header:
+     U8  magic RF_MAGIC
+     U8  message type
+     U16 session id (chosen by the client)
+
+   RF_OPEN_REQ     U32 image size, U16 timeout (seconds, 0 = default),
+                   U8 length + device path, U8 length + file name
+   RF_OPEN_RSP     U8 status, U16 chunk size, U16 window
+   RF_DATA         U16 sequence number, chunk data (offset = seq * chunk size)
+   RF_ACK          U16 base (all chunks < base received),
+                   U32 bitmap, bit N set if chunk base + 1 + N was received
+   RF_START        (empty) start flashing the complete image
+   RF_STATUS       (empty) query, answered with RF_ACK, RF_PROGRESS or RF_RESULT
+   RF_PROGRESS     U8 percent
+   RF_RESULT       U8 status
+   RF_DISCOVER_REQ (empty) sent to RF_DISCOVERY_GROUP or a single host
+   RF_DISCOVER_RSP U8 device count, per device:
+                   U8 length + path, U8 length + serial, U8 length + type name,
+                   U32 firmware version (0 if unknown)
+
+   The client keeps up to 'window' chunks in flight and retransmits
+   chunks which aren't acknowledged within RF_RTO.
+
+   The protocol has no authentication, the server listens on loopback unless
+   -i gives another address. It only opens devices it enumerates itself
+   (exact path or stable path) or the one given by -d on its command line,
+   and answers RF_STATUS_BUSY while another session is uploading.
+
+   Servers (-p) and serial bridges (-c -p) join RF_DISCOVERY_GROUP and
+   answer discovery requests with their attached devices, the client (-n)
+   prints all responses received within RF_DISCOVER_WINDOW.
+*/
+#define RF_MAGIC        0xF5
+#define RF_OPEN_REQ     0x01
+#define RF_DATA         0x02
+#define RF_START        0x03
+#define RF_STATUS       0x04
+#define RF_DISCOVER_REQ 0x05
+#define RF_OPEN_RSP     0x81
+#define RF_ACK          0x82
+#define RF_PROGRESS     0x84
+#define RF_RESULT       0x85
+#define RF_DISCOVER_RSP 0x86
+
+#define RF_STATUS_OK            0
+#define RF_STATUS_BUSY          1
+#define RF_STATUS_INVALID       2
+#define RF_STATUS_INCOMPLETE    3
+#define RF_STATUS_INVALID_FILE  4
+#define RF_STATUS_FLASH_FAILED  5
+#define RF_STATUS_NO_SESSION    6
+
+#define RF_HEADER_SIZE 4
+#define RF_CHUNK_SIZE  1024
+#define RF_WINDOW      32 /* must match the ACK bitmap size */
+#define RF_MAX_CHUNKS  ((MAX_GCF_FILE_SIZE + RF_CHUNK_SIZE - 1) / RF_CHUNK_SIZE)
+#define RF_RTO         200
+#define RF_TICK        50
+#define RF_PEER_TIMEOUT (30 * 1000)
+#define RF_DEFAULT_PORT 19817
+#define RF_DISCOVERY_GROUP "239.255.71.70" /* organization-local scope */
+#define RF_DISCOVER_WINDOW 1500
 
 typedef enum
 {
-    T_NONE,
-    T_RESET,
-    T_PROGRAM,
-    T_LIST,
-    T_CONNECT,
-    T_HELP
-} Task;
+    RF_STATE_IDLE,
+    RF_STATE_RECEIVING,
+    RF_STATE_FLASHING,
+    RF_STATE_DONE
+} RF_State;
 
-typedef enum
-{
-    DEV_UNKNOWN,
-    DEV_RASPBEE_1,
-    DEV_RASPBEE_2,
-    DEV_CONBEE_1,
-    DEV_CONBEE_2,
-    DEV_HIVE
-} DeviceType;
+/* -d of the server, opened for clients even if it isn't enumerated */
+static char gcfServerDevice[MAX_DEV_PATH_LENGTH];
 
-typedef struct GCF_File_t
+typedef struct GCF_Remote_t
 {
-    char fname[MAX_DEV_PATH_LENGTH];
-    unsigned long fsize;
-
-    unsigned long fwVersion; /* taken from file name */
-
-    /* parsed GCF file header */
-    unsigned char gcfFileType;
-    unsigned long gcfTargetAddress;
-    unsigned long gcfFileSize;
-    unsigned char gcfCrc;
-    unsigned long gcfCrc32;
-
-    unsigned char fcontent[MAX_GCF_FILE_SIZE];
-} GCF_File;
+    RF_State state;
+    unsigned short session;
+    unsigned char result;
+    unsigned char percent;
+    unsigned long size;   /* image size */
+    unsigned nchunks;
+    unsigned chunkSize;
+    unsigned window;
+    unsigned base;        /* all chunks < base are received (server) or acknowledged (client) */
+    unsigned long timeout;
+    PL_time_t lastRx;
+    char peerAddr[64];    /* client: address of the remote GCFFlasher */
+    unsigned short peerPort;
+    unsigned char chunkMap[(RF_MAX_CHUNKS + 7) / 8];
+    PL_time_t sendTime[RF_MAX_CHUNKS]; /* client: last transmission of a chunk */
+} GCF_Remote;
+#endif /* USE_NET */
 
 typedef struct UI_Line
 {
     char buf[UI_MAX_LINE_LENGTH];
+    U_SStream ss;
 } UI_Line;
 
-/* The GCF struct holds the complete state as well as GCF file data. */
-typedef struct GCF_t
+/* Working buffers of a session which runs a task, taken from gcfSessionSlab.
+   Idle sessions only keep the GCF struct. */
+typedef struct GCF_SessionBuffers_t
 {
-    int argc;
-    char **argv;
-    unsigned wp;     /* ascii[] write pointer */
-    char ascii[512]; /* buffer for raw data */
-    state_handler_t state;
-    state_handler_t substate;
-
-    /* UI line buffering */
-    unsigned uiCurrentLine;
-    UI_Line uiLines[UI_MAX_LINES];
-    U_SStream uiStringStream;
-
-    int retry;
-
-    unsigned remaining; /* remaining bytes during upload */
-
-    Task task;
-
-    PROT_RxState rxstate;
-
-    PL_time_t startTime;
-    PL_time_t maxTime;
-
-    unsigned devCount;
+    char ascii[GCF_ASCII_SIZE];
     Device devices[MAX_DEVICES];
+#ifdef USE_NET
+    GCF_Remote remote;
+#endif
+} GCF_SessionBuffers;
 
-    DeviceType devType;
-
-    PL_Baudrate devBaudrate;
-    char devpath[MAX_DEV_PATH_LENGTH];
-    char devSerialNum[MAX_DEV_SERIALNR_LENGTH];
-    GCF_File file;
-} GCF;
-
-
-static DeviceType gcfGetDeviceType(GCF *gcf);
 static void gcfRetry(GCF *gcf);
 static void gcfPrintHelp(void);
 static GCF_Status gcfProcessCommandline(GCF *gcf);
-static void gcfGetDevices(GCF *gcf);
+static void gcfPrepareServerTask(GCF *gcf, unsigned long timeout);
+static void gcfTaskDone(GCF *gcf, GCF_Status status);
 static void gcfCommandResetUart(void);
 static void gcfCommandQueryStatus(void);
 static void gcfCommandQueryFirmwareVersion(void);
-static void ST_Void(GCF *gcf, Event event);
 static void ST_Init(GCF *gcf, Event event);
 
 static void ST_Program(GCF *gcf, Event event);
@@ -164,17 +191,50 @@ static void ST_Connected(GCF *gcf, Event event);
 
 static void ST_Reset(GCF *gcf, Event event);
 static void ST_ResetUart(GCF *gcf, Event event);
-static void ST_ResetFtdi(GCF *gcf, Event event);
-static void ST_ResetRaspBee(GCF *gcf, Event event);
+static void ST_ResetGpio(GCF *gcf, Event event);
 
 static void ST_ListDevices(GCF *gcf, Event event);
+static void ST_Server(GCF *gcf, Event event);
+static void ST_Query(GCF *gcf, Event event);
+
+static void gcfControlProgress(GCF *gcf, unsigned char percent);
+
+#ifdef USE_NET
+static void ST_RemoteOpen(GCF *gcf, Event event);
+static void ST_RemoteUpload(GCF *gcf, Event event);
+static void ST_RemoteFlash(GCF *gcf, Event event);
+static void ST_Discover(GCF *gcf, Event event);
+static void gcfDiscoverRespond(GCF *gcf, int client_id, unsigned short session);
+static void gcfDiscoverReceived(GCF *gcf, int client_id, unsigned char type, U_BStream *bs);
+static void gcfRemoteProgress(GCF *gcf, unsigned char percent);
+static void gcfRemoteSendStatus(GCF *gcf, int client_id);
+static void gcfRemoteServerReceived(GCF *gcf, int client_id, unsigned char type, unsigned short session, U_BStream *bs);
+static void gcfRemoteClientReceived(GCF *gcf, unsigned char type, unsigned short session, U_BStream *bs);
+#endif
 
-static UI_Line *UI_NextLine(GCF *gcf);
-U_SStream *UI_StringStream(GCF *gcf);
-void U_sstream_put_u32hex(U_SStream *ss, unsigned long val);
+static UI_Line *UI_NextLine(void);
 
 static GCF gcfLocal;
 
+static GCF_SessionBuffers gcfSessionMem[GCF_MAX_ACTIVE_SESSIONS];
+static unsigned short gcfSessionRefs[GCF_MAX_ACTIVE_SESSIONS];
+static U_Slab gcfSessionSlab;
+
+static unsigned char gcfFirmwareMem[GCF_FIRMWARE_BUFFERS][MAX_GCF_FILE_SIZE];
+static unsigned short gcfFirmwareRefs[GCF_FIRMWARE_BUFFERS];
+static U_Slab gcfFirmwareSlab;
+static int gcfPoolsReady;
+
+/* UI line buffering, shared by all sessions */
+static unsigned uiCurrentLine;
+static UI_Line uiLines[UI_MAX_LINES];
+
+char gcfOutputFile[MAX_DEV_PATH_LENGTH];
+
+/* Session of the running GCF_HandleEvent() / GCF_Received() call, needed by
+   callbacks without context argument like PROT_Packet() and NET_Received(). */
+static GCF *gcfCurrent = &gcfLocal;
+
 
 static const char hex_lookup[16] =
 {
@@ -188,12 +248,12 @@ void put_hex(unsigned char ch, char *buf)
     buf[1] = hex_lookup[(ch & 0x0F)];
 }
 
-static UI_Line *UI_NextLine(GCF *gcf)
+static UI_Line *UI_NextLine(void)
 {
     UI_Line *line;
 
-    gcf->uiCurrentLine = (gcf->uiCurrentLine + 1) % UI_MAX_LINES;
-    line = &gcf->uiLines[gcf->uiCurrentLine];
+    uiCurrentLine = (uiCurrentLine + 1) % UI_MAX_LINES;
+    line = &uiLines[uiCurrentLine];
 
     line->buf[0] = '\0';
 
@@ -212,9 +272,118 @@ void UI_Puts(GCF *gcf, const char *str)
 U_SStream *UI_StringStream(GCF *gcf)
 {
     UI_Line *line;
-    line = UI_NextLine(gcf);
-    U_sstream_init(&gcf->uiStringStream, line->buf, sizeof(line->buf));
-    return &gcf->uiStringStream;
+    (void)gcf;
+    line = UI_NextLine();
+    U_sstream_init(&line->ss, line->buf, sizeof(line->buf));
+    return &line->ss;
+}
+
+/* Session and firmware pools
+
+   A session only holds its working buffers while it runs a task, sessions
+   created by GCF_CreateSession() return them when the task is done.
+   Firmware content is shared: sessions flashing the same image reference one
+   gcfFirmwareSlab block, which is free again when the last one lets go.
+ */
+static void gcfInitPools(void)
+{
+    if (gcfPoolsReady)
+        return;
+
+    U_slab_init(&gcfSessionSlab, gcfSessionMem, sizeof(gcfSessionMem[0]), GCF_MAX_ACTIVE_SESSIONS, gcfSessionRefs);
+    U_slab_init(&gcfFirmwareSlab, gcfFirmwareMem, sizeof(gcfFirmwareMem[0]), GCF_FIRMWARE_BUFFERS, gcfFirmwareRefs);
+    gcfPoolsReady = 1;
+}
+
+static GCF_Status gcfSessionAttach(GCF *gcf)
+{
+    GCF_SessionBuffers *buffers;
+
+    if (gcf->buffers)
+        return GCF_SUCCESS;
+
+    buffers = (GCF_SessionBuffers*)U_slab_alloc(&gcfSessionSlab);
+    if (!buffers)
+    {
+        PL_Printf(DBG_DEBUG, "no free session buffers\n");
+        return GCF_FAILED;
+    }
+
+    U_bzero(buffers, sizeof(*buffers));
+    gcf->buffers = buffers;
+    gcf->ascii = &buffers->ascii[0];
+    gcf->devices = &buffers->devices[0];
+#ifdef USE_NET
+    gcf->remote = &buffers->remote;
+#endif
+    gcf->wp = 0;
+    gcf->devCount = 0;
+    return GCF_SUCCESS;
+}
+
+static void gcfSessionDetach(GCF *gcf)
+{
+    if (!gcf->buffers)
+        return;
+
+    U_slab_unref(&gcfSessionSlab, gcf->buffers);
+    gcf->buffers = 0;
+    gcf->ascii = 0;
+    gcf->devices = 0;
+#ifdef USE_NET
+    gcf->remote = 0;
+#endif
+    gcf->devCount = 0;
+}
+
+/*! Drops the reference to the firmware content. */
+void gcfFileRelease(GCF *gcf)
+{
+    if (gcf->file.fbuf)
+        U_slab_unref(&gcfFirmwareSlab, gcf->file.fbuf);
+
+    gcf->file.fbuf = 0;
+    gcf->file.fcontent = 0;
+    gcf->file.fsize = 0;
+    gcf->fileStamp = 0;
+}
+
+/*! Returns a firmware buffer of MAX_GCF_FILE_SIZE which only \p gcf references,
+    the previous content is dropped. Returns 0 if all buffers are in use.
+ */
+unsigned char *gcfFileBuffer(GCF *gcf)
+{
+    unsigned char *buf;
+
+    buf = gcf->file.fbuf;
+    if (!buf || U_slab_refs(&gcfFirmwareSlab, buf) != 1)
+    {
+        gcfFileRelease(gcf);
+        buf = (unsigned char*)U_slab_alloc(&gcfFirmwareSlab);
+        if (!buf)
+        {
+            PL_Printf(DBG_DEBUG, "no free firmware buffer\n");
+            return 0;
+        }
+    }
+
+    gcf->file.fbuf = buf;
+    gcf->file.fcontent = buf;
+    gcf->file.fsize = 0;
+    gcf->fileStamp = 0;
+    return buf;
+}
+
+/*! Lets \p dst reference the firmware loaded by \p src. */
+void gcfFileShare(GCF *dst, const GCF *src)
+{
+    if (dst->file.fbuf == src->file.fbuf && dst->file.fcontent == src->file.fcontent)
+        return;
+
+    gcfFileRelease(dst);
+    dst->file = src->file;
+    if (dst->file.fbuf)
+        U_slab_ref(&gcfFirmwareSlab, dst->file.fbuf);
 }
 
 #ifdef PL_NO_UTF8
@@ -250,6 +419,19 @@ static void UI_UpdateProgress(GCF *gcf)
     if (percent > 95)
         percent = 100;
 
+    if (gcf->serverMode)
+    {
+        gcfControlProgress(gcf, (unsigned char)percent);
+#ifdef USE_NET
+        gcfRemoteProgress(gcf, (unsigned char)percent);
+#endif
+        if (gcf->callbacks.progress)
+            gcf->callbacks.progress(gcf->callbacks.user, (unsigned)percent);
+    }
+
+    if (gcf->quiet)
+        return;
+
     U_sstream_put_str(&ss, "\r ");
 
     /* ' 100 % '   right align percent number */
@@ -277,7 +459,7 @@ static void UI_UpdateProgress(GCF *gcf)
     PL_Print(&buf[0]);
 }
 
-static void ST_Void(GCF *gcf, Event event)
+void ST_Void(GCF *gcf, Event event)
 {
     (void)gcf;
     (void)event;
@@ -285,7 +467,11 @@ static void ST_Void(GCF *gcf, Event event)
 
 static void ST_Init(GCF *gcf, Event event)
 {
-    if (event == EV_PL_STARTED || event == EV_TIMEOUT)
+    if (event == EV_TIMEOUT && gcf->serverMode)
+    {
+        gcfStartTask(gcf); /* retry, the task didn't come from the command line */
+    }
+    else if (event == EV_PL_STARTED || event == EV_TIMEOUT)
     {
         if (gcfProcessCommandline(gcf) == GCF_FAILED)
         {
@@ -298,11 +484,139 @@ static void ST_Init(GCF *gcf, Event event)
     }
 }
 
+/* Reset strategies
+
+   The UART reset asks the firmware to reboot into the bootloader, which takes
+   up to 3 s to fail when the firmware is hung. RaspBee I & II also have a GPIO
+   reset, when the platform runs jobs on worker threads both are raced: the
+   GPIO reset job starts GCF_RESET_STAGGER ms after the UART reset, or right
+   away when it won more often for the device type before, and the first one
+   to succeed moves on to the bootloader. A UART success while the GPIO job
+   runs is held back until the job is done, since the GPIO reset restarts the
+   device.
+
+   Without workers the job would block the main loop for the whole reset, and
+   the ConBee I FTDI reset must not run in parallel since it can't be sure to
+   hit the right device when several are attached. In both cases the GPIO
+   reset only runs after the UART reset failed.
+ */
+#define GCF_RESET_TIMEOUT 3000
+#define GCF_RESET_STAGGER 300
+
+typedef enum
+{
+    RESET_GPIO_NONE,     /* device has no GPIO reset */
+    RESET_GPIO_WAIT,     /* started after the stagger */
+    RESET_GPIO_RUNNING,
+    RESET_GPIO_DONE,
+    RESET_GPIO_FALLBACK  /* not raced, started when the UART reset failed */
+} GCF_ResetGpio;
+
+/* wins per device type, kept for the process */
+static unsigned gcfResetWins[DEV_HIVE + 1][RESET_METHOD_MAX];
+
+static const char *gcfResetMethodName(GCF *gcf, GCF_ResetMethod method)
+{
+    if (method == RESET_METHOD_UART)
+        return "UART";
+
+    return gcf->devType == DEV_CONBEE_1 ? "FTDI" : "RaspBee GPIO";
+}
+
+static void gcfResetWon(GCF *gcf, GCF_ResetMethod method)
+{
+    unsigned *wins;
+
+    wins = gcfResetWins[gcf->devType];
+    wins[method]++;
+    gcf->resetWon = (unsigned char)(method + 1);
+
+    PL_Printf(DBG_DEBUG, "%s reset won after %u ms (UART %u, GPIO %u)\n",
+              gcfResetMethodName(gcf, method), (unsigned)(PL_Time() - gcf->resetStart),
+              wins[RESET_METHOD_UART], wins[RESET_METHOD_GPIO]);
+}
+
+/*! Returns the delay of the GPIO reset after the UART reset. */
+unsigned long gcfResetStagger(GCF *gcf)
+{
+    unsigned *wins;
+    GCF_Profile *prof;
+
+    /* the device itself is known better than its type */
+    prof = gcfDeviceProfile(gcf);
+    if (prof && prof->reset)
+        return prof->reset == RESET_METHOD_GPIO + 1 ? 0 : GCF_RESET_STAGGER;
+
+    wins = gcfResetWins[gcf->devType];
+    if (wins[RESET_METHOD_GPIO] > wins[RESET_METHOD_UART])
+        return 0;
+
+    return GCF_RESET_STAGGER;
+}
+
+/* Reset jobs, the resets sleep and run off the main loop. */
+static void gcfJobResetFtdi(void *arg)
+{
+    GCF *gcf;
+
+    gcf = (GCF*)arg;
+    gcf->jobResult = PL_ResetFTDI(0, &gcf->devSerialNum[0]);
+}
+
+static void gcfJobResetRaspBee(void *arg)
+{
+    GCF *gcf;
+
+    gcf = (GCF*)arg;
+    gcf->jobResult = PL_ResetRaspBee();
+}
+
+/*! Starts the GPIO reset job, the result arrives as EV_JOB_DONE which may
+    be handled before returning.
+ */
+static void gcfResetStartGpio(GCF *gcf)
+{
+    gcf->resetGpio = RESET_GPIO_RUNNING;
+    PROT_Flush(); /* the staged UART reset goes out before the line is toggled */
+
+    if (gcf->devType == DEV_CONBEE_1) /* FTDI reset applies only to ConBee I */
+        PL_RunJob(gcfJobResetFtdi, gcf, EV_JOB_DONE);
+    else /* RaspBee reset applies only to RaspBee I & II */
+        PL_RunJob(gcfJobResetRaspBee, gcf, EV_JOB_DONE);
+}
+
+/*! The UART reset succeeded, \p timeout is the delay to connect the bootloader. */
+static void gcfResetUartDone(GCF *gcf, unsigned long timeout)
+{
+    PL_ClearTimeout();
+
+    if (gcf->resetGpio == RESET_GPIO_RUNNING)
+    {
+        gcf->resetPending = timeout + 1;
+        return;
+    }
+
+    gcfResetWon(gcf, RESET_METHOD_UART);
+    gcf->substate = ST_Void;
+    if (timeout)
+        PL_SetTimeout(timeout);
+    GCF_HandleEvent(gcf, EV_UART_RESET_SUCCESS);
+}
+
 static void ST_Reset(GCF *gcf, Event event)
 {
     if (event == EV_ACTION)
     {
         gcf->wp = 0;
+        gcf->resetStart = PL_Time();
+        gcf->resetPending = 0;
+        gcf->resetWon = 0;
+        gcf->resetGpio = RESET_GPIO_NONE;
+        if (gcf->devType == DEV_CONBEE_1)
+            gcf->resetGpio = RESET_GPIO_FALLBACK;
+        else if (gcf->devType == DEV_RASPBEE_1 || gcf->devType == DEV_RASPBEE_2)
+            gcf->resetGpio = PL_HasWorkers() ? RESET_GPIO_WAIT : RESET_GPIO_FALLBACK;
+
         gcf->substate = ST_ResetUart;
         gcf->substate(gcf, EV_ACTION);
     }
@@ -312,7 +626,7 @@ static void ST_Reset(GCF *gcf, Event event)
 
         if (gcf->task == T_RESET)
         {
-            PL_ShutDown();
+            gcfTaskDone(gcf, GCF_SUCCESS);
         }
         else if (gcf->task == T_PROGRAM)
         {
@@ -322,41 +636,27 @@ static void ST_Reset(GCF *gcf, Event event)
     }
     else if (event == EV_UART_RESET_FAILED)
     {
-        if (gcf->devType == DEV_CONBEE_1)
+        gcfMetrics.retries[RETRY_RESET]++;
+
+        if (gcf->resetGpio == RESET_GPIO_FALLBACK && PL_Connect(gcf->devpath, gcf->devBaudrate) == GCF_SUCCESS)
         {
-            if (PL_Connect(gcf->devpath, gcf->devBaudrate) == GCF_SUCCESS)
-            {
-                gcf->substate = ST_ResetFtdi;
-                gcf->substate(gcf, EV_ACTION);
-                return;
-            }
+            gcf->substate = ST_ResetGpio;
+            gcf->substate(gcf, EV_ACTION);
+            return;
         }
-        else if (gcf->devType == DEV_RASPBEE_1 || gcf->devType == DEV_RASPBEE_2)
+
+        /* pretent it worked and jump to bootloader detection,
+           when the GPIO reset failed as well it is connected right away */
+        if (gcf->resetGpio == RESET_GPIO_DONE && PL_Connect(gcf->devpath, gcf->devBaudrate) == GCF_SUCCESS)
         {
-            if (PL_Connect(gcf->devpath, gcf->devBaudrate) == GCF_SUCCESS)
-            {
-                gcf->substate = ST_ResetRaspBee;
-                gcf->substate(gcf, EV_ACTION);
-                return;
-            }
+            PL_SetTimeout(1); /* for connect bootloader */
+            GCF_HandleEvent(gcf, gcf->devType == DEV_CONBEE_1 ? EV_FTDI_RESET_SUCCESS : EV_RASPBEE_RESET_SUCCESS);
+            return;
         }
 
-        /* pretent it worked and jump to bootloader detection */
         PL_SetTimeout(500); /* for connect bootloader */
         GCF_HandleEvent(gcf, EV_UART_RESET_SUCCESS);
     }
-    else if (event == EV_FTDI_RESET_FAILED)
-    {
-        /* pretent it worked and jump to bootloader detection */
-        PL_SetTimeout(1); /* for connect bootloader */
-        GCF_HandleEvent(gcf, EV_FTDI_RESET_SUCCESS);
-    }
-    else if (event == EV_RASPBEE_RESET_FAILED)
-    {
-        /* pretent it worked and jump to bootloader detection */
-        PL_SetTimeout(1); /* for connect bootloader */
-        GCF_HandleEvent(gcf, EV_RASPBEE_RESET_SUCCESS);
-    }
     else
     {
         gcf->substate(gcf, event);
@@ -365,9 +665,12 @@ static void ST_Reset(GCF *gcf, Event event)
 
 static void ST_ResetUart(GCF *gcf, Event event)
 {
+    unsigned long stagger;
+
     if (event == EV_ACTION)
     {
-        PL_SetTimeout(3000);
+        stagger = gcf->resetGpio == RESET_GPIO_WAIT ? gcfResetStagger(gcf) : 0;
+        PL_SetTimeout(stagger ? stagger : GCF_RESET_TIMEOUT);
 
         if (PL_Connect(gcf->devpath, gcf->devBaudrate) == GCF_SUCCESS)
         {
@@ -375,21 +678,20 @@ static void ST_ResetUart(GCF *gcf, Event event)
                 gcfCommandQueryFirmwareVersion();
             gcfCommandResetUart();
         }
+
+        if (gcf->resetGpio == RESET_GPIO_WAIT && stagger == 0)
+            gcfResetStartGpio(gcf);
     }
     else if (event == EV_RX_BTL_PKG_DATA)
     {
         if ((unsigned char)gcf->ascii[1] == BTL_ID_RESPONSE)
         {
-            PL_ClearTimeout();
-            PL_SetTimeout(100); /* for connect bootloader */
-            GCF_HandleEvent(gcf, EV_UART_RESET_SUCCESS);
+            gcfResetUartDone(gcf, 100); /* for connect bootloader */
         }
     }
     else if (event == EV_DISCONNECTED)
     {
-        PL_ClearTimeout();
-        PL_SetTimeout(500); /* for connect bootloader */
-        GCF_HandleEvent(gcf, EV_UART_RESET_SUCCESS);
+        gcfResetUartDone(gcf, 500); /* for connect bootloader */
     }
     else if (event == EV_PKG_UART_RESET)
     {
@@ -397,62 +699,101 @@ static void ST_ResetUart(GCF *gcf, Event event)
         if (gcf->devType == DEV_RASPBEE_1 || gcf->devType == DEV_CONBEE_1)
         {
             /* due FTDI don't wait for disconnect */
-            PL_ClearTimeout();
-            GCF_HandleEvent(gcf, EV_UART_RESET_SUCCESS);
+            gcfResetUartDone(gcf, 0);
         }
     }
-    else if (event == EV_TIMEOUT)
+    else if (event == EV_JOB_DONE)
     {
-        UI_Puts(gcf, "command reset timeout\n");
-        gcf->substate = ST_Void;
-        PL_Disconnect();
-        GCF_HandleEvent(gcf, EV_UART_RESET_FAILED);
-    }
-}
+        gcf->resetGpio = RESET_GPIO_DONE;
 
-/*! FTDI reset applies only to ConBee I */
-static void ST_ResetFtdi(GCF *gcf, Event event)
-{
-    if (event == EV_ACTION)
+        if (gcf->jobResult == 0)
+            UI_Puts(gcf, gcf->devType == DEV_CONBEE_1 ? "FTDI reset done\n" : "RaspBee reset done\n");
+        else
+            UI_Puts(gcf, gcf->devType == DEV_CONBEE_1 ? "FTDI reset failed\n" : "RaspBee reset failed\n");
+
+        if (gcf->resetPending)
+        {
+            /* the UART reset was first, continue as it would have */
+            gcfResetUartDone(gcf, gcf->resetPending - 1);
+        }
+        else if (gcf->jobResult == 0)
+        {
+            PL_ClearTimeout();
+            gcfResetWon(gcf, RESET_METHOD_GPIO);
+            gcf->substate = ST_Void;
+            PL_Connect(gcf->devpath, gcf->devBaudrate); /* for the bootloader, if the UART reset couldn't */
+            GCF_HandleEvent(gcf, gcf->devType == DEV_CONBEE_1 ? EV_FTDI_RESET_SUCCESS : EV_RASPBEE_RESET_SUCCESS);
+        }
+        /* else keep waiting for the UART reset */
+    }
+    else if (event == EV_TIMEOUT)
     {
-        if (PL_ResetFTDI(0, &gcf->devSerialNum[0]) == 0)
+        if (gcf->resetGpio == RESET_GPIO_WAIT)
+        {
+            PL_SetTimeout(GCF_RESET_TIMEOUT - gcfResetStagger(gcf));
+            gcfResetStartGpio(gcf);
+        }
+        else if (gcf->resetGpio == RESET_GPIO_RUNNING)
         {
-            UI_Puts(gcf, "FTDI reset done\n");
-            GCF_HandleEvent(gcf, EV_FTDI_RESET_SUCCESS);
+            PL_SetTimeout(100); /* the GPIO reset outlasts the UART timeout */
         }
         else
         {
-            UI_Puts(gcf,  "FTDI reset failed\n");
-            GCF_HandleEvent(gcf, EV_FTDI_RESET_FAILED);
+            UI_Puts(gcf, "command reset timeout\n");
+            gcf->substate = ST_Void;
+            PL_Disconnect();
+            GCF_HandleEvent(gcf, EV_UART_RESET_FAILED);
         }
     }
 }
 
-/*! RaspBee reset applies only to RaspBee I & II */
-static void ST_ResetRaspBee(GCF *gcf, Event event)
+/*! GPIO reset after the UART reset failed, when the two aren't raced. */
+static void ST_ResetGpio(GCF *gcf, Event event)
 {
     if (event == EV_ACTION)
     {
-        if (PL_ResetRaspBee() == 0)
+        gcfResetStartGpio(gcf);
+    }
+    else if (event == EV_JOB_DONE)
+    {
+        gcf->resetGpio = RESET_GPIO_DONE;
+        gcf->substate = ST_Void;
+
+        if (gcf->jobResult == 0)
         {
-            UI_Puts(gcf, "RaspBee reset done\n");
-            GCF_HandleEvent(gcf, EV_RASPBEE_RESET_SUCCESS);
+            UI_Puts(gcf, gcf->devType == DEV_CONBEE_1 ? "FTDI reset done\n" : "RaspBee reset done\n");
         }
         else
         {
-            UI_Puts(gcf, "RaspBee reset failed\n");
-            GCF_HandleEvent(gcf, EV_RASPBEE_RESET_FAILED);
+            UI_Puts(gcf, gcf->devType == DEV_CONBEE_1 ? "FTDI reset failed\n" : "RaspBee reset failed\n");
+            /* pretent it worked and jump to bootloader detection */
+            PL_SetTimeout(1); /* for connect bootloader */
         }
+
+        GCF_HandleEvent(gcf, gcf->devType == DEV_CONBEE_1 ? EV_FTDI_RESET_SUCCESS : EV_RASPBEE_RESET_SUCCESS);
     }
 }
 
-static void gcfGetDevices(GCF *gcf)
+void gcfGetDevices(GCF *gcf)
 {
     int i;
     int n;
+    PL_time_t t;
+    PL_time_t now;
     U_SStream ss;
-    n = PL_GetDevices(&gcf->devices[0], MAX_DEVICES);
-    gcf->devCount = n > 0 ? (unsigned)n : 0;
+
+    /* enumeration is slow on some platforms, in server mode the list is reused for a while */
+    now = PL_Time();
+    if (!gcf->serverMode || gcf->devCount == 0 || gcf->devicesTime + GCF_DEVICE_CACHE_TIME < now)
+    {
+        t = PL_TimeMicro();
+        n = PL_GetDevices(&gcf->devices[0], MAX_DEVICES);
+        gcfMetricsObserve(&gcfMetrics.enumeration, PL_TimeMicro() - t);
+        gcf->devCount = n > 0 ? (unsigned)n : 0;
+        gcf->devicesTime = now;
+    }
+
+    n = (int)gcf->devCount;
 
     if (gcf->devpath[0] != '\0' && gcf->devSerialNum[0] == '\0')
     {
@@ -476,6 +817,73 @@ static void gcfGetDevices(GCF *gcf)
     }
 }
 
+int gcfStrEquals(const char *a, const char *b)
+{
+    for (; *a != '\0' && *a == *b; a++, b++)
+    {
+    }
+
+    return *a == *b;
+}
+
+/*! Splits the next blank separated token off \p *str, returns 0 at the end of the line. */
+char *gcfNextToken(char **str)
+{
+    char *p;
+    char *tok;
+
+    p = *str;
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+
+    if (*p == '\0' || *p == '#')
+        return 0;
+
+    tok = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+
+    if (*p != '\0')
+        *p++ = '\0';
+
+    *str = p;
+    return tok;
+}
+
+/*! Counts the time since the last data sent, at the next bootloader data request. */
+static void gcfCycleRequest(GCF *gcf)
+{
+    PL_time_t t;
+
+    if (gcf->cycleStart == 0)
+        return;
+
+    t = PL_TimeMicro() - gcf->cycleStart;
+    gcfMetricsObserve(&gcfMetrics.chunkRtt, t);
+    gcf->cycleSum += (unsigned long)t;
+    gcf->cycleCount++;
+    gcf->cycleStart = 0;
+}
+
+/*! Returns the timeout for the next bootloader data request, at most \p timeout ms.
+    With a known upload cycle a stalled upload is retried sooner.
+ */
+static unsigned long gcfCycleTimeout(GCF *gcf, unsigned long timeout)
+{
+    unsigned long t;
+    GCF_Profile *prof;
+
+    prof = gcfDeviceProfile(gcf);
+    if (!prof || prof->cycle == 0)
+        return timeout;
+
+    t = prof->cycle / 1000 * 20;
+    if (t < 1000)
+        t = 1000;
+
+    return t < timeout ? t : timeout;
+}
+
 static void ST_ListDevices(GCF *gcf, Event event)
 {
     unsigned i;
@@ -532,6 +940,13 @@ static void ST_Program(GCF *gcf, Event event)
     {
         gcfGetDevices(gcf);
         UI_Puts(gcf, "flash firmware\n");
+        if (!gcf->retrying)
+            gcfMetrics.started[gcf->devType]++;
+        gcf->retrying = 0;
+        gcf->btlVersion = 0;
+        gcf->cycleStart = 0;
+        gcf->cycleSum = 0;
+        gcf->cycleCount = 0;
         gcf->state = ST_Reset;
         GCF_HandleEvent(gcf, event);
     }
@@ -550,7 +965,7 @@ static void ST_Program(GCF *gcf, Event event)
     }
     else if (event == EV_RESET_FAILED)
     {
-        PL_ShutDown();
+        gcfTaskDone(gcf, GCF_FAILED);
     }
 }
 
@@ -567,6 +982,7 @@ static void ST_BootloaderConnect(GCF *gcf, Event event)
         else
         {
             // todo retry, a couple of times and revert to gcfRetry()
+            gcfMetrics.retries[RETRY_CONNECT]++;
             PL_SetTimeout(500);
             ss = UI_StringStream(gcf);
             U_sstream_put_str(ss, "retry connect bootloader ");
@@ -592,19 +1008,32 @@ static void ST_BootloaderQuery(GCF *gcf, Event event)
     U_SStream *ss;
     U_SStream ss1;
     unsigned char buf[2];
+    GCF_Profile *prof;
 
     if (event == EV_ACTION)
     {
         gcf->retry = 0;
         gcf->wp = 0;
         gcf->ascii[0] = '\0';
-        U_bzero(&gcf->ascii[0], sizeof(gcf->ascii));
+        U_bzero(&gcf->ascii[0], GCF_ASCII_SIZE);
 
         /* 1) wait for ConBee I and RaspBee I, which send ID on their own */
         PL_SetTimeout(200);
+
+        /* a V3 bootloader known from the profile is queried right away */
+        prof = gcfDeviceProfile(gcf);
+        if (prof && prof->btlVersion != 0 && gcf->file.gcfFileType >= 30)
+        {
+            buf[0] = BTL_MAGIC;
+            buf[1] = BTL_ID_REQUEST;
+            PROT_SendFlagged(buf, 2);
+        }
     }
     else if (event == EV_TIMEOUT)
     {
+        if (gcf->retry > 0) /* the first timeout only ends the wait for bootloaders which announce themselves */
+            gcfMetrics.retries[RETRY_QUERY]++;
+
         if (++gcf->retry == 3)
         {
             UI_Puts(gcf, "query bootloader failed\n");
@@ -662,6 +1091,7 @@ static void ST_BootloaderQuery(GCF *gcf, Event event)
 
             get_u32_le((unsigned char*)&gcf->ascii[2], &btlVersion);
             get_u32_le((unsigned char*)&gcf->ascii[6], &appCrc);
+            gcf->btlVersion = btlVersion;
 
             ss = UI_StringStream(gcf);
             U_sstream_put_str(ss, "bootloader version 0x");
@@ -746,6 +1176,7 @@ static void ST_V1ProgramWriteHeader(GCF *gcf, Event event)
         gcf->state = ST_V1ProgramUpload;
 
         PROT_Write(buf, sizeof(buf));
+        gcf->uploadStart = PL_TimeMicro();
 
         PL_SetTimeout(1000);
     }
@@ -755,8 +1186,8 @@ static void ST_V1ProgramUpload(GCF *gcf, Event event)
 {
     if (event == EV_RX_ASCII)
     {
-        unsigned char *end;
-        unsigned char *page;
+        const unsigned char *end;
+        const unsigned char *page;
         unsigned long pageNumber;
         unsigned size;
 
@@ -771,6 +1202,7 @@ static void ST_V1ProgramUpload(GCF *gcf, Event event)
         pageNumber = (unsigned char)gcf->ascii[4];
         pageNumber <<= 8;
         pageNumber |= (unsigned char)(gcf->ascii[3] & 0xFF);
+        gcfCycleRequest(gcf);
 
         page = &gcf->file.fcontent[GCF_HEADER_SIZE] + pageNumber * V1_PAGESIZE;
         end = &gcf->file.fcontent[GCF_HEADER_SIZE + gcf->file.gcfFileSize];
@@ -793,16 +1225,19 @@ static void ST_V1ProgramUpload(GCF *gcf, Event event)
         gcf->ascii[0] = '\0';
 
         PROT_Write(page, size);
+        gcf->cycleStart = PL_TimeMicro();
+        gcfMetrics.uploadBytes += size;
 
         if ((gcf->remaining - size) == 0)
         {
+            gcfMetricsObserve(&gcfMetrics.upload, gcf->cycleStart - gcf->uploadStart);
             gcf->state = ST_V1ProgramValidate;
             UI_Puts(gcf, "\ndone, wait validation...\n");
             PL_SetTimeout(25600);
         }
         else
         {
-            PL_SetTimeout(2000);
+            PL_SetTimeout(gcfCycleTimeout(gcf, 2000));
         }
     }
     else if (event == EV_TIMEOUT)
@@ -822,7 +1257,7 @@ static void ST_V1ProgramValidate(GCF *gcf, Event event)
         if (gcf->wp > 6 && U_sstream_find(&ss, "#VALID CRC"))
         {
             UI_Puts(gcf, FMT_GREEN "firmware successful written\n" FMT_RESET);
-            PL_ShutDown();
+            gcfTaskDone(gcf, GCF_SUCCESS);
         }
         else
         {
@@ -861,6 +1296,7 @@ static void ST_V3ProgramSync(GCF *gcf, Event event)
         (void)p;
 
         PROT_SendFlagged(cmd, sizeof(cmd));
+        gcf->uploadStart = PL_TimeMicro();
     }
     else if (event == EV_RX_BTL_PKG_DATA)
     {
@@ -892,7 +1328,8 @@ static void ST_V3ProgramUpload(GCF *gcf, Event event)
             unsigned short length;
             unsigned char status;
 
-            PL_SetTimeout(5000);
+            PL_SetTimeout(gcfCycleTimeout(gcf, 5000));
+            gcfCycleRequest(gcf);
 
             get_u32_le((unsigned char*)&gcf->ascii[2], &offset);
             get_u16_le((unsigned char*)&gcf->ascii[6], &length);
@@ -920,7 +1357,7 @@ static void ST_V3ProgramUpload(GCF *gcf, Event event)
             {
                 status = 1; /* error */
             }
-            else if (length > (sizeof(gcf->ascii) - 32))
+            else if (length > (GCF_ASCII_SIZE - 32))
             {
                 status = 2; /* error */
             }
@@ -946,6 +1383,7 @@ static void ST_V3ProgramUpload(GCF *gcf, Event event)
                 Assert(length > 0);
                 U_memcpy(p, &gcf->file.fcontent[GCF_HEADER_SIZE + offset], length);
                 p += length;
+                gcfMetrics.uploadBytes += length;
             }
             else
             {
@@ -957,14 +1395,16 @@ static void ST_V3ProgramUpload(GCF *gcf, Event event)
             }
 
             Assert(p > buf);
-            Assert(p < buf + sizeof(gcf->ascii));
+            Assert(p < buf + GCF_ASCII_SIZE);
 
-            PROT_SendFlagged(buf, (unsigned)(p - buf));
+            PROT_SendFrame(buf, (unsigned)(p - buf), PROT_URGENT);
+            gcf->cycleStart = PL_TimeMicro();
 
             UI_UpdateProgress(gcf);
 
             if (gcf->remaining == length)
             {
+                gcfMetricsObserve(&gcfMetrics.upload, gcf->cycleStart - gcf->uploadStart);
                 UI_Puts(gcf, "\ndone, wait (up to 20 seconds) for verification\n");
                 PL_SetTimeout(20000);
                 gcf->state = ST_V3ProgramWaitID;
@@ -990,10 +1430,13 @@ static void ST_V3ProgramWaitID(GCF *gcf, Event event)
         {
             unsigned long btlVersion;
             unsigned long appCrc;
+            GCF_Status status;
 
             get_u32_le((unsigned char*)&gcf->ascii[2], &btlVersion);
             get_u32_le((unsigned char*)&gcf->ascii[6], &appCrc);
 
+            status = GCF_SUCCESS;
+
             if (gcf->file.gcfCrc32 != 0)
             {
                 ss = UI_StringStream(gcf);
@@ -1008,13 +1451,14 @@ static void ST_V3ProgramWaitID(GCF *gcf, Event event)
                     U_sstream_put_str(ss, " (expected 0x");
                     U_sstream_put_u32hex(ss, gcf->file.gcfCrc32);
                     U_sstream_put_str(ss, ")");
+                    status = GCF_FAILED;
                 }
                 U_sstream_put_str(ss, "\n");
                 UI_Puts(gcf, ss->str);
             }
 
             UI_Puts(gcf, "finished\n");
-            PL_ShutDown();
+            gcfTaskDone(gcf, status);
         }
     }
     else if (event == EV_TIMEOUT)
@@ -1023,30 +1467,338 @@ static void ST_V3ProgramWaitID(GCF *gcf, Event event)
     }
 }
 
-static void ST_Connect(GCF *gcf, Event event)
+/* Connect mode traffic statistics (-c)
+
+   Frames are counted per deCONZ serial protocol command id. A request sent
+   to the device is remembered by command id and sequence number until the
+   response with the same pair arrives, which gives the round trip latency.
+   Requests without response within GCF_TRAFFIC_LOST_TIME count as lost.
+
+   Instead of printing every frame the table of rates, latency percentiles
+   and errors is redrawn every GCF_TRAFFIC_REFRESH milliseconds.
+*/
+#define GCF_TRAFFIC_MAX_COMMANDS 16
+#define GCF_TRAFFIC_MAX_PENDING 32
+#define GCF_TRAFFIC_SAMPLES 64
+#define GCF_TRAFFIC_REFRESH 1000
+#define GCF_TRAFFIC_LOST_TIME 5000
+#define GCF_TRAFFIC_QUERY_INTERVAL 10 /* refreshes between status queries */
+
+typedef struct
 {
-    if (event == EV_ACTION)
+    unsigned char cmd;
+    unsigned long tx;
+    unsigned long rx;
+    unsigned long txLast;   /* at the previous refresh, for the rates */
+    unsigned long rxLast;
+    unsigned long lost;
+    unsigned long latencyCount;
+    unsigned short latency[GCF_TRAFFIC_SAMPLES]; /* ring of the latest in ms */
+} GCF_TrafficCommand;
+
+typedef struct
+{
+    unsigned char used;
+    unsigned char cmd;
+    unsigned char seq;
+    PL_time_t time;
+} GCF_TrafficPending;
+
+typedef struct
+{
+    unsigned commandCount;
+    unsigned long refreshCount;
+    PL_time_t lastRefresh;
+    GCF_TrafficCommand commands[GCF_TRAFFIC_MAX_COMMANDS];
+    GCF_TrafficPending pending[GCF_TRAFFIC_MAX_PENDING];
+} GCF_Traffic;
+
+static GCF_Traffic gcfTraffic;
+
+static const char *gcfCommandName(unsigned char cmd)
+{
+    switch (cmd)
     {
-        if (PL_Connect(gcf->devpath, gcf->devBaudrate) == GCF_SUCCESS)
-        {
-            gcf->state = ST_Connected;
-            PL_SetTimeout(1000);
-        }
-        else
-        {
-            gcf->state = ST_Init;
-            UI_Puts(gcf, "failed to connect\n");
-            PL_SetTimeout(10000);
-        }
+        case 0x04: return "aps confirm";
+        case 0x07: return "device state";
+        case 0x08: return "network state";
+        case 0x0A: return "read param";
+        case 0x0B: return "write param";
+        case 0x0D: return "version";
+        case 0x0E: return "state changed";
+        case 0x12: return "aps request";
+        case 0x17: return "aps indication";
+        case 0x1C: return "mac poll";
+        default:
+            break;
     }
+
+    return "";
 }
 
-static void ST_Connected(GCF *gcf, Event event)
+static GCF_TrafficCommand *gcfTrafficCommand(unsigned char cmd)
+{
+    unsigned i;
+    GCF_TrafficCommand *c;
+
+    for (i = 0; i < gcfTraffic.commandCount; i++)
+    {
+        if (gcfTraffic.commands[i].cmd == cmd)
+            return &gcfTraffic.commands[i];
+    }
+
+    if (gcfTraffic.commandCount == GCF_TRAFFIC_MAX_COMMANDS)
+        return 0;
+
+    c = &gcfTraffic.commands[gcfTraffic.commandCount++];
+    U_bzero(c, sizeof(*c));
+    c->cmd = cmd;
+    return c;
+}
+
+/*! Counts a frame sent to the device and remembers it as pending request. */
+static void gcfTrafficSent(const unsigned char *data, unsigned len)
+{
+    unsigned i;
+    GCF_TrafficCommand *c;
+    GCF_TrafficPending *p;
+    GCF_TrafficPending *oldest;
+
+    if (len < 2 || gcfCurrent->task != T_CONNECT)
+        return;
+
+    c = gcfTrafficCommand(data[0]);
+    if (!c)
+        return;
+
+    c->tx++;
+
+    oldest = &gcfTraffic.pending[0];
+    for (i = 0; i < GCF_TRAFFIC_MAX_PENDING; i++)
+    {
+        p = &gcfTraffic.pending[i];
+        if (!p->used || (p->cmd == data[0] && p->seq == data[1]))
+        {
+            oldest = p;
+            break;
+        }
+
+        if (p->time < oldest->time)
+            oldest = p;
+    }
+
+    if (oldest->used)
+        gcfTrafficCommand(oldest->cmd)->lost++;
+
+    oldest->used = 1;
+    oldest->cmd = data[0];
+    oldest->seq = data[1];
+    oldest->time = PL_Time();
+}
+
+/*! Counts a frame received from the device, a response completes its request. */
+static void gcfTrafficReceived(const unsigned char *data, unsigned len)
+{
+    unsigned i;
+    PL_time_t dt;
+    GCF_TrafficCommand *c;
+    GCF_TrafficPending *p;
+
+    if (len < 2)
+        return;
+
+    c = gcfTrafficCommand(data[0]);
+    if (!c)
+        return;
+
+    c->rx++;
+
+    for (i = 0; i < GCF_TRAFFIC_MAX_PENDING; i++)
+    {
+        p = &gcfTraffic.pending[i];
+        if (p->used && p->cmd == data[0] && p->seq == data[1])
+        {
+            p->used = 0;
+            dt = PL_Time() - p->time;
+            c->latency[c->latencyCount % GCF_TRAFFIC_SAMPLES] = (unsigned short)(dt < 0xFFFF ? dt : 0xFFFF);
+            c->latencyCount++;
+            break;
+        }
+    }
+}
+
+/*! Returns the \p percent percentile of \p n ascending \p sorted latencies. */
+static unsigned gcfTrafficPercentile(const unsigned short *sorted, unsigned n, unsigned percent)
+{
+    unsigned i;
+
+    i = (n * percent + 99) / 100;
+    return sorted[i > 0 ? i - 1 : 0];
+}
+
+static void gcfTrafficPutColumn(U_SStream *ss, unsigned long val, unsigned width)
+{
+    unsigned pos;
+    unsigned long div;
+
+    pos = U_sstream_pos(ss);
+    for (div = 10; div <= val; div *= 10)
+        pos++;
+
+    for (pos++; pos < width; pos++)
+        U_sstream_put_str(ss, " ");
+
+    U_sstream_put_long(ss, (long)val);
+}
+
+/*! Prints a table line at terminal \p row, or as next line if \p row is 0. */
+static void gcfTrafficPutLine(GCF *gcf, U_SStream *ss, unsigned row)
+{
+    while (U_sstream_pos(ss) < 75)
+        U_sstream_put_str(ss, " ");
+
+    if (row)
+    {
+        UI_SetCursor(0, row);
+    }
+    else
+    {
+        U_sstream_put_str(ss, "\n");
+    }
+
+    UI_Puts(gcf, ss->str);
+}
+
+/*! Redraws the table at the bottom of the terminal, or appends it if the
+    output isn't a terminal.
+ */
+static void gcfTrafficRefresh(GCF *gcf)
+{
+    unsigned i;
+    unsigned j;
+    unsigned k;
+    unsigned n;
+    unsigned w;
+    unsigned h;
+    unsigned lines;
+    unsigned short v;
+    unsigned short sorted[GCF_TRAFFIC_SAMPLES];
+    unsigned long elapsed;
+    unsigned long pending;
+    PL_time_t now;
+    U_SStream *ss;
+    GCF_TrafficCommand *c;
+    GCF_TrafficPending *p;
+
+    now = PL_Time();
+    elapsed = gcfTraffic.lastRefresh ? (unsigned long)(now - gcfTraffic.lastRefresh) : GCF_TRAFFIC_REFRESH;
+    gcfTraffic.lastRefresh = now;
+    if (elapsed == 0)
+        elapsed = 1;
+
+    pending = 0;
+    for (i = 0; i < GCF_TRAFFIC_MAX_PENDING; i++)
+    {
+        p = &gcfTraffic.pending[i];
+        if (p->used && p->time + GCF_TRAFFIC_LOST_TIME < now)
+        {
+            p->used = 0;
+            gcfTrafficCommand(p->cmd)->lost++;
+        }
+
+        pending += p->used;
+    }
+
+    UI_GetWinSize(&w, &h);
+    lines = gcfTraffic.commandCount + 2;
+    if (h < lines + 2 || h > 1000)
+        h = 0; /* not a terminal */
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "cmd                  tx/s  rx/s      tx      rx  lost   p50   p90   p99 ms");
+    gcfTrafficPutLine(gcf, ss, h ? h - lines : 0);
+
+    for (i = 0; i < gcfTraffic.commandCount; i++)
+    {
+        c = &gcfTraffic.commands[i];
+
+        /* insertion sort of the latest latencies */
+        n = c->latencyCount < GCF_TRAFFIC_SAMPLES ? (unsigned)c->latencyCount : GCF_TRAFFIC_SAMPLES;
+        for (j = 0; j < n; j++)
+        {
+            v = c->latency[j];
+            for (k = j; k > 0 && sorted[k - 1] > v; k--)
+                sorted[k] = sorted[k - 1];
+            sorted[k] = v;
+        }
+
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, "0x");
+        U_sstream_put_hex(ss, &c->cmd, 1);
+        U_sstream_put_str(ss, " ");
+        U_sstream_put_str(ss, gcfCommandName(c->cmd));
+        gcfTrafficPutColumn(ss, (c->tx - c->txLast) * 1000 / elapsed, 26);
+        gcfTrafficPutColumn(ss, (c->rx - c->rxLast) * 1000 / elapsed, 32);
+        gcfTrafficPutColumn(ss, c->tx, 40);
+        gcfTrafficPutColumn(ss, c->rx, 48);
+        gcfTrafficPutColumn(ss, c->lost, 54);
+        if (n > 0)
+        {
+            gcfTrafficPutColumn(ss, gcfTrafficPercentile(sorted, n, 50), 60);
+            gcfTrafficPutColumn(ss, gcfTrafficPercentile(sorted, n, 90), 66);
+            gcfTrafficPutColumn(ss, gcfTrafficPercentile(sorted, n, 99), 72);
+        }
+
+        c->txLast = c->tx;
+        c->rxLast = c->rx;
+        gcfTrafficPutLine(gcf, ss, h ? h - lines + 1 + i : 0);
+    }
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "crc errors: ");
+    U_sstream_put_long(ss, (long)gcf->rxstate.crcErrors);
+    U_sstream_put_str(ss, ", pending requests: ");
+    U_sstream_put_long(ss, (long)pending);
+    gcfTrafficPutLine(gcf, ss, h ? h - 1 : 0);
+}
+
+static void ST_Connect(GCF *gcf, Event event)
+{
+    if (event == EV_ACTION)
+    {
+        if (PL_Connect(gcf->devpath, gcf->devBaudrate) == GCF_SUCCESS)
+        {
+            U_bzero(&gcfTraffic, sizeof(gcfTraffic));
+            gcf->rxstate.crcErrors = 0;
+            gcf->state = ST_Connected;
+            PL_SetTimeout(GCF_TRAFFIC_REFRESH);
+        }
+        else
+        {
+            gcf->state = ST_Init;
+            UI_Puts(gcf, "failed to connect\n");
+            PL_SetTimeout(10000);
+        }
+    }
+}
+
+static void ST_Connected(GCF *gcf, Event event)
 {
     if (event == EV_TIMEOUT)
     {
-        gcfCommandQueryStatus();
-        PL_SetTimeout(10000);
+        if (gcfTraffic.refreshCount % GCF_TRAFFIC_QUERY_INTERVAL == 0)
+        {
+            gcfCommandQueryStatus();
+#ifdef USE_NET
+            /* answer discovery requests with the firmware version */
+            if (NET_Handle() != -1 && !gcfFindKnownFirmware(gcf, gcfDeviceKey(gcf)))
+                gcfCommandQueryFirmwareVersion();
+#endif
+        }
+
+        gcfTraffic.refreshCount++;
+        gcfTrafficRefresh(gcf);
+        PL_SetTimeout(GCF_TRAFFIC_REFRESH);
     }
     else if (event == EV_DISCONNECTED)
     {
@@ -1063,6 +1815,10 @@ GCF *GCF_Init(int argc, char *argv[])
 
     gcf = &gcfLocal;
 
+    gcfInitPools();
+    gcfSessionAttach(gcf); /* the main session keeps its buffers */
+
+    gcf->ctlClient = -1;
     U_bzero(&gcf->rxstate, sizeof(gcf->rxstate));
     gcf->startTime = PL_Time();
     gcf->maxTime = 0;
@@ -1080,7 +1836,18 @@ GCF *GCF_Init(int argc, char *argv[])
 
 void GCF_Exit(GCF *gcf)
 {
-    (void)gcf;
+    if (gcf->daemon)
+        PL_ControlClose();
+
+    NET_Exit();
+
+    gcfProfileExit();
+
+    if (gcf->task == T_STATION)
+    {
+        gcfStationSummary(gcf);
+        gcfBatchWriteResults(gcf);
+    }
 }
 
 void GCF_HandleEvent(GCF *gcf, Event event)
@@ -1088,8 +1855,8 @@ void GCF_HandleEvent(GCF *gcf, Event event)
 #if 0
     const char *str;
 
-    if      (gcf->substate == ST_ResetFtdi) str = "ST_ResetFtdi";
-    else if (gcf->substate == ST_ResetUart) str = "ST_ResetUart";
+    if      (gcf->substate == ST_ResetUart) str = "ST_ResetUart";
+    else if (gcf->substate == ST_ResetGpio) str = "ST_ResetGpio";
     else if (gcf->state == ST_Reset) str = "ST_Reset";
     else if (gcf->state == ST_Program) str = "ST_Program";
     else if (gcf->state == ST_V1ProgramSync) str = "ST_V1ProgramSync";
@@ -1104,16 +1871,66 @@ void GCF_HandleEvent(GCF *gcf, Event event)
     PL_Printf(DBG_DEBUG, "GCF_HandleEvent: state: %s, event: %d\n", str, (int)event);
 #endif
 
+    GCF *prev;
+
+    prev = gcfCurrent;
+    gcfCurrent = gcf;
+    gcf->txDepth++;
+
+    if (event == EV_DISCONNECTED)
+        gcf->txStaged = 0; /* dropped with the connection */
+
     if (event == EV_PL_LOOP)
+    {
+        NET_Flush(); /* datagrams queued during the last loop iteration */
+    }
+    else if (event == EV_NET_READY)
     {
         NET_Step();
-        return;
+    }
+    else if (event == EV_PROFILES_SAVED)
+    {
+        gcfProfileSaved(); /* not bound to the session which started it */
+    }
+    else
+    {
+        gcf->state(gcf, event);
+    }
+
+    /* the frames sent by the handler go out in one write */
+    gcf->txDepth--;
+    if (gcf->txDepth == 0 && gcf->txStaged != 0)
+    {
+        gcf->txStaged = 0;
+        PROT_Flush();
     }
 
-    gcf->state(gcf, event);
+    gcfCurrent = prev;
 }
 
-int GCF_ParseFile(GCF_File *file)
+int PROT_Stage(unsigned len)
+{
+    GCF *gcf;
+
+    gcf = gcfCurrent;
+    if (!gcf || gcf->txDepth == 0)
+        return 0;
+
+    /* more is written right away, including the staged frames */
+    if (gcf->txStaged + len > GCF_TX_STAGE_SIZE)
+    {
+        gcf->txStaged = 0;
+        return 0;
+    }
+
+    gcf->txStaged += len;
+    return 1;
+}
+
+/*! Parses the file name and the GCF header of \p file, the content may be
+    truncated after the header. \returns 0 on success.
+ */
+int gcfParseHeader(GCF_File *file)
 {
     unsigned char ch;
     const char *version;
@@ -1125,7 +1942,7 @@ int GCF_ParseFile(GCF_File *file)
         return -1;
     }
 
-    U_bstream_init(bs, file->fcontent, file->fsize);
+    U_bstream_init(bs, (unsigned char*)file->fcontent, file->fsize);
 
     Assert(file->fname[0] != '\0');
 
@@ -1177,6 +1994,7 @@ int GCF_ParseFile(GCF_File *file)
 
     /* newer products have extended format with CRC32 */
     file->gcfCrc32 = 0;
+    file->gcfProduct = 0;
     if (file->gcfFileType == FLASH_TYPE_APP_ENCRYPTED)
     {
         /*
@@ -1207,6 +2025,7 @@ int GCF_ParseFile(GCF_File *file)
         unsigned long imagePlainSize;
 
         magic1 = U_bstream_get_u32_le(bs);
+        file->gcfProduct = magic1;
 
         totalSize = U_bstream_get_u32_le(bs);
         Assert(totalSize == file->gcfFileSize);
@@ -1226,6 +2045,19 @@ int GCF_ParseFile(GCF_File *file)
         return -2;
     }
 
+    return 0;
+}
+
+int GCF_ParseFile(GCF_File *file)
+{
+    int ret;
+
+    ret = gcfParseHeader(file);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
     if (file->gcfFileSize != (file->fsize - GCF_HEADER_SIZE))
     {
         return -3;
@@ -1239,9 +2071,16 @@ void GCF_Received(GCF *gcf, const unsigned char *data, int len)
     int i;
     unsigned char ch;
     unsigned ascii;
+    GCF *prev;
 
     Assert(len > 0);
 
+    if (!gcf->buffers)
+        return; /* idle session */
+
+    prev = gcfCurrent;
+    gcfCurrent = gcf;
+
     /*gcfDebugHex(gcf, "recv", data, len);*/
 
     if (gcf->state == ST_BootloaderQuery ||
@@ -1255,7 +2094,7 @@ void GCF_Received(GCF *gcf, const unsigned char *data, int len)
         {
             ch = data[i];
 
-            if (gcf->wp < sizeof(gcf->ascii) - 2)
+            if (gcf->wp < GCF_ASCII_SIZE - 2)
             {
                 gcf->ascii[gcf->wp++] = (char)ch;
                 gcf->ascii[gcf->wp] = '\0';
@@ -1287,47 +2126,96 @@ void GCF_Received(GCF *gcf, const unsigned char *data, int len)
     }
 
     PROT_ReceiveFlagged(&gcf->rxstate, data, (unsigned)len);
+    gcfCurrent = prev;
 }
 
+/* Serial-over-UDP bridge in connect mode (-c with -p).
+
+   Each datagram carries one unescaped deCONZ serial frame without CRC.
+   Any datagram subscribes the sender to all frames received from the device,
+   datagrams of at least 5 bytes (command, seq, status, U16 frame length)
+   are forwarded to the device. Clients which don't send anything within
+   the client TTL are unsubscribed, so they should send keep-alives.
+*/
+#define GCF_BRIDGE_MIN_FRAME_SIZE 5
+
 void NET_Received(int client_id, const unsigned char *buf, unsigned bufsize)
 {
-    (void)buf;
+    GCF *gcf;
+
+    gcf = gcfCurrent;
+
+#ifdef USE_NET
+    /* 4 byte datagrams are only keep-alives for the bridge */
+    if (bufsize == RF_HEADER_SIZE && buf[0] == RF_MAGIC && buf[1] == RF_DISCOVER_REQ)
+    {
+        if (gcf->serverMode || gcf->task == T_CONNECT)
+            gcfDiscoverRespond(gcf, client_id, (unsigned short)(buf[2] | buf[3] << 8));
+        return;
+    }
+
+    if (bufsize >= RF_HEADER_SIZE && buf[0] == RF_MAGIC && gcf->task != T_CONNECT)
+    {
+        U_BStream bs;
+        unsigned char type;
+        unsigned short session;
+
+        U_bstream_init(&bs, (unsigned char*)buf, bufsize);
+        (void)U_bstream_get_u8(&bs);
+        type = U_bstream_get_u8(&bs);
+        session = U_bstream_get_u16_le(&bs);
+
+        if (gcf->serverMode)
+            gcfRemoteServerReceived(gcf, client_id, type, session, &bs);
+        else if (gcf->task == T_REMOTE_PROGRAM)
+            gcfRemoteClientReceived(gcf, type, session, &bs);
+        else if (gcf->task == T_DISCOVER && session == gcf->remote->session)
+            gcfDiscoverReceived(gcf, client_id, type, &bs);
+        return;
+    }
+#endif
+
+    if (gcf->task == T_CONNECT && client_id >= 0)
+    {
+        NET_Subscribe(client_id);
+
+        if (bufsize >= GCF_BRIDGE_MIN_FRAME_SIZE && gcf->state == ST_Connected)
+        {
+            gcfTrafficSent(buf, bufsize);
+            PROT_SendFlagged(buf, bufsize);
+        }
+        return;
+    }
+
     PL_Printf(DBG_DEBUG, "NET received from client %d: %d bytes\n", client_id, bufsize);
 }
 
 void PROT_Packet(const unsigned char *data, unsigned len)
 {
-    int i;
-    char *p;
     GCF *gcf;
-    U_SStream *ss;
 
     Assert(len > 0);
 
-    gcf = &gcfLocal;
+    gcf = gcfCurrent;
+    gcfDebugHex(gcf, "recv_packet", data, len);
 
     if (data[0] != BTL_MAGIC && gcf->task == T_CONNECT)
     {
-        p = &gcf->ascii[0];
-        for (i = 0; i < (int)len; i++, p += 2)
-        {
-            put_hex(data[i], p);
-        }
-        *p = '\0';
-        ss = UI_StringStream(gcf);
-        U_sstream_put_str(ss, "packet: ");
-        U_sstream_put_long(ss, (long)len);
-        U_sstream_put_str(ss, " bytes, ");
-        U_sstream_put_str(ss, gcf->ascii);
-        U_sstream_put_str(ss, "\n");
-        UI_Puts(gcf, ss->str);
+        NET_Broadcast(data, len);
+        gcfTrafficReceived(data, len);
     }
-    else
+    else if (gcf->task == T_BENCHMARK)
     {
-        gcfDebugHex(gcf, "recv_packet", data, len);
+        gcfBenchReceived(data, len);
     }
 
-    if (data[0] == 0x0B && len >= 8) /* write parameter response */
+    if (data[0] == 0x0D && len >= 9 && data[2] == 0x00) /* firmware version response */
+    {
+        gcfSetKnownFirmware(gcf, (unsigned long)data[5] | (unsigned long)data[6] << 8 |
+                                 (unsigned long)data[7] << 16 | (unsigned long)data[8] << 24);
+        GCF_HandleEvent(gcf, EV_PKG_FW_VERSION);
+    }
+    else if (data[0] == 0x0B && len >= 8) /* write parameter response */
     {
         switch (data[7])
         {
@@ -1342,7 +2230,7 @@ void PROT_Packet(const unsigned char *data, unsigned len)
     }
     else if (data[0] == BTL_MAGIC)
     {
-        if (len < sizeof(gcf->ascii))
+        if (len < GCF_ASCII_SIZE)
         {
             U_memcpy(&gcf->ascii[0], data, len);
             gcf->wp = len;
@@ -1351,68 +2239,1228 @@ void PROT_Packet(const unsigned char *data, unsigned len)
     }
 }
 
-static DeviceType gcfGetDeviceType(GCF *gcf)
-{
-    int ftype;
-    U_SStream ss;
-    DeviceType result;
-    PL_Baudrate baudrate;
+/* Daemon mode control interface (-D).
 
-    result = DEV_UNKNOWN;
-    ftype = gcf->file.gcfFileType;
-    baudrate = PL_BAUDRATE_UNKNOWN;
+   Commands are text lines, arguments are separated by spaces:
 
-    if (gcf->devpath[0] != '\0')
-    {
-        U_sstream_init(&ss, &gcf->devpath[0], U_strlen(&gcf->devpath[0]));
+     list                             device <path> <serial> <firmware> <type>, one line per device
+     flash <device> <file> [timeout]  progress <percent>, while flashing
+     flash <device> auto [timeout]    newest firmware of --firmware-dir
+     reset <device>
+     query <device>                   firmware <version>
 
-        if      (U_sstream_find(&ss, "ttyACM"))        { result = DEV_CONBEE_2; baudrate = PL_BAUDRATE_115200; }
-        else if (U_sstream_find(&ss, "ConBee_II"))     { result = DEV_CONBEE_2; baudrate = PL_BAUDRATE_115200; }
-        else if (U_sstream_find(&ss, "cu.usbmodemDE")) { result = DEV_CONBEE_2; baudrate = PL_BAUDRATE_115200; }
-        else if (U_sstream_find(&ss, "ttyUSB"))        { result = DEV_CONBEE_1; baudrate = PL_BAUDRATE_38400; }
-        else if (U_sstream_find(&ss, "usb-FTDI"))      { result = DEV_CONBEE_1; baudrate = PL_BAUDRATE_38400; }
-        else if (U_sstream_find(&ss, "cu.usbserial"))  { result = DEV_CONBEE_1; baudrate = PL_BAUDRATE_38400; }
-        else if (U_sstream_find(&ss, "ttyAMA"))        { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; }
-        else if (U_sstream_find(&ss, "ttyAML"))        { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; } /* Odroid */
-        else if (U_sstream_find(&ss, "ttyS"))          { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; }
-        else if (U_sstream_find(&ss, "/serial"))       { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; }
-#ifdef _WIN32
-        else if (U_sstream_find(&ss, "COM"))
-        {
-            if (ftype == 1 && gcf->file.gcfTargetAddress == 0)
-            {
-                result = DEV_CONBEE_1;
-                baudrate = PL_BAUDRATE_38400;
-            }
-            else if (ftype < 30 && gcf->file.gcfTargetAddress == 0x5000)
-            {
-                result = DEV_CONBEE_2;
-                baudrate = PL_BAUDRATE_115200;
-            }
-        }
-#endif
-    }
+   The last line of each answer is "ok" or "error <reason>". Only one flash,
+   reset or query task runs at a time, the device list and the last
+   firmware file are cached between commands.
+*/
+#define GCF_CONTROL_MAX_ARGS 5
 
-    /* further detemine detive type from the GCF header */
-    if      (ftype == 60) { result = DEV_HIVE; baudrate = PL_BAUDRATE_115200; }
-    else if (result == DEV_CONBEE_1 && ftype > 9)                   { result = DEV_UNKNOWN; baudrate = PL_BAUDRATE_38400; }
-    else if (result == DEV_RASPBEE_2 && ftype >= 30 && ftype <= 39) { result = DEV_RASPBEE_2; baudrate = PL_BAUDRATE_38400; }
+static void ST_Server(GCF *gcf, Event event)
+{
+    (void)gcf;
+    (void)event;
+}
 
-    if (gcf->devBaudrate == PL_BAUDRATE_UNKNOWN)
-        gcf->devBaudrate = baudrate;
+/*! Resets device and timing state for a task started by a remote or control client. */
+static void gcfPrepareServerTask(GCF *gcf, unsigned long timeout)
+{
+    gcf->devSerialNum[0] = '\0';
+    gcf->devBaudrate = PL_BAUDRATE_UNKNOWN;
+    gcf->startTime = PL_Time();
+    gcf->maxTime = gcf->startTime + (timeout ? timeout : 10) * 1000;
 
-    return result;
+    gcfGetDevices(gcf);
+    gcf->devType = gcfGetDeviceType(gcf);
 }
 
-static void gcfRetry(GCF *gcf)
+static int gcfServerBusy(GCF *gcf)
 {
-    PL_time_t now;
+    if (gcf->task != T_SERVER)
+        return 1;
+
+#ifdef USE_NET
+    /* a remote upload in progress owns the firmware buffer */
+    if (gcf->remote && gcf->remote->state == RF_STATE_RECEIVING)
+    {
+        if (gcf->remote->lastRx + RF_PEER_TIMEOUT > PL_Time())
+            return 1;
+
+        gcf->remote->state = RF_STATE_IDLE;
+    }
+#endif
+
+    return 0;
+}
+
+/*! Loads firmware \p path unless it is already loaded and unchanged. */
+GCF_Status gcfLoadFile(GCF *gcf, const char *path)
+{
+    unsigned char *buf;
+    long nread;
+    unsigned len;
+    unsigned long stamp;
+
+    len = U_strlen(path);
+    if (len >= sizeof(gcf->file.fname))
+        return GCF_FAILED;
+
+    stamp = PL_FileStamp(path);
+    if (stamp != 0 && stamp == gcf->fileStamp && gcfStrEquals(gcf->file.fname, path))
+    {
+        PL_Printf(DBG_DEBUG, "use cached file: %s\n", path);
+        return GCF_SUCCESS;
+    }
+
+    buf = gcfFileBuffer(gcf);
+    if (!buf)
+        return GCF_FAILED;
+
+    U_memcpy(gcf->file.fname, path, len + 1);
+    nread = (long)PL_ReadFile(gcf->file.fname, buf, MAX_GCF_FILE_SIZE);
+    if (nread <= 0)
+        return GCF_FAILED;
+
+    gcf->file.fsize = (unsigned long)nread;
+    if (GCF_ParseFile(&gcf->file) != 0)
+        return GCF_FAILED;
+
+    gcf->fileStamp = stamp;
+    return GCF_SUCCESS;
+}
+
+static void gcfControlProgress(GCF *gcf, unsigned char percent)
+{
+    U_SStream *ss;
+
+    if (gcf->ctlClient >= 0 && gcf->ctlPercent != percent)
+    {
+        gcf->ctlPercent = percent;
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, "progress ");
+        U_sstream_put_long(ss, (long)percent);
+        U_sstream_put_str(ss, "\n");
+        PL_ControlWrite(gcf->ctlClient, ss->str);
+    }
+}
+
+static void ST_Query(GCF *gcf, Event event)
+{
+    U_SStream *ss;
+    GCF_KnownFirmware *kfw;
+
+    if (event == EV_ACTION)
+    {
+        if (PL_Connect(gcf->devpath, gcf->devBaudrate) != GCF_SUCCESS)
+        {
+            gcfTaskDone(gcf, GCF_FAILED);
+            return;
+        }
+
+        gcfCommandQueryFirmwareVersion();
+        PL_SetTimeout(1000);
+    }
+    else if (event == EV_PKG_FW_VERSION)
+    {
+        kfw = gcfFindKnownFirmware(gcf, gcfDeviceKey(gcf));
+        if (kfw && gcf->ctlClient >= 0)
+        {
+            ss = UI_StringStream(gcf);
+            U_sstream_put_str(ss, "firmware 0x");
+            U_sstream_put_u32hex(ss, kfw->fwVersion);
+            U_sstream_put_str(ss, "\n");
+            PL_ControlWrite(gcf->ctlClient, ss->str);
+        }
+        gcfTaskDone(gcf, kfw ? GCF_SUCCESS : GCF_FAILED);
+    }
+    else if (event == EV_TIMEOUT)
+    {
+        gcfTaskDone(gcf, GCF_FAILED);
+    }
+}
+
+static void gcfControlList(GCF *gcf, int client)
+{
+    unsigned i;
+    Device *dev;
+    U_SStream *ss;
+    GCF_KnownFirmware *kfw;
+
+    gcfGetDevices(gcf);
+
+    for (i = 0; i < gcf->devCount; i++)
+    {
+        dev = &gcf->devices[i];
+        kfw = gcfFindDeviceFirmware(gcf, dev);
+
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, "device ");
+        U_sstream_put_str(ss, dev->path);
+        U_sstream_put_str(ss, " ");
+        U_sstream_put_str(ss, dev->serial[0] ? dev->serial : "-");
+        if (kfw)
+        {
+            U_sstream_put_str(ss, " 0x");
+            U_sstream_put_u32hex(ss, kfw->fwVersion);
+        }
+        else
+        {
+            U_sstream_put_str(ss, " -");
+        }
+        U_sstream_put_str(ss, " ");
+        U_sstream_put_str(ss, dev->name);
+        U_sstream_put_str(ss, "\n");
+        PL_ControlWrite(client, ss->str);
+    }
+
+    PL_ControlWrite(client, "ok\n");
+}
+
+/*! Completes a daemon flash command with firmware auto after the library was rescanned. */
+static void ST_LibraryScan(GCF *gcf, Event event)
+{
+    const char *err;
+
+    if (event != EV_JOB_DONE)
+        return;
+
+    err = 0;
+    if (gcfLibraryScanned() != GCF_SUCCESS || gcfLibraryLoad(gcf) != GCF_SUCCESS)
+        err = "error no firmware\n";
+    else if (gcfSetupProgram(gcf) != GCF_SUCCESS)
+        err = "error invalid arguments\n";
+
+    if (err)
+    {
+        if (gcf->ctlClient >= 0)
+            PL_ControlWrite(gcf->ctlClient, err);
+        gcf->ctlClient = -1;
+        gcf->task = T_SERVER;
+        gcf->state = ST_Server;
+        return;
+    }
+
+    gcfStartTask(gcf);
+}
+
+static const char *gcfControlTask(GCF *gcf, int client, Task task, unsigned argc, char **argv)
+{
+    unsigned len;
+    int library;
+    long timeout;
+    U_SStream ss;
+
+    timeout = 0;
+
+    if (argc < 2 || (task == T_PROGRAM && argc < 3) || argc > (task == T_PROGRAM ? 4u : 2u))
+        return "error invalid arguments\n";
+
+    if (gcfServerBusy(gcf))
+        return "error busy\n";
+
+    if (argc == 4)
+    {
+        U_sstream_init(&ss, argv[3], U_strlen(argv[3]));
+        timeout = U_sstream_get_long(&ss);
+        if (ss.status != U_SSTREAM_OK || timeout < 0 || timeout > 3600)
+            return "error invalid timeout\n";
+    }
+
+    len = U_strlen(argv[1]);
+    if (len >= sizeof(gcf->devpath))
+        return "error invalid device\n";
+
+    library = task == T_PROGRAM && gcfStrEquals(argv[2], "auto");
+
+    if (library && !gcfLibraryIsOpen())
+        return "error no firmware\n";
+
+    if (task == T_PROGRAM && !library && gcfLoadFile(gcf, argv[2]) != GCF_SUCCESS)
+        return "error invalid file\n";
+
+    U_memcpy(gcf->devpath, argv[1], len + 1);
+    gcfPrepareServerTask(gcf, (unsigned long)timeout);
+
+    if (library && gcfLibraryScanBegin())
+    {
+        /* the directory changed, ST_LibraryScan continues after the rescan */
+        gcf->ctlClient = client;
+        gcf->ctlPercent = 0xFF;
+        gcf->task = task;
+        gcf->state = ST_LibraryScan;
+        PL_RunJob(gcfLibraryScanJob, 0, EV_JOB_DONE);
+        return 0;
+    }
+
+    if (library && gcfLibraryLoad(gcf) != GCF_SUCCESS)
+        return "error no firmware\n";
+
+    if (task == T_PROGRAM && gcfSetupProgram(gcf) != GCF_SUCCESS)
+        return "error invalid arguments\n";
+
+    gcf->ctlClient = client;
+    gcf->ctlPercent = 0xFF;
+    gcf->task = task;
+    gcfStartTask(gcf);
+
+    return 0;
+}
+
+void GCF_ControlReceived(GCF *gcf, int client, char *line)
+{
+    unsigned argc;
+    const char *err;
+    char *argv[GCF_CONTROL_MAX_ARGS];
+
+    /* split in place at spaces */
+    for (argc = 0; *line != '\0' && argc < GCF_CONTROL_MAX_ARGS;)
+    {
+        for (; *line == ' '; line++)
+            *line = '\0';
+
+        if (*line == '\0')
+            break;
+
+        argv[argc++] = line;
+
+        for (; *line != ' ' && *line != '\0'; line++)
+        {
+        }
+    }
+
+    for (; *line == ' '; line++)
+    {
+    }
+
+    if (argc == 0)
+        return;
+
+    err = 0;
+
+    if (*line != '\0')
+        err = "error invalid arguments\n";
+    else if (gcfStrEquals(argv[0], "list"))
+        gcfControlList(gcf, client);
+    else if (gcfStrEquals(argv[0], "flash"))
+        err = gcfControlTask(gcf, client, T_PROGRAM, argc, argv);
+    else if (gcfStrEquals(argv[0], "reset"))
+        err = gcfControlTask(gcf, client, T_RESET, argc, argv);
+    else if (gcfStrEquals(argv[0], "query"))
+        err = gcfControlTask(gcf, client, T_QUERY, argc, argv);
+    else
+        err = "error unknown command\n";
+
+    if (err)
+        PL_ControlWrite(client, err);
+}
+
+void GCF_ControlClosed(GCF *gcf, int client)
+{
+    /* a running task continues without reporting */
+    if (gcf->ctlClient == client)
+        gcf->ctlClient = -1;
+}
+
+/* Embedding API, see gcf.h. */
+
+unsigned long GCF_SessionSize(void)
+{
+    return (unsigned long)sizeof(GCF);
+}
+
+GCF *GCF_CreateSession(void *mem, unsigned long size, const GCF_Callbacks *callbacks)
+{
+    GCF *gcf;
+
+    if (!mem || size < sizeof(GCF))
+        return 0;
+
+    gcfInitPools();
+    gcf = (GCF*)mem;
+    U_bzero(gcf, sizeof(*gcf));
+
+    gcf->ctlClient = -1;
+    gcf->startTime = PL_Time();
+    gcf->serverMode = 1;
+    gcf->task = T_SERVER;
+    gcf->state = ST_Server;
+    gcf->substate = ST_Void;
+
+    if (callbacks)
+        gcf->callbacks = *callbacks;
+
+    return gcf;
+}
+
+GCF *GCF_CurrentSession(void)
+{
+    return gcfCurrent;
+}
+
+void *GCF_SessionUser(const GCF *gcf)
+{
+    return gcf->callbacks.user;
+}
+
+GCF_Status GCF_SetDevice(GCF *gcf, const char *path, PL_Baudrate baudrate)
+{
+    unsigned len;
+
+    len = U_strlen(path);
+    if (gcfServerBusy(gcf) || len == 0 || len >= sizeof(gcf->devpath))
+        return GCF_FAILED;
+
+    U_memcpy(gcf->devpath, path, len + 1);
+    gcf->devBaudrate = baudrate;
+    return GCF_SUCCESS;
+}
+
+GCF_Status GCF_SetFirmware(GCF *gcf, const char *name, const unsigned char *data, unsigned long size)
+{
+    unsigned len;
+
+    len = U_strlen(name);
+    if (gcfServerBusy(gcf) || len == 0 || len >= sizeof(gcf->file.fname) ||
+        size == 0 || size > MAX_GCF_FILE_SIZE)
+        return GCF_FAILED;
+
+    /* the name carries the version, e.g. deCONZ_ConBeeII_0x26780700.bin.GCF */
+    gcfFileRelease(gcf);
+    U_memcpy(gcf->file.fname, name, len + 1);
+    gcf->file.fcontent = data;
+    gcf->file.fsize = size;
+
+    if (GCF_ParseFile(&gcf->file) != 0)
+    {
+        gcf->file.fsize = 0;
+        return GCF_FAILED;
+    }
+
+    return GCF_SUCCESS;
+}
+
+GCF_Status GCF_Start(GCF *gcf, GCF_TaskType type, unsigned long timeout)
+{
+    GCF *prev;
+    Task task;
+    PL_Baudrate baudrate;
+    GCF_Status ret;
+
+    if      (type == GCF_TASK_PROGRAM) { task = T_PROGRAM; }
+    else if (type == GCF_TASK_RESET)   { task = T_RESET; }
+    else if (type == GCF_TASK_QUERY)   { task = T_QUERY; }
+    else                               { return GCF_FAILED; }
+
+    if (gcfServerBusy(gcf) || gcf->devpath[0] == '\0')
+        return GCF_FAILED;
+
+    if (task == T_PROGRAM && gcf->file.fsize == 0)
+        return GCF_FAILED;
+
+    if (gcfSessionAttach(gcf) != GCF_SUCCESS)
+        return GCF_FAILED;
+
+    prev = gcfCurrent;
+    gcfCurrent = gcf;
+    ret = GCF_SUCCESS;
+
+    baudrate = gcf->devBaudrate;
+    gcfPrepareServerTask(gcf, timeout);
+    gcf->devBaudrate = baudrate;
+
+    if (task == T_PROGRAM && gcfSetupProgram(gcf) != GCF_SUCCESS)
+    {
+        gcfSessionDetach(gcf);
+        ret = GCF_FAILED;
+    }
+    else
+    {
+        gcf->task = task;
+        gcfStartTask(gcf);
+    }
+
+    gcfCurrent = prev;
+    return ret;
+}
+
+unsigned long GCF_FirmwareVersion(GCF *gcf)
+{
+    GCF_KnownFirmware *kfw;
+
+    kfw = gcfFindKnownFirmware(gcf, gcfDeviceKey(gcf));
+    return kfw ? kfw->fwVersion : 0;
+}
+
+#ifdef USE_NET
+static int gcfRemoteChunkReceived(const GCF_Remote *rf, unsigned seq)
+{
+    return (rf->chunkMap[seq / 8] >> (seq % 8)) & 1;
+}
+
+static void gcfRemoteMarkChunk(GCF_Remote *rf, unsigned seq)
+{
+    rf->chunkMap[seq / 8] |= (unsigned char)(1 << (seq % 8));
+
+    while (rf->base < rf->nchunks && gcfRemoteChunkReceived(rf, rf->base))
+        rf->base++;
+}
+
+static void gcfRemoteHeader(U_BStream *bs, unsigned char *buf, unsigned size, unsigned char type, unsigned short session)
+{
+    U_bstream_init(bs, buf, size);
+    U_bstream_put_u8(bs, RF_MAGIC);
+    U_bstream_put_u8(bs, type);
+    U_bstream_put_u16_le(bs, session);
+}
+
+static void gcfRemoteSend(int client_id, U_BStream *bs)
+{
+    if (bs->status != U_BSTREAM_OK)
+        return;
+
+    if (client_id < 0)
+        NET_Broadcast(bs->data, (unsigned)bs->pos);
+    else
+        NET_Send(client_id, bs->data, (unsigned)bs->pos);
+}
+
+/*! Sends the server session state to \p client_id, or to all subscribers if < 0. */
+static void gcfRemoteSendStatus(GCF *gcf, int client_id)
+{
+    unsigned i;
+    unsigned long bitmap;
+    U_BStream bs;
+    unsigned char buf[16];
+    GCF_Remote *rf;
+
+    rf = gcf->remote;
+
+    if (rf->state == RF_STATE_RECEIVING)
+    {
+        bitmap = 0;
+        for (i = 0; i < 32 && rf->base + 1 + i < rf->nchunks; i++)
+        {
+            if (gcfRemoteChunkReceived(rf, rf->base + 1 + i))
+                bitmap |= 1UL << i;
+        }
+
+        gcfRemoteHeader(&bs, buf, sizeof(buf), RF_ACK, rf->session);
+        U_bstream_put_u16_le(&bs, (unsigned short)rf->base);
+        U_bstream_put_u32_le(&bs, bitmap);
+    }
+    else if (rf->state == RF_STATE_FLASHING)
+    {
+        gcfRemoteHeader(&bs, buf, sizeof(buf), RF_PROGRESS, rf->session);
+        U_bstream_put_u8(&bs, rf->percent);
+    }
+    else if (rf->state == RF_STATE_DONE)
+    {
+        gcfRemoteHeader(&bs, buf, sizeof(buf), RF_RESULT, rf->session);
+        U_bstream_put_u8(&bs, rf->result);
+    }
+    else
+    {
+        gcfRemoteHeader(&bs, buf, sizeof(buf), RF_RESULT, rf->session);
+        U_bstream_put_u8(&bs, RF_STATUS_NO_SESSION);
+    }
+
+    gcfRemoteSend(client_id, &bs);
+}
+
+static void gcfRemoteProgress(GCF *gcf, unsigned char percent)
+{
+    if (gcf->remote->state == RF_STATE_FLASHING && gcf->remote->percent != percent)
+    {
+        gcf->remote->percent = percent;
+        gcfRemoteSendStatus(gcf, -1);
+    }
+}
+
+static void gcfRemoteGetString(U_BStream *bs, char *str, unsigned size)
+{
+    unsigned i;
+    unsigned len;
+
+    len = U_bstream_get_u8(bs);
+    if (len >= size)
+        bs->status = U_BSTREAM_READ_PAST_END;
+
+    for (i = 0; i < len && bs->status == U_BSTREAM_OK; i++)
+        str[i] = (char)U_bstream_get_u8(bs);
+
+    str[bs->status == U_BSTREAM_OK ? len : 0] = '\0';
+}
+
+static void gcfRemotePutString(U_BStream *bs, const char *str)
+{
+    unsigned i;
+    unsigned len;
+
+    len = U_strlen(str);
+    if (len > 255)
+        bs->status = U_BSTREAM_WRITE_PAST_END;
+
+    U_bstream_put_u8(bs, (unsigned char)len);
+    for (i = 0; i < len && bs->status == U_BSTREAM_OK; i++)
+        U_bstream_put_u8(bs, (unsigned char)str[i]);
+}
+
+/*! Remote clients may only open devices which are enumerated locally,
+    compared exactly against the path or stable path.
+ */
+static int gcfIsEnumeratedDevice(GCF *gcf, const char *path)
+{
+    unsigned i;
+    const Device *dev;
+
+    if (path[0] == '\0')
+        return 0;
+
+    if (gcfStrEquals(path, gcfServerDevice))
+        return 1; /* explicitly allowed by the operator */
+
+    gcfGetDevices(gcf);
+
+    for (i = 0; i < gcf->devCount; i++)
+    {
+        dev = &gcf->devices[i];
+        if (gcfStrEquals(path, dev->path) || gcfStrEquals(path, dev->stablepath))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void gcfRemoteServerReceived(GCF *gcf, int client_id, unsigned char type, unsigned short session, U_BStream *bs)
+{
+    unsigned seq;
+    unsigned len;
+    unsigned long offset;
+    unsigned long size;
+    U_SStream *ss;
+    GCF_Remote *rf;
+    U_BStream bs1;
+    unsigned char buf[16];
+
+    rf = gcf->remote;
+
+    if (type == RF_OPEN_REQ)
+    {
+        unsigned char status;
+        unsigned short timeout;
+        char devpath[MAX_DEV_PATH_LENGTH];
+        char fname[MAX_DEV_PATH_LENGTH];
+
+        status = RF_STATUS_OK;
+
+        if ((rf->state == RF_STATE_FLASHING && rf->session != session) ||
+            (rf->state != RF_STATE_FLASHING && gcf->task != T_SERVER))
+        {
+            status = RF_STATUS_BUSY; /* also if a control socket task is running */
+        }
+        else if (rf->state == RF_STATE_RECEIVING && rf->session != session &&
+                 rf->lastRx + RF_PEER_TIMEOUT > PL_Time())
+        {
+            status = RF_STATUS_BUSY; /* another client's upload owns the firmware buffer */
+        }
+        else if (rf->state != RF_STATE_FLASHING)
+        {
+            size = U_bstream_get_u32_le(bs);
+            timeout = U_bstream_get_u16_le(bs);
+            gcfRemoteGetString(bs, devpath, sizeof(devpath));
+            gcfRemoteGetString(bs, fname, sizeof(fname));
+
+            if (bs->status != U_BSTREAM_OK || fname[0] == '\0' ||
+                size <= GCF_HEADER_SIZE || size > MAX_GCF_FILE_SIZE ||
+                !gcfIsEnumeratedDevice(gcf, devpath))
+            {
+                status = RF_STATUS_INVALID;
+                rf->state = RF_STATE_IDLE;
+            }
+            else if ((rf->state != RF_STATE_RECEIVING || rf->session != session) && !gcfFileBuffer(gcf))
+            {
+                status = RF_STATUS_BUSY; /* all firmware buffers are in use */
+                rf->state = RF_STATE_IDLE;
+            }
+            else
+            {
+                U_memcpy(gcf->devpath, devpath, sizeof(devpath));
+                U_memcpy(gcf->file.fname, fname, sizeof(fname));
+
+                if (rf->state != RF_STATE_RECEIVING || rf->session != session)
+                {
+                    ss = UI_StringStream(gcf);
+                    U_sstream_put_str(ss, "remote session for ");
+                    U_sstream_put_str(ss, gcf->devpath);
+                    U_sstream_put_str(ss, "\n");
+                    UI_Puts(gcf, ss->str);
+                }
+
+                rf->state = RF_STATE_RECEIVING;
+                rf->timeout = timeout;
+                rf->session = session;
+                rf->lastRx = PL_Time();
+                gcf->fileStamp = 0; /* the upload overwrites the cached file */
+                rf->size = size;
+                rf->chunkSize = RF_CHUNK_SIZE;
+                rf->nchunks = (unsigned)((size + RF_CHUNK_SIZE - 1) / RF_CHUNK_SIZE);
+                rf->base = 0;
+                rf->percent = 0;
+                U_bzero(&rf->chunkMap[0], sizeof(rf->chunkMap));
+            }
+        }
+
+        NET_Subscribe(client_id);
+
+        gcfRemoteHeader(&bs1, buf, sizeof(buf), RF_OPEN_RSP, session);
+        U_bstream_put_u8(&bs1, status);
+        U_bstream_put_u16_le(&bs1, RF_CHUNK_SIZE);
+        U_bstream_put_u16_le(&bs1, RF_WINDOW);
+        gcfRemoteSend(client_id, &bs1);
+        return;
+    }
+
+    if (rf->session != session || rf->state == RF_STATE_IDLE)
+    {
+        gcfRemoteHeader(&bs1, buf, sizeof(buf), RF_RESULT, session);
+        U_bstream_put_u8(&bs1, RF_STATUS_NO_SESSION);
+        gcfRemoteSend(client_id, &bs1);
+        return;
+    }
+
+    if (type == RF_DATA && rf->state == RF_STATE_RECEIVING)
+    {
+        seq = U_bstream_get_u16_le(bs);
+        offset = (unsigned long)seq * rf->chunkSize;
+        len = (unsigned)(bs->size - bs->pos);
+
+        if (bs->status == U_BSTREAM_OK && seq < rf->nchunks &&
+            len == ((rf->size - offset) < rf->chunkSize ? (rf->size - offset) : rf->chunkSize))
+        {
+            rf->lastRx = PL_Time();
+
+            if (!gcfRemoteChunkReceived(rf, seq))
+            {
+                /* the image lands directly in the buffer used by the upload states */
+                U_memcpy(&gcf->file.fbuf[offset], &bs->data[bs->pos], len);
+                gcfRemoteMarkChunk(rf, seq);
+            }
+        }
+
+        gcfRemoteSendStatus(gcf, client_id);
+    }
+    else if (type == RF_START && rf->state == RF_STATE_RECEIVING)
+    {
+        if (rf->base != rf->nchunks)
+        {
+            gcfRemoteHeader(&bs1, buf, sizeof(buf), RF_RESULT, session);
+            U_bstream_put_u8(&bs1, RF_STATUS_INCOMPLETE);
+            gcfRemoteSend(client_id, &bs1);
+            return;
+        }
+
+        gcf->file.fsize = rf->size;
+
+        if (GCF_ParseFile(&gcf->file) != 0)
+        {
+            rf->state = RF_STATE_DONE;
+            rf->result = RF_STATUS_INVALID_FILE;
+            gcfRemoteSendStatus(gcf, client_id);
+            return;
+        }
+
+        gcfPrepareServerTask(gcf, rf->timeout);
+
+        if (gcfSetupProgram(gcf) != GCF_SUCCESS)
+        {
+            rf->state = RF_STATE_DONE;
+            rf->result = RF_STATUS_INVALID;
+            gcfRemoteSendStatus(gcf, client_id);
+            return;
+        }
+
+        rf->state = RF_STATE_FLASHING;
+        gcfRemoteSendStatus(gcf, client_id);
+
+        gcf->task = T_PROGRAM;
+        gcfStartTask(gcf);
+    }
+    else
+    {
+        gcfRemoteSendStatus(gcf, client_id);
+    }
+}
+
+static void gcfRemoteClientSend(GCF *gcf, U_BStream *bs)
+{
+    int client_id;
+
+    client_id = NET_Peer(gcf->remote->peerAddr, gcf->remote->peerPort);
+    gcfRemoteSend(client_id, bs);
+}
+
+static void gcfRemoteSendChunk(GCF *gcf, unsigned seq, PL_time_t now)
+{
+    unsigned len;
+    unsigned long offset;
+    U_BStream bs;
+    GCF_Remote *rf;
+    unsigned char buf[RF_HEADER_SIZE + 2 + RF_CHUNK_SIZE];
+
+    rf = gcf->remote;
+    offset = (unsigned long)seq * rf->chunkSize;
+    len = (unsigned)((rf->size - offset) < rf->chunkSize ? (rf->size - offset) : rf->chunkSize);
+
+    gcfRemoteHeader(&bs, buf, sizeof(buf), RF_DATA, rf->session);
+    U_bstream_put_u16_le(&bs, (unsigned short)seq);
+
+    if (bs.pos + len > bs.size)
+        return;
+
+    U_memcpy(&buf[bs.pos], &gcf->file.fcontent[offset], len);
+    bs.pos += len;
+
+    rf->sendTime[seq] = now;
+    gcfRemoteClientSend(gcf, &bs);
+}
+
+/*! Sends chunks in the window which weren't sent yet or timed out. */
+static void gcfRemoteFillWindow(GCF *gcf)
+{
+    unsigned seq;
+    unsigned end;
+    PL_time_t now;
+    GCF_Remote *rf;
+
+    rf = gcf->remote;
+    now = PL_Time();
+
+    end = rf->base + rf->window;
+    if (end > rf->nchunks)
+        end = rf->nchunks;
+
+    for (seq = rf->base; seq < end; seq++)
+    {
+        if (gcfRemoteChunkReceived(rf, seq))
+            continue;
+
+        if (rf->sendTime[seq] == 0 || rf->sendTime[seq] + RF_RTO < now)
+            gcfRemoteSendChunk(gcf, seq, now);
+    }
+}
+
+static void gcfRemoteSendSimple(GCF *gcf, unsigned char type)
+{
+    U_BStream bs;
+    unsigned char buf[RF_HEADER_SIZE];
+
+    gcfRemoteHeader(&bs, buf, sizeof(buf), type, gcf->remote->session);
+    gcfRemoteClientSend(gcf, &bs);
+}
+
+static void gcfRemoteFailed(GCF *gcf, const char *msg)
+{
+    UI_Puts(gcf, msg);
+    PL_ShutDown();
+}
+
+static void ST_RemoteOpen(GCF *gcf, Event event)
+{
+    U_BStream bs;
+    unsigned char buf[RF_HEADER_SIZE + 8 + 2 * 256];
+    GCF_Remote *rf;
+
+    rf = gcf->remote;
+
+    if (event == EV_ACTION || event == EV_TIMEOUT)
+    {
+        if (event == EV_ACTION)
+        {
+            rf->session = (unsigned short)(PL_Time() & 0xFFFF);
+            rf->size = gcf->file.fsize;
+            rf->nchunks = 0;
+            rf->base = 0;
+            rf->percent = 0;
+            rf->lastRx = PL_Time();
+            U_bzero(&rf->chunkMap[0], sizeof(rf->chunkMap));
+            U_bzero(&rf->sendTime[0], sizeof(rf->sendTime));
+        }
+        else if (rf->lastRx + RF_PEER_TIMEOUT / 3 < PL_Time())
+        {
+            gcfRemoteFailed(gcf, "remote GCFFlasher not reachable\n");
+            return;
+        }
+
+        gcfRemoteHeader(&bs, buf, sizeof(buf), RF_OPEN_REQ, rf->session);
+        U_bstream_put_u32_le(&bs, rf->size);
+        U_bstream_put_u16_le(&bs, (unsigned short)rf->timeout);
+
+        gcfRemotePutString(&bs, gcf->devpath);
+        gcfRemotePutString(&bs, gcf->file.fname);
+
+        gcfRemoteClientSend(gcf, &bs);
+        PL_SetTimeout(500);
+    }
+}
+
+static void ST_RemoteUpload(GCF *gcf, Event event)
+{
+    if (event == EV_ACTION || event == EV_TIMEOUT)
+    {
+        if (gcf->remote->lastRx + RF_PEER_TIMEOUT < PL_Time())
+        {
+            gcfRemoteFailed(gcf, "\nremote GCFFlasher timeout\n");
+            return;
+        }
+
+        gcfRemoteFillWindow(gcf);
+        PL_SetTimeout(RF_TICK);
+    }
+}
+
+static void ST_RemoteFlash(GCF *gcf, Event event)
+{
+    if (event == EV_ACTION || event == EV_TIMEOUT)
+    {
+        if (gcf->remote->lastRx + RF_PEER_TIMEOUT < PL_Time())
+        {
+            gcfRemoteFailed(gcf, "\nremote GCFFlasher timeout\n");
+            return;
+        }
+
+        /* START is idempotent and also serves as keep-alive */
+        gcfRemoteSendSimple(gcf, event == EV_ACTION ? RF_START : RF_STATUS);
+        PL_SetTimeout(1000);
+    }
+}
+
+static void gcfRemoteClientReceived(GCF *gcf, unsigned char type, unsigned short session, U_BStream *bs)
+{
+    unsigned i;
+    unsigned base;
+    unsigned char status;
+    unsigned long bitmap;
+    U_SStream *ss;
+    GCF_Remote *rf;
+
+    rf = gcf->remote;
+
+    if (session != rf->session)
+        return;
+
+    rf->lastRx = PL_Time();
+
+    if (type == RF_OPEN_RSP && gcf->state == ST_RemoteOpen)
+    {
+        status = U_bstream_get_u8(bs);
+        rf->chunkSize = U_bstream_get_u16_le(bs);
+        rf->window = U_bstream_get_u16_le(bs);
+
+        if (bs->status != U_BSTREAM_OK || status != RF_STATUS_OK ||
+            rf->chunkSize == 0 || rf->chunkSize > RF_CHUNK_SIZE)
+        {
+            ss = UI_StringStream(gcf);
+            U_sstream_put_str(ss, "remote session rejected, status: ");
+            U_sstream_put_long(ss, (long)status);
+            U_sstream_put_str(ss, "\n");
+            gcfRemoteFailed(gcf, ss->str);
+            return;
+        }
+
+        if (rf->window == 0 || rf->window > RF_WINDOW)
+            rf->window = RF_WINDOW;
+
+        rf->nchunks = (unsigned)((rf->size + rf->chunkSize - 1) / rf->chunkSize);
+        if (rf->nchunks > RF_MAX_CHUNKS)
+        {
+            gcfRemoteFailed(gcf, "remote chunk size too small\n");
+            return;
+        }
+
+        UI_Puts(gcf, "remote session opened\n");
+        gcf->state = ST_RemoteUpload;
+        GCF_HandleEvent(gcf, EV_ACTION);
+    }
+    else if (type == RF_ACK && gcf->state == ST_RemoteUpload)
+    {
+        base = U_bstream_get_u16_le(bs);
+        bitmap = U_bstream_get_u32_le(bs);
+
+        if (bs->status != U_BSTREAM_OK || base > rf->nchunks)
+            return;
+
+        for (i = rf->base; i < base; i++)
+            gcfRemoteMarkChunk(rf, i);
+
+        for (i = 0; i < 32 && base + 1 + i < rf->nchunks; i++)
+        {
+            if (bitmap & (1UL << i))
+                gcfRemoteMarkChunk(rf, base + 1 + i);
+        }
+
+        gcf->remaining = (unsigned)(rf->size - (rf->base < rf->nchunks ? (unsigned long)rf->base * rf->chunkSize : rf->size));
+        UI_UpdateProgress(gcf);
+
+        if (rf->base == rf->nchunks)
+        {
+            UI_Puts(gcf, "\nupload done, start remote flashing\n");
+            gcf->state = ST_RemoteFlash;
+            GCF_HandleEvent(gcf, EV_ACTION);
+        }
+        else
+        {
+            gcfRemoteFillWindow(gcf);
+        }
+    }
+    else if (type == RF_PROGRESS && gcf->state == ST_RemoteFlash)
+    {
+        rf->percent = U_bstream_get_u8(bs);
+        if (bs->status == U_BSTREAM_OK && rf->percent <= 100)
+        {
+            gcf->remaining = (unsigned)(rf->size - rf->size * rf->percent / 100);
+            UI_UpdateProgress(gcf);
+        }
+    }
+    else if (type == RF_RESULT && gcf->state != ST_RemoteOpen)
+    {
+        status = U_bstream_get_u8(bs);
+
+        ss = UI_StringStream(gcf);
+        if (status == RF_STATUS_OK)
+        {
+            U_sstream_put_str(ss, FMT_GREEN "\nremote firmware successful written\n" FMT_RESET);
+        }
+        else
+        {
+            U_sstream_put_str(ss, "\nremote flashing failed, status: ");
+            U_sstream_put_long(ss, (long)status);
+            U_sstream_put_str(ss, "\n");
+        }
+        UI_Puts(gcf, ss->str);
+        PL_ShutDown();
+    }
+}
+
+static void gcfDiscoverRespond(GCF *gcf, int client_id, unsigned short session)
+{
+    unsigned i;
+    unsigned n;
+    unsigned long pos;
+    Device *dev;
+    GCF_KnownFirmware *kfw;
+    U_BStream bs;
+    unsigned char buf[1280]; /* S_UDP_MAX_PKG_SIZE, MAX_DEVICES entries always fit */
+
+    if (client_id < 0)
+        return;
+
+    /* a running task works with the device list, only refresh it while idle */
+    if (gcf->state == ST_Server)
+        gcfGetDevices(gcf);
+
+    gcfRemoteHeader(&bs, buf, sizeof(buf), RF_DISCOVER_RSP, session);
+    U_bstream_put_u8(&bs, 0); /* device count, set below */
+
+    for (i = 0, n = 0; i < gcf->devCount; i++)
+    {
+        dev = &gcf->devices[i];
+        pos = bs.pos;
+
+        kfw = gcfFindDeviceFirmware(gcf, dev);
+
+        gcfRemotePutString(&bs, dev->path);
+        gcfRemotePutString(&bs, dev->serial);
+        gcfRemotePutString(&bs, dev->name);
+        U_bstream_put_u32_le(&bs, kfw ? kfw->fwVersion : 0);
+
+        if (bs.status != U_BSTREAM_OK)
+        {
+            bs.pos = pos;
+            bs.status = U_BSTREAM_OK;
+            break;
+        }
+        n++;
+    }
+
+    buf[RF_HEADER_SIZE] = (unsigned char)n;
+    gcfRemoteSend(client_id, &bs);
+}
+
+static void gcfPadColumn(U_SStream *ss, unsigned col)
+{
+    for (;ss->pos < col && ss->status == U_SSTREAM_OK;)
+    {
+        U_sstream_put_str(ss, " ");
+    }
+    U_sstream_put_str(ss, "| ");
+}
+
+static void gcfDiscoverReceived(GCF *gcf, int client_id, unsigned char type, U_BStream *bs)
+{
+    unsigned i;
+    unsigned count;
+    unsigned long fwVersion;
+    U_SStream *ss;
+    char host[64];
+    char path[MAX_DEV_PATH_LENGTH];
+    char serial[MAX_DEV_SERIALNR_LENGTH];
+    char name[MAX_DEV_NAME_LENGTH];
+
+    if (type != RF_DISCOVER_RSP)
+        return;
+
+    if (NET_PeerAddress(client_id, host, sizeof(host)) != 1)
+        return;
+
+    gcf->discoverCount++;
+    count = U_bstream_get_u8(bs);
+
+    if (bs->status == U_BSTREAM_OK && count == 0)
+    {
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, host);
+        gcfPadColumn(ss, 21);
+        U_sstream_put_str(ss, "no devices\n");
+        UI_Puts(gcf, ss->str);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        gcfRemoteGetString(bs, path, sizeof(path));
+        gcfRemoteGetString(bs, serial, sizeof(serial));
+        gcfRemoteGetString(bs, name, sizeof(name));
+        fwVersion = U_bstream_get_u32_le(bs);
+
+        if (bs->status != U_BSTREAM_OK)
+            break;
+
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, host);
+        gcfPadColumn(ss, 21);
+        U_sstream_put_str(ss, path);
+        gcfPadColumn(ss, 43);
+        U_sstream_put_str(ss, serial);
+        gcfPadColumn(ss, 57);
+        U_sstream_put_str(ss, name);
+        gcfPadColumn(ss, 74);
+
+        if (fwVersion != 0)
+        {
+            U_sstream_put_str(ss, "0x");
+            U_sstream_put_u32hex(ss, fwVersion);
+        }
+        else
+        {
+            U_sstream_put_str(ss, "unknown");
+        }
+
+        U_sstream_put_str(ss, "\n");
+        UI_Puts(gcf, ss->str);
+    }
+}
+
+static void ST_Discover(GCF *gcf, Event event)
+{
+    U_BStream bs;
+    U_SStream *ss;
+    unsigned char buf[RF_HEADER_SIZE];
+
+    if (event == EV_ACTION)
+    {
+        gcf->remote->session = (unsigned short)(PL_Time() & 0xFFFF);
+        gcf->discoverCount = 0;
+
+        gcfRemoteHeader(&bs, buf, sizeof(buf), RF_DISCOVER_REQ, gcf->remote->session);
+        gcfRemoteClientSend(gcf, &bs);
+
+        UI_Puts(gcf, "Host                 | Path                | Serial      | Type           | Firmware\n");
+        UI_Puts(gcf, "---------------------+---------------------+-------------+----------------+-----------\n");
+        PL_SetTimeout(RF_DISCOVER_WINDOW);
+    }
+    else if (event == EV_TIMEOUT)
+    {
+        ss = UI_StringStream(gcf);
+        U_sstream_put_long(ss, (long)gcf->discoverCount);
+        U_sstream_put_str(ss, gcf->discoverCount == 1 ? " GCFFlasher found\n" : " GCFFlashers found\n");
+        UI_Puts(gcf, ss->str);
+        PL_ShutDown();
+    }
+}
+#endif /* USE_NET */
+
+DeviceType gcfGetDeviceType(GCF *gcf)
+{
+    int ftype;
+    U_SStream ss;
+    DeviceType result;
+    PL_Baudrate baudrate;
+    GCF_Profile *prof;
+
+    result = DEV_UNKNOWN;
+    ftype = gcf->file.gcfFileType;
+    baudrate = PL_BAUDRATE_UNKNOWN;
+
+    if (gcf->devpath[0] != '\0')
+    {
+        U_sstream_init(&ss, &gcf->devpath[0], U_strlen(&gcf->devpath[0]));
+
+        if      (U_sstream_find(&ss, "ttyACM"))        { result = DEV_CONBEE_2; baudrate = PL_BAUDRATE_115200; }
+        else if (U_sstream_find(&ss, "ConBee_II"))     { result = DEV_CONBEE_2; baudrate = PL_BAUDRATE_115200; }
+        else if (U_sstream_find(&ss, "cu.usbmodemDE")) { result = DEV_CONBEE_2; baudrate = PL_BAUDRATE_115200; }
+        else if (U_sstream_find(&ss, "ttyUSB"))        { result = DEV_CONBEE_1; baudrate = PL_BAUDRATE_38400; }
+        else if (U_sstream_find(&ss, "usb-FTDI"))      { result = DEV_CONBEE_1; baudrate = PL_BAUDRATE_38400; }
+        else if (U_sstream_find(&ss, "cu.usbserial"))  { result = DEV_CONBEE_1; baudrate = PL_BAUDRATE_38400; }
+        else if (U_sstream_find(&ss, "ttyAMA"))        { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; }
+        else if (U_sstream_find(&ss, "ttyAML"))        { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; } /* Odroid */
+        else if (U_sstream_find(&ss, "ttyS"))          { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; }
+        else if (U_sstream_find(&ss, "/serial"))       { result = DEV_RASPBEE_1; baudrate = PL_BAUDRATE_38400; }
+#ifdef _WIN32
+        else if (U_sstream_find(&ss, "COM"))
+        {
+            if (ftype == 1 && gcf->file.gcfTargetAddress == 0)
+            {
+                result = DEV_CONBEE_1;
+                baudrate = PL_BAUDRATE_38400;
+            }
+            else if (ftype < 30 && gcf->file.gcfTargetAddress == 0x5000)
+            {
+                result = DEV_CONBEE_2;
+                baudrate = PL_BAUDRATE_115200;
+            }
+        }
+#endif
+    }
+
+    /* the path doesn't tell, but the device was seen before */
+    prof = gcfDeviceProfile(gcf);
+    if (result == DEV_UNKNOWN && prof && prof->devType != DEV_UNKNOWN)
+    {
+        result = (DeviceType)prof->devType;
+        baudrate = (PL_Baudrate)prof->baudrate;
+    }
+
+    /* further detemine detive type from the GCF header */
+    if      (ftype == 60) { result = DEV_HIVE; baudrate = PL_BAUDRATE_115200; }
+    else if (result == DEV_CONBEE_1 && ftype > 9)                   { result = DEV_UNKNOWN; baudrate = PL_BAUDRATE_38400; }
+    else if (result == DEV_RASPBEE_2 && ftype >= 30 && ftype <= 39) { result = DEV_RASPBEE_2; baudrate = PL_BAUDRATE_38400; }
+
+    if (gcf->devBaudrate == PL_BAUDRATE_UNKNOWN)
+        gcf->devBaudrate = baudrate;
+
+    return result;
+}
+
+static void gcfRetry(GCF *gcf)
+{
+    PL_time_t now;
     U_SStream *ss;
 
     now = PL_Time();
 
     if (gcf->maxTime > now)
     {
+        gcfMetrics.retries[RETRY_TASK]++;
+        gcf->retrying = 1;
+
         ss = UI_StringStream(gcf);
         U_sstream_put_str(ss, "retry: ");
         U_sstream_put_long(ss, (long)(gcf->maxTime - now) / 1000);
@@ -1425,8 +3473,86 @@ static void gcfRetry(GCF *gcf)
     }
     else
     {
-        PL_ShutDown();
+        gcfTaskDone(gcf, GCF_FAILED);
+    }
+}
+
+/*! Starts gcf->task which is already configured, used for tasks not
+    originating from the command line and their retries.
+ */
+void gcfStartTask(GCF *gcf)
+{
+    gcf->substate = ST_Void;
+
+    if      (gcf->task == T_PROGRAM) { gcf->state = ST_Program; }
+    else if (gcf->task == T_RESET)   { gcf->state = ST_Reset; }
+    else if (gcf->task == T_CONNECT) { gcf->state = ST_Connect; }
+    else if (gcf->task == T_QUERY)   { gcf->state = ST_Query; }
+    else if (gcf->task == T_SERVER)  { gcf->state = ST_Server; }
+    else
+    {
+        gcfTaskDone(gcf, GCF_FAILED);
+        return;
+    }
+
+    GCF_HandleEvent(gcf, EV_ACTION);
+}
+
+/*! Ends the current task. In server mode the result is reported to the
+    remote or control client and the next task is awaited, otherwise the program ends.
+ */
+static void gcfTaskDone(GCF *gcf, GCF_Status status)
+{
+    U_SStream *ss;
+
+    gcfProfileUpdate(gcf, status);
+
+    gcf->retrying = 0;
+    if (gcf->task == T_PROGRAM)
+    {
+        if (status == GCF_SUCCESS)
+            gcfMetrics.succeeded[gcf->devType]++;
+        else
+            gcfMetrics.failed[gcf->devType]++;
+    }
+
+    if (gcf->serverMode)
+    {
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, status == GCF_SUCCESS ? "task done\n" : "task failed\n");
+        UI_Puts(gcf, ss->str);
+
+        if (status == GCF_SUCCESS && gcf->task == T_PROGRAM && gcf->file.fwVersion != 0)
+            gcfSetKnownFirmware(gcf, gcf->file.fwVersion);
+
+        PL_ClearTimeout();
+        gcf->task = T_SERVER;
+        gcf->state = ST_Server;
+        gcf->substate = ST_Void;
+#ifdef USE_NET
+        if (gcf->remote->state == RF_STATE_FLASHING)
+        {
+            gcf->remote->state = RF_STATE_DONE;
+            gcf->remote->result = status == GCF_SUCCESS ? RF_STATUS_OK : RF_STATUS_FLASH_FAILED;
+            gcfRemoteSendStatus(gcf, -1);
+        }
+#endif
+        if (gcf->ctlClient >= 0)
+        {
+            PL_ControlWrite(gcf->ctlClient, status == GCF_SUCCESS ? "ok\n" : "error failed\n");
+            gcf->ctlClient = -1;
+        }
+        PL_Disconnect();
+
+        if (gcf != &gcfLocal)
+            gcfSessionDetach(gcf);
+
+        if (gcf->callbacks.done)
+            gcf->callbacks.done(gcf->callbacks.user, status);
+        return;
     }
+
+    PL_ShutDown();
 }
 
 static void gcfPrintHelp(void)
@@ -1436,17 +3562,40 @@ static void gcfPrintHelp(void)
     "options:\n"
     " -r              force device reboot without programming\n"
     " -f <firmware>   flash firmware file\n"
+    " --firmware-dir <dir>\n"
+    "                 flash the newest fitting firmware of dir when -f is missing,\n"
+    "                 also for batch jobs and daemon commands with firmware auto\n"
+    " -S              station mode, flash -f on each newly attached device\n"
+    " -U <limit>      station mode devices flashed at once per USB hub, default 2,\n"
+    "                 optionally per root port, e.g. 2:3\n"
+    " -M <manifest>   batch mode, flash the firmware files assigned to devices\n"
+    " -j <jobs>       station and batch mode devices flashed at once\n"
+    " -o <file>       results file, CSV in batch mode, JSON report with -b\n"
+    " -e [<rtt>]      estimate the flash time of -f on -d per phase without flashing,\n"
+    "                 also --estimate, optionally with a measured rtt in us or a -b report\n"
+    " -P <file>       device profiles, learned per device and reused across runs\n"
 #if defined(PL_WIN) || defined(PL_DOS)
     " -d <com port>   COM port to use, e.g. COM1\n"
 #else
     " -d <device>     device number or path to use, e.g. 0, /dev/ttyUSB0 or RaspBee\n"
+    " -D <socket>     daemon mode, accept commands on a unix domain socket\n"
+    " -R <policy>     real-time scheduling: fifo or rr, optional priority, e.g. fifo:20\n"
+    " -A <cpu>        pin to a CPU core\n"
 #ifdef USE_NET
-    " -i <interface>  listen interface\n"
-    "                 when only -p is specified default is 0.0.0.0 for any interface\n"
-    " -p <port>       listen port\n"
+    " -i <address>    listen address, e.g. 0.0.0.0 for any interface\n"
+    "                 when only -p is specified default is 127.0.0.1\n"
+    " -p <port>       listen port, clients may flash the listed devices and -d\n"
+    " -v              log network peers\n"
+    " -m <port|path>  serve Prometheus metrics on 127.0.0.1:port or a unix domain socket\n"
+    " -u <address>    upload and flash firmware (-f) on a remote GCFFlasher (-p)\n"
+    "                 address[:port], the device path (-d) is on the remote host\n"
+    " -n              discover GCFFlashers (-p) and their devices on the LAN\n"
+    "                 with -u only the given host is queried\n"
 #endif
 #endif
-    " -c              connect and debug serial protocol\n"
+    " -c              connect and show serial protocol statistics\n"
+    " -b <rate>       benchmark the serial link with requests per second, 0 = max,\n"
+    "                 optionally requests in flight, e.g. 0:8, duration -t or 10 s\n"
 //    " -s <serial>     serial number to use\n"
     " -t <timeout>    retry until timeout (seconds) is reached\n"
     " -l              list devices\n"
@@ -1521,11 +3670,26 @@ void gcfDebugHex(GCF *gcf, const char *msg, const unsigned char *data, unsigned
 
 static GCF_Status gcfProcessCommandline(GCF *gcf)
 {
+    unsigned char *buf;
     int i;
     const char *arg;
     unsigned long arglen;
     long longval;
     long nread;
+    long schedCpu;
+    long schedPriority;
+    long rootLimit;
+    long window;
+    PL_SchedPolicy schedPolicy;
+    int station;
+    int estimate;
+    long estimateRtt;
+    GCF_Profile *prof;
+    const char *manifest;
+#ifdef USE_NET
+    const char *listenInterface;
+    long listenPort;
+#endif
     GCF_Status ret = GCF_FAILED;
     U_SStream ss;
 
@@ -1539,6 +3703,21 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
     gcf->file.gcfFileType = 0;
     gcf->file.fsize = 0;
     gcf->task = T_NONE;
+#ifdef USE_NET
+    gcf->remote->peerAddr[0] = '\0';
+    gcf->remote->timeout = 0;
+#endif
+    schedPolicy = PL_SCHED_DEFAULT;
+    schedPriority = 0;
+    schedCpu = -1;
+    station = 0;
+    estimate = 0;
+    estimateRtt = -1;
+    manifest = 0;
+#ifdef USE_NET
+    listenInterface = 0;
+    listenPort = -1;
+#endif
 
     if (gcf->argc == 1)
     {
@@ -1558,68 +3737,249 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
                     gcf->task = T_RESET;
                 } break;
 
-                case 'c':
-                {
-                    gcf->task = T_CONNECT;
+                case 'c':
+                {
+                    gcf->task = T_CONNECT;
+                } break;
+
+                case 'd':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -d\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    arg = gcf->argv[i];
+
+                    arglen = U_strlen(arg);
+                    if (arglen >= sizeof(gcf->devpath))
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -d\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    U_memcpy(gcf->devpath, arg, arglen + 1);
+                } break;
+
+                case 'f':
+                {
+                    gcf->task = T_PROGRAM;
+
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -f\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    arg = gcf->argv[i];
+
+                    arglen = U_strlen(arg);
+                    if (arglen >= sizeof(gcf->file.fname))
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -f\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    buf = gcfFileBuffer(gcf);
+                    U_memcpy(gcf->file.fname, arg, arglen + 1);
+                    nread = buf ? (long)PL_ReadFile(gcf->file.fname, buf, MAX_GCF_FILE_SIZE) : 0;
+                    if (nread <= 0)
+                    {
+                        PL_Printf(DBG_INFO, "failed to read file: %s\n", gcf->file.fname);
+                        return GCF_FAILED;
+                    }
+
+                    PL_Printf(DBG_INFO, "read file success: %s (%ld bytes)\n", gcf->file.fname, nread);
+                    gcf->file.fsize = (unsigned long)nread;
+
+                    if (GCF_ParseFile(&gcf->file) != 0)
+                    {
+                        PL_Printf(DBG_INFO, "invalid file: %s\n", gcf->file.fname);
+                        return GCF_FAILED;
+                    }
+                } break;
+
+                case 'S':
+                {
+                    station = 1;
+                } break;
+
+                case 'P':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -P\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    if (gcfProfileLoad(gcf->argv[i]) != GCF_SUCCESS)
+                        return GCF_FAILED;
+                } break;
+
+                case 'e':
+                case '-':
+                {
+                    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+                    if (arg[1] == '-' && U_sstream_starts_with(&ss, "--firmware-dir") && ss.len == 14)
+                    {
+                        if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                        {
+                            PL_Printf(DBG_INFO, "missing argument for parameter --firmware-dir\n");
+                            return GCF_FAILED;
+                        }
+
+                        i++;
+                        if (gcfLibraryOpen(gcf->argv[i]) != GCF_SUCCESS)
+                            return GCF_FAILED;
+                        break;
+                    }
+
+                    if (arg[1] == '-' && (!U_sstream_starts_with(&ss, "--estimate") || ss.len != 10))
+                    {
+                        PL_Printf(DBG_INFO, "unknown option: %s\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    estimate = 1;
+
+                    /* optional rtt or -b report */
+                    if ((i + 1) < gcf->argc && gcf->argv[i + 1][0] != '-')
+                    {
+                        i++;
+                        arg = gcf->argv[i];
+                        estimateRtt = gcfEstimateLoadRtt(arg);
+                        if (estimateRtt < 0)
+                        {
+                            PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -e\n", arg);
+                            return GCF_FAILED;
+                        }
+                    }
+                } break;
+
+                case 'U':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -U\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    arg = gcf->argv[i];
+
+                    /* <per hub> or <per hub>:<per root port> */
+                    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+                    longval = U_sstream_get_long(&ss);
+                    rootLimit = GCF_STATION_ROOT_LIMIT;
+
+                    if (ss.status == U_SSTREAM_OK && U_sstream_peek_char(&ss) == ':')
+                    {
+                        U_sstream_seek(&ss, U_sstream_pos(&ss) + 1);
+                        rootLimit = U_sstream_get_long(&ss);
+                    }
+
+                    if (ss.status != U_SSTREAM_OK || !U_sstream_at_end(&ss) ||
+                        longval < 1 || longval > 16 || rootLimit < 1 || rootLimit > 16)
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -U\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    gcfStationSetLimits((unsigned)longval, (unsigned)rootLimit);
                 } break;
 
-                case 'd':
+                case 'b':
                 {
                     if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
                     {
-                        PL_Printf(DBG_INFO, "missing argument for parameter -d\n");
+                        PL_Printf(DBG_INFO, "missing argument for parameter -b\n");
                         return GCF_FAILED;
                     }
 
                     i++;
                     arg = gcf->argv[i];
 
-                    arglen = U_strlen(arg);
-                    if (arglen >= sizeof(gcf->devpath))
+                    /* <requests/s> or <requests/s>:<window> */
+                    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+                    longval = U_sstream_get_long(&ss);
+                    window = 1;
+
+                    if (ss.status == U_SSTREAM_OK && U_sstream_peek_char(&ss) == ':')
                     {
-                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -d\n", arg);
+                        U_sstream_seek(&ss, U_sstream_pos(&ss) + 1);
+                        window = U_sstream_get_long(&ss);
+                    }
+
+                    if (ss.status != U_SSTREAM_OK || !U_sstream_at_end(&ss) ||
+                        longval < 0 || longval > 100000 || window < 1 || window > GCF_BENCH_MAX_WINDOW)
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -b\n", arg);
                         return GCF_FAILED;
                     }
 
-                    U_memcpy(gcf->devpath, arg, arglen + 1);
+                    gcfBenchSetup((unsigned long)longval, (unsigned)window);
+                    gcf->task = T_BENCHMARK;
                 } break;
 
-                case 'f':
+                case 'M':
                 {
-                    gcf->task = T_PROGRAM;
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -M\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    manifest = gcf->argv[i];
+                } break;
 
+                case 'j':
+                {
                     if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
                     {
-                        PL_Printf(DBG_INFO, "missing argument for parameter -f\n");
+                        PL_Printf(DBG_INFO, "missing argument for parameter -j\n");
                         return GCF_FAILED;
                     }
 
                     i++;
                     arg = gcf->argv[i];
 
-                    arglen = U_strlen(arg);
-                    if (arglen >= sizeof(gcf->file.fname))
+                    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+                    longval = U_sstream_get_long(&ss);
+
+                    if (ss.status != U_SSTREAM_OK || !U_sstream_at_end(&ss) ||
+                        longval < 1 || longval > GCF_STATION_WORKERS)
                     {
-                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -f\n", arg);
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -j\n", arg);
                         return GCF_FAILED;
                     }
 
-                    U_memcpy(gcf->file.fname, arg, arglen + 1);
-                    nread = (long)PL_ReadFile(gcf->file.fname, gcf->file.fcontent, sizeof(gcf->file.fcontent));
-                    if (nread <= 0)
+                    gcfStationSetWorkers((unsigned)longval);
+                } break;
+
+                case 'o':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
                     {
-                        PL_Printf(DBG_INFO, "failed to read file: %s\n", gcf->file.fname);
+                        PL_Printf(DBG_INFO, "missing argument for parameter -o\n");
                         return GCF_FAILED;
                     }
 
-                    PL_Printf(DBG_INFO, "read file success: %s (%ld bytes)\n", gcf->file.fname, nread);
-                    gcf->file.fsize = (unsigned long)nread;
+                    i++;
+                    arg = gcf->argv[i];
 
-                    if (GCF_ParseFile(&gcf->file) != 0)
+                    arglen = U_strlen(arg);
+                    if (arglen >= sizeof(gcfOutputFile))
                     {
-                        PL_Printf(DBG_INFO, "invalid file: %s\n", gcf->file.fname);
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -o\n", arg);
                         return GCF_FAILED;
                     }
+
+                    U_memcpy(gcfOutputFile, arg, arglen + 1);
                 } break;
 
                 case 'l':
@@ -1653,6 +4013,9 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
                     gcf->maxTime = (PL_time_t)longval;
                     gcf->maxTime *= 1000;
                     gcf->maxTime += gcf->startTime;
+#ifdef USE_NET
+                    gcf->remote->timeout = (unsigned long)longval;
+#endif
 
                 } break;
 
@@ -1668,6 +4031,94 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
                     /* TODO this is a no-op currently */
                 } break;
 
+                case 'D':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -D\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    arg = gcf->argv[i];
+
+                    if (PL_ControlOpen(arg) != 1)
+                    {
+                        PL_Printf(DBG_INFO, "failed to open control socket: %s\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    gcf->daemon = 1;
+                } break;
+
+                case 'R':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -R\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    arg = gcf->argv[i];
+
+                    /* fifo, rr, fifo:<priority> or rr:<priority> */
+                    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+                    longval = 10;
+
+                    if (U_sstream_starts_with(&ss, "fifo"))
+                    {
+                        schedPolicy = PL_SCHED_FIFO;
+                        U_sstream_seek(&ss, 4);
+                    }
+                    else if (U_sstream_starts_with(&ss, "rr"))
+                    {
+                        schedPolicy = PL_SCHED_RR;
+                        U_sstream_seek(&ss, 2);
+                    }
+                    else
+                    {
+                        ss.status = U_SSTREAM_ERR_INVALID;
+                    }
+
+                    if (ss.status == U_SSTREAM_OK && U_sstream_peek_char(&ss) == ':')
+                    {
+                        U_sstream_seek(&ss, U_sstream_pos(&ss) + 1);
+                        longval = U_sstream_get_long(&ss);
+                    }
+
+                    if (ss.status != U_SSTREAM_OK || !U_sstream_at_end(&ss) || longval < 1 || longval > 99)
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -R\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    schedPriority = longval;
+                } break;
+
+                case 'A':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -A\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    arg = gcf->argv[i];
+
+                    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+                    longval = U_sstream_get_long(&ss); /* cpu */
+
+                    if (ss.status != U_SSTREAM_OK || longval < 0 || longval > 1023)
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -A\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    schedCpu = longval;
+                } break;
+
 #ifdef USE_NET
                 case 'p':
                 {
@@ -1690,13 +4141,129 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
                         return GCF_FAILED;
                     }
 
-                    if (NET_Init(0, (unsigned short)longval) != 1)
+                    listenPort = longval;
+                }
+                    break;
+
+                case 'i':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -i\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    listenInterface = gcf->argv[i];
+                } break;
+
+                case 'v':
+                {
+                    NET_SetLogPeers(1);
+                } break;
+
+                case 'm':
+                {
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
                     {
-                        PL_Printf(DBG_INFO, "failed to start network server\n");
+                        PL_Printf(DBG_INFO, "missing argument for parameter -m\n");
                         return GCF_FAILED;
                     }
-                }
-                    break;
+
+                    i++;
+                    arg = gcf->argv[i];
+
+                    /* a port number listens on loopback TCP, anything else is a socket path */
+                    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+                    longval = U_sstream_get_long(&ss);
+                    if (ss.status != U_SSTREAM_OK || !U_sstream_at_end(&ss))
+                        longval = 0;
+                    else if (longval <= 0 || longval > 65535)
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -m\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    if (NET_MetricsOpen(arg, (unsigned short)longval) != 1)
+                    {
+                        PL_Printf(DBG_INFO, "failed to open metrics listener: %s\n", arg);
+                        return GCF_FAILED;
+                    }
+                } break;
+
+                case 'n':
+                {
+                    gcf->task = T_DISCOVER;
+                } break;
+
+                case 'u':
+                {
+                    unsigned j;
+                    unsigned end;
+                    unsigned colons;
+
+                    if ((i + 1) == gcf->argc || gcf->argv[i + 1][0] == '-')
+                    {
+                        PL_Printf(DBG_INFO, "missing argument for parameter -u\n");
+                        return GCF_FAILED;
+                    }
+
+                    i++;
+                    arg = gcf->argv[i];
+                    arglen = U_strlen(arg);
+
+                    /* address, address:port or [ipv6-address]:port */
+                    longval = RF_DEFAULT_PORT;
+                    colons = 0;
+                    end = 0;
+                    j = 0;
+
+                    for (j = 0; j < arglen; j++)
+                    {
+                        if (arg[j] == ':')
+                        {
+                            colons++;
+                            end = j;
+                        }
+                    }
+
+                    j = 0;
+                    if (arg[0] == '[')
+                    {
+                        j = 1;
+                        for (end = 1; end < arglen && arg[end] != ']'; end++)
+                        {
+                        }
+                        colons = (end + 1 < arglen && arg[end + 1] == ':') ? 1 : 0;
+                        end++; /* port separator */
+                    }
+                    else if (colons != 1)
+                    {
+                        end = (unsigned)arglen; /* no port, IPv6 address without [] */
+                        colons = 0;
+                    }
+
+                    U_sstream_init(&ss, (void*)arg, (unsigned)arglen);
+                    if (colons == 1)
+                    {
+                        U_sstream_seek(&ss, end + 1);
+                        longval = U_sstream_get_long(&ss);
+                    }
+
+                    if (arg[0] == '[')
+                        end--;
+
+                    if (end <= j || end - j >= sizeof(gcf->remote->peerAddr) ||
+                        ss.status != U_SSTREAM_OK || longval <= 0 || longval > 65535)
+                    {
+                        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -u\n", arg);
+                        return GCF_FAILED;
+                    }
+
+                    U_memcpy(gcf->remote->peerAddr, &arg[j], end - j);
+                    gcf->remote->peerAddr[end - j] = '\0';
+                    gcf->remote->peerPort = (unsigned short)longval;
+                } break;
 #endif
                 case '?':
                 case 'h':
@@ -1715,10 +4282,103 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
         }
     }
 
+#ifdef USE_NET
+    /* remote flashing isn't authenticated, other hosts only on request */
+    if (listenPort >= 0 && NET_Init(listenInterface ? listenInterface : "127.0.0.1", (unsigned short)listenPort) != 1)
+    {
+        PL_Printf(DBG_INFO, "failed to start network server\n");
+        return GCF_FAILED;
+    }
+#endif
+
+    /* failures are reported by the platform, flashing works without */
+    if (schedPolicy != PL_SCHED_DEFAULT || schedCpu >= 0)
+        PL_SetRealtime(schedPolicy, (int)schedPriority, (int)schedCpu);
+
+    if (manifest)
+    {
+        /* enumerates the devices itself */
+        if (gcfBatchLoadManifest(gcf, manifest) != GCF_SUCCESS)
+            return GCF_FAILED;
+
+        gcf->task = T_STATION;
+        gcf->state = ST_Station;
+        return GCF_SUCCESS;
+    }
+
     gcfGetDevices(gcf);
     gcf->devType = gcfGetDeviceType(gcf);
 
+    if (station)
+    {
+        if (gcf->file.fsize == 0)
+        {
+            PL_Printf(DBG_INFO, "missing -f argument\n");
+            return GCF_FAILED;
+        }
+
+        gcf->task = T_STATION;
+        gcf->state = ST_Station;
+        return GCF_SUCCESS;
+    }
+
+    if (estimate)
+    {
+        if (gcfSetupProgram(gcf) != GCF_SUCCESS)
+            return GCF_FAILED;
+
+        prof = gcfDeviceProfile(gcf);
+        if (estimateRtt < 0 && prof && prof->rtt)
+            estimateRtt = (long)prof->rtt;
+
+        gcfEstimate(gcf, estimateRtt);
+        PL_ShutDown();
+        return GCF_SUCCESS;
+    }
+
+#ifdef USE_NET
+    /* multicast doesn't reach a socket bound to loopback */
+    if ((gcf->task == T_NONE || gcf->task == T_CONNECT) && NET_Handle() != -1 && listenInterface)
+    {
+        if (NET_JoinGroup(RF_DISCOVERY_GROUP) != 1)
+            PL_Printf(DBG_INFO, "failed to join discovery group %s\n", RF_DISCOVERY_GROUP);
+    }
+
+    if (gcf->task == T_PROGRAM && gcf->remote->peerAddr[0] != '\0')
+    {
+        gcf->task = T_REMOTE_PROGRAM;
+    }
+#endif
+
+    /* --firmware-dir picks the firmware for -d, remote devices need -f */
+    if (gcf->task == T_NONE && gcf->devpath[0] != '\0' && gcfLibraryIsOpen())
+    {
+#ifdef USE_NET
+        if (gcf->remote->peerAddr[0] == '\0')
+#endif
+            gcf->task = T_PROGRAM;
+    }
+
+    if (gcf->task == T_NONE && (gcf->daemon || NET_Handle() != -1))
+    {
+#ifdef USE_NET
+        U_memcpy(gcfServerDevice, gcf->devpath, sizeof(gcfServerDevice));
+#endif
+        PL_Printf(DBG_INFO, "waiting for remote clients\n");
+        gcf->task = T_SERVER;
+        gcf->serverMode = 1;
+        gcf->state = ST_Server;
+        return GCF_SUCCESS;
+    }
+
     if (gcf->task == T_PROGRAM)
+    {
+        ret = gcfSetupProgram(gcf);
+        if (ret == GCF_SUCCESS)
+            gcf->state = ST_Program;
+    }
+#ifdef USE_NET
+    else if (gcf->task == T_REMOTE_PROGRAM)
     {
         if (gcf->devpath[0] == '\0')
         {
@@ -1726,38 +4386,35 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
             return GCF_FAILED;
         }
 
-        if (gcf->file.fname[0] == '\0')
+        if (NET_Handle() == -1 && NET_Init(0, 0) != 1)
         {
-            PL_Printf(DBG_INFO, "missing -f argument\n");
+            PL_Printf(DBG_INFO, "failed to open network socket\n");
             return GCF_FAILED;
         }
 
-        /* if no -t parameter was specified, use 10 seconds retry time */
-        if (gcf->maxTime < gcf->startTime)
+        gcf->state = ST_RemoteOpen;
+        ret = GCF_SUCCESS;
+    }
+    else if (gcf->task == T_DISCOVER)
+    {
+        /* -u queries a single host instead of the group */
+        if (gcf->remote->peerAddr[0] == '\0')
         {
-            gcf->maxTime = 10 * 1000;
-            gcf->maxTime += gcf->startTime;
+            U_memcpy(gcf->remote->peerAddr, RF_DISCOVERY_GROUP, sizeof(RF_DISCOVERY_GROUP));
+            gcf->remote->peerPort = RF_DEFAULT_PORT;
         }
 
-        /* The /dev/ttyACM0 and similar doesn't tell if this is RaspBee II,
-           the fwVersion of the file is more specific.
-        */
-        if (gcf->devType == DEV_RASPBEE_1 &&
-            (gcf->file.fwVersion & FW_VERSION_PLATFORM_MASK) == FW_VERSION_PLATFORM_R21)
-        {
-            PL_Printf(DBG_DEBUG, "assume RaspBee II\n");
-            gcf->devType = DEV_RASPBEE_2;
-        }
-        else if (gcf->devType == DEV_RASPBEE_1 && gcf->file.gcfTargetAddress == 0x5000)
+        if (NET_Handle() == -1 && NET_Init(0, 0) != 1)
         {
-            PL_Printf(DBG_DEBUG, "assume RaspBee II\n");
-            gcf->devType = DEV_RASPBEE_2;
+            PL_Printf(DBG_INFO, "failed to open network socket\n");
+            return GCF_FAILED;
         }
 
-        gcf->state = ST_Program;
+        gcf->state = ST_Discover;
         ret = GCF_SUCCESS;
     }
-    else if (gcf->task == T_CONNECT)
+#endif
+    else if (gcf->task == T_CONNECT || gcf->task == T_BENCHMARK)
     {
         if (gcf->devpath[0] == '\0')
         {
@@ -1765,7 +4422,7 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
             return GCF_FAILED;
         }
 
-        gcf->state = ST_Connect;
+        gcf->state = gcf->task == T_CONNECT ? ST_Connect : ST_Benchmark;
         ret = GCF_SUCCESS;
     }
     else if (gcf->task == T_RESET)
@@ -1789,6 +4446,54 @@ static GCF_Status gcfProcessCommandline(GCF *gcf)
     return ret;
 }
 
+/*! Checks the device and firmware of a T_PROGRAM task and
+    refines the device type based on the firmware file.
+ */
+GCF_Status gcfSetupProgram(GCF *gcf)
+{
+    if (gcf->devpath[0] == '\0')
+    {
+        PL_Printf(DBG_INFO, "missing -d argument\n");
+        return GCF_FAILED;
+    }
+
+    if (gcf->file.fname[0] == '\0' && gcfLibraryIsOpen())
+    {
+        if (gcfLibraryLoad(gcf) != GCF_SUCCESS)
+            return GCF_FAILED;
+    }
+
+    if (gcf->file.fname[0] == '\0')
+    {
+        PL_Printf(DBG_INFO, "missing -f argument\n");
+        return GCF_FAILED;
+    }
+
+    /* if no -t parameter was specified, use 10 seconds retry time */
+    if (gcf->maxTime < gcf->startTime)
+    {
+        gcf->maxTime = 10 * 1000;
+        gcf->maxTime += gcf->startTime;
+    }
+
+    /* The /dev/ttyACM0 and similar doesn't tell if this is RaspBee II,
+       the fwVersion of the file is more specific.
+    */
+    if (gcf->devType == DEV_RASPBEE_1 &&
+        (gcf->file.fwVersion & FW_VERSION_PLATFORM_MASK) == FW_VERSION_PLATFORM_R21)
+    {
+        PL_Printf(DBG_DEBUG, "assume RaspBee II\n");
+        gcf->devType = DEV_RASPBEE_2;
+    }
+    else if (gcf->devType == DEV_RASPBEE_1 && gcf->file.gcfTargetAddress == 0x5000)
+    {
+        PL_Printf(DBG_DEBUG, "assume RaspBee II\n");
+        gcf->devType = DEV_RASPBEE_2;
+    }
+
+    return GCF_SUCCESS;
+}
+
 static void gcfCommandResetUart(void)
 {
     const unsigned char cmd[] = {
@@ -1810,6 +4515,11 @@ static void gcfCommandQueryStatus(void)
 {
     static unsigned char seq = 1;
 
+    gcfCommandQueryStatusSeq(seq++);
+}
+
+void gcfCommandQueryStatusSeq(unsigned char seq)
+{
     unsigned char cmd[] = {
         0x07, // command: write parmater
         0x02, // seq
@@ -1818,8 +4528,9 @@ static void gcfCommandQueryStatus(void)
         0x00, 0x00, 0x00 // dummy bytes
     };
 
-    cmd[1] = seq++;
+    cmd[1] = seq;
 
+    gcfTrafficSent(cmd, sizeof(cmd));
     PROT_SendFlagged(cmd, sizeof(cmd));
 }
 
@@ -1833,5 +4544,6 @@ static void gcfCommandQueryFirmwareVersion(void)
         0x00, 0x00, 0x00, 0x00 // dummy bytes
     };
 
+    gcfTrafficSent(cmd, sizeof(cmd));
     PROT_SendFlagged(cmd, sizeof(cmd));
 }
@@ -23,8 +23,12 @@ typedef enum
     EV_RASPBEE_RESET_SUCCESS = 13,
     EV_RASPBEE_RESET_FAILED = 23,
     EV_PKG_UART_RESET = 41,
+    EV_PKG_FW_VERSION = 42,
     EV_PL_STARTED = 100,
     EV_PL_LOOP = 101,
+    EV_NET_READY = 102,
+    EV_JOB_DONE = 103,
+    EV_PROFILES_SAVED = 104,
     EV_RX_ASCII = 50,
     EV_RX_BTL_PKG_DATA = 40,
     EV_CONNECTED = 200,
@@ -71,6 +75,81 @@ void GCF_Exit(GCF *gcf);
 void GCF_Received(GCF *gcf, const unsigned char *data, int len);
 void GCF_HandleEvent(GCF *gcf, Event event);
 
+/*! Called from platform layer for each command line received from control
+    socket \p client, \p line is '\0' terminated without line ending.
+ */
+void GCF_ControlReceived(GCF *gcf, int client, char *line);
+
+/*! Called from platform layer when control socket \p client has disconnected. */
+void GCF_ControlClosed(GCF *gcf, int client);
+
+/* Embedding API
+
+   The core is built as the gcfcore static library. An application creates
+   sessions in memory it owns, drives them with GCF_HandleEvent() and
+   GCF_Received() and implements the PL_* and UI_* functions below as well as
+   PROT_Write(), PROT_Putc() and PROT_Flush() from protocol.h. Within these
+   functions GCF_CurrentSession() tells which session is calling.
+
+   All calls for sessions must be made from the same thread.
+ */
+
+typedef enum
+{
+    GCF_TASK_PROGRAM,
+    GCF_TASK_RESET,
+    GCF_TASK_QUERY
+} GCF_TaskType;
+
+typedef struct
+{
+    void *user;
+    /*! Called during GCF_TASK_PROGRAM upload with \p percent 0..100. */
+    void (*progress)(void *user, unsigned percent);
+    /*! Called when a task has finished, a new one can be started from here. */
+    void (*done)(void *user, GCF_Status status);
+} GCF_Callbacks;
+
+/*! Returns the size of the memory required by GCF_CreateSession(). */
+unsigned long GCF_SessionSize(void);
+
+/*! Creates a session in \p mem, which must be suitably aligned (e.g. from malloc())
+    and stay valid while the session is used. An idle session only needs
+    GCF_SessionSize() bytes, working buffers are taken from a fixed pool in
+    the core while a task runs, GCF_Start() fails if none is free.
+
+    \param callbacks - may be 0, the struct is copied.
+    \returns the session or 0 if \p size is too small.
+ */
+GCF *GCF_CreateSession(void *mem, unsigned long size, const GCF_Callbacks *callbacks);
+
+/*! Returns the session of the running GCF_* call. */
+GCF *GCF_CurrentSession(void);
+
+/*! Returns the \c user pointer of the session callbacks. */
+void *GCF_SessionUser(const GCF *gcf);
+
+/*! Sets the device \p path, \p baudrate may be PL_BAUDRATE_UNKNOWN. */
+GCF_Status GCF_SetDevice(GCF *gcf, const char *path, PL_Baudrate baudrate);
+
+/*! Sets \p size bytes of firmware \p data for the session. The data isn't
+    copied and must stay valid until it is replaced or the session is gone.
+
+    \param name - the file name, which carries the firmware version
+                  like deCONZ_ConBeeII_0x26780700.bin.GCF
+ */
+GCF_Status GCF_SetFirmware(GCF *gcf, const char *name, const unsigned char *data, unsigned long size);
+
+/*! Starts a task, the result is reported via GCF_Callbacks::done.
+
+    \param timeout - retry time in seconds, 0 uses 10 seconds.
+    \returns GCF_FAILED if a task is running or device or firmware aren't set.
+ */
+GCF_Status GCF_Start(GCF *gcf, GCF_TaskType type, unsigned long timeout);
+
+/*! Returns the last known firmware version of the session device, or 0. */
+unsigned long GCF_FirmwareVersion(GCF *gcf);
+
 int GCF_ParseFile(GCF_File *file);
 void gcfDebugHex(GCF *gcf, const char *msg, const unsigned char *data, unsigned size);
 void put_hex(unsigned char ch, char *buf);
@@ -83,6 +162,9 @@ void put_hex(unsigned char ch, char *buf);
 /*! Returns a monotonic time in milliseconds. */
 PL_time_t PL_Time(void);
 
+/*! Returns a monotonic time in microseconds, used for latency measurements. */
+PL_time_t PL_TimeMicro(void);
+
 /*! Lets the programm sleep for \p ms milliseconds. */
 void PL_MSleep(unsigned long ms);
 
@@ -96,6 +178,7 @@ void PL_ClearTimeout(void);
 #define MAX_DEV_NAME_LENGTH 32
 #define MAX_DEV_SERIALNR_LENGTH 18
 #define MAX_DEV_PATH_LENGTH 255
+#define MAX_DEV_USBPATH_LENGTH 32
 #define MAX_GCF_FILE_SIZE (1024 * 800) // 800K
 
 typedef struct
@@ -105,6 +188,7 @@ typedef struct
     char path[MAX_DEV_PATH_LENGTH];
     char serial[MAX_DEV_SERIALNR_LENGTH];
     char stablepath[MAX_DEV_PATH_LENGTH];
+    char usbpath[MAX_DEV_USBPATH_LENGTH]; /* USB port path like 1-1.4.2, empty if unknown */
 } Device;
 
 /* Fills up to \p max devices in the \p devs array.
@@ -134,6 +218,65 @@ int PL_ResetRaspBee(void);
 
 int PL_ReadFile(const char *path, unsigned char *buf, unsigned long buflen);
 
+/*! Creates or replaces the file at \p path with \p len bytes of \p data.
+    \returns the number of bytes written or -1 on error.
+ */
+int PL_WriteFile(const char *path, const unsigned char *data, unsigned long len);
+
+/*! Returns a value which changes when the file at \p path is modified,
+    or 0 if unknown. Used to detect if a cached firmware file is still valid.
+ */
+unsigned long PL_FileStamp(const char *path);
+
+/*! Calls \p fn with the name of each entry in directory \p path, . and .. excluded.
+    \returns the number of entries or -1 if the directory can't be read.
+ */
+int PL_ListDir(const char *path, void (*fn)(void *user, const char *name), void *user);
+
+/*! Opens the daemon mode control socket at \p path.
+    \returns 1 on success, 0 if not supported or on error.
+ */
+int PL_ControlOpen(const char *path);
+
+/*! Writes \p str to control socket \p client, returns 1 on success. */
+int PL_ControlWrite(int client, const char *str);
+
+/*! Closes the control socket and all its clients. */
+void PL_ControlClose(void);
+
+typedef enum
+{
+    PL_SCHED_DEFAULT,
+    PL_SCHED_FIFO,
+    PL_SCHED_RR
+} PL_SchedPolicy;
+
+typedef void (*PL_Job)(void *arg);
+
+/*! Runs \p job(arg) for the calling session off the main loop, so blocking
+    operations like device enumeration, resets and file reads don't stall
+    the serial I/O of other sessions. When the job has returned \p event is
+    delivered to the session from the main loop. The job must not call GCF_*
+    functions, its results are passed via \p arg.
+
+    Platforms without worker threads run the job right away and deliver
+    \p event before returning.
+ */
+void PL_RunJob(PL_Job job, void *arg, Event event);
+
+/*! Returns 1 if PL_RunJob() runs jobs on worker threads, 0 if it runs them
+    right away.
+ */
+int PL_HasWorkers(void);
+
+/*! Moves the main loop to real-time scheduling \p policy with \p priority,
+    locks its memory and pins it to \p cpu if >= 0. The wakeup latency of
+    the loop is reported when it ends.
+
+    \returns 1 on success, 0 if not supported or not permitted.
+ */
+int PL_SetRealtime(PL_SchedPolicy policy, int priority, int cpu);
+
 
 /* Terminal printing and logging */
 
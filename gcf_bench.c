@@ -0,0 +1,724 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Serial link benchmark (-b)
+
+   Sends device state requests, like the connect mode status query, with
+   consecutive sequence numbers at a fixed rate or as fast as possible,
+   keeping at most a window of requests outstanding. Each response is
+   matched by its sequence number to measure the round trip time.
+
+   A response which arrives after the response of a later request is counted
+   as reordered, requests without response within GCF_BENCH_LOSS_TIME are
+   lost and responses to unknown or lost requests are unexpected. The
+   throughput is measured as responses per second, the mean over the run
+   and the best full second.
+*/
+
+#include "u_sstream.h"
+#include "u_strlen.h"
+#include "buffer_helper.h"
+#include "gcf_bench.h"
+#include "gcf_profile.h"
+
+#define GCF_BENCH_DURATION 10000 /* ms, -t changes it */
+#define GCF_BENCH_LOSS_TIME 1000
+#define GCF_BENCH_BUCKET 100     /* histogram resolution in microseconds */
+#define GCF_BENCH_BUCKETS 500    /* the last one holds all above 50 ms */
+#define GCF_BENCH_REPORT_SIZE (1024 + GCF_BENCH_BUCKETS * 24) /* JSON with all buckets used */
+
+typedef struct
+{
+    unsigned char used;
+    unsigned long index;       /* number of the request */
+    PL_time_t time;            /* sent, microseconds */
+} GCF_BenchRequest;
+
+typedef struct
+{
+    unsigned long rate;        /* requests per second, 0 = unlimited */
+    unsigned window;
+    PL_time_t start;
+    PL_time_t end;
+    unsigned long sent;
+    unsigned long received;
+    unsigned long lost;
+    unsigned long reordered;
+    unsigned long unexpected;
+    unsigned long answered;    /* highest request number with response + 1 */
+    unsigned outstanding;
+    PL_time_t secondStart;
+    unsigned long secondCount;
+    unsigned long maxPerSecond;
+    PL_time_t rttMin;
+    PL_time_t rttMax;
+    PL_time_t rttSum;
+    GCF_BenchRequest requests[256];
+    unsigned long histogram[GCF_BENCH_BUCKETS];
+} GCF_Bench;
+
+static GCF_Bench gcfBench;
+static unsigned char gcfBenchReportBuf[GCF_BENCH_REPORT_SIZE]; /* -o written by -b, read by -e */
+
+/*! Sets the -b request \p rate per second, 0 = unlimited, and the \p window of outstanding requests. */
+void gcfBenchSetup(unsigned long rate, unsigned window)
+{
+    gcfBench.rate = rate;
+    gcfBench.window = window;
+}
+
+static void gcfBenchSend(void)
+{
+    unsigned char seq;
+    GCF_BenchRequest *req;
+
+    seq = (unsigned char)(gcfBench.sent & 0xFF);
+    req = &gcfBench.requests[seq];
+    if (req->used) /* only with a lost request */
+    {
+        req->used = 0;
+        gcfBench.lost++;
+        gcfBench.outstanding--;
+    }
+
+    req->used = 1;
+    req->index = gcfBench.sent;
+    req->time = PL_TimeMicro();
+    gcfBench.sent++;
+    gcfBench.outstanding++;
+
+    gcfCommandQueryStatusSeq(seq);
+}
+
+/*! Sends the requests which are due by rate and fit into the window. */
+static void gcfBenchFill(PL_time_t now)
+{
+    unsigned long due;
+
+    if (now >= gcfBench.end)
+        return;
+
+    due = gcfBench.rate ? (unsigned long)((now - gcfBench.start) * gcfBench.rate / 1000) + 1 : 0xFFFFFFFFUL;
+
+    while (gcfBench.sent < due && gcfBench.outstanding < gcfBench.window)
+        gcfBenchSend();
+}
+
+/*! Counts requests without response as lost and the responses per second. */
+static void gcfBenchUpdate(PL_time_t now)
+{
+    unsigned i;
+    PL_time_t nowUs;
+    GCF_BenchRequest *req;
+
+    nowUs = PL_TimeMicro();
+    for (i = 0; i < 256; i++)
+    {
+        req = &gcfBench.requests[i];
+        if (req->used && req->time + GCF_BENCH_LOSS_TIME * 1000UL < nowUs)
+        {
+            req->used = 0;
+            gcfBench.lost++;
+            gcfBench.outstanding--;
+        }
+    }
+
+    if (now - gcfBench.secondStart >= 1000 && now <= gcfBench.end)
+    {
+        if (gcfBench.secondCount > gcfBench.maxPerSecond)
+            gcfBench.maxPerSecond = gcfBench.secondCount;
+        gcfBench.secondCount = 0;
+        gcfBench.secondStart = now;
+    }
+}
+
+void gcfBenchReceived(const unsigned char *data, unsigned len)
+{
+    PL_time_t rtt;
+    PL_time_t now;
+    GCF_BenchRequest *req;
+
+    if (len < 2 || data[0] != 0x07) /* device state response */
+        return;
+
+    now = PL_Time();
+    req = &gcfBench.requests[data[1]];
+    if (!req->used)
+    {
+        gcfBench.unexpected++;
+        return;
+    }
+
+    rtt = PL_TimeMicro() - req->time;
+    if (req->index < gcfBench.answered)
+        gcfBench.reordered++;
+    else
+        gcfBench.answered = req->index + 1;
+
+    req->used = 0;
+    gcfBench.outstanding--;
+    gcfBench.received++;
+    gcfBench.secondCount++;
+    gcfBench.rttSum += rtt;
+    if (gcfBench.received == 1 || rtt < gcfBench.rttMin)
+        gcfBench.rttMin = rtt;
+    if (rtt > gcfBench.rttMax)
+        gcfBench.rttMax = rtt;
+
+    gcfBench.histogram[rtt / GCF_BENCH_BUCKET < GCF_BENCH_BUCKETS ? rtt / GCF_BENCH_BUCKET : GCF_BENCH_BUCKETS - 1]++;
+
+    gcfBenchUpdate(now);
+    gcfBenchFill(now);
+}
+
+/*! Returns the upper bound of the \p permille percentile bucket in microseconds. */
+static unsigned long gcfBenchPercentile(unsigned long permille)
+{
+    unsigned i;
+    unsigned long n;
+    unsigned long rank;
+
+    rank = (gcfBench.received * permille + 999) / 1000;
+    n = 0;
+    for (i = 0; i < GCF_BENCH_BUCKETS; i++)
+    {
+        n += gcfBench.histogram[i];
+        if (n >= rank && n > 0)
+            break;
+    }
+
+    if (i >= GCF_BENCH_BUCKETS - 1)
+        return (unsigned long)gcfBench.rttMax;
+
+    return (i + 1) * GCF_BENCH_BUCKET;
+}
+
+static void gcfBenchPutField(U_SStream *ss, const char *name, unsigned long val)
+{
+    U_sstream_put_str(ss, "\"");
+    U_sstream_put_str(ss, name);
+    U_sstream_put_str(ss, "\": ");
+    U_sstream_put_long(ss, (long)val);
+}
+
+/*! Prints the summary and writes the JSON report to the -o file. */
+static void gcfBenchReport(GCF *gcf, const char *path)
+{
+    unsigned i;
+    int first;
+    unsigned long duration;
+    U_SStream *ss;
+    U_SStream js;
+
+    duration = (unsigned long)(gcfBench.end - gcfBench.start);
+    if (duration == 0)
+        duration = 1;
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "benchmark: ");
+    U_sstream_put_long(ss, (long)gcfBench.sent);
+    U_sstream_put_str(ss, " sent, ");
+    U_sstream_put_long(ss, (long)gcfBench.received);
+    U_sstream_put_str(ss, " received, ");
+    U_sstream_put_long(ss, (long)gcfBench.lost);
+    U_sstream_put_str(ss, " lost, ");
+    U_sstream_put_long(ss, (long)gcfBench.reordered);
+    U_sstream_put_str(ss, " reordered, ");
+    U_sstream_put_long(ss, (long)gcfBench.unexpected);
+    U_sstream_put_str(ss, " unexpected\n");
+    UI_Puts(gcf, ss->str);
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "benchmark: ");
+    U_sstream_put_long(ss, (long)(gcfBench.received * 1000UL / duration));
+    U_sstream_put_str(ss, " responses/s, best second ");
+    U_sstream_put_long(ss, (long)gcfBench.maxPerSecond);
+    U_sstream_put_str(ss, "\n");
+    UI_Puts(gcf, ss->str);
+
+    if (gcfBench.received)
+    {
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, "benchmark: rtt us min ");
+        U_sstream_put_long(ss, (long)gcfBench.rttMin);
+        U_sstream_put_str(ss, ", mean ");
+        U_sstream_put_long(ss, (long)(gcfBench.rttSum / gcfBench.received));
+        U_sstream_put_str(ss, ", p50 ");
+        U_sstream_put_long(ss, (long)gcfBenchPercentile(500));
+        U_sstream_put_str(ss, ", p90 ");
+        U_sstream_put_long(ss, (long)gcfBenchPercentile(900));
+        U_sstream_put_str(ss, ", p99 ");
+        U_sstream_put_long(ss, (long)gcfBenchPercentile(990));
+        U_sstream_put_str(ss, ", max ");
+        U_sstream_put_long(ss, (long)gcfBench.rttMax);
+        U_sstream_put_str(ss, "\n");
+        UI_Puts(gcf, ss->str);
+    }
+
+    if (!path || path[0] == '\0')
+        return;
+
+    U_sstream_init(&js, gcfBenchReportBuf, sizeof(gcfBenchReportBuf));
+    U_sstream_put_str(&js, "{\n  \"device\": \"");
+    U_sstream_put_str(&js, gcf->devpath);
+    U_sstream_put_str(&js, "\",\n  ");
+    gcfBenchPutField(&js, "rate", gcfBench.rate);
+    U_sstream_put_str(&js, ",\n  ");
+    gcfBenchPutField(&js, "window", gcfBench.window);
+    U_sstream_put_str(&js, ",\n  ");
+    gcfBenchPutField(&js, "duration_ms", duration);
+    U_sstream_put_str(&js, ",\n  ");
+    gcfBenchPutField(&js, "sent", gcfBench.sent);
+    U_sstream_put_str(&js, ",\n  ");
+    gcfBenchPutField(&js, "received", gcfBench.received);
+    U_sstream_put_str(&js, ",\n  ");
+    gcfBenchPutField(&js, "lost", gcfBench.lost);
+    U_sstream_put_str(&js, ",\n  ");
+    gcfBenchPutField(&js, "reordered", gcfBench.reordered);
+    U_sstream_put_str(&js, ",\n  ");
+    gcfBenchPutField(&js, "unexpected", gcfBench.unexpected);
+    U_sstream_put_str(&js, ",\n  \"responses_per_second\": { ");
+    gcfBenchPutField(&js, "mean", gcfBench.received * 1000UL / duration);
+    U_sstream_put_str(&js, ", ");
+    gcfBenchPutField(&js, "max", gcfBench.maxPerSecond);
+    U_sstream_put_str(&js, " }");
+
+    if (gcfBench.received)
+    {
+        U_sstream_put_str(&js, ",\n  \"rtt_us\": { ");
+        gcfBenchPutField(&js, "min", (unsigned long)gcfBench.rttMin);
+        U_sstream_put_str(&js, ", ");
+        gcfBenchPutField(&js, "mean", (unsigned long)(gcfBench.rttSum / gcfBench.received));
+        U_sstream_put_str(&js, ", ");
+        gcfBenchPutField(&js, "p50", gcfBenchPercentile(500));
+        U_sstream_put_str(&js, ", ");
+        gcfBenchPutField(&js, "p90", gcfBenchPercentile(900));
+        U_sstream_put_str(&js, ", ");
+        gcfBenchPutField(&js, "p99", gcfBenchPercentile(990));
+        U_sstream_put_str(&js, ", ");
+        gcfBenchPutField(&js, "p999", gcfBenchPercentile(999));
+        U_sstream_put_str(&js, ", ");
+        gcfBenchPutField(&js, "max", (unsigned long)gcfBench.rttMax);
+        U_sstream_put_str(&js, " }");
+    }
+
+    /* non empty buckets as [upper bound us, count] */
+    U_sstream_put_str(&js, ",\n  \"histogram_us\": [");
+    first = 1;
+    for (i = 0; i < GCF_BENCH_BUCKETS; i++)
+    {
+        if (gcfBench.histogram[i] == 0)
+            continue;
+
+        U_sstream_put_str(&js, first ? "[" : ", [");
+        U_sstream_put_long(&js, (long)((i + 1) * GCF_BENCH_BUCKET));
+        U_sstream_put_str(&js, ", ");
+        U_sstream_put_long(&js, (long)gcfBench.histogram[i]);
+        U_sstream_put_str(&js, "]");
+        first = 0;
+    }
+    U_sstream_put_str(&js, "]\n}\n");
+
+    if (js.status != U_SSTREAM_OK ||
+        PL_WriteFile(path, gcfBenchReportBuf, U_sstream_pos(&js)) != (int)U_sstream_pos(&js))
+    {
+        PL_Printf(DBG_INFO, "failed to write report file: %s\n", path);
+    }
+}
+
+static void gcfBenchFinish(GCF *gcf)
+{
+    gcfBench.lost += gcfBench.outstanding;
+    gcfBench.outstanding = 0;
+    PL_ClearTimeout();
+    gcfBenchReport(gcf, gcfOutputFile);
+
+    if (gcfBench.received)
+    {
+        gcfProfileSetRtt(gcf, (unsigned long)(gcfBench.rttSum / gcfBench.received));
+        gcfProfileUpdate(gcf, GCF_SUCCESS);
+    }
+    PL_ShutDown();
+}
+
+void ST_Benchmark(GCF *gcf, Event event)
+{
+    PL_time_t now;
+
+    if (event == EV_ACTION)
+    {
+        if (PL_Connect(gcf->devpath, gcf->devBaudrate) != GCF_SUCCESS)
+        {
+            UI_Puts(gcf, "failed to connect\n");
+            PL_ShutDown();
+            return;
+        }
+
+        now = PL_Time();
+        gcfBench.start = now;
+        gcfBench.secondStart = now;
+        gcfBench.end = now + (gcf->maxTime > gcf->startTime ? gcf->maxTime - gcf->startTime : GCF_BENCH_DURATION);
+        gcfBenchFill(now);
+        PL_SetTimeout(1);
+    }
+    else if (event == EV_TIMEOUT)
+    {
+        now = PL_Time();
+        gcfBenchUpdate(now);
+
+        /* wait for the responses of the last requests */
+        if (now >= gcfBench.end && (gcfBench.outstanding == 0 || now >= gcfBench.end + GCF_BENCH_LOSS_TIME))
+        {
+            gcf->state = ST_Void;
+            PL_Disconnect();
+            gcfBenchFinish(gcf);
+            return;
+        }
+
+        gcfBenchFill(now);
+        PL_SetTimeout(1);
+    }
+    else if (event == EV_DISCONNECTED)
+    {
+        UI_Puts(gcf, "disconnected\n");
+        gcf->state = ST_Void;
+        if (PL_Time() < gcfBench.end)
+            gcfBench.end = PL_Time();
+        gcfBenchFinish(gcf);
+    }
+}
+
+/* Flash time estimate (-e, --estimate)
+
+   Predicts the duration of a -f run per phase without touching the device.
+   The delays of the state machine are taken as they are, the device reboot
+   and flash write times are typical values per device type. The upload is
+   modeled request by request: the data request and the escaped response on
+   the wire at the device baud rate (8N1), plus the turnaround of host and
+   device and the time the device needs to write the data to flash.
+   A round trip time measured on an earlier run, e.g. the mean of a -b
+   report, replaces the default turnaround.
+
+   Assumes a responding firmware, with a hung one the UART reset times out
+   after GCF_RESET_TIMEOUT ms unless the GPIO reset wins.
+ */
+#define GCF_EST_V3_CHUNK      256 /* data request length of the V3 bootloaders */
+#define GCF_EST_GPIO_PULSE    200 /* ms, RaspBee reset line held low */
+#define GCF_EST_CMD_BYTES      32 /* UART reset command and response, framed */
+#define GCF_EST_V1_SYNC_BYTES  64 /* ID query, banner, sync, READY and header */
+#define GCF_EST_V3_SYNC_BYTES  46 /* ID and update request with responses, framed */
+#define GCF_EST_BENCH_BYTES    24 /* -b status request and response, framed */
+
+typedef struct
+{
+    const char *name;
+    unsigned long rebootMs;     /* reset until the bootloader is up */
+    unsigned long turnaroundUs; /* host and device latency per request */
+    unsigned long flashUs;      /* device writes 256 bytes to flash */
+    unsigned long verifyMs;     /* image check after the upload */
+} GCF_EstimateProfile;
+
+static const GCF_EstimateProfile gcfEstimateProfiles[DEV_HIVE + 1] =
+{
+    { "unknown device", 1000,  1000, 2000, 2000 },
+    { "RaspBee I",       300,   500, 4500, 1000 },
+    { "RaspBee II",      300,   500, 2000, 2000 },
+    { "ConBee I",       1000, 16000, 4500, 1000 }, /* FTDI latency timer */
+    { "ConBee II",      1000,  1000, 2000, 2000 },
+    { "Hive",           1000,  1000, 2000, 2000 }
+};
+
+typedef enum
+{
+    EST_PHASE_RESET,
+    EST_PHASE_BOOTLOADER,
+    EST_PHASE_UPLOAD,
+    EST_PHASE_VERIFY,
+    EST_PHASE_MAX
+} GCF_EstimatePhase;
+
+static const char *gcfEstimatePhaseNames[EST_PHASE_MAX] =
+{
+    "reset", "bootloader", "upload", "verify"
+};
+
+/*! Returns the size of \p data escaped by PROT_SendFlagged(), adds it to \p crc. */
+static unsigned long gcfEstimateEscaped(const unsigned char *data, unsigned len, unsigned short *crc)
+{
+    unsigned i;
+    unsigned long size;
+
+    size = len;
+    for (i = 0; i < len; i++)
+    {
+        *crc += data[i];
+        if (data[i] == 0xC0 || data[i] == 0xDB)
+            size++;
+    }
+
+    return size;
+}
+
+/*! Returns the size of a PROT_SendFlagged() frame of \p hdr followed by \p data. */
+static unsigned long gcfEstimateFrame(const unsigned char *hdr, unsigned hdrLen,
+                                      const unsigned char *data, unsigned len)
+{
+    unsigned char c[2];
+    unsigned short crc;
+    unsigned long size;
+
+    crc = 0;
+    size = 2; /* frame ends */
+    size += gcfEstimateEscaped(hdr, hdrLen, &crc);
+    size += gcfEstimateEscaped(data, len, &crc);
+
+    crc = (unsigned short)(~crc + 1);
+    c[0] = (unsigned char)(crc & 0xFF);
+    c[1] = (unsigned char)((crc >> 8) & 0xFF);
+
+    return size + gcfEstimateEscaped(c, 2, &crc);
+}
+
+/*! Returns the wire time of \p bytes at \p baudrate in microseconds. */
+static PL_time_t gcfEstimateWire(unsigned long baudrate, unsigned long bytes)
+{
+    return (PL_time_t)bytes * 10 * 1000000 / baudrate;
+}
+
+/*! Parses the -e argument, a round trip time in microseconds or a -b JSON
+    report with its mean. Returns -1 if it is neither.
+ */
+long gcfEstimateLoadRtt(const char *arg)
+{
+    long rtt;
+    long nread;
+    U_SStream ss;
+
+    U_sstream_init(&ss, (void*)arg, U_strlen(arg));
+    rtt = U_sstream_get_long(&ss);
+    if (ss.status == U_SSTREAM_OK && U_sstream_at_end(&ss))
+        return rtt > 0 ? rtt : -1;
+
+    nread = (long)PL_ReadFile(arg, gcfBenchReportBuf, sizeof(gcfBenchReportBuf));
+    if (nread <= 0 || (unsigned long)nread >= sizeof(gcfBenchReportBuf))
+    {
+        PL_Printf(DBG_INFO, "failed to read file: %s\n", arg);
+        return -1;
+    }
+
+    rtt = -1;
+    U_sstream_init(&ss, gcfBenchReportBuf, (unsigned)nread);
+    if (U_sstream_find(&ss, "\"rtt_us\"") && U_sstream_find(&ss, "\"mean\": "))
+    {
+        U_sstream_seek(&ss, U_sstream_pos(&ss) + 8);
+        rtt = U_sstream_get_long(&ss);
+        if (ss.status != U_SSTREAM_OK || rtt <= 0)
+            rtt = -1;
+    }
+
+    if (rtt == -1)
+        PL_Printf(DBG_INFO, "no rtt_us mean in benchmark report: %s\n", arg);
+
+    return rtt;
+}
+
+static void gcfEstimatePutMs(U_SStream *ss, PL_time_t us)
+{
+    U_sstream_put_long(ss, (long)((us + 500) / 1000));
+    U_sstream_put_str(ss, " ms");
+}
+
+/*! Prints the predicted duration per phase of flashing gcf->file to gcf->devpath,
+    \p rtt is a measured round trip time in microseconds or -1.
+ */
+void gcfEstimate(GCF *gcf, long rtt)
+{
+    unsigned i;
+    int v3;
+    unsigned len;
+    unsigned long off;
+    unsigned long size;
+    unsigned long frames;
+    unsigned long wire;
+    unsigned long esc;
+    unsigned long escaped;
+    unsigned long requests;
+    unsigned long permyriad;
+    unsigned long chunk;
+    unsigned long nominal;
+    unsigned long baudrate;
+    PL_time_t turnaround;
+    PL_time_t total;
+    PL_time_t phase[EST_PHASE_MAX];
+    const unsigned char *data;
+    const GCF_EstimateProfile *prof;
+    unsigned char hdr[9];
+    unsigned char *p;
+    U_SStream *ss;
+
+    prof = &gcfEstimateProfiles[gcf->devType];
+    v3 = gcf->file.gcfFileType >= 30;
+    size = gcf->file.gcfFileSize;
+    data = &gcf->file.fcontent[GCF_HEADER_SIZE];
+    chunk = v3 ? GCF_EST_V3_CHUNK : V1_PAGESIZE;
+
+    nominal = gcf->devBaudrate != PL_BAUDRATE_UNKNOWN ? (unsigned long)gcf->devBaudrate : 115200;
+    baudrate = nominal;
+
+    turnaround = (PL_time_t)prof->turnaroundUs;
+    if (rtt >= 0) /* the measured requests were on the wire too */
+    {
+        turnaround = (PL_time_t)rtt;
+        if (turnaround > gcfEstimateWire(baudrate, GCF_EST_BENCH_BYTES))
+        {
+            turnaround -= gcfEstimateWire(baudrate, GCF_EST_BENCH_BYTES);
+        }
+        else
+        {
+            /* USB CDC devices aren't bound to the nominal baud rate */
+            turnaround = 0;
+            baudrate = GCF_EST_BENCH_BYTES * 10 * 1000000UL / (unsigned long)rtt;
+        }
+    }
+
+    /* reset, with a responding firmware the UART reset of ConBee I and
+       RaspBee I is done by the reply, RaspBee II waits for the GPIO reset
+       and the USB devices for the disconnect after the reboot
+     */
+    phase[EST_PHASE_RESET] = gcfEstimateWire(baudrate, GCF_EST_CMD_BYTES) + turnaround;
+    phase[EST_PHASE_BOOTLOADER] = 0;
+
+    if (gcf->devType == DEV_RASPBEE_2)
+        phase[EST_PHASE_RESET] = (PL_time_t)(gcfResetStagger(gcf) + GCF_EST_GPIO_PULSE) * 1000;
+    else if (gcf->devType != DEV_CONBEE_1 && gcf->devType != DEV_RASPBEE_1)
+        phase[EST_PHASE_RESET] += (PL_time_t)prof->rebootMs * 1000;
+
+    /* bootloader, ConBee I and RaspBee I send their banner after the reboot,
+       the others are connected after 500 ms and queried after 200 ms more
+     */
+    if (gcf->devType == DEV_CONBEE_1 || gcf->devType == DEV_RASPBEE_1)
+        phase[EST_PHASE_BOOTLOADER] = (PL_time_t)prof->rebootMs * 1000;
+    else
+        phase[EST_PHASE_BOOTLOADER] = (500 + 200) * 1000UL;
+
+    if (v3)
+        phase[EST_PHASE_BOOTLOADER] += gcfEstimateWire(baudrate, GCF_EST_V3_SYNC_BYTES) + 2 * turnaround + 50 * 1000UL;
+    else
+        phase[EST_PHASE_BOOTLOADER] += gcfEstimateWire(baudrate, GCF_EST_V1_SYNC_BYTES) + 3 * turnaround;
+
+    /* upload, V1 pages are written raw after a 6 byte GET request,
+       V3 chunks are framed and escaped in both directions
+     */
+    frames = 0;
+    escaped = 0;
+    requests = 0;
+    for (off = 0; off < size; off += len)
+    {
+        len = (unsigned)(size - off < chunk ? size - off : chunk);
+        requests++;
+
+        if (v3)
+        {
+            p = put_u32_le(&hdr[2], &off);
+            hdr[0] = BTL_MAGIC;
+            hdr[1] = BTL_FW_DATA_REQUEST;
+            *p++ = len & 0xFF;
+            *p++ = (len >> 8) & 0xFF;
+            wire = gcfEstimateFrame(hdr, 8, 0, 0);
+
+            hdr[1] = BTL_FW_DATA_RESPONSE;
+            hdr[2] = 0x00; /* status */
+            p = put_u32_le(&hdr[3], &off);
+            *p++ = len & 0xFF;
+            *p++ = (len >> 8) & 0xFF;
+            wire += gcfEstimateFrame(hdr, 9, &data[off], len);
+
+            esc = wire - (8 + 4) - (9 + 4) - len;
+            escaped += esc;
+            frames += wire - len - esc;
+        }
+        else
+        {
+            frames += 6;
+        }
+    }
+
+    phase[EST_PHASE_UPLOAD] = gcfEstimateWire(baudrate, size + frames + escaped) +
+                              requests * turnaround +
+                              (PL_time_t)size * prof->flashUs / 256;
+    phase[EST_PHASE_VERIFY] = (PL_time_t)prof->verifyMs * 1000;
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "estimate: ");
+    U_sstream_put_str(ss, prof->name);
+    U_sstream_put_str(ss, ", ");
+    U_sstream_put_long(ss, (long)nominal);
+    U_sstream_put_str(ss, v3 ? " baud, V3 bootloader, " : " baud, V1 bootloader, ");
+    U_sstream_put_long(ss, (long)size);
+    U_sstream_put_str(ss, " bytes\n");
+    UI_Puts(gcf, ss->str);
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "estimate: ");
+    U_sstream_put_long(ss, (long)requests);
+    U_sstream_put_str(ss, " requests of ");
+    U_sstream_put_long(ss, (long)chunk);
+    U_sstream_put_str(ss, " bytes, ");
+    U_sstream_put_long(ss, (long)frames);
+    U_sstream_put_str(ss, " framing bytes, ");
+    U_sstream_put_long(ss, (long)escaped);
+    U_sstream_put_str(ss, " escaped (");
+    permyriad = size ? escaped * 10000 / size : 0;
+    U_sstream_put_long(ss, (long)(permyriad / 100));
+    U_sstream_put_str(ss, permyriad % 100 < 10 ? ".0" : ".");
+    U_sstream_put_long(ss, (long)(permyriad % 100));
+    U_sstream_put_str(ss, " %)\n");
+    UI_Puts(gcf, ss->str);
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "estimate: turnaround ");
+    U_sstream_put_long(ss, (long)turnaround);
+    U_sstream_put_str(ss, rtt >= 0 ? " us per request from rtt " : " us per request, default\n");
+    if (rtt >= 0)
+    {
+        U_sstream_put_long(ss, rtt);
+        U_sstream_put_str(ss, " us");
+        if (baudrate != nominal)
+        {
+            U_sstream_put_str(ss, ", link faster than nominal, ");
+            U_sstream_put_long(ss, (long)baudrate);
+            U_sstream_put_str(ss, " baud");
+        }
+        U_sstream_put_str(ss, "\n");
+    }
+    UI_Puts(gcf, ss->str);
+
+    total = 0;
+    for (i = 0; i < EST_PHASE_MAX; i++)
+    {
+        total += phase[i];
+
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, gcfEstimatePhaseNames[i]);
+        for (;ss->pos < 12;)
+        {
+            U_sstream_put_str(ss, " ");
+        }
+        gcfEstimatePutMs(ss, phase[i]);
+        U_sstream_put_str(ss, "\n");
+        UI_Puts(gcf, ss->str);
+    }
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "total       ");
+    gcfEstimatePutMs(ss, total);
+    U_sstream_put_str(ss, "\n");
+    UI_Puts(gcf, ss->str);
+}
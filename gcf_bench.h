@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+#ifndef GCF_BENCH_H
+#define GCF_BENCH_H
+
+#include "gcf_private.h"
+
+#define GCF_BENCH_MAX_WINDOW 128 /* less than the 256 sequence numbers */
+
+/* serial link benchmark (-b) */
+void gcfBenchSetup(unsigned long rate, unsigned window);
+void gcfBenchReceived(const unsigned char *data, unsigned len);
+void ST_Benchmark(GCF *gcf, Event event);
+
+/* flash time estimate (-e) */
+long gcfEstimateLoadRtt(const char *arg);
+void gcfEstimate(GCF *gcf, long rtt);
+
+#endif /* GCF_BENCH_H */
@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Firmware library (--firmware-dir)
+
+   The GCF files of a directory are indexed by the slot of devices they fit,
+   derived from the product magic, platform bits of the version and file type.
+   The best[] table holds the newest image per slot, so picking one is a
+   lookup no matter how many images are archived. The directory is scanned
+   when it is opened. Daemon commands rescan it in a PL_RunJob() job when its
+   stamp changed, only the headers of new or modified files are read again.
+   Batch jobs use the index of the start. Platforms without file stamps scan
+   the directory once.
+ */
+
+#include "u_sstream.h"
+#include "u_strlen.h"
+#include "u_mem.h"
+#include "gcf_library.h"
+#include "gcf_profile.h"
+
+#ifndef GCF_LIBRARY_MAX
+  #define GCF_LIBRARY_MAX 512
+#endif
+#define GCF_LIBRARY_NAME_LENGTH 96
+#define GCF_LIBRARY_HEAD_SIZE (GCF_HEADER_SIZE + 7 * 4) /* incl. the extended header */
+
+typedef enum
+{
+    LIB_SLOT_AVR,      /* ConBee I, RaspBee I */
+    LIB_SLOT_R21_V1,   /* ConBee II */
+    LIB_SLOT_R21_V3,   /* RaspBee II */
+    LIB_SLOT_HIVE,
+    LIB_SLOT_CONBEE_3,
+    LIB_SLOT_MAX       /* not usable */
+} GCF_LibrarySlot;
+
+typedef struct
+{
+    char name[GCF_LIBRARY_NAME_LENGTH]; /* in the directory */
+    unsigned long stamp;                /* PL_FileStamp(), 0 if unknown */
+    unsigned long fwVersion;
+    unsigned char slot;                 /* GCF_LibrarySlot */
+    unsigned char seen;                 /* during a scan */
+} GCF_LibraryEntry;
+
+typedef struct
+{
+    char dir[MAX_DEV_PATH_LENGTH];
+    unsigned long stamp;    /* of the directory at the last scan */
+    unsigned long scanStamp; /* of the directory when the running scan started */
+    int scanned;
+    int scanResult;         /* PL_ListDir() of the last scan */
+    unsigned skipped;       /* files of the last scan which didn't fit */
+    unsigned count;
+    int scanning;           /* between gcfLibraryScanBegin() and gcfLibraryScanned() */
+    unsigned char head[GCF_LIBRARY_HEAD_SIZE]; /* file header during a scan */
+    int best[LIB_SLOT_MAX]; /* newest entry per slot, -1 if none */
+    GCF_LibraryEntry entries[GCF_LIBRARY_MAX];
+} GCF_Library;
+
+static GCF_Library gcfLibrary;
+
+static const char *gcfLibrarySlotNames[] = { "ConBee I / RaspBee I", "ConBee II", "RaspBee II", "Hive", "ConBee III" };
+
+static GCF_LibrarySlot gcfLibraryFileSlot(const GCF_File *file)
+{
+    unsigned long platform;
+
+    if (file->gcfProduct == 0xDEC0DE02)
+        return LIB_SLOT_HIVE;
+
+    if (file->gcfProduct == 0xDEC0DE03)
+        return LIB_SLOT_CONBEE_3;
+
+    platform = file->fwVersion & FW_VERSION_PLATFORM_MASK;
+
+    if (platform == FW_VERSION_PLATFORM_AVR && file->gcfFileType <= 9)
+        return LIB_SLOT_AVR;
+
+    if (platform == FW_VERSION_PLATFORM_R21 && file->gcfFileType < 30 && file->gcfTargetAddress == 0x5000)
+        return LIB_SLOT_R21_V1;
+
+    if (platform == FW_VERSION_PLATFORM_R21 && file->gcfFileType >= 30 && file->gcfFileType <= 39)
+        return LIB_SLOT_R21_V3;
+
+    return LIB_SLOT_MAX;
+}
+
+/*! Writes the path of \p name in the library directory to \p path. */
+static int gcfLibraryPath(char *path, unsigned size, const char *name)
+{
+    unsigned len;
+    U_SStream ss;
+
+    len = U_strlen(gcfLibrary.dir);
+    U_sstream_init(&ss, path, size);
+    U_sstream_put_str(&ss, gcfLibrary.dir);
+    if (len && gcfLibrary.dir[len - 1] != '/' && gcfLibrary.dir[len - 1] != '\\')
+        U_sstream_put_str(&ss, "/");
+    U_sstream_put_str(&ss, name);
+
+    return ss.status == U_SSTREAM_OK;
+}
+
+static void gcfLibraryVisit(void *user, const char *name)
+{
+    unsigned i;
+    unsigned len;
+    long nread;
+    unsigned long stamp;
+    GCF_File file;
+    GCF_LibraryEntry *entry;
+
+    (void)user;
+
+    len = U_strlen(name);
+    if (len < 4 || len >= sizeof(entry->name) ||
+        !(gcfStrEquals(&name[len - 4], ".GCF") || gcfStrEquals(&name[len - 4], ".gcf")))
+        return;
+
+    if (!gcfLibraryPath(file.fname, sizeof(file.fname), name))
+        return;
+
+    stamp = PL_FileStamp(file.fname);
+
+    for (i = 0; i < gcfLibrary.count; i++)
+    {
+        entry = &gcfLibrary.entries[i];
+        if (gcfStrEquals(entry->name, name))
+        {
+            entry->seen = 1;
+            if (stamp != 0 && stamp == entry->stamp)
+                return; /* unchanged */
+            break;
+        }
+    }
+
+    if (i == gcfLibrary.count)
+    {
+        if (i == GCF_LIBRARY_MAX)
+        {
+            gcfLibrary.skipped++;
+            return;
+        }
+
+        gcfLibrary.count++;
+    }
+
+    entry = &gcfLibrary.entries[i];
+    U_memcpy(entry->name, name, len + 1);
+    entry->stamp = stamp;
+    entry->seen = 1;
+    entry->slot = LIB_SLOT_MAX;
+    entry->fwVersion = 0;
+
+    /* only the header is read, the size is checked when the image is loaded */
+    nread = (long)PL_ReadFile(file.fname, gcfLibrary.head, sizeof(gcfLibrary.head));
+    if (nread <= 0)
+        return;
+
+    file.fsize = (unsigned long)nread;
+    file.fcontent = gcfLibrary.head;
+    if (gcfParseHeader(&file) != 0 || file.fwVersion == 0)
+        return;
+
+    entry->fwVersion = file.fwVersion;
+    entry->slot = (unsigned char)gcfLibraryFileSlot(&file);
+}
+
+/*! Prepares a rescan if the library directory changed since the last scan.
+    \returns 1 if gcfLibraryScanJob() and gcfLibraryScanned() must follow.
+ */
+int gcfLibraryScanBegin(void)
+{
+    unsigned i;
+    unsigned long stamp;
+
+    stamp = PL_FileStamp(gcfLibrary.dir);
+    if (gcfLibrary.scanning || (gcfLibrary.scanned && (stamp == 0 || stamp == gcfLibrary.stamp)))
+        return 0;
+
+    gcfLibrary.scanning = 1;
+
+    for (i = 0; i < gcfLibrary.count; i++)
+        gcfLibrary.entries[i].seen = 0;
+
+    gcfLibrary.scanStamp = stamp;
+    gcfLibrary.skipped = 0;
+    return 1;
+}
+
+/*! Reads the new and changed files, may run as PL_RunJob() job. */
+void gcfLibraryScanJob(void *arg)
+{
+    (void)arg;
+    gcfLibrary.scanResult = PL_ListDir(gcfLibrary.dir, gcfLibraryVisit, 0);
+}
+
+/*! Completes a scan, drops removed files and picks the newest image per slot. */
+GCF_Status gcfLibraryScanned(void)
+{
+    unsigned i;
+    unsigned n;
+    GCF_LibraryEntry *entry;
+
+    gcfLibrary.scanning = 0;
+
+    if (gcfLibrary.scanResult < 0)
+    {
+        PL_Printf(DBG_INFO, "failed to read directory: %s\n", gcfLibrary.dir);
+        return GCF_FAILED;
+    }
+
+    for (i = 0; i < LIB_SLOT_MAX; i++)
+        gcfLibrary.best[i] = -1;
+
+    for (i = 0, n = 0; i < gcfLibrary.count; i++)
+    {
+        if (!gcfLibrary.entries[i].seen)
+            continue;
+
+        if (n != i)
+            gcfLibrary.entries[n] = gcfLibrary.entries[i];
+
+        entry = &gcfLibrary.entries[n];
+        if (entry->slot < LIB_SLOT_MAX &&
+            (gcfLibrary.best[entry->slot] == -1 ||
+             gcfLibrary.entries[gcfLibrary.best[entry->slot]].fwVersion < entry->fwVersion))
+        {
+            gcfLibrary.best[entry->slot] = (int)n;
+        }
+
+        n++;
+    }
+
+    gcfLibrary.count = n;
+    gcfLibrary.stamp = gcfLibrary.scanStamp;
+    gcfLibrary.scanned = 1;
+
+    if (gcfLibrary.skipped)
+        PL_Printf(DBG_DEBUG, "firmware library full, skipped %u files\n", gcfLibrary.skipped);
+    PL_Printf(DBG_DEBUG, "firmware library: %u files in %s\n", n, gcfLibrary.dir);
+    return GCF_SUCCESS;
+}
+
+/*! Returns 1 if --firmware-dir was given. */
+int gcfLibraryIsOpen(void)
+{
+    return gcfLibrary.dir[0] != '\0';
+}
+
+/*! Sets the library directory, the index is kept if it doesn't change. */
+GCF_Status gcfLibraryOpen(const char *dir)
+{
+    unsigned len;
+
+    len = U_strlen(dir);
+    if (len == 0 || len + GCF_LIBRARY_NAME_LENGTH >= sizeof(gcfLibrary.dir))
+    {
+        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter --firmware-dir\n", dir);
+        return GCF_FAILED;
+    }
+
+    if (!gcfStrEquals(gcfLibrary.dir, dir))
+    {
+        U_memcpy(gcfLibrary.dir, dir, len + 1);
+        gcfLibrary.scanned = 0;
+        gcfLibrary.count = 0;
+    }
+
+    /* before the main loop runs, the scan may block */
+    if (gcfLibraryScanBegin())
+    {
+        gcfLibraryScanJob(0);
+        return gcfLibraryScanned();
+    }
+
+    return gcfLibrary.scanned ? GCF_SUCCESS : GCF_FAILED;
+}
+
+/*! Returns the library slot for the device of \p gcf, \p name is the
+    enumerated device name or empty. The path doesn't tell RaspBee I from II,
+    the last known firmware does, or the library having images for only one.
+ */
+static GCF_LibrarySlot gcfLibraryDeviceSlot(GCF *gcf, const char *name)
+{
+    unsigned long fwVersion;
+    U_SStream ss;
+    GCF_Profile *prof;
+    GCF_KnownFirmware *kfw;
+
+    U_sstream_init(&ss, (void*)name, U_strlen(name));
+    if (U_sstream_find(&ss, "ConBee_III") || U_sstream_find(&ss, "ConBee III"))
+        return LIB_SLOT_CONBEE_3;
+
+    U_sstream_init(&ss, &gcf->devpath[0], U_strlen(&gcf->devpath[0]));
+    if (U_sstream_find(&ss, "ConBee_III"))
+        return LIB_SLOT_CONBEE_3;
+
+    switch (gcf->devType)
+    {
+        case DEV_CONBEE_1:  return LIB_SLOT_AVR;
+        case DEV_CONBEE_2:  return LIB_SLOT_R21_V1;
+        case DEV_RASPBEE_2: return LIB_SLOT_R21_V3;
+        case DEV_HIVE:      return LIB_SLOT_HIVE;
+        case DEV_RASPBEE_1: break;
+        default:            return LIB_SLOT_MAX;
+    }
+
+    prof = gcfDeviceProfile(gcf);
+    if (prof && prof->devType == DEV_RASPBEE_2)
+        return LIB_SLOT_R21_V3;
+
+    fwVersion = 0;
+    kfw = gcfFindKnownFirmware(gcf, gcfDeviceKey(gcf));
+    if (prof && prof->fwVersion)
+        fwVersion = prof->fwVersion;
+    else if (kfw)
+        fwVersion = kfw->fwVersion;
+
+    if ((fwVersion & FW_VERSION_PLATFORM_MASK) == FW_VERSION_PLATFORM_R21)
+        return LIB_SLOT_R21_V3;
+
+    if ((fwVersion & FW_VERSION_PLATFORM_MASK) == FW_VERSION_PLATFORM_AVR)
+        return LIB_SLOT_AVR;
+
+    if (gcfLibrary.best[LIB_SLOT_R21_V3] == -1)
+        return LIB_SLOT_AVR;
+
+    if (gcfLibrary.best[LIB_SLOT_AVR] == -1)
+        return LIB_SLOT_R21_V3;
+
+    return LIB_SLOT_MAX;
+}
+
+/*! Writes the path of the newest library image for the device of \p gcf to \p path,
+    \p name is the enumerated device name or empty.
+ */
+GCF_Status gcfLibrarySelect(GCF *gcf, const char *name, char *path, unsigned size)
+{
+    int best;
+    GCF_LibrarySlot slot;
+
+    if (!gcfLibrary.scanned)
+        return GCF_FAILED;
+
+    slot = gcfLibraryDeviceSlot(gcf, name);
+    if (slot == LIB_SLOT_MAX && gcf->devType == DEV_RASPBEE_1)
+    {
+        PL_Printf(DBG_INFO, "can't tell RaspBee I from II for %s, use -f\n", gcf->devpath);
+        return GCF_FAILED;
+    }
+
+    if (slot == LIB_SLOT_MAX)
+    {
+        PL_Printf(DBG_INFO, "no firmware for unknown device %s\n", gcf->devpath);
+        return GCF_FAILED;
+    }
+
+    best = gcfLibrary.best[slot];
+    if (best == -1)
+    {
+        PL_Printf(DBG_INFO, "no %s firmware in %s\n", gcfLibrarySlotNames[slot], gcfLibrary.dir);
+        return GCF_FAILED;
+    }
+
+    if (!gcfLibraryPath(path, size, gcfLibrary.entries[best].name))
+        return GCF_FAILED;
+
+    return GCF_SUCCESS;
+}
+
+/*! Loads the newest library image for the device of \p gcf. */
+GCF_Status gcfLibraryLoad(GCF *gcf)
+{
+    unsigned i;
+    const char *name;
+    const Device *dev;
+    char path[MAX_DEV_PATH_LENGTH];
+
+    /* the enumerated name tells ConBee III from II */
+    name = "";
+    for (i = 0; i < gcf->devCount; i++)
+    {
+        dev = &gcf->devices[i];
+        if (gcfStrEquals(gcf->devpath, dev->path) ||
+            (dev->stablepath[0] != '\0' && gcfStrEquals(gcf->devpath, dev->stablepath)))
+        {
+            name = &dev->name[0];
+            break;
+        }
+    }
+
+    if (gcfLibrarySelect(gcf, name, path, sizeof(path)) != GCF_SUCCESS)
+        return GCF_FAILED;
+
+    if (gcfLoadFile(gcf, path) != GCF_SUCCESS)
+    {
+        PL_Printf(DBG_INFO, "failed to read file: %s\n", path);
+        return GCF_FAILED;
+    }
+
+    PL_Printf(DBG_INFO, "select firmware: %s\n", path);
+    gcf->devType = gcfGetDeviceType(gcf);
+    return GCF_SUCCESS;
+}
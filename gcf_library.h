@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+#ifndef GCF_LIBRARY_H
+#define GCF_LIBRARY_H
+
+#include "gcf_private.h"
+
+/* firmware library (--firmware-dir) */
+GCF_Status gcfLibraryOpen(const char *dir);
+int gcfLibraryIsOpen(void);
+
+/* rescan: gcfLibraryScanBegin(), if it returns 1 gcfLibraryScanJob(), then gcfLibraryScanned() */
+int gcfLibraryScanBegin(void);
+void gcfLibraryScanJob(void *arg);
+GCF_Status gcfLibraryScanned(void);
+
+GCF_Status gcfLibrarySelect(GCF *gcf, const char *name, char *path, unsigned size);
+GCF_Status gcfLibraryLoad(GCF *gcf);
+
+#endif /* GCF_LIBRARY_H */
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Metrics (-m)
+
+   Counters and histograms of all sessions, served in Prometheus text format
+   by the metrics listener of the net layer. Durations are kept in us and
+   written in seconds.
+ */
+
+#include "u_sstream.h"
+#include "gcf_metrics.h"
+#include "net.h"
+
+static const unsigned long gcfUploadBuckets[GCF_METRICS_BUCKETS] =
+{
+    5000000, 10000000, 15000000, 20000000, 30000000, 45000000, 60000000, 90000000, 120000000, 300000000
+};
+
+static const unsigned long gcfRttBuckets[GCF_METRICS_BUCKETS] =
+{
+    500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 250000, 1000000
+};
+
+static const unsigned long gcfEnumBuckets[GCF_METRICS_BUCKETS] =
+{
+    1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+
+static const char *gcfMetricsDevNames[DEV_HIVE + 1] =
+{
+    "unknown", "raspbee1", "raspbee2", "conbee1", "conbee2", "hive"
+};
+
+static const char *gcfRetryTierNames[RETRY_TIER_MAX] =
+{
+    "reset", "connect", "query", "task"
+};
+
+GCF_Metrics gcfMetrics;
+
+/* Bucket upper bounds in us, per histogram of GCF_Metrics. */
+static const unsigned long *gcfMetricsBounds(const GCF_Histogram *h)
+{
+    if (h == &gcfMetrics.upload)
+        return &gcfUploadBuckets[0];
+    if (h == &gcfMetrics.chunkRtt)
+        return &gcfRttBuckets[0];
+    return &gcfEnumBuckets[0];
+}
+
+void gcfMetricsObserve(GCF_Histogram *h, unsigned long long us)
+{
+    unsigned i;
+    const unsigned long *bounds;
+
+    bounds = gcfMetricsBounds(h);
+    for (i = 0; i < GCF_METRICS_BUCKETS && us > bounds[i]; i++)
+    {
+    }
+
+    h->count[i]++;
+    h->sum += us;
+}
+
+static void gcfMetricsPutSeconds(U_SStream *ss, unsigned long long us)
+{
+    unsigned i;
+    unsigned long frac;
+    char buf[8];
+
+    U_sstream_put_ulonglong(ss, us / 1000000);
+
+    frac = (unsigned long)(us % 1000000);
+    if (frac == 0)
+        return;
+
+    buf[0] = '.';
+    for (i = 6; i > 0; i--, frac /= 10)
+        buf[i] = (char)('0' + frac % 10);
+
+    for (i = 6; buf[i] == '0'; i--)
+    {
+    }
+
+    buf[i + 1] = '\0';
+    U_sstream_put_str(ss, &buf[0]);
+}
+
+static void gcfMetricsPutHeader(U_SStream *ss, const char *name, const char *type, const char *help)
+{
+    U_sstream_put_str(ss, "# HELP ");
+    U_sstream_put_str(ss, name);
+    U_sstream_put_str(ss, " ");
+    U_sstream_put_str(ss, help);
+    U_sstream_put_str(ss, "\n# TYPE ");
+    U_sstream_put_str(ss, name);
+    U_sstream_put_str(ss, " ");
+    U_sstream_put_str(ss, type);
+    U_sstream_put_str(ss, "\n");
+}
+
+static void gcfMetricsPutDevCounter(U_SStream *ss, const char *name, const char *help, const unsigned long *values)
+{
+    unsigned i;
+
+    gcfMetricsPutHeader(ss, name, "counter", help);
+
+    for (i = 0; i <= DEV_HIVE; i++)
+    {
+        U_sstream_put_str(ss, name);
+        U_sstream_put_str(ss, "{type=\"");
+        U_sstream_put_str(ss, gcfMetricsDevNames[i]);
+        U_sstream_put_str(ss, "\"} ");
+        U_sstream_put_ulonglong(ss, values[i]);
+        U_sstream_put_str(ss, "\n");
+    }
+}
+
+static void gcfMetricsPutHistogram(U_SStream *ss, const char *name, const char *help, const GCF_Histogram *h)
+{
+    unsigned i;
+    unsigned long long n;
+
+    gcfMetricsPutHeader(ss, name, "histogram", help);
+
+    for (i = 0, n = 0; i <= GCF_METRICS_BUCKETS; i++)
+    {
+        n += h->count[i];
+        U_sstream_put_str(ss, name);
+        U_sstream_put_str(ss, "_bucket{le=\"");
+        if (i < GCF_METRICS_BUCKETS)
+            gcfMetricsPutSeconds(ss, gcfMetricsBounds(h)[i]);
+        else
+            U_sstream_put_str(ss, "+Inf");
+        U_sstream_put_str(ss, "\"} ");
+        U_sstream_put_ulonglong(ss, n);
+        U_sstream_put_str(ss, "\n");
+    }
+
+    U_sstream_put_str(ss, name);
+    U_sstream_put_str(ss, "_sum ");
+    gcfMetricsPutSeconds(ss, h->sum);
+    U_sstream_put_str(ss, "\n");
+    U_sstream_put_str(ss, name);
+    U_sstream_put_str(ss, "_count ");
+    U_sstream_put_ulonglong(ss, n);
+    U_sstream_put_str(ss, "\n");
+}
+
+unsigned NET_Metrics(char *buf, unsigned bufsize)
+{
+    unsigned i;
+    U_SStream ss;
+    const char *name;
+
+    U_sstream_init(&ss, buf, bufsize);
+
+    gcfMetricsPutDevCounter(&ss, "gcfflasher_flashes_started_total", "Flash tasks started.", &gcfMetrics.started[0]);
+    gcfMetricsPutDevCounter(&ss, "gcfflasher_flashes_succeeded_total", "Flash tasks succeeded.", &gcfMetrics.succeeded[0]);
+    gcfMetricsPutDevCounter(&ss, "gcfflasher_flashes_failed_total", "Flash tasks failed.", &gcfMetrics.failed[0]);
+
+    name = "gcfflasher_retries_total";
+    gcfMetricsPutHeader(&ss, name, "counter", "Retries by tier, from UART reset up to restarting the task.");
+    for (i = 0; i < RETRY_TIER_MAX; i++)
+    {
+        U_sstream_put_str(&ss, name);
+        U_sstream_put_str(&ss, "{tier=\"");
+        U_sstream_put_str(&ss, gcfRetryTierNames[i]);
+        U_sstream_put_str(&ss, "\"} ");
+        U_sstream_put_ulonglong(&ss, gcfMetrics.retries[i]);
+        U_sstream_put_str(&ss, "\n");
+    }
+
+    name = "gcfflasher_upload_bytes_total";
+    gcfMetricsPutHeader(&ss, name, "counter", "Firmware bytes sent to bootloaders.");
+    U_sstream_put_str(&ss, name);
+    U_sstream_put_str(&ss, " ");
+    U_sstream_put_ulonglong(&ss, gcfMetrics.uploadBytes);
+    U_sstream_put_str(&ss, "\n");
+
+    gcfMetricsPutHistogram(&ss, "gcfflasher_upload_duration_seconds",
+                           "Firmware upload, from the update request to the last chunk.", &gcfMetrics.upload);
+    gcfMetricsPutHistogram(&ss, "gcfflasher_chunk_rtt_seconds",
+                           "Time from a chunk sent to the next bootloader data request.", &gcfMetrics.chunkRtt);
+    gcfMetricsPutHistogram(&ss, "gcfflasher_enumeration_duration_seconds",
+                           "Device enumeration.", &gcfMetrics.enumeration);
+
+    return ss.status == U_SSTREAM_OK ? U_sstream_pos(&ss) : 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+#ifndef GCF_METRICS_H
+#define GCF_METRICS_H
+
+#include "gcf_private.h"
+
+/* Counters and histograms of all sessions, served by NET_Metrics(). */
+#define GCF_METRICS_BUCKETS 10
+
+typedef enum
+{
+    RETRY_RESET,    /* UART reset timed out */
+    RETRY_CONNECT,  /* bootloader port not there yet */
+    RETRY_QUERY,    /* bootloader query timed out */
+    RETRY_TASK,     /* task restarted by gcfRetry() */
+    RETRY_TIER_MAX
+} GCF_RetryTier;
+
+typedef struct
+{
+    unsigned long count[GCF_METRICS_BUCKETS + 1]; /* per bucket, the last one is +Inf */
+    unsigned long long sum;
+} GCF_Histogram;
+
+typedef struct
+{
+    GCF_Histogram upload;
+    GCF_Histogram chunkRtt;
+    GCF_Histogram enumeration;
+    unsigned long started[DEV_HIVE + 1];
+    unsigned long succeeded[DEV_HIVE + 1];
+    unsigned long failed[DEV_HIVE + 1];
+    unsigned long retries[RETRY_TIER_MAX];
+    unsigned long long uploadBytes;
+} GCF_Metrics;
+
+extern GCF_Metrics gcfMetrics;
+
+void gcfMetricsObserve(GCF_Histogram *h, unsigned long long us);
+
+#endif /* GCF_METRICS_H */
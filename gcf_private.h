@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+#ifndef GCF_PRIVATE_H
+#define GCF_PRIVATE_H
+
+/* Session state and helpers shared by the gcf*.c modules of the core,
+   not part of the embedding API in gcf.h.
+ */
+
+#include "u_sstream.h"
+#include "gcf.h"
+#include "protocol.h"
+
+#define MAX_DEVICES 4
+
+#define GCF_HEADER_SIZE 14
+#define GCF_MAGIC 0xCAFEFEED
+
+#define FLASH_TYPE_APP_ENCRYPTED             60
+#define FLASH_TYPE_APP_COMPRESSED_ENCRYPTED  70
+#define FLASH_TYPE_BTL_ENCRYPTED             80
+
+#define FW_VERSION_PLATFORM_MASK 0x0000FF00
+#define FW_VERSION_PLATFORM_R21  0x00000700 /* 0x26120700*/
+#define FW_VERSION_PLATFORM_AVR  0x00000500 /* 0x26390500*/
+
+
+/* Bootloader V3.x serial protocol */
+#define BTL_MAGIC              0x81
+#define BTL_ID_REQUEST         0x02
+#define BTL_ID_RESPONSE        0x82
+#define BTL_FW_UPDATE_REQUEST  0x03
+#define BTL_FW_UPDATE_RESPONSE 0x83
+#define BTL_FW_DATA_REQUEST    0x04
+#define BTL_FW_DATA_RESPONSE   0x84
+
+/* Bootloader V1 */
+#define V1_PAGESIZE 256
+
+typedef void (*state_handler_t)(GCF*, Event);
+
+typedef enum
+{
+    T_NONE,
+    T_RESET,
+    T_PROGRAM,
+    T_LIST,
+    T_CONNECT,
+    T_HELP,
+    T_SERVER,
+    T_REMOTE_PROGRAM,
+    T_DISCOVER,
+    T_QUERY,
+    T_STATION,
+    T_BENCHMARK
+} Task;
+
+typedef enum
+{
+    DEV_UNKNOWN,
+    DEV_RASPBEE_1,
+    DEV_RASPBEE_2,
+    DEV_CONBEE_1,
+    DEV_CONBEE_2,
+    DEV_HIVE
+} DeviceType;
+
+/* Reset which brought the bootloader up first, see ST_Reset(). */
+typedef enum
+{
+    RESET_METHOD_UART,
+    RESET_METHOD_GPIO,
+    RESET_METHOD_MAX
+} GCF_ResetMethod;
+
+struct GCF_File_t
+{
+    char fname[MAX_DEV_PATH_LENGTH];
+    unsigned long fsize;
+
+    unsigned long fwVersion; /* taken from file name */
+
+    /* parsed GCF file header */
+    unsigned char gcfFileType;
+    unsigned long gcfTargetAddress;
+    unsigned long gcfFileSize;
+    unsigned char gcfCrc;
+    unsigned long gcfCrc32;
+    unsigned long gcfProduct; /* magic 0xDEC0DE0x of the extended format, 0 if older */
+
+    /* The content is referenced, either a block of gcfFirmwareSlab
+       shared by the sessions flashing it or GCF_SetFirmware() data. */
+    const unsigned char *fcontent;
+    unsigned char *fbuf; /* gcfFirmwareSlab block of fcontent, 0 if not owned */
+};
+
+/* The GCF struct holds the complete state of a session, the GCF file data
+   is referenced from a gcfFirmwareSlab block or the embedding application. */
+struct GCF_t
+{
+    int argc;
+    char **argv;
+    unsigned wp;     /* ascii[] write pointer */
+    char *ascii;     /* buffer for raw data, GCF_ASCII_SIZE */
+    state_handler_t state;
+    state_handler_t substate;
+
+    int retry;
+
+    unsigned remaining; /* remaining bytes during upload */
+
+    Task task;
+
+    PROT_RxState rxstate;
+
+    PL_time_t startTime;
+    PL_time_t maxTime;
+
+    unsigned devCount;
+    Device *devices; /* MAX_DEVICES */
+
+    DeviceType devType;
+
+    PL_Baudrate devBaudrate;
+    char devpath[MAX_DEV_PATH_LENGTH];
+    char devSerialNum[MAX_DEV_SERIALNR_LENGTH];
+
+    /* Tasks are started by a remote or control socket client instead of the
+       command line, after a task the next one is awaited instead of shutting down. */
+    unsigned char serverMode;
+    unsigned char daemon;       /* control socket is open (-D) */
+    int ctlClient;              /* control client of the running task, or -1 */
+    unsigned char ctlPercent;   /* last progress sent to ctlClient */
+    PL_time_t devicesTime;      /* last device enumeration */
+    unsigned long fileStamp;    /* PL_FileStamp() of the loaded file, 0 if not cached */
+    GCF_Callbacks callbacks;    /* sessions created by GCF_CreateSession() */
+    unsigned char quiet;        /* no progress bar, e.g. station mode workers */
+    int jobResult;              /* of the last PL_RunJob() job of the session */
+    PL_time_t resetStart;
+    int resetGpio;              /* GCF_ResetGpio, GPIO reset raced against the UART reset */
+    unsigned long resetPending; /* UART reset succeeded while the GPIO reset runs, bootloader timeout + 1 */
+    unsigned char resetWon;     /* GCF_ResetMethod + 1 of the running task, 0 if none */
+    unsigned long btlVersion;   /* of the running task, 0 if not queried */
+    PL_time_t cycleStart;       /* us, last data sent to the bootloader, 0 before */
+    unsigned long cycleSum;     /* us, between data sent and the next request */
+    unsigned cycleCount;
+    unsigned char retrying;     /* task restarted by gcfRetry(), counted as started once */
+    PL_time_t uploadStart;      /* us, update request sent to the bootloader */
+    unsigned char txDepth;      /* nested GCF_HandleEvent() calls */
+    unsigned txStaged;          /* bytes of frames written when the outer handler returns */
+    struct GCF_SessionBuffers_t *buffers; /* ascii, devices and remote point here, 0 if idle */
+
+#ifdef USE_NET
+    struct GCF_Remote_t *remote;
+    unsigned discoverCount;
+#endif
+    GCF_File file;
+};
+
+extern char gcfOutputFile[MAX_DEV_PATH_LENGTH]; /* -o results or report file */
+
+void UI_Puts(GCF *gcf, const char *str);
+U_SStream *UI_StringStream(GCF *gcf);
+void U_sstream_put_u32hex(U_SStream *ss, unsigned long val);
+
+int gcfStrEquals(const char *a, const char *b);
+char *gcfNextToken(char **str);
+int gcfParseHeader(GCF_File *file);
+
+/* firmware buffers, gcf->file */
+unsigned char *gcfFileBuffer(GCF *gcf);
+void gcfFileRelease(GCF *gcf);
+void gcfFileShare(GCF *dst, const GCF *src);
+GCF_Status gcfLoadFile(GCF *gcf, const char *path);
+
+/* tasks */
+void gcfGetDevices(GCF *gcf);
+DeviceType gcfGetDeviceType(GCF *gcf);
+GCF_Status gcfSetupProgram(GCF *gcf);
+void gcfStartTask(GCF *gcf);
+unsigned long gcfResetStagger(GCF *gcf);
+void gcfCommandQueryStatusSeq(unsigned char seq);
+void ST_Void(GCF *gcf, Event event);
+
+#endif /* GCF_PRIVATE_H */
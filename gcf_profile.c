@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Known firmware versions and device profiles (-P)
+
+   The firmware version of a device, learned from a successful flash or a
+   query, is kept for the process.
+
+   What was learned about a device is kept in a text file across runs, one
+   line per device with the same key as the known firmware versions:
+
+     DE2132105 type=4 baud=115200 reset=uart btl=0x00000302 rtt=1305 cycle=2950 fw=0x26780700 runs=3
+
+   It seeds the next tasks of the device: the device type and baud rate when
+   the path doesn't tell them, the reset method which won last starts without
+   stagger, a known V3 bootloader is queried without waiting for it to speak
+   first, the data request timeouts follow the measured upload cycle and -e
+   uses the measured round trip time. The profile is updated after each
+   successful task and the file is written right away.
+ */
+
+#include "u_sstream.h"
+#include "u_strlen.h"
+#include "u_mem.h"
+#include "gcf_profile.h"
+
+#define GCF_MAX_KNOWN_FIRMWARE 32
+#define GCF_MAX_PROFILES 64
+#define GCF_PROFILE_LINE_LENGTH (MAX_DEV_PATH_LENGTH + 128) /* key and all options */
+
+/* Firmware versions learned by all sessions */
+static unsigned gcfKnownFwNext;
+static GCF_KnownFirmware gcfKnownFw[GCF_MAX_KNOWN_FIRMWARE];
+/* Device profiles, loaded from and written to -P */
+static unsigned gcfProfileCount;
+static GCF_Profile gcfProfiles[GCF_MAX_PROFILES];
+static char gcfProfileFile[MAX_DEV_PATH_LENGTH];
+static char gcfProfileBuf[(GCF_MAX_PROFILES + 1) * GCF_PROFILE_LINE_LENGTH];
+static unsigned gcfProfileLength;     /* of the text in gcfProfileBuf being written */
+static int gcfProfileWritten;         /* result of the write job */
+static unsigned char gcfProfileSaving; /* write job running, gcfProfileBuf is in use */
+static unsigned char gcfProfilePending; /* changed while saving, written again afterwards */
+
+const char *gcfDeviceKey(const GCF *gcf)
+{
+    return gcf->devSerialNum[0] != '\0' ? &gcf->devSerialNum[0] : &gcf->devpath[0];
+}
+
+GCF_KnownFirmware *gcfFindKnownFirmware(GCF *gcf, const char *key)
+{
+    unsigned i;
+
+    (void)gcf;
+    for (i = 0; key[0] != '\0' && i < GCF_MAX_KNOWN_FIRMWARE; i++)
+    {
+        if (gcfStrEquals(gcfKnownFw[i].key, key))
+            return &gcfKnownFw[i];
+    }
+
+    return 0;
+}
+
+/*! Remembers \p fwVersion for the current device, the oldest entry is replaced. */
+void gcfSetKnownFirmware(GCF *gcf, unsigned long fwVersion)
+{
+    unsigned len;
+    const char *key;
+    GCF_KnownFirmware *kfw;
+
+    key = gcfDeviceKey(gcf);
+    kfw = gcfFindKnownFirmware(gcf, key);
+
+    if (!kfw)
+    {
+        len = U_strlen(key);
+        if (len == 0 || len >= sizeof(kfw->key))
+            return;
+
+        kfw = &gcfKnownFw[gcfKnownFwNext % GCF_MAX_KNOWN_FIRMWARE];
+        gcfKnownFwNext++;
+        U_memcpy(&kfw->key[0], key, len + 1);
+    }
+
+    kfw->fwVersion = fwVersion;
+}
+
+GCF_KnownFirmware *gcfFindDeviceFirmware(GCF *gcf, const Device *dev)
+{
+    GCF_KnownFirmware *kfw;
+
+    kfw = gcfFindKnownFirmware(gcf, dev->serial);
+    if (!kfw) kfw = gcfFindKnownFirmware(gcf, dev->path);
+    if (!kfw) kfw = gcfFindKnownFirmware(gcf, dev->stablepath);
+
+    return kfw;
+}
+
+static GCF_Profile *gcfFindProfile(const char *key)
+{
+    unsigned i;
+
+    for (i = 0; key[0] != '\0' && i < gcfProfileCount; i++)
+    {
+        if (gcfStrEquals(gcfProfiles[i].key, key))
+            return &gcfProfiles[i];
+    }
+
+    return 0;
+}
+
+/*! Returns the profile of the device of \p gcf, 0 without -P or if unknown. */
+GCF_Profile *gcfDeviceProfile(const GCF *gcf)
+{
+    if (gcfProfileFile[0] == '\0')
+        return 0;
+
+    return gcfFindProfile(gcfDeviceKey(gcf));
+}
+
+/*! Returns the profile for \p key, a new one replaces the one with the fewest runs when full. */
+static GCF_Profile *gcfAddProfile(const char *key)
+{
+    unsigned i;
+    unsigned len;
+    GCF_Profile *prof;
+
+    prof = gcfFindProfile(key);
+    if (prof)
+        return prof;
+
+    len = U_strlen(key);
+    if (len == 0 || len >= sizeof(prof->key))
+        return 0;
+
+    if (gcfProfileCount < GCF_MAX_PROFILES)
+    {
+        prof = &gcfProfiles[gcfProfileCount++];
+    }
+    else
+    {
+        prof = &gcfProfiles[0];
+        for (i = 1; i < GCF_MAX_PROFILES; i++)
+        {
+            if (gcfProfiles[i].runs < prof->runs)
+                prof = &gcfProfiles[i];
+        }
+    }
+
+    U_bzero(prof, sizeof(*prof));
+    U_memcpy(&prof->key[0], key, len + 1);
+    return prof;
+}
+
+/*! Parses a 0x prefixed hex number, returns 0 if it isn't one. */
+static int gcfParseHex(const char *str, unsigned long *val)
+{
+    unsigned i;
+    unsigned char ch;
+
+    if (str[0] != '0' || str[1] != 'x' || str[2] == '\0')
+        return 0;
+
+    *val = 0;
+    for (i = 2; str[i] != '\0'; i++)
+    {
+        ch = (unsigned char)str[i];
+        if      (ch >= 'a' && ch <= 'f') { ch = ch - 'a' + 10; }
+        else if (ch >= 'A' && ch <= 'F') { ch = ch - 'A' + 10; }
+        else if (ch >= '0' && ch <= '9') { ch = ch - '0'; }
+        else    { return 0; }
+
+        if (i > 9)
+            return 0;
+
+        *val = (*val << 4) | ch;
+    }
+
+    return 1;
+}
+
+/*! Loads the -P file, a missing file is an empty store. */
+GCF_Status gcfProfileLoad(const char *path)
+{
+    unsigned char *buf;
+    long nread;
+    long longval;
+    unsigned line;
+    unsigned long hex;
+    char *p;
+    char *end;
+    char *key;
+    char *opt;
+    GCF_Profile *prof;
+    U_SStream ss;
+
+    nread = (long)U_strlen(path);
+    if (nread >= (long)sizeof(gcfProfileFile))
+    {
+        PL_Printf(DBG_INFO, "invalid argument, %s, for parameter -P\n", path);
+        return GCF_FAILED;
+    }
+
+    U_memcpy(gcfProfileFile, path, (unsigned long)nread + 1);
+    gcfProfileCount = 0;
+
+    buf = (unsigned char*)&gcfProfileBuf[0];
+    nread = (long)PL_ReadFile(path, buf, sizeof(gcfProfileBuf));
+    if (nread <= 0 || (unsigned long)nread >= sizeof(gcfProfileBuf))
+    {
+        if (nread <= 0) /* not written yet */
+            return GCF_SUCCESS;
+
+        PL_Printf(DBG_INFO, "failed to read file: %s\n", path);
+        return GCF_FAILED;
+    }
+
+    buf[nread] = '\0';
+
+    p = (char*)buf;
+    for (line = 1; *p != '\0'; line++)
+    {
+        end = p;
+        while (*end != '\0' && *end != '\n')
+            end++;
+
+        if (*end == '\n')
+            *end++ = '\0';
+
+        key = gcfNextToken(&p);
+        prof = key ? gcfAddProfile(key) : 0;
+
+        while (prof && (opt = gcfNextToken(&p)) != 0)
+        {
+            U_sstream_init(&ss, opt, U_strlen(opt));
+            longval = -1;
+            hex = 0;
+
+            if (U_sstream_find(&ss, "="))
+            {
+                U_sstream_seek(&ss, U_sstream_pos(&ss) + 1);
+                if (U_sstream_starts_with(&ss, "0x"))
+                {
+                    if (gcfParseHex(U_sstream_str(&ss), &hex))
+                        longval = 0;
+                }
+                else if (gcfStrEquals(U_sstream_str(&ss), "uart"))
+                {
+                    longval = RESET_METHOD_UART + 1;
+                }
+                else if (gcfStrEquals(U_sstream_str(&ss), "gpio"))
+                {
+                    longval = RESET_METHOD_GPIO + 1;
+                }
+                else
+                {
+                    longval = U_sstream_get_long(&ss);
+                    if (ss.status != U_SSTREAM_OK || !U_sstream_at_end(&ss))
+                        longval = -1;
+                }
+            }
+
+            U_sstream_seek(&ss, 0);
+            if (longval < 0)
+            {
+                PL_Printf(DBG_INFO, "profile line %u: invalid option %s\n", line, opt);
+            }
+            else if (U_sstream_starts_with(&ss, "type="))
+            {
+                if (longval <= DEV_HIVE)
+                    prof->devType = (unsigned char)longval;
+            }
+            else if (U_sstream_starts_with(&ss, "baud="))  { prof->baudrate = (unsigned long)longval; }
+            else if (U_sstream_starts_with(&ss, "reset=")) { prof->reset = (unsigned char)(longval <= RESET_METHOD_MAX ? longval : 0); }
+            else if (U_sstream_starts_with(&ss, "btl="))   { prof->btlVersion = hex; }
+            else if (U_sstream_starts_with(&ss, "rtt="))   { prof->rtt = (unsigned long)longval; }
+            else if (U_sstream_starts_with(&ss, "cycle=")) { prof->cycle = (unsigned long)longval; }
+            else if (U_sstream_starts_with(&ss, "fw="))    { prof->fwVersion = hex; }
+            else if (U_sstream_starts_with(&ss, "runs="))  { prof->runs = (unsigned long)longval; }
+            /* unknown options are from newer versions */
+        }
+
+        p = end;
+    }
+
+    PL_Printf(DBG_DEBUG, "loaded %u device profiles\n", gcfProfileCount);
+    return GCF_SUCCESS;
+}
+
+static void gcfJobWriteProfiles(void *arg)
+{
+    (void)arg;
+    gcfProfileWritten = PL_WriteFile(gcfProfileFile, (unsigned char*)&gcfProfileBuf[0], gcfProfileLength);
+}
+
+/*! Writes all profiles to the -P file off the main loop, completed by gcfProfileSaved(). */
+static void gcfProfileSave(void)
+{
+    unsigned i;
+    GCF_Profile *prof;
+    U_SStream ss;
+
+    if (gcfProfileSaving)
+    {
+        gcfProfilePending = 1;
+        return;
+    }
+
+    gcfProfilePending = 0;
+    U_sstream_init(&ss, &gcfProfileBuf[0], sizeof(gcfProfileBuf));
+    U_sstream_put_str(&ss, "# GCFFlasher device profiles, written after each task\n");
+
+    for (i = 0; i < gcfProfileCount; i++)
+    {
+        prof = &gcfProfiles[i];
+        U_sstream_put_str(&ss, prof->key);
+        U_sstream_put_str(&ss, " type=");
+        U_sstream_put_long(&ss, (long)prof->devType);
+        U_sstream_put_str(&ss, " baud=");
+        U_sstream_put_long(&ss, (long)prof->baudrate);
+        if (prof->reset)
+            U_sstream_put_str(&ss, prof->reset == RESET_METHOD_GPIO + 1 ? " reset=gpio" : " reset=uart");
+        if (prof->btlVersion)
+        {
+            U_sstream_put_str(&ss, " btl=0x");
+            U_sstream_put_u32hex(&ss, prof->btlVersion);
+        }
+        if (prof->rtt)
+        {
+            U_sstream_put_str(&ss, " rtt=");
+            U_sstream_put_long(&ss, (long)prof->rtt);
+        }
+        if (prof->cycle)
+        {
+            U_sstream_put_str(&ss, " cycle=");
+            U_sstream_put_long(&ss, (long)prof->cycle);
+        }
+        if (prof->fwVersion)
+        {
+            U_sstream_put_str(&ss, " fw=0x");
+            U_sstream_put_u32hex(&ss, prof->fwVersion);
+        }
+        U_sstream_put_str(&ss, " runs=");
+        U_sstream_put_long(&ss, (long)prof->runs);
+        U_sstream_put_str(&ss, "\n");
+    }
+
+    if (ss.status != U_SSTREAM_OK)
+    {
+        PL_Printf(DBG_INFO, "failed to write device profiles: %s\n", gcfProfileFile);
+        return;
+    }
+
+    gcfProfileLength = U_sstream_pos(&ss);
+    gcfProfileSaving = 1;
+    PL_RunJob(gcfJobWriteProfiles, 0, EV_PROFILES_SAVED);
+}
+
+void gcfProfileSaved(void)
+{
+    gcfProfileSaving = 0;
+
+    if (gcfProfileWritten != (int)gcfProfileLength)
+        PL_Printf(DBG_INFO, "failed to write device profiles: %s\n", gcfProfileFile);
+
+    if (gcfProfilePending)
+        gcfProfileSave();
+}
+
+/*! Learns from the task of \p gcf which just ended. */
+void gcfProfileUpdate(GCF *gcf, GCF_Status status)
+{
+    GCF_Profile *prof;
+    GCF_KnownFirmware *kfw;
+
+    if (gcfProfileFile[0] == '\0' || status != GCF_SUCCESS)
+        return;
+
+    if (gcf->task != T_PROGRAM && gcf->task != T_RESET && gcf->task != T_QUERY && gcf->task != T_BENCHMARK)
+        return;
+
+    prof = gcfAddProfile(gcfDeviceKey(gcf));
+    if (!prof)
+        return;
+
+    if (gcf->devType != DEV_UNKNOWN)
+        prof->devType = (unsigned char)gcf->devType;
+    if (gcf->devBaudrate != PL_BAUDRATE_UNKNOWN)
+        prof->baudrate = (unsigned long)gcf->devBaudrate;
+
+    if (gcf->task == T_PROGRAM || gcf->task == T_RESET)
+    {
+        if (gcf->resetWon)
+            prof->reset = gcf->resetWon;
+    }
+
+    if (gcf->task == T_PROGRAM)
+    {
+        if (gcf->btlVersion)
+            prof->btlVersion = gcf->btlVersion;
+        if (gcf->cycleCount)
+            prof->cycle = gcf->cycleSum / gcf->cycleCount;
+        if (gcf->file.fwVersion)
+            prof->fwVersion = gcf->file.fwVersion;
+    }
+    else
+    {
+        kfw = gcfFindKnownFirmware(gcf, prof->key);
+        if (kfw)
+            prof->fwVersion = kfw->fwVersion;
+    }
+
+    prof->runs++;
+    gcfProfileSave();
+}
+
+/*! Stores the mean round trip time \p rtt of a -b benchmark in the profile of \p gcf. */
+void gcfProfileSetRtt(GCF *gcf, unsigned long rtt)
+{
+    GCF_Profile *prof;
+
+    prof = gcfProfileFile[0] != '\0' ? gcfAddProfile(gcfDeviceKey(gcf)) : 0;
+    if (prof)
+        prof->rtt = rtt;
+}
+
+/*! Writes the changes after the last save, the platform has finished all jobs. */
+void gcfProfileExit(void)
+{
+    if (gcfProfilePending)
+    {
+        gcfProfileSaving = 0;
+        gcfProfileSave();
+    }
+}
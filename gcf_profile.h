@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+#ifndef GCF_PROFILE_H
+#define GCF_PROFILE_H
+
+#include "gcf_private.h"
+
+/* Firmware version of a device, learned from a successful flash
+   or a firmware version query.
+   The key is the device serial number, or the path if it has none.
+ */
+typedef struct GCF_KnownFirmware_t
+{
+    char key[MAX_DEV_PATH_LENGTH];
+    unsigned long fwVersion;
+} GCF_KnownFirmware;
+
+/* What was learned about a device, kept across runs in the -P file.
+   The key is the device serial number, or the path if it has none.
+ */
+typedef struct GCF_Profile_t
+{
+    char key[MAX_DEV_PATH_LENGTH];
+    unsigned char devType;     /* DeviceType, DEV_UNKNOWN if not known */
+    unsigned long baudrate;    /* 0 if not known */
+    unsigned char reset;       /* GCF_ResetMethod + 1 which won last, 0 if not known */
+    unsigned long btlVersion;  /* 0 if not known */
+    unsigned long rtt;         /* us, mean of the last -b benchmark */
+    unsigned long cycle;       /* us, mean time per bootloader data request */
+    unsigned long fwVersion;
+    unsigned long runs;        /* successful tasks */
+} GCF_Profile;
+
+const char *gcfDeviceKey(const GCF *gcf);
+GCF_KnownFirmware *gcfFindKnownFirmware(GCF *gcf, const char *key);
+void gcfSetKnownFirmware(GCF *gcf, unsigned long fwVersion);
+GCF_KnownFirmware *gcfFindDeviceFirmware(GCF *gcf, const Device *dev);
+
+GCF_Status gcfProfileLoad(const char *path);
+GCF_Profile *gcfDeviceProfile(const GCF *gcf);
+void gcfProfileUpdate(GCF *gcf, GCF_Status status);
+void gcfProfileSetRtt(GCF *gcf, unsigned long rtt);
+void gcfProfileSaved(void);
+void gcfProfileExit(void);
+
+#endif /* GCF_PROFILE_H */
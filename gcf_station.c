@@ -0,0 +1,1072 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Station mode (-S) and batch mode (-M)
+
+   For production lines: each device attached after the start is flashed
+   with the -f firmware as soon as a worker session is free. The workers run
+   concurrently, so the verification of one unit overlaps with reset and
+   upload of the next one.
+
+   Units are known by their serial number. A unit isn't flashed again before
+   it was detached for GCF_STATION_GONE_TIME, so the re-enumeration after a
+   reset doesn't count as a new unit. Each result is logged as one line with
+   the running totals and the throughput in units per hour.
+
+   Many units resetting at once behind one USB hub can fail to re-enumerate,
+   so the units running per hub and per root port are limited (-U). Waiting
+   units on the least busy root port and hub are started first, which keeps
+   the whole topology busy.
+
+   Batch mode runs the jobs of a manifest on the same workers instead of
+   waiting for devices. Each line assigns a firmware file to a device given
+   by serial number or path, with optional per job settings:
+
+       # device      firmware                                 options
+       DE2132105     deCONZ_ConBeeII_0x26780700.bin.GCF       timeout=60
+       /dev/ttyACM2  deCONZ_ConBeeII_0x26780700.bin.GCF       skip-current
+
+   With --firmware-dir the firmware "auto" picks the newest image of the
+   library for the device when the manifest is read.
+
+   The devices are enumerated once. The jobs are run grouped by firmware,
+   so each distinct file is read once into the main session and copied to a
+   worker when it switches to the next file. With skip-current the firmware
+   version is queried first and a device which already runs it is skipped.
+   The results are written as CSV file (-o) with status and duration per job.
+*/
+
+#include "u_sstream.h"
+#include "u_strlen.h"
+#include "u_mem.h"
+#include "gcf_station.h"
+#include "gcf_library.h"
+#include "gcf_metrics.h"
+#include "gcf_profile.h"
+
+#define GCF_STATION_MAX_UNITS 32
+#define GCF_STATION_SCAN_INTERVAL 500
+#define GCF_STATION_GONE_TIME 5000
+#define GCF_STATION_HUB_LIMIT 2
+#define GCF_BATCH_MAX_IMAGES 8
+
+typedef enum
+{
+    SU_NONE,
+    SU_PRESENT, /* attached before the start, not flashed */
+    SU_WAITING,
+    SU_FLASHING,
+    SU_DONE
+} SU_State;
+
+typedef enum
+{
+    SU_RESULT_NONE,
+    SU_RESULT_OK,
+    SU_RESULT_FAILED,
+    SU_RESULT_SKIPPED,  /* batch: already runs the firmware */
+    SU_RESULT_NOT_FOUND /* batch: device not enumerated */
+} SU_Result;
+
+static const char *gcfStationResults[] = { "not run", "ok", "failed", "skipped", "not found" };
+
+typedef struct
+{
+    SU_State state;
+    SU_Result result;
+    char serial[MAX_DEV_SERIALNR_LENGTH];
+    char path[MAX_DEV_PATH_LENGTH];
+    char usbpath[MAX_DEV_USBPATH_LENGTH];
+    PL_Baudrate baudrate;
+    PL_time_t attachTime;
+    PL_time_t lastSeen;
+    PL_time_t duration;
+    unsigned long timeout;     /* batch: retry time in seconds, 0 = -t */
+    unsigned char image;       /* batch: index in gcfStation.images[] */
+    unsigned char skipCurrent; /* batch: query the version before flashing */
+    unsigned char querying;
+} GCF_StationUnit;
+
+typedef struct
+{
+    GCF *gcf;
+    GCF_StationUnit *unit; /* 0 if idle */
+    unsigned long number;  /* of the unit in the log */
+    PL_time_t startTime;
+    int image;             /* firmware copied to the session, -1 if none */
+} GCF_StationWorker;
+
+typedef struct
+{
+    char name[MAX_DEV_PATH_LENGTH];
+    unsigned long fwVersion;
+} GCF_StationImage;
+
+typedef struct
+{
+    GCF *gcf;               /* main session, prints the log and holds the batch image */
+    int started;
+    int batch;
+    unsigned long timeout;  /* retry time per unit in seconds, 0 = default */
+    unsigned hubLimit;      /* units running per USB hub */
+    unsigned rootLimit;     /* units running per USB root port */
+    unsigned workerCount;   /* -j, 0 = GCF_STATION_WORKERS */
+    unsigned long count;    /* units started */
+    unsigned long unitsOk;
+    unsigned long unitsFailed;
+    unsigned long unitsSkipped;
+    PL_time_t firstStart;
+    int image;              /* batch: image loaded in the main session, -1 if none */
+    int loading;            /* batch: image + 1 which is read by a job, 0 if none */
+    int scanning;           /* enumeration job running */
+    int scanCount;          /* result of the last enumeration */
+    PL_time_t scanTime;     /* us, of the last enumeration */
+    unsigned imageCount;
+    GCF_StationImage images[GCF_BATCH_MAX_IMAGES];
+    GCF_StationUnit units[GCF_STATION_MAX_UNITS];
+    GCF_StationWorker workers[GCF_STATION_WORKERS];
+    Device devices[GCF_STATION_MAX_UNITS];
+} GCF_Station;
+
+static GCF_Station gcfStation;
+static GCF gcfStationSessions[GCF_STATION_WORKERS];
+
+/*! Sets the -U limits of units running per USB hub and per root port. */
+void gcfStationSetLimits(unsigned hub, unsigned root)
+{
+    gcfStation.hubLimit = hub;
+    gcfStation.rootLimit = root;
+}
+
+/*! Sets the -j number of workers, at most GCF_STATION_WORKERS. */
+void gcfStationSetWorkers(unsigned count)
+{
+    gcfStation.workerCount = count;
+}
+
+static const char *gcfStationPrefix(void)
+{
+    return gcfStation.batch ? "batch: " : "station: ";
+}
+
+static void gcfStationPutRate(U_SStream *ss)
+{
+    PL_time_t elapsed;
+
+    elapsed = gcfStation.firstStart ? PL_Time() - gcfStation.firstStart : 0;
+
+    U_sstream_put_long(ss, (long)gcfStation.unitsOk);
+    U_sstream_put_str(ss, " ok, ");
+    if (gcfStation.unitsSkipped)
+    {
+        U_sstream_put_long(ss, (long)gcfStation.unitsSkipped);
+        U_sstream_put_str(ss, " skipped, ");
+    }
+    U_sstream_put_long(ss, (long)gcfStation.unitsFailed);
+    U_sstream_put_str(ss, " failed, ");
+    U_sstream_put_long(ss, elapsed < 1000 ? 0 : (long)(gcfStation.unitsOk * 3600000UL / elapsed));
+    U_sstream_put_str(ss, " units/h");
+}
+
+void gcfStationSummary(GCF *gcf)
+{
+    U_SStream *ss;
+
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, gcfStationPrefix());
+    gcfStationPutRate(ss);
+    U_sstream_put_str(ss, "\n");
+    UI_Puts(gcf, ss->str);
+}
+
+/*! Logs the result of \p unit like: station: #3 DE2132105 ok 38.2 s | 3 ok, 0 failed, 84 units/h */
+static void gcfStationResult(GCF_StationWorker *w, SU_Result result)
+{
+    U_SStream *ss;
+    GCF_StationUnit *unit;
+
+    unit = w->unit;
+    w->unit = 0;
+
+    /* the next image of a batch may need the firmware buffer */
+    if (gcfStation.batch)
+    {
+        gcfFileRelease(w->gcf);
+        w->image = -1;
+    }
+
+    unit->state = SU_DONE;
+    unit->result = result;
+    unit->querying = 0;
+    unit->duration = PL_Time() - w->startTime;
+    unit->lastSeen = PL_Time(); /* the unit may be re-enumerating */
+
+    if      (result == SU_RESULT_OK)      { gcfStation.unitsOk++; }
+    else if (result == SU_RESULT_SKIPPED) { gcfStation.unitsSkipped++; }
+    else                                  { gcfStation.unitsFailed++; }
+
+    ss = UI_StringStream(gcfStation.gcf);
+    U_sstream_put_str(ss, gcfStationPrefix());
+    U_sstream_put_str(ss, "#");
+    U_sstream_put_long(ss, (long)w->number);
+    U_sstream_put_str(ss, " ");
+    U_sstream_put_str(ss, unit->serial[0] != '\0' ? unit->serial : unit->path);
+    U_sstream_put_str(ss, result == SU_RESULT_FAILED ? " FAILED " : " ");
+    if (result != SU_RESULT_FAILED)
+    {
+        U_sstream_put_str(ss, gcfStationResults[result]);
+        U_sstream_put_str(ss, " ");
+    }
+    U_sstream_put_long(ss, (long)(unit->duration / 1000));
+    U_sstream_put_str(ss, ".");
+    U_sstream_put_long(ss, (long)(unit->duration % 1000) / 100);
+    U_sstream_put_str(ss, " s | ");
+    gcfStationPutRate(ss);
+    U_sstream_put_str(ss, "\n");
+    UI_Puts(gcfStation.gcf, ss->str);
+}
+
+static unsigned long gcfStationTimeout(const GCF_StationUnit *unit)
+{
+    return unit->timeout ? unit->timeout : gcfStation.timeout;
+}
+
+static void gcfStationDone(void *user, GCF_Status status)
+{
+    GCF_StationWorker *w;
+    GCF_StationUnit *unit;
+
+    w = (GCF_StationWorker*)user;
+    unit = w->unit;
+    if (!unit)
+        return;
+
+    if (unit->querying)
+    {
+        unit->querying = 0;
+
+        if (status == GCF_SUCCESS && gcfStation.images[unit->image].fwVersion != 0 &&
+            GCF_FirmwareVersion(w->gcf) == gcfStation.images[unit->image].fwVersion)
+        {
+            gcfStationResult(w, SU_RESULT_SKIPPED);
+            return;
+        }
+
+        /* the query also fails for devices stuck in the bootloader */
+        if (GCF_Start(w->gcf, GCF_TASK_PROGRAM, gcfStationTimeout(unit)) == GCF_SUCCESS)
+            return;
+
+        status = GCF_FAILED;
+    }
+
+    if (w->unit == unit)
+        gcfStationResult(w, status == GCF_SUCCESS ? SU_RESULT_OK : SU_RESULT_FAILED);
+}
+
+/*! Returns the unit with \p serial, or a free entry if \p serial is 0. */
+static GCF_StationUnit *gcfStationFindUnit(const char *serial)
+{
+    unsigned i;
+    GCF_StationUnit *unit;
+
+    for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+    {
+        unit = &gcfStation.units[i];
+        if (!serial && unit->state == SU_NONE)
+            return unit;
+
+        if (serial && unit->state != SU_NONE && gcfStrEquals(unit->serial, serial))
+            return unit;
+    }
+
+    return 0;
+}
+
+/*! Enumeration job, forks udevadm and resolves links on Linux. */
+static void gcfStationScanJob(void *arg)
+{
+    PL_time_t t;
+
+    (void)arg;
+    t = PL_TimeMicro();
+    gcfStation.scanCount = PL_GetDevices(&gcfStation.devices[0], GCF_STATION_MAX_UNITS);
+    gcfStation.scanTime = PL_TimeMicro() - t;
+}
+
+/*! Processes the enumerated devices, new ones are added as waiting units
+    and units which are gone for a while are forgotten.
+ */
+static void gcfStationScanned(void)
+{
+    int n;
+    unsigned i;
+    unsigned len;
+    PL_time_t now;
+    Device *dev;
+    const char *path;
+    GCF_StationUnit *unit;
+
+    now = PL_Time();
+    n = gcfStation.scanCount;
+    gcfMetricsObserve(&gcfMetrics.enumeration, gcfStation.scanTime);
+
+    for (i = 0; n > 0 && i < (unsigned)n; i++)
+    {
+        dev = &gcfStation.devices[i];
+        if (dev->serial[0] == '\0') /* RaspBee */
+            continue;
+
+        /* the stable path survives the re-enumeration after reset */
+        path = dev->stablepath[0] != '\0' ? dev->stablepath : dev->path;
+
+        unit = gcfStationFindUnit(dev->serial);
+        if (!unit)
+        {
+            unit = gcfStationFindUnit(0);
+            len = U_strlen(path);
+            if (!unit || len >= sizeof(unit->path))
+                continue;
+
+            U_memcpy(unit->serial, dev->serial, sizeof(unit->serial));
+            unit->state = gcfStation.started ? SU_WAITING : SU_PRESENT;
+            unit->attachTime = now;
+        }
+
+        if (unit->state == SU_WAITING)
+        {
+            U_memcpy(unit->path, path, U_strlen(path) + 1);
+            U_memcpy(unit->usbpath, dev->usbpath, sizeof(unit->usbpath));
+            unit->baudrate = dev->baudrate;
+        }
+
+        unit->lastSeen = now;
+    }
+
+    for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+    {
+        unit = &gcfStation.units[i];
+        if (unit->state != SU_NONE && unit->state != SU_FLASHING &&
+            unit->lastSeen + GCF_STATION_GONE_TIME < now)
+        {
+            unit->state = SU_NONE;
+            unit->serial[0] = '\0';
+        }
+    }
+}
+
+/*! Returns the length of the root port (1-1) or \p hub (1-1.4) part of
+    a USB port path like 1-1.4.2, 0 if unknown or not behind a hub.
+ */
+static unsigned gcfUsbPrefixLength(const char *usbpath, int hub)
+{
+    unsigned i;
+    unsigned len;
+
+    len = 0;
+    for (i = 0; usbpath[i] != '\0'; i++)
+    {
+        if (usbpath[i] == '.')
+        {
+            if (!hub)
+                return i;
+            len = i;
+        }
+    }
+
+    return hub ? len : i;
+}
+
+/*! Returns 1 if both USB port paths are at the same root port or \p hub. */
+static int gcfUsbShared(const char *a, const char *b, int hub)
+{
+    unsigned i;
+    unsigned len;
+
+    len = gcfUsbPrefixLength(a, hub);
+    if (len == 0 || len != gcfUsbPrefixLength(b, hub))
+        return 0;
+
+    for (i = 0; i < len; i++)
+    {
+        if (a[i] != b[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+/*! Returns the waiting unit to start next, or 0 if none may start. */
+static GCF_StationUnit *gcfStationNextUnit(void)
+{
+    unsigned i;
+    unsigned j;
+    unsigned nhub;
+    unsigned nroot;
+    unsigned bestHub;
+    unsigned bestRoot;
+    GCF_StationUnit *unit;
+    GCF_StationUnit *best;
+
+    best = 0;
+    bestHub = 0;
+    bestRoot = 0;
+
+    for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+    {
+        unit = &gcfStation.units[i];
+        if (unit->state != SU_WAITING)
+            continue;
+
+        if (gcfStation.batch && (int)unit->image != gcfStation.image)
+            continue;
+
+        nhub = 0;
+        nroot = 0;
+        for (j = 0; j < GCF_STATION_MAX_UNITS; j++)
+        {
+            if (gcfStation.units[j].state != SU_FLASHING)
+                continue;
+
+            nroot += (unsigned)gcfUsbShared(unit->usbpath, gcfStation.units[j].usbpath, 0);
+            nhub += (unsigned)gcfUsbShared(unit->usbpath, gcfStation.units[j].usbpath, 1);
+        }
+
+        if (nroot >= gcfStation.rootLimit || nhub >= gcfStation.hubLimit)
+            continue;
+
+        /* least busy root port and hub first, then the longest waiting */
+        if (best)
+        {
+            if (nroot > bestRoot) continue;
+            if (nroot == bestRoot && nhub > bestHub) continue;
+            if (nroot == bestRoot && nhub == bestHub && unit->attachTime >= best->attachTime) continue;
+        }
+
+        best = unit;
+        bestHub = nhub;
+        bestRoot = nroot;
+    }
+
+    return best;
+}
+
+/*! Starts waiting units on idle workers. */
+static void gcfStationSchedule(void)
+{
+    unsigned w;
+    U_SStream *ss;
+    GCF_TaskType type;
+    GCF_StationUnit *unit;
+    GCF_StationWorker *worker;
+
+    for (w = 0; w < gcfStation.workerCount; w++)
+    {
+        worker = &gcfStation.workers[w];
+        if (worker->unit)
+            continue;
+
+        unit = gcfStationNextUnit();
+        if (!unit)
+            return;
+
+        gcfStation.count++;
+        worker->unit = unit;
+        worker->number = gcfStation.count;
+        worker->startTime = PL_Time();
+        unit->state = SU_FLASHING;
+        if (gcfStation.firstStart == 0)
+            gcfStation.firstStart = worker->startTime;
+
+        ss = UI_StringStream(gcfStation.gcf);
+        U_sstream_put_str(ss, gcfStationPrefix());
+        U_sstream_put_str(ss, "#");
+        U_sstream_put_long(ss, (long)worker->number);
+        U_sstream_put_str(ss, " ");
+        U_sstream_put_str(ss, unit->serial[0] != '\0' ? unit->serial : unit->path);
+        U_sstream_put_str(ss, " start");
+        if (unit->usbpath[0] != '\0')
+        {
+            U_sstream_put_str(ss, " (usb ");
+            U_sstream_put_str(ss, unit->usbpath);
+            U_sstream_put_str(ss, ")");
+        }
+        U_sstream_put_str(ss, "\n");
+        UI_Puts(gcfStation.gcf, ss->str);
+
+        /* the worker's device list must include the new unit */
+        worker->gcf->devCount = 0;
+
+        if (gcfStation.batch && worker->image != (int)unit->image)
+        {
+            worker->image = -1;
+            if (gcfStation.gcf->file.fsize != 0)
+            {
+                gcfFileShare(worker->gcf, gcfStation.gcf);
+                worker->image = (int)unit->image;
+            }
+        }
+
+        type = GCF_TASK_PROGRAM;
+        if (unit->skipCurrent)
+        {
+            type = GCF_TASK_QUERY;
+            unit->querying = 1;
+        }
+
+        if ((gcfStation.batch && worker->image != (int)unit->image) ||
+            GCF_SetDevice(worker->gcf, unit->path, unit->baudrate) != GCF_SUCCESS ||
+            GCF_Start(worker->gcf, type, gcfStationTimeout(unit)) != GCF_SUCCESS)
+        {
+            if (worker->unit == unit)
+                gcfStationResult(worker, SU_RESULT_FAILED);
+        }
+    }
+}
+
+/*! Adds a batch job for \p key, a serial number or device path.
+    The devices must be enumerated in gcfStation.devices[].
+ */
+static GCF_Status gcfBatchAddJob(const char *key, int ndevs, unsigned image, unsigned long timeout, int skipCurrent, unsigned line)
+{
+    int i;
+    unsigned len;
+    Device *dev;
+    const char *path;
+    GCF_StationUnit *unit;
+
+    unit = gcfStationFindUnit(0);
+    if (!unit)
+    {
+        PL_Printf(DBG_INFO, "manifest line %u: too many jobs, max. %u\n", line, GCF_STATION_MAX_UNITS);
+        return GCF_FAILED;
+    }
+
+    dev = 0;
+    for (i = 0; i < ndevs; i++)
+    {
+        if (gcfStrEquals(key, gcfStation.devices[i].serial) ||
+            gcfStrEquals(key, gcfStation.devices[i].path) ||
+            gcfStrEquals(key, gcfStation.devices[i].stablepath))
+        {
+            dev = &gcfStation.devices[i];
+            break;
+        }
+    }
+
+    U_bzero(unit, sizeof(*unit));
+    unit->state = SU_WAITING;
+    unit->attachTime = line; /* keeps the manifest order */
+    unit->image = (unsigned char)image;
+    unit->timeout = timeout;
+    unit->skipCurrent = (unsigned char)skipCurrent;
+
+    if (dev)
+    {
+        path = dev->stablepath[0] != '\0' ? dev->stablepath : dev->path;
+        U_memcpy(unit->serial, dev->serial, sizeof(unit->serial));
+        U_memcpy(unit->usbpath, dev->usbpath, sizeof(unit->usbpath));
+        unit->baudrate = dev->baudrate;
+    }
+    else
+    {
+        path = key;
+        for (len = 0; key[len] != '\0'; len++)
+        {
+            if (key[len] == '/' || key[len] == '\\' || key[len] == ':')
+                break;
+        }
+
+        /* a serial number, paths like /dev/ttyAMA0 or COM3 are used as is */
+        if (key[len] == '\0' && !(key[0] == 'C' && key[1] == 'O' && key[2] == 'M'))
+        {
+            if (len >= sizeof(unit->serial))
+            {
+                PL_Printf(DBG_INFO, "manifest line %u: invalid device %s\n", line, key);
+                return GCF_FAILED;
+            }
+
+            U_memcpy(unit->serial, key, len + 1);
+            unit->state = SU_DONE;
+            unit->result = SU_RESULT_NOT_FOUND;
+            gcfStation.unitsFailed++;
+            PL_Printf(DBG_INFO, "batch: device %s not found\n", key);
+            return GCF_SUCCESS;
+        }
+    }
+
+    len = U_strlen(path);
+    if (len >= sizeof(unit->path))
+    {
+        PL_Printf(DBG_INFO, "manifest line %u: invalid device %s\n", line, key);
+        return GCF_FAILED;
+    }
+
+    for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+    {
+        if (gcfStation.units[i].state != SU_NONE && gcfStrEquals(gcfStation.units[i].path, path))
+        {
+            PL_Printf(DBG_INFO, "manifest line %u: device %s is listed twice\n", line, key);
+            return GCF_FAILED;
+        }
+    }
+
+    U_memcpy(unit->path, path, len + 1);
+    return GCF_SUCCESS;
+}
+
+/*! Writes the newest --firmware-dir image for batch \p unit to \p path,
+    it is resolved in the main session like -d would.
+ */
+static GCF_Status gcfBatchLibraryImage(GCF *gcf, const GCF_StationUnit *unit, int ndevs, char *path, unsigned size)
+{
+    int i;
+    const char *name;
+    const Device *dev;
+    GCF_Status ret;
+
+    if (!gcfLibraryIsOpen())
+    {
+        PL_Printf(DBG_INFO, "missing --firmware-dir argument\n");
+        return GCF_FAILED;
+    }
+
+    name = "";
+    for (i = 0; i < ndevs; i++)
+    {
+        dev = &gcfStation.devices[i];
+        if ((unit->serial[0] != '\0' && gcfStrEquals(unit->serial, dev->serial)) ||
+            gcfStrEquals(unit->path, dev->path) || gcfStrEquals(unit->path, dev->stablepath))
+        {
+            name = dev->name;
+            break;
+        }
+    }
+
+    U_memcpy(gcf->devpath, unit->path, sizeof(gcf->devpath));
+    U_memcpy(gcf->devSerialNum, unit->serial, sizeof(gcf->devSerialNum));
+    gcf->devType = gcfGetDeviceType(gcf);
+
+    ret = gcfLibrarySelect(gcf, name, path, size);
+
+    gcf->devpath[0] = '\0';
+    gcf->devSerialNum[0] = '\0';
+    gcf->devType = DEV_UNKNOWN;
+    gcf->devBaudrate = PL_BAUDRATE_UNKNOWN;
+
+    return ret;
+}
+
+/*! Reads the batch \p manifest and enumerates the devices of the jobs.
+    The file is read into the firmware buffer which isn't used yet.
+ */
+GCF_Status gcfBatchLoadManifest(GCF *gcf, const char *manifest)
+{
+    unsigned char *buf;
+    int ndevs;
+    long nread;
+    long longval;
+    unsigned i;
+    unsigned len;
+    unsigned line;
+    unsigned long timeout;
+    int skipCurrent;
+    char *p;
+    char *end;
+    char *key;
+    char *name;
+    char *opt;
+    GCF_StationUnit *unit;
+    U_SStream ss;
+    char path[MAX_DEV_PATH_LENGTH];
+
+    buf = gcfFileBuffer(gcf);
+    nread = buf ? (long)PL_ReadFile(manifest, buf, MAX_GCF_FILE_SIZE) : 0;
+    if (nread <= 0 || (unsigned long)nread >= MAX_GCF_FILE_SIZE)
+    {
+        PL_Printf(DBG_INFO, "failed to read file: %s\n", manifest);
+        return GCF_FAILED;
+    }
+
+    gcf->file.fname[0] = '\0';
+    buf[nread] = '\0';
+
+    ndevs = PL_GetDevices(&gcfStation.devices[0], GCF_STATION_MAX_UNITS);
+    if (ndevs < 0)
+        ndevs = 0;
+
+    p = (char*)buf;
+    for (line = 1; *p != '\0'; line++)
+    {
+        end = p;
+        while (*end != '\0' && *end != '\n')
+            end++;
+
+        if (*end == '\n')
+            *end++ = '\0';
+
+        key = gcfNextToken(&p);
+        if (!key)
+        {
+            p = end;
+            continue;
+        }
+
+        name = gcfNextToken(&p);
+        if (!name)
+        {
+            PL_Printf(DBG_INFO, "manifest line %u: missing firmware file\n", line);
+            return GCF_FAILED;
+        }
+
+        timeout = 0;
+        skipCurrent = 0;
+        while ((opt = gcfNextToken(&p)) != 0)
+        {
+            U_sstream_init(&ss, opt, U_strlen(opt));
+
+            if (gcfStrEquals(opt, "skip-current"))
+            {
+                skipCurrent = 1;
+            }
+            else if (U_sstream_starts_with(&ss, "timeout="))
+            {
+                U_sstream_seek(&ss, 8);
+                longval = U_sstream_get_long(&ss);
+                if (ss.status != U_SSTREAM_OK || !U_sstream_at_end(&ss) || longval < 1)
+                {
+                    PL_Printf(DBG_INFO, "manifest line %u: invalid option %s\n", line, opt);
+                    return GCF_FAILED;
+                }
+                timeout = (unsigned long)longval;
+            }
+            else
+            {
+                PL_Printf(DBG_INFO, "manifest line %u: unknown option %s\n", line, opt);
+                return GCF_FAILED;
+            }
+        }
+
+        unit = gcfStationFindUnit(0); /* taken by gcfBatchAddJob() */
+        if (gcfBatchAddJob(key, ndevs, 0, timeout, skipCurrent, line) != GCF_SUCCESS)
+            return GCF_FAILED;
+
+        if (gcfStrEquals(name, "auto"))
+        {
+            if (unit->result == SU_RESULT_NOT_FOUND)
+            {
+                p = end;
+                continue;
+            }
+
+            if (gcfBatchLibraryImage(gcf, unit, ndevs, path, sizeof(path)) != GCF_SUCCESS)
+            {
+                PL_Printf(DBG_INFO, "manifest line %u: no firmware for %s\n", line, key);
+                return GCF_FAILED;
+            }
+
+            name = path;
+            PL_Printf(DBG_INFO, "batch: %s uses %s\n", key, name);
+        }
+
+        for (i = 0; i < gcfStation.imageCount; i++)
+        {
+            if (gcfStrEquals(gcfStation.images[i].name, name))
+                break;
+        }
+
+        if (i == gcfStation.imageCount)
+        {
+            len = U_strlen(name);
+            if (i == GCF_BATCH_MAX_IMAGES || len >= sizeof(gcfStation.images[i].name))
+            {
+                PL_Printf(DBG_INFO, "manifest line %u: too many firmware files, max. %u\n", line, GCF_BATCH_MAX_IMAGES);
+                return GCF_FAILED;
+            }
+
+            U_memcpy(gcfStation.images[i].name, name, len + 1);
+            gcfStation.imageCount++;
+        }
+
+        unit->image = (unsigned char)i;
+        p = end;
+    }
+
+    if (gcfStation.imageCount == 0)
+    {
+        PL_Printf(DBG_INFO, "manifest has no jobs: %s\n", manifest);
+        return GCF_FAILED;
+    }
+
+    gcfStation.batch = 1;
+    gcfStation.image = -1;
+    return GCF_SUCCESS;
+}
+
+static void gcfJobReadFile(void *arg)
+{
+    GCF *gcf;
+
+    gcf = (GCF*)arg;
+    gcf->jobResult = PL_ReadFile(gcf->file.fname, gcf->file.fbuf, MAX_GCF_FILE_SIZE);
+}
+
+/*! Starts loading the firmware of the next waiting jobs once the current one has none left.
+    \returns 0 when no job is waiting anymore.
+ */
+static int gcfBatchNextImage(GCF *gcf)
+{
+    unsigned i;
+    int next;
+    unsigned len;
+    U_SStream *ss;
+    GCF_StationUnit *unit;
+
+    if (gcfStation.loading)
+        return 1;
+
+    next = -1;
+    for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+    {
+        unit = &gcfStation.units[i];
+        if (unit->state != SU_WAITING)
+            continue;
+
+        if ((int)unit->image == gcfStation.image)
+            return 1;
+
+        if (next == -1)
+            next = (int)unit->image;
+    }
+
+    if (next == -1)
+        return 0;
+
+    /* workers still flashing the previous firmware keep referencing it,
+       retried on the next timeout when no buffer is free */
+    if (!gcfFileBuffer(gcf))
+        return 1;
+
+    /* no worker shares the buffer while it is read */
+    gcfStation.image = -1;
+    gcfStation.loading = next + 1;
+    ss = UI_StringStream(gcf);
+    U_sstream_put_str(ss, "batch: firmware ");
+    U_sstream_put_str(ss, gcfStation.images[next].name);
+    U_sstream_put_str(ss, "\n");
+    UI_Puts(gcf, ss->str);
+
+    len = U_strlen(gcfStation.images[next].name);
+    U_memcpy(gcf->file.fname, gcfStation.images[next].name, len + 1);
+    PL_RunJob(gcfJobReadFile, gcf, EV_JOB_DONE);
+    return 1;
+}
+
+/*! Completes gcfBatchNextImage() after the file was read. */
+static void gcfBatchImageLoaded(GCF *gcf)
+{
+    unsigned i;
+    int next;
+    GCF_StationUnit *unit;
+
+    next = gcfStation.loading - 1;
+    gcfStation.loading = 0;
+
+    if (gcf->jobResult > 0)
+    {
+        gcf->file.fsize = (unsigned long)gcf->jobResult;
+        if (GCF_ParseFile(&gcf->file) == 0)
+        {
+            gcfStation.image = next;
+            gcfStation.images[next].fwVersion = gcf->file.fwVersion;
+            return;
+        }
+    }
+
+    PL_Printf(DBG_INFO, "batch: failed to read firmware file: %s\n", gcfStation.images[next].name);
+    gcf->file.fsize = 0;
+
+    for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+    {
+        unit = &gcfStation.units[i];
+        if (unit->state == SU_WAITING && (int)unit->image == next)
+        {
+            unit->state = SU_DONE;
+            unit->result = SU_RESULT_FAILED;
+            gcfStation.unitsFailed++;
+        }
+    }
+}
+
+/*! Writes the batch results to the -o file, one CSV line per job.
+    The firmware buffer of \p gcf isn't needed anymore and holds the text.
+ */
+void gcfBatchWriteResults(GCF *gcf)
+{
+    unsigned char *buf;
+    unsigned i;
+    U_SStream ss;
+    GCF_StationUnit *unit;
+
+    if (!gcfStation.batch || gcfOutputFile[0] == '\0')
+        return;
+
+    buf = gcfFileBuffer(gcf);
+    if (!buf)
+        return;
+
+    U_sstream_init(&ss, buf, MAX_GCF_FILE_SIZE);
+    U_sstream_put_str(&ss, "serial,path,firmware,result,seconds\n");
+
+    for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+    {
+        unit = &gcfStation.units[i];
+        if (unit->state == SU_NONE)
+            continue;
+
+        U_sstream_put_str(&ss, unit->serial);
+        U_sstream_put_str(&ss, ",");
+        U_sstream_put_str(&ss, unit->path);
+        U_sstream_put_str(&ss, ",");
+        U_sstream_put_str(&ss, gcfStation.images[unit->image].name);
+        U_sstream_put_str(&ss, ",");
+        U_sstream_put_str(&ss, gcfStationResults[unit->result]);
+        U_sstream_put_str(&ss, ",");
+        U_sstream_put_long(&ss, (long)(unit->duration / 1000));
+        U_sstream_put_str(&ss, ".");
+        U_sstream_put_long(&ss, (long)(unit->duration % 1000) / 100);
+        U_sstream_put_str(&ss, "\n");
+    }
+
+    if (ss.status != U_SSTREAM_OK ||
+        PL_WriteFile(gcfOutputFile, buf, U_sstream_pos(&ss)) != (int)U_sstream_pos(&ss))
+    {
+        PL_Printf(DBG_INFO, "failed to write results file: %s\n", gcfOutputFile);
+    }
+}
+
+void ST_Station(GCF *gcf, Event event)
+{
+    unsigned i;
+    unsigned jobs;
+    U_SStream *ss;
+    GCF_Callbacks cb;
+    GCF_StationWorker *w;
+
+    if (event == EV_ACTION)
+    {
+        gcfStation.gcf = gcf;
+        U_bzero(&cb, sizeof(cb));
+        cb.done = gcfStationDone;
+
+        if (gcfStation.workerCount == 0)
+            gcfStation.workerCount = GCF_STATION_WORKERS;
+
+        for (i = 0; i < gcfStation.workerCount; i++)
+        {
+            w = &gcfStation.workers[i];
+            cb.user = w;
+            w->gcf = GCF_CreateSession(&gcfStationSessions[i], sizeof(gcfStationSessions[i]), &cb);
+            w->gcf->quiet = 1;
+            w->image = -1;
+
+            if (gcfStation.batch)
+                continue;
+
+            gcfFileShare(w->gcf, gcf);
+            if (w->gcf->file.fsize == 0)
+            {
+                PL_Printf(DBG_INFO, "station: invalid firmware file\n");
+                PL_ShutDown();
+                return;
+            }
+        }
+
+        if (gcf->maxTime > gcf->startTime)
+            gcfStation.timeout = (unsigned long)(gcf->maxTime - gcf->startTime) / 1000;
+
+        if (gcfStation.hubLimit == 0)
+            gcfStation.hubLimit = GCF_STATION_HUB_LIMIT;
+        if (gcfStation.rootLimit == 0)
+            gcfStation.rootLimit = GCF_STATION_ROOT_LIMIT;
+
+        ss = UI_StringStream(gcf);
+        U_sstream_put_str(ss, gcfStationPrefix());
+
+        if (gcfStation.batch)
+        {
+            jobs = 0;
+            for (i = 0; i < GCF_STATION_MAX_UNITS; i++)
+                jobs += gcfStation.units[i].state != SU_NONE ? 1 : 0;
+
+            U_sstream_put_long(ss, (long)jobs);
+            U_sstream_put_str(ss, " jobs, ");
+            U_sstream_put_long(ss, (long)gcfStation.imageCount);
+            U_sstream_put_str(ss, " firmware files, ");
+            U_sstream_put_long(ss, (long)gcfStation.workerCount);
+            U_sstream_put_str(ss, " workers\n");
+            UI_Puts(gcf, ss->str);
+            gcfStation.started = 1;
+            PL_SetTimeout(0);
+            return;
+        }
+
+        /* units attached before the start aren't touched */
+        gcfStationScanJob(0);
+        gcfStationScanned();
+        gcfStation.started = 1;
+
+        U_sstream_put_long(ss, (long)gcfStation.workerCount);
+        U_sstream_put_str(ss, " workers, waiting for devices\n");
+        UI_Puts(gcf, ss->str);
+        PL_SetTimeout(GCF_STATION_SCAN_INTERVAL);
+    }
+    else if (event == EV_TIMEOUT)
+    {
+        if (gcfStation.batch)
+        {
+            if (!gcfBatchNextImage(gcf))
+            {
+                for (i = 0; i < gcfStation.workerCount; i++)
+                {
+                    if (gcfStation.workers[i].unit)
+                        break;
+                }
+
+                if (i == gcfStation.workerCount)
+                {
+                    PL_ShutDown();
+                    return;
+                }
+            }
+        }
+        else if (!gcfStation.scanning)
+        {
+            gcfStation.scanning = 1;
+            PL_RunJob(gcfStationScanJob, 0, EV_JOB_DONE);
+        }
+
+        gcfStationSchedule();
+        PL_SetTimeout(GCF_STATION_SCAN_INTERVAL);
+    }
+    else if (event == EV_JOB_DONE)
+    {
+        if (gcfStation.loading)
+        {
+            gcfBatchImageLoaded(gcf);
+        }
+        else if (gcfStation.scanning)
+        {
+            gcfStation.scanning = 0;
+            gcfStationScanned();
+        }
+
+        gcfStationSchedule();
+    }
+}
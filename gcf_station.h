@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+#ifndef GCF_STATION_H
+#define GCF_STATION_H
+
+#include "gcf_private.h"
+
+#if defined(PL_WIN) || defined(PL_DOS)
+  #define GCF_STATION_WORKERS 1 /* one serial connection at a time */
+#else
+  #define GCF_STATION_WORKERS 4
+#endif
+#define GCF_STATION_ROOT_LIMIT 3
+
+/* station mode (-S) and batch mode (-M) */
+void gcfStationSetLimits(unsigned hub, unsigned root);
+void gcfStationSetWorkers(unsigned count);
+GCF_Status gcfBatchLoadManifest(GCF *gcf, const char *manifest);
+void ST_Station(GCF *gcf, Event event);
+
+/* at exit */
+void gcfStationSummary(GCF *gcf);
+void gcfBatchWriteResults(GCF *gcf);
+
+#endif /* GCF_STATION_H */
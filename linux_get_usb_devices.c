@@ -200,6 +200,63 @@ static int query_udevadm(Device *dev, Device *end)
     return (int)(dev_cur - dev);
 }
 
+/*  Query the USB port path via sysfs, the last USB device in
+
+    /sys/class/tty/ttyACM0/device -> /sys/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1.4/1-1.4:1.0
+
+    is 1-1.4: bus 1, root port 1, hub port 4.
+*/
+static void query_usb_path(Device *dev)
+{
+    const char *name;
+    const char *comp;
+    const char *p;
+    size_t len;
+    char buf[MAX_DEV_PATH_LENGTH];
+    char rbuf[PATH_MAX];
+
+    dev->usbpath[0] = '\0';
+
+    name = strrchr(dev->path, '/');
+    name = name ? name + 1 : dev->path;
+
+    if (snprintf(buf, sizeof(buf), "/sys/class/tty/%s/device", name) >= (int)sizeof(buf))
+        return;
+
+    if (!realpath(buf, rbuf))
+        return;
+
+    for (comp = rbuf; *comp; comp = p)
+    {
+        while (*comp == '/')
+            comp++;
+
+        for (p = comp; *p && *p != '/'; p++)
+        {
+        }
+
+        len = (size_t)(p - comp);
+
+        /* USB devices are named <bus>-<port>[.<port>]..., interfaces have a ':' */
+        if (len == 0 || len >= sizeof(dev->usbpath) || comp[0] < '0' || comp[0] > '9' ||
+            !memchr(comp, '-', len) || memchr(comp, ':', len))
+            continue;
+
+        memcpy(dev->usbpath, comp, len);
+        dev->usbpath[len] = '\0';
+    }
+}
+
+static int query_usb_paths(Device *dev, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        query_usb_path(&dev[i]);
+
+    return count;
+}
+
 /*! Fills the \p dev array with ConBee I and II devices.
 
 	The array is filled based on the Linux /dev/serial/by-id/ symlinks
@@ -219,7 +276,7 @@ int plGetLinuxUSBDevices(Device *dev, Device *end)
 
     result = query_udevadm(dev, end);
     if (result > 0)
-        return result;
+        return query_usb_paths(dev, result);
 
     Assert(sizeof(dev->stablepath) == sizeof(buf));
 
@@ -346,7 +403,7 @@ int plGetLinuxUSBDevices(Device *dev, Device *end)
 
     closedir(dir);
 
-    return result;
+    return query_usb_paths(dev - result, result);
 }
 
 int plGetLinuxSerialDevices(Device *dev, Device *end)
@@ -0,0 +1,646 @@
+/*
+ * Copyright (c) 2021-2023 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* io_uring main loop backend (USE_IO_URING), raw syscalls without liburing.
+
+   plUringWait() replaces poll() in PL_Loop(). Each call submits everything
+   queued since the last call and waits for completions with a single
+   io_uring_enter():
+
+     - for each connected device a read is pre-posted and re-armed after
+       each completion, the device entry in the poll set reports POLLIN /
+       POLLHUP from it
+     - writes queued by plUringWrite() are submitted as one linked chain
+       per device, so they reach the device in order
+     - the loop tick is a timeout op
+     - the other fds (network, control sockets) get one-shot poll ops,
+       which are removed on the next call as the fds may have been closed
+
+   If the ring can't be created, e.g. io_uring disabled by the kernel or a
+   container profile, the functions fall back to poll(), read() and write().
+ */
+
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "gcf.h"
+
+#define PL_URING_ENTRIES 64
+#define PL_URING_TX_SLOTS 8
+#define PL_URING_TX_SIZE 512
+#define PL_URING_RX_SIZE 1024
+#define PL_URING_DRAIN_TICKS 20
+#define PL_URING_MAX_DEVICES 8
+
+/* user_data: type | index << 8 | generation << 32,
+   for reads index is the device, for writes the tx slot and generation the device */
+#define UD_READ    1
+#define UD_WRITE   2
+#define UD_POLL    3
+#define UD_TIMEOUT 4
+#define UD_CANCEL  5
+#define UD_MAKE(type, index, gen) ((unsigned long long)(type) | (unsigned long long)(index) << 8 | (unsigned long long)(gen) << 32)
+
+typedef struct
+{
+    unsigned len;
+    unsigned pos;
+    unsigned char buf[PL_URING_TX_SIZE];
+} PL_UringTx;
+
+typedef struct
+{
+    int fd; /* -1 if unused */
+    int readPending;
+    int hangup;
+    unsigned rxlen;
+    unsigned char rxbuf[PL_URING_RX_SIZE];
+
+    unsigned txFirst;   /* FIFO of tx slots */
+    unsigned txCount;
+    unsigned txInflight;
+    PL_UringTx tx[PL_URING_TX_SLOTS];
+} PL_UringDev;
+
+typedef struct
+{
+    int ring;
+    void *ringMem;
+    size_t ringSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned sqEntries;
+    unsigned sqLocalTail;
+
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+
+    struct __kernel_timespec tick;
+    int timeoutPending;
+    int timedOut;
+
+    unsigned pollGen;
+    unsigned pollArmed; /* bit per fds[] index with a poll op of pollGen */
+
+    PL_UringDev dev[PL_URING_MAX_DEVICES];
+} PL_Uring;
+
+static PL_Uring plUring;
+
+static int plUringEnter(unsigned toSubmit, unsigned minComplete)
+{
+    return (int)syscall(__NR_io_uring_enter, plUring.ring, toSubmit, minComplete,
+                        minComplete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/* Publishes queued SQEs and optionally waits for \p minComplete completions. */
+static int plUringSubmit(unsigned minComplete)
+{
+    unsigned toSubmit;
+
+    __atomic_store_n(plUring.sqTail, plUring.sqLocalTail, __ATOMIC_RELEASE);
+    toSubmit = plUring.sqLocalTail - __atomic_load_n(plUring.sqHead, __ATOMIC_ACQUIRE);
+
+    if (toSubmit == 0 && minComplete == 0)
+        return 0;
+
+    return plUringEnter(toSubmit, minComplete);
+}
+
+static struct io_uring_sqe *plUringSqe(unsigned char opcode, int fd, unsigned long long userData)
+{
+    unsigned idx;
+    struct io_uring_sqe *sqe;
+
+    if (plUring.sqLocalTail - __atomic_load_n(plUring.sqHead, __ATOMIC_ACQUIRE) >= plUring.sqEntries)
+    {
+        plUringSubmit(0);
+        if (plUring.sqLocalTail - __atomic_load_n(plUring.sqHead, __ATOMIC_ACQUIRE) >= plUring.sqEntries)
+            return 0;
+    }
+
+    idx = plUring.sqLocalTail & *plUring.sqMask;
+    sqe = &plUring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    plUring.sqArray[idx] = idx;
+    plUring.sqLocalTail++;
+
+    return sqe;
+}
+
+/*! Creates the ring, returns 0 if io_uring isn't available. */
+int plUringOpen(void)
+{
+    unsigned i;
+    unsigned char *mem;
+    struct io_uring_params p;
+
+    for (i = 0; i < PL_URING_MAX_DEVICES; i++)
+        plUring.dev[i].fd = -1;
+
+    memset(&p, 0, sizeof(p));
+    plUring.ring = (int)syscall(__NR_io_uring_setup, PL_URING_ENTRIES, &p);
+    if (plUring.ring == -1)
+    {
+        PL_Printf(DBG_DEBUG, "io_uring not available (%s), use poll()\n", strerror(errno));
+        plUring.ring = 0;
+        return 0;
+    }
+
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        PL_Printf(DBG_DEBUG, "io_uring too old, use poll()\n");
+        close(plUring.ring);
+        plUring.ring = 0;
+        return 0;
+    }
+
+    plUring.ringSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    if (plUring.ringSize < p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe))
+        plUring.ringSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    plUring.sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    plUring.ringMem = mmap(0, plUring.ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           plUring.ring, IORING_OFF_SQ_RING);
+    plUring.sqes = mmap(0, plUring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        plUring.ring, IORING_OFF_SQES);
+
+    if (plUring.ringMem == MAP_FAILED || plUring.sqes == MAP_FAILED)
+    {
+        if (plUring.ringMem != MAP_FAILED) munmap(plUring.ringMem, plUring.ringSize);
+        if (plUring.sqes != MAP_FAILED) munmap(plUring.sqes, plUring.sqesSize);
+        close(plUring.ring);
+        plUring.ring = 0;
+        return 0;
+    }
+
+    mem = plUring.ringMem;
+    plUring.sqHead = (unsigned*)(mem + p.sq_off.head);
+    plUring.sqTail = (unsigned*)(mem + p.sq_off.tail);
+    plUring.sqMask = (unsigned*)(mem + p.sq_off.ring_mask);
+    plUring.sqArray = (unsigned*)(mem + p.sq_off.array);
+    plUring.sqEntries = p.sq_entries;
+    plUring.sqLocalTail = *plUring.sqTail;
+
+    plUring.cqHead = (unsigned*)(mem + p.cq_off.head);
+    plUring.cqTail = (unsigned*)(mem + p.cq_off.tail);
+    plUring.cqMask = (unsigned*)(mem + p.cq_off.ring_mask);
+    plUring.cqes = (struct io_uring_cqe*)(mem + p.cq_off.cqes);
+
+    return 1;
+}
+
+void plUringClose(void)
+{
+    if (plUring.ring == 0)
+        return;
+
+    munmap(plUring.sqes, plUring.sqesSize);
+    munmap(plUring.ringMem, plUring.ringSize);
+    close(plUring.ring);
+    plUring.ring = 0;
+}
+
+static void plUringTxDone(PL_UringDev *dev)
+{
+    PL_UringTx *tx;
+
+    while (dev->txCount != 0)
+    {
+        tx = &dev->tx[dev->txFirst];
+        if (tx->pos != tx->len)
+            break;
+
+        dev->txFirst = (dev->txFirst + 1) % PL_URING_TX_SLOTS;
+        dev->txCount--;
+    }
+}
+
+/* Returns the number of fds[] entries which got an event. */
+static unsigned plUringReap(struct pollfd *fds, unsigned nfds)
+{
+    int res;
+    unsigned head;
+    unsigned type;
+    unsigned index;
+    unsigned events;
+    unsigned long long ud;
+    PL_UringDev *dev;
+    struct io_uring_cqe *cqe;
+
+    events = 0;
+    head = *plUring.cqHead;
+
+    for (;head != __atomic_load_n(plUring.cqTail, __ATOMIC_ACQUIRE); head++)
+    {
+        cqe = &plUring.cqes[head & *plUring.cqMask];
+        ud = cqe->user_data;
+        res = cqe->res;
+        type = (unsigned)(ud & 0xFF);
+        index = (unsigned)(ud >> 8) & 0xFFFFFF;
+
+        if (type == UD_READ && index < PL_URING_MAX_DEVICES)
+        {
+            dev = &plUring.dev[index];
+            dev->readPending = 0;
+            if (res > 0)
+                dev->rxlen = (unsigned)res;
+            else if (res != -ECANCELED && res != -EAGAIN && res != -EINTR)
+                dev->hangup = 1;
+        }
+        else if (type == UD_WRITE && index < PL_URING_TX_SLOTS && (ud >> 32) < PL_URING_MAX_DEVICES)
+        {
+            dev = &plUring.dev[ud >> 32];
+            dev->txInflight--;
+            if (res > 0)
+            {
+                dev->tx[index].pos += (unsigned)res;
+            }
+            else if (res != -ECANCELED && res != -EAGAIN && res != -EINTR)
+            {
+                PL_Printf(DBG_DEBUG, "write() failed: %s\n", strerror(-res));
+                dev->tx[index].pos = dev->tx[index].len;
+            }
+            /* short or cancelled writes are submitted again */
+            plUringTxDone(dev);
+        }
+        else if (type == UD_POLL && (unsigned)(ud >> 32) == plUring.pollGen && index < nfds)
+        {
+            plUring.pollArmed &= ~(1U << index);
+            if (res > 0)
+            {
+                fds[index].revents = (short)res;
+                events++;
+            }
+        }
+        else if (type == UD_TIMEOUT)
+        {
+            plUring.timeoutPending = 0;
+            plUring.timedOut = 1;
+        }
+    }
+
+    __atomic_store_n(plUring.cqHead, head, __ATOMIC_RELEASE);
+
+    return events;
+}
+
+static void plUringQueueWrites(unsigned d)
+{
+    unsigned i;
+    unsigned slot;
+    PL_UringDev *dev;
+    PL_UringTx *tx;
+    struct io_uring_sqe *sqe;
+
+    dev = &plUring.dev[d];
+
+    /* a new chain only starts after the previous one completed, this keeps the order */
+    if (dev->txInflight != 0 || dev->fd == -1 || dev->hangup)
+        return;
+
+    for (i = 0; i < dev->txCount; i++)
+    {
+        slot = (dev->txFirst + i) % PL_URING_TX_SLOTS;
+        tx = &dev->tx[slot];
+
+        sqe = plUringSqe(IORING_OP_WRITE, dev->fd, UD_MAKE(UD_WRITE, slot, d));
+        if (!sqe)
+            break;
+
+        sqe->addr = (unsigned long long)(unsigned long)&tx->buf[tx->pos];
+        sqe->len = tx->len - tx->pos;
+        sqe->off = (unsigned long long)-1;
+        if (i + 1 < dev->txCount)
+            sqe->flags = IOSQE_IO_LINK;
+        dev->txInflight++;
+    }
+}
+
+static void plUringQueueRead(unsigned d)
+{
+    PL_UringDev *dev;
+    struct io_uring_sqe *sqe;
+
+    dev = &plUring.dev[d];
+
+    if (dev->fd == -1 || dev->readPending || dev->rxlen != 0 || dev->hangup)
+        return;
+
+    sqe = plUringSqe(IORING_OP_READ, dev->fd, UD_MAKE(UD_READ, d, 0));
+    if (sqe)
+    {
+        sqe->addr = (unsigned long long)(unsigned long)&dev->rxbuf[0];
+        sqe->len = sizeof(dev->rxbuf);
+        sqe->off = (unsigned long long)-1;
+        dev->readPending = 1;
+    }
+}
+
+/* Queues the reads and writes of all devices, returns 1 if one has
+   received data or hung up, which ends the wait.
+ */
+static int plUringQueueDevices(void)
+{
+    int ready;
+    unsigned d;
+
+    ready = 0;
+    for (d = 0; d < PL_URING_MAX_DEVICES; d++)
+    {
+        if (plUring.dev[d].fd == -1)
+            continue;
+
+        plUringQueueRead(d);
+        plUringQueueWrites(d);
+
+        if (plUring.dev[d].rxlen != 0 || plUring.dev[d].hangup)
+            ready = 1;
+    }
+
+    return ready;
+}
+
+/* Returns the device of \p fd, or 0. */
+static PL_UringDev *plUringFindDevice(int fd)
+{
+    unsigned d;
+
+    for (d = 0; fd != -1 && d < PL_URING_MAX_DEVICES; d++)
+    {
+        if (plUring.dev[d].fd == fd)
+            return &plUring.dev[d];
+    }
+
+    return 0;
+}
+
+static void plUringQueueTimeout(unsigned timeout)
+{
+    struct io_uring_sqe *sqe;
+
+    if (plUring.timeoutPending)
+        return;
+
+    plUring.tick.tv_sec = timeout / 1000;
+    plUring.tick.tv_nsec = (long long)(timeout % 1000) * 1000000;
+
+    sqe = plUringSqe(IORING_OP_TIMEOUT, -1, UD_MAKE(UD_TIMEOUT, 0, 0));
+    if (sqe)
+    {
+        sqe->addr = (unsigned long long)(unsigned long)&plUring.tick;
+        sqe->len = 1;
+        plUring.timeoutPending = 1;
+    }
+}
+
+/*! poll() replacement, see top of file. */
+int plUringWait(struct pollfd *fds, unsigned nfds, unsigned timeout)
+{
+    int ret;
+    int ready;
+    unsigned i;
+    unsigned events;
+    unsigned minComplete;
+    PL_UringDev *dev;
+    struct io_uring_sqe *sqe;
+
+    if (plUring.ring == 0)
+        return poll(fds, (nfds_t)nfds, (int)timeout);
+
+    /* poll ops of the last call, their fds may have been closed meanwhile */
+    for (i = 0; plUring.pollArmed != 0; i++)
+    {
+        if (plUring.pollArmed & (1U << i))
+        {
+            sqe = plUringSqe(IORING_OP_POLL_REMOVE, -1, UD_MAKE(UD_CANCEL, 0, 0));
+            if (sqe)
+                sqe->addr = UD_MAKE(UD_POLL, i, plUring.pollGen);
+            plUring.pollArmed &= ~(1U << i);
+        }
+    }
+
+    plUring.pollGen++;
+
+    for (i = 0; i < nfds; i++)
+    {
+        fds[i].revents = 0;
+        if (fds[i].fd < 0 || plUringFindDevice(fds[i].fd) || i >= 32)
+            continue;
+
+        sqe = plUringSqe(IORING_OP_POLL_ADD, fds[i].fd, UD_MAKE(UD_POLL, i, plUring.pollGen));
+        if (sqe)
+        {
+            sqe->poll32_events = (unsigned)fds[i].events;
+            plUring.pollArmed |= 1U << i;
+        }
+    }
+
+    ready = plUringQueueDevices();
+    plUringQueueTimeout(timeout);
+
+    plUring.timedOut = 0;
+    minComplete = ready ? 0 : 1;
+
+    for (;;)
+    {
+        ret = plUringSubmit(minComplete);
+        if (ret < 0 && errno != EINTR && errno != EBUSY)
+            return -1;
+
+        events = plUringReap(fds, nfds);
+
+        /* tty reads and writes fail with EINTR while task work of other ops
+           is pending, submit them again right away instead of on the next tick */
+        ready = plUringQueueDevices();
+
+        /* completions of removed polls don't end the wait */
+        if (events != 0 || ready || plUring.timedOut || minComplete == 0)
+            break;
+
+        if (ret < 0 && errno == EINTR)
+            return -1;
+    }
+
+    for (i = 0; i < nfds; i++)
+    {
+        dev = plUringFindDevice(fds[i].fd);
+        if (dev)
+        {
+            /* deliver received data before reporting the hangup */
+            if (dev->rxlen != 0)
+                fds[i].revents = POLLIN;
+            else if (dev->hangup)
+                fds[i].revents = POLLHUP;
+
+            if (fds[i].revents)
+                events++;
+        }
+    }
+
+    return (int)events;
+}
+
+/*! Returns data received from device \p d, or -1 on error. */
+int plUringRead(int d, unsigned char *buf, unsigned max)
+{
+    unsigned len;
+    PL_UringDev *dev;
+
+    dev = &plUring.dev[d];
+
+    if (plUring.ring == 0)
+        return (int)read(dev->fd, buf, max);
+
+    len = dev->rxlen < max ? dev->rxlen : max;
+    memcpy(buf, dev->rxbuf, len);
+    dev->rxlen -= len;
+    if (dev->rxlen != 0)
+        memmove(&dev->rxbuf[0], &dev->rxbuf[len], dev->rxlen);
+
+    return (int)len;
+}
+
+/*! Queues up to \p len bytes for device \p d to be written on the next plUringWait().
+    \returns the number of queued bytes.
+ */
+unsigned plUringWrite(int d, const unsigned char *data, unsigned len)
+{
+    int n;
+    unsigned slot;
+    PL_UringDev *dev;
+    PL_UringTx *tx;
+
+    dev = &plUring.dev[d];
+
+    if (plUring.ring == 0)
+    {
+        n = (int)write(dev->fd, data, len);
+        return n > 0 ? (unsigned)n : 0;
+    }
+
+    if (dev->txCount == PL_URING_TX_SLOTS || dev->fd == -1)
+        return 0;
+
+    if (len > PL_URING_TX_SIZE)
+        len = PL_URING_TX_SIZE;
+
+    slot = (dev->txFirst + dev->txCount) % PL_URING_TX_SLOTS;
+    tx = &dev->tx[slot];
+    memcpy(tx->buf, data, len);
+    tx->len = len;
+    tx->pos = 0;
+    dev->txCount++;
+
+    return len;
+}
+
+/* Writes what is still queued for device \p d and cancels its pre-posted
+   read, so that the device fd can be closed. Completions of the other
+   devices are kept for the next plUringWait().
+ */
+static void plUringDrain(unsigned d)
+{
+    unsigned i;
+    unsigned ticks;
+    PL_UringDev *dev;
+    struct io_uring_sqe *sqe;
+
+    dev = &plUring.dev[d];
+
+    if (dev->readPending)
+    {
+        sqe = plUringSqe(IORING_OP_ASYNC_CANCEL, -1, UD_MAKE(UD_CANCEL, 0, 0));
+        if (sqe)
+            sqe->addr = UD_MAKE(UD_READ, d, 0);
+    }
+
+    for (ticks = 0; ticks < PL_URING_DRAIN_TICKS; )
+    {
+        plUringQueueWrites(d);
+
+        if (!dev->readPending && dev->txInflight == 0 &&
+            (dev->txCount == 0 || dev->hangup))
+            break;
+
+        plUringQueueTimeout(5);
+        plUring.timedOut = 0;
+        if (plUringSubmit(1) < 0 && errno != EINTR)
+            break;
+        plUringReap(0, 0);
+
+        if (plUring.timedOut)
+            ticks++;
+    }
+
+    /* device doesn't take the data, give up */
+    for (i = 0; dev->txInflight != 0 && i < PL_URING_TX_SLOTS; i++)
+    {
+        sqe = plUringSqe(IORING_OP_ASYNC_CANCEL, -1, UD_MAKE(UD_CANCEL, 0, 0));
+        if (sqe)
+            sqe->addr = UD_MAKE(UD_WRITE, i, d);
+    }
+
+    while (dev->txInflight != 0 || dev->readPending)
+    {
+        if (plUringSubmit(1) < 0 && errno != EINTR)
+            break;
+        plUringReap(0, 0);
+    }
+}
+
+/*! Adds the connected device \p fd, returns its index or -1 if too many. */
+int plUringAddDevice(int fd)
+{
+    unsigned d;
+    PL_UringDev *dev;
+
+    for (d = 0; d < PL_URING_MAX_DEVICES; d++)
+    {
+        dev = &plUring.dev[d];
+        if (dev->fd != -1)
+            continue;
+
+        dev->fd = fd;
+        dev->readPending = 0;
+        dev->rxlen = 0;
+        dev->hangup = 0;
+        dev->txFirst = 0;
+        dev->txCount = 0;
+        dev->txInflight = 0;
+        return (int)d;
+    }
+
+    return -1;
+}
+
+/*! Removes device \p d before its fd is closed. */
+void plUringRemoveDevice(int d)
+{
+    if (plUring.ring != 0)
+        plUringDrain((unsigned)d);
+
+    plUring.dev[d].fd = -1;
+}
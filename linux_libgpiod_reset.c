@@ -8,11 +8,49 @@
  *
  */
 
-#ifdef HAS_LIBGPIOD
-#include <dlfcn.h>
-#include <gpiod.h>
+/* GPIO based resets of the RaspBee (gpio17) and FTDI based devices (CBUS0).
+
+   The gpiochip of a reset line is located once by its label and kept open
+   for the lifetime of the process, so a reset only requests the line,
+   toggles it and releases it again. FTDI chips are also matched by the
+   serial number of their USB device, so with several ConBee I attached
+   only the one being flashed is reset.
+
+   Two backends drive the line:
+
+     - libgpiod v1, loaded via dlopen() when built with HAS_LIBGPIOD
+     - the kernel GPIO character device ioctls (uAPI v2, or v1 on kernels
+       before 5.10), used when libgpiod is missing or is v2 which lacks
+       the v1 line API
+
+   Both can be exercised without hardware via the gpio-sim kernel module
+   by giving a simulated chip the "ftdi-cbus" or "pinctrl-bcm2835" label,
+   see test/gpio_sim_reset.py.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/gpio.h>
+
+#ifdef HAS_LIBGPIOD
+  #include <dlfcn.h>
+  #include <gpiod.h>
+#endif
+
+#ifdef USE_WORKER_POOL
+  #include <pthread.h>
+#endif
+
 #include "gcf.h"
+#include "u_sstream.h"
+#include "u_mem.h"
 
 /*
    /sys/bus/usb/drivers/cdc_acm
@@ -20,36 +58,79 @@
    /sys/devices/pci0000:00/0000:00:14.0/usb1/1-4/1-4.4/serial
 */
 
-typedef struct gpiod_chip_iter *(*pl_gpiod_chip_iter_new)(void);
-typedef struct gpiod_chip *(*pl_gpiod_chip_iter_next)(struct gpiod_chip_iter *iter);
-typedef const char *(*pl_gpiod_chip_name)(struct gpiod_chip *chip);
-typedef const char *(*pl_gpiod_chip_label)(struct gpiod_chip *chip);
+#define PL_GPIO_MAX_CHIPS 64
+
+typedef struct
+{
+    unsigned offset;        /* line offset on the chip */
+    int chipFd;             /* open /dev/gpiochipN, -1 if not located */
+    int lineFd;             /* requested line, -1 if none */
+    int uapiV1;             /* kernel only supports the v1 line handles */
+    char serial[MAX_DEV_SERIALNR_LENGTH]; /* USB device of the chip, FTDI only */
+#ifdef HAS_LIBGPIOD
+    struct gpiod_chip *chip;
+    struct gpiod_line *line;
+#endif
+} PL_GpioLine;
+
+#ifdef HAS_LIBGPIOD
+  #define PL_GPIO_LINE_INIT { 0, -1, -1, 0, { 0 }, NULL, NULL }
+#else
+  #define PL_GPIO_LINE_INIT { 0, -1, -1, 0, { 0 } }
+#endif
+
+static PL_GpioLine plGpioRaspBee = PL_GPIO_LINE_INIT;
+static PL_GpioLine plGpioFtdi = PL_GPIO_LINE_INIT;
+
+#ifdef USE_WORKER_POOL
+/* resets may run on worker threads */
+static pthread_mutex_t plGpioMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#ifdef HAS_LIBGPIOD
+
+typedef struct gpiod_chip *(*pl_gpiod_chip_open)(const char *path);
+typedef void (*pl_gpiod_chip_close)(struct gpiod_chip *chip);
 typedef struct gpiod_line *(*pl_gpiod_chip_get_line)(struct gpiod_chip *chip, unsigned int offset);
 typedef int (*pl_gpiod_line_request_output)(struct gpiod_line *line, const char *consumer, int default_val);
 typedef int (*pl_gpiod_line_request_input)(struct gpiod_line *line, const char *consumer);
 typedef int (*pl_gpiod_line_set_value)(struct gpiod_line *line, int value);
 typedef void (*pl_gpiod_line_release)(struct gpiod_line *line);
-typedef void (*pl_gpiod_chip_iter_free)(struct gpiod_chip_iter *iter);
 
+static int lib_gpiod_state; /* 0 not loaded yet, 1 loaded, -1 not available */
 static void* lib_gpiod_handle;
-static pl_gpiod_chip_iter_new        fn_gpiod_chip_iter_new;
-static pl_gpiod_chip_iter_next       fn_gpiod_chip_iter_next;
-static pl_gpiod_chip_iter_free       fn_gpiod_chip_iter_free;
-static pl_gpiod_chip_name            fn_gpiod_chip_name;
-static pl_gpiod_chip_label           fn_gpiod_chip_label;
+static pl_gpiod_chip_open            fn_gpiod_chip_open;
+static pl_gpiod_chip_close           fn_gpiod_chip_close;
 static pl_gpiod_chip_get_line        fn_gpiod_chip_get_line;
 static pl_gpiod_line_request_output  fn_gpiod_line_request_output;
-static pl_gpiod_line_request_input  fn_gpiod_line_request_input;
+static pl_gpiod_line_request_input   fn_gpiod_line_request_input;
 static pl_gpiod_line_set_value       fn_gpiod_line_set_value;
 static pl_gpiod_line_release         fn_gpiod_line_release;
 
-static int plLoadLibGpiod(void);
-static int plUnloadLibGpiod(void);
+static void plUnloadLibGpiod(void)
+{
+    if (lib_gpiod_handle)
+    {
+        dlclose(lib_gpiod_handle);
+        lib_gpiod_handle = NULL;
+    }
+
+    fn_gpiod_chip_open = NULL;
+    fn_gpiod_chip_close = NULL;
+    fn_gpiod_chip_get_line = NULL;
+    fn_gpiod_line_request_output = NULL;
+    fn_gpiod_line_request_input = NULL;
+    fn_gpiod_line_set_value = NULL;
+    fn_gpiod_line_release = NULL;
+}
 
+/*! Loads libgpiod once per process, returns 0 if the v1 API is usable. */
 static int plLoadLibGpiod(void)
 {
-    Assert(lib_gpiod_handle == NULL);
+    if (lib_gpiod_state != 0)
+        return lib_gpiod_state == 1 ? 0 : -1;
 
+    lib_gpiod_state = -1;
     lib_gpiod_handle = dlopen("libgpiod.so", RTLD_LAZY);
     if (!lib_gpiod_handle)
     {
@@ -57,197 +138,402 @@ static int plLoadLibGpiod(void)
         return -1;
     }
 
-    fn_gpiod_chip_iter_new = (pl_gpiod_chip_iter_new)dlsym(lib_gpiod_handle, "gpiod_chip_iter_new");
-    fn_gpiod_chip_iter_next = (pl_gpiod_chip_iter_next)dlsym(lib_gpiod_handle, "gpiod_chip_iter_next");
-    fn_gpiod_chip_iter_free = (pl_gpiod_chip_iter_free)dlsym(lib_gpiod_handle, "gpiod_chip_iter_free");
-    fn_gpiod_chip_name = (pl_gpiod_chip_name)dlsym(lib_gpiod_handle, "gpiod_chip_name");
-    fn_gpiod_chip_label = (pl_gpiod_chip_label)dlsym(lib_gpiod_handle, "gpiod_chip_label");
+    fn_gpiod_chip_open = (pl_gpiod_chip_open)dlsym(lib_gpiod_handle, "gpiod_chip_open");
+    fn_gpiod_chip_close = (pl_gpiod_chip_close)dlsym(lib_gpiod_handle, "gpiod_chip_close");
     fn_gpiod_chip_get_line = (pl_gpiod_chip_get_line)dlsym(lib_gpiod_handle, "gpiod_chip_get_line");
     fn_gpiod_line_request_output = (pl_gpiod_line_request_output)dlsym(lib_gpiod_handle, "gpiod_line_request_output");
     fn_gpiod_line_request_input = (pl_gpiod_line_request_input)dlsym(lib_gpiod_handle, "gpiod_line_request_input");
     fn_gpiod_line_set_value = (pl_gpiod_line_set_value)dlsym(lib_gpiod_handle, "gpiod_line_set_value");
     fn_gpiod_line_release = (pl_gpiod_line_release)dlsym(lib_gpiod_handle, "gpiod_line_release");
 
-    if (!fn_gpiod_chip_iter_new ||
-        !fn_gpiod_chip_iter_next ||
-        !fn_gpiod_chip_iter_free ||
-        !fn_gpiod_chip_name ||
-        !fn_gpiod_chip_label ||
+    /* libgpiod v2 has no gpiod_chip_get_line() and friends */
+    if (!fn_gpiod_chip_open ||
+        !fn_gpiod_chip_close ||
         !fn_gpiod_chip_get_line ||
         !fn_gpiod_line_request_output ||
         !fn_gpiod_line_request_input ||
         !fn_gpiod_line_set_value ||
         !fn_gpiod_line_release)
     {
+        PL_Printf(DBG_DEBUG, "libgpiod.so has no v1 API, using GPIO character device\n");
         plUnloadLibGpiod();
         return -1;
     }
 
+    lib_gpiod_state = 1;
     return 0;
 }
+#endif /* HAS_LIBGPIOD */
 
-static int plUnloadLibGpiod(void)
+static void plGpioForget(PL_GpioLine *gl)
 {
-    Assert(lib_gpiod_handle != NULL);
+    if (gl->lineFd != -1)
+        close(gl->lineFd);
 
-    if (lib_gpiod_handle)
-    {
-        dlclose(lib_gpiod_handle);
-        lib_gpiod_handle = NULL;
-        fn_gpiod_chip_iter_new = NULL;
-        fn_gpiod_chip_iter_next = NULL;
-        fn_gpiod_chip_iter_free = NULL;
-        fn_gpiod_chip_name = NULL;
-        fn_gpiod_chip_label = NULL;
-        fn_gpiod_chip_get_line = NULL;
-        fn_gpiod_line_request_output = NULL;
-        fn_gpiod_line_request_input = NULL;
-        fn_gpiod_line_set_value = NULL;
-        fn_gpiod_line_release = NULL;
-        return 0;
-    }
+    if (gl->chipFd != -1)
+        close(gl->chipFd);
 
-    return -1;
+#ifdef HAS_LIBGPIOD
+    if (gl->chip)
+        fn_gpiod_chip_close(gl->chip);
+
+    gl->chip = NULL;
+    gl->line = NULL;
+#endif
+
+    gl->lineFd = -1;
+    gl->chipFd = -1;
+    gl->uapiV1 = 0;
+    gl->serial[0] = '\0';
 }
 
-int plResetRaspBeeLibGpiod(void)
+/*! Returns 1 if the gpiochip \p fd belongs to the USB device with serial
+    number \p serial, the first directory above the chip with a serial
+    attribute is the USB device:
+
+    /sys/dev/char/254:3 -> /sys/devices/.../usb1/1-4/1-4:1.0/ttyUSB0/gpiochip3
+    /sys/devices/.../usb1/1-4/serial
+ */
+static int plGpioChipHasSerial(int fd, const char *serial)
 {
-    int ret = -1;
-    struct gpiod_chip *chip;
-    struct gpiod_chip_iter *iter;
-    struct gpiod_line *line;
-    const char *name;
-    const char *label;
+    int n;
+    int sfd;
+    char *p;
+    U_SStream ss;
+    struct stat st;
+    char buf[64];
+    char path[PATH_MAX];
+    char rpath[PATH_MAX];
+
+    if (fstat(fd, &st) != 0)
+        return 0;
 
-    if (plLoadLibGpiod() != 0)
-    {
-        return -1;
-    }
+    U_sstream_init(&ss, path, sizeof(path));
+    U_sstream_put_str(&ss, "/sys/dev/char/");
+    U_sstream_put_long(&ss, (long)major(st.st_rdev));
+    U_sstream_put_str(&ss, ":");
+    U_sstream_put_long(&ss, (long)minor(st.st_rdev));
 
-    iter = fn_gpiod_chip_iter_new();
+    if (ss.status != U_SSTREAM_OK || !realpath(path, rpath))
+        return 0;
 
-    if (!iter)
+    while ((p = strrchr(rpath, '/')) != NULL && p != rpath)
     {
-        plUnloadLibGpiod();
-        return -2;
+        *p = '\0';
+
+        U_sstream_init(&ss, path, sizeof(path));
+        U_sstream_put_str(&ss, rpath);
+        U_sstream_put_str(&ss, "/serial");
+        if (ss.status != U_SSTREAM_OK)
+            return 0;
+
+        sfd = open(path, O_RDONLY);
+        if (sfd == -1)
+            continue;
+
+        n = (int)read(sfd, buf, sizeof(buf) - 1);
+        close(sfd);
+
+        for (; n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '); n--)
+        {
+        }
+
+        if (n <= 0)
+            return 0;
+
+        buf[n] = '\0';
+        return strcmp(buf, serial) == 0;
     }
 
-    while ((chip = fn_gpiod_chip_iter_next(iter)) != NULL)
+    return 0;
+}
+
+/*! Searches the /dev/gpiochipN devices for the chip with \p label, which has
+    line \p offset, and keeps it open in \p gl.
+    If \p prefix is set the chip label only needs to start with \p label.
+    If \p serial is set the chip must belong to the USB device with this
+    serial number.
+    \returns 0 on success.
+ */
+static int plGpioLocate(PL_GpioLine *gl, const char *label, int prefix, unsigned offset, const char *serial)
+{
+    int i;
+    int fd;
+    int match;
+    U_SStream ss;
+    char path[32];
+    struct gpiochip_info info;
+
+    for (i = 0; i < PL_GPIO_MAX_CHIPS; i++)
     {
-        name = fn_gpiod_chip_name(chip);
-        label = fn_gpiod_chip_label(chip);
+        U_sstream_init(&ss, path, sizeof(path));
+        U_sstream_put_str(&ss, "/dev/gpiochip");
+        U_sstream_put_long(&ss, i);
 
-        if (!label || strncmp(label, "pinctrl-bcm", 11) != 0)
-        {
+        /* numbers may have gaps after chips were removed */
+        fd = open(path, O_RDWR);
+        if (fd == -1)
             continue;
-        }
 
-        /* https://pinout.xyz/pinout/raspbee
-           RaspBee reset pin on gpio17
-        */
-        line = fn_gpiod_chip_get_line(chip, 17);
+        U_bzero(&info, sizeof(info));
+        match = 0;
+        if (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0 && offset < info.lines)
+        {
+            info.label[sizeof(info.label) - 1] = '\0';
+            if (prefix)
+                match = strncmp(info.label, label, strlen(label)) == 0;
+            else
+                match = strcmp(info.label, label) == 0;
+
+            if (match && serial)
+                match = plGpioChipHasSerial(fd, serial);
+        }
 
-        if (!line)
+        if (!match)
         {
+            close(fd);
             continue;
         }
 
-        PL_Printf(DBG_DEBUG, "gpiod chip: name: %s, label: %s\n", name, label);
+        PL_Printf(DBG_DEBUG, "gpio chip: name: %s, label: %s\n", path, info.label);
+        gl->chipFd = fd;
+        gl->offset = offset;
+        if (serial && strlen(serial) < sizeof(gl->serial))
+            U_memcpy(gl->serial, serial, strlen(serial) + 1);
 
-        ret = fn_gpiod_line_request_output(line, "gcf", 1);
-        Assert(ret != -1);
+#ifdef HAS_LIBGPIOD
+        if (plLoadLibGpiod() == 0)
+        {
+            gl->chip = fn_gpiod_chip_open(path);
+            if (gl->chip)
+                gl->line = fn_gpiod_chip_get_line(gl->chip, gl->offset);
+
+            if (!gl->line)
+            {
+                plGpioForget(gl);
+                return -1;
+            }
+        }
+#endif
+        return 0;
+    }
 
-        ret = fn_gpiod_line_set_value(line, 0);
-        Assert(ret != -1);
+    return -1;
+}
 
-        PL_MSleep(200);
+/*! Requests the line as output with \p value, or as input if \p value is -1. */
+static int plGpioRequest(PL_GpioLine *gl, int value)
+{
+    struct gpiohandle_request hreq;
+#ifdef GPIO_V2_GET_LINE_IOCTL
+    struct gpio_v2_line_request req;
+#endif
 
-        ret = fn_gpiod_line_set_value(line, 1);
-        Assert(ret != -1);
+#ifdef HAS_LIBGPIOD
+    if (gl->line)
+    {
+        if (value == -1)
+            return fn_gpiod_line_request_input(gl->line, "gcf");
+        return fn_gpiod_line_request_output(gl->line, "gcf", value);
+    }
+#endif
 
-        fn_gpiod_line_release(line);
+#ifdef GPIO_V2_GET_LINE_IOCTL
+    if (!gl->uapiV1)
+    {
+        U_bzero(&req, sizeof(req));
+        req.offsets[0] = gl->offset;
+        req.num_lines = 1;
+        U_memcpy(req.consumer, "gcf", 4);
+        if (value == -1)
+        {
+            req.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+        }
+        else
+        {
+            req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+            req.config.num_attrs = 1;
+            req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+            req.config.attrs[0].attr.values = value ? 1 : 0;
+            req.config.attrs[0].mask = 1;
+        }
 
-        ret = fn_gpiod_line_request_input(line, "gcf");
-        Assert(ret != -1);
+        if (ioctl(gl->chipFd, GPIO_V2_GET_LINE_IOCTL, &req) == 0)
+        {
+            gl->lineFd = req.fd;
+            return 0;
+        }
 
-        fn_gpiod_line_release(line);
+        if (errno != ENOTTY && errno != EINVAL)
+            return -1;
 
-        ret = 0;
-        break;
+        gl->uapiV1 = 1; /* kernel before 5.10 */
     }
+#endif
 
-    fn_gpiod_chip_iter_free(iter);
+    U_bzero(&hreq, sizeof(hreq));
+    hreq.lineoffsets[0] = gl->offset;
+    hreq.lines = 1;
+    U_memcpy(hreq.consumer_label, "gcf", 4);
+    if (value == -1)
+    {
+        hreq.flags = GPIOHANDLE_REQUEST_INPUT;
+    }
+    else
+    {
+        hreq.flags = GPIOHANDLE_REQUEST_OUTPUT;
+        hreq.default_values[0] = value ? 1 : 0;
+    }
 
-    plUnloadLibGpiod();
+    if (ioctl(gl->chipFd, GPIO_GET_LINEHANDLE_IOCTL, &hreq) == 0)
+    {
+        gl->lineFd = hreq.fd;
+        return 0;
+    }
 
-    return ret;
+    return -1;
 }
 
-int plResetFtdiLibGpiod(void)
+static int plGpioSet(PL_GpioLine *gl, int value)
 {
-    int ret = -1;
-    struct gpiod_chip *chip;
-    struct gpiod_chip_iter *iter;
-    struct gpiod_line *line;
-    const char *name;
-    const char *label;
+    struct gpiohandle_data data;
+#ifdef GPIO_V2_LINE_SET_VALUES_IOCTL
+    struct gpio_v2_line_values values;
+#endif
 
-    if (plLoadLibGpiod() != 0)
+#ifdef HAS_LIBGPIOD
+    if (gl->line)
+        return fn_gpiod_line_set_value(gl->line, value);
+#endif
+
+#ifdef GPIO_V2_LINE_SET_VALUES_IOCTL
+    if (!gl->uapiV1)
     {
-        return -1;
+        values.bits = value ? 1 : 0;
+        values.mask = 1;
+        return ioctl(gl->lineFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
     }
+#endif
 
-    iter = fn_gpiod_chip_iter_new();
+    U_bzero(&data, sizeof(data));
+    data.values[0] = value ? 1 : 0;
+    return ioctl(gl->lineFd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+}
 
-    if (!iter)
+static void plGpioRelease(PL_GpioLine *gl)
+{
+#ifdef HAS_LIBGPIOD
+    if (gl->line)
     {
-        plUnloadLibGpiod();
-        return -2;
+        fn_gpiod_line_release(gl->line);
+        return;
     }
+#endif
 
-    while ((chip = fn_gpiod_chip_iter_next(iter)) != NULL)
+    if (gl->lineFd != -1)
     {
-        name = fn_gpiod_chip_name(chip);
-        label = fn_gpiod_chip_label(chip);
+        close(gl->lineFd);
+        gl->lineFd = -1;
+    }
+}
 
-        if (!label || strcmp(label, "ftdi-cbus") != 0)
-        {
-            continue;
-        }
+/*! Requests the line as output with the first of \p values and sets the
+    others one after another, the last one \p delay milliseconds later.
+ */
+static int plGpioToggle(PL_GpioLine *gl, const int *values, unsigned count, unsigned long delay, int input)
+{
+    unsigned i;
+
+    if (plGpioRequest(gl, values[0]) != 0)
+        return -1;
 
-        line = fn_gpiod_chip_get_line(chip, 0); /* CBUS0 */
+    for (i = 1; i < count; i++)
+    {
+        if (i == count - 1 && delay)
+            PL_MSleep(delay);
 
-        if (!line)
+        if (plGpioSet(gl, values[i]) != 0)
         {
-            continue;
+            plGpioRelease(gl);
+            return -1;
         }
+    }
 
-        PL_Printf(DBG_DEBUG, "gpiod chip: name: %s, label: %s\n", name, label);
+    plGpioRelease(gl);
 
-        /* toggle CBUS0 which is connected to MCU reset */
+    /* leave the line floating */
+    if (input && plGpioRequest(gl, -1) == 0)
+        plGpioRelease(gl);
+
+    return 0;
+}
 
-        ret = fn_gpiod_line_request_output(line, "gcf", 0);
-        Assert(ret != -1);
+static int plGpioReset(PL_GpioLine *gl, const char *label, int prefix, unsigned offset, const char *serial,
+                       const int *values, unsigned count, unsigned long delay, int input)
+{
+    int ret;
+    int attempt;
 
-        ret = fn_gpiod_line_set_value(line, 1);
-        Assert(ret != -1);
+#ifdef USE_WORKER_POOL
+    pthread_mutex_lock(&plGpioMutex);
+#endif
 
-        ret = fn_gpiod_line_set_value(line, 0);
-        Assert(ret != -1);
+    /* the cached chip belongs to another FTDI device */
+    if (serial && strcmp(gl->serial, serial) != 0)
+        plGpioForget(gl);
 
-        ret = fn_gpiod_line_set_value(line, 1);
-        Assert(ret != -1);
+    ret = -1;
+    for (attempt = 0; attempt < 2 && ret != 0; attempt++)
+    {
+        /* the cached chip is gone when a FTDI device was unplugged */
+        if (attempt == 1)
+            plGpioForget(gl);
 
-        fn_gpiod_line_release(line);
+        if (gl->chipFd == -1 && plGpioLocate(gl, label, prefix, offset, serial) != 0)
+            break;
 
-        ret = 0;
-        break;
+        ret = plGpioToggle(gl, values, count, delay, input);
     }
 
-    fn_gpiod_chip_iter_free(iter);
-
-    plUnloadLibGpiod();
+#ifdef USE_WORKER_POOL
+    pthread_mutex_unlock(&plGpioMutex);
+#endif
 
     return ret;
 }
+
+int plResetRaspBeeGpio(void)
+{
+    static const int values[] = { 1, 0, 1 };
+
+    /* https://pinout.xyz/pinout/raspbee
+       RaspBee reset pin on gpio17
+    */
+    return plGpioReset(&plGpioRaspBee, "pinctrl-bcm", 1, 17, 0, values, 3, 200, 1);
+}
+
+/*! Resets the ConBee I with USB serial number \p serial, which must be known,
+    any other would reset the first FTDI device found.
+ */
+int plResetFtdiGpio(const char *serial)
+{
+    /* toggle CBUS0 which is connected to MCU reset */
+    static const int values[] = { 0, 1, 0, 1 };
+
+    if (!serial || serial[0] == '\0')
+        return -1;
+
+    return plGpioReset(&plGpioFtdi, "ftdi-cbus", 0, 0 /* CBUS0 */, serial, values, 4, 0, 0);
+}
+
+/*! Closes the cached gpiochips. */
+void plGpioClose(void)
+{
+    plGpioForget(&plGpioRaspBee);
+    plGpioForget(&plGpioFtdi);
+
+#ifdef HAS_LIBGPIOD
+    plUnloadLibGpiod();
+    lib_gpiod_state = 0;
 #endif
+}
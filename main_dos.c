@@ -54,6 +54,23 @@ PL_time_t PL_Time(void)
     return platform.time;
 }
 
+PL_time_t PL_TimeMicro(void)
+{
+    return (PL_time_t)platform.time * 1000; /* only millisecond resolution */
+}
+
+/*! Runs \p job right away, there are no worker threads on this platform. */
+void PL_RunJob(PL_Job job, void *arg, Event event)
+{
+    job(arg);
+    GCF_HandleEvent(GCF_CurrentSession(), event);
+}
+
+int PL_HasWorkers(void)
+{
+    return 0;
+}
+
 /*! Lets the programm sleep for \p ms milliseconds. */
 void PL_MSleep(unsigned long ms)
 {
@@ -250,6 +267,65 @@ int PL_ReadFile(const char *path, unsigned char *buf, unsigned long buflen)
     return result;
 }
 
+int PL_WriteFile(const char *path, const unsigned char *data, unsigned long len)
+{
+    FILE *f;
+    int result = -1;
+
+    f = fopen(path, "wb");
+    if (!f)
+        return result;
+
+    if (fwrite(data, 1, (size_t)len, f) == (size_t)len)
+        result = (int)len;
+
+    if (fclose(f) != 0)
+        result = -1;
+
+    return result;
+}
+
+unsigned long PL_FileStamp(const char *path)
+{
+    (void)path;
+    return 0; /* unknown, cached files are always reloaded */
+}
+
+int PL_ListDir(const char *path, void (*fn)(void *user, const char *name), void *user)
+{
+    (void)path;
+    (void)fn;
+    (void)user;
+    return -1;
+}
+
+/* The daemon mode control socket isn't supported on this platform. */
+int PL_ControlOpen(const char *path)
+{
+    (void)path;
+    return 0;
+}
+
+int PL_ControlWrite(int client, const char *str)
+{
+    (void)client;
+    (void)str;
+    return 0;
+}
+
+void PL_ControlClose(void)
+{
+}
+
+int PL_SetRealtime(PL_SchedPolicy policy, int priority, int cpu)
+{
+    (void)policy;
+    (void)priority;
+    (void)cpu;
+    PL_Printf(DBG_INFO, "real-time scheduling isn't supported on this platform\n");
+    return 0;
+}
+
 
 void PL_Print(const char *line)
 {
@@ -286,7 +362,7 @@ void UI_SetCursor(unsigned x, unsigned y)
 }
 
 
-int PROT_Write(const unsigned char *data, unsigned len)
+static int plWrite(const unsigned char *data, unsigned len)
 {
     int n;
     n = 0;
@@ -324,7 +400,7 @@ int PROT_Flush(void)
 
     if (platform.txpos != 0 && platform.txpos < sizeof(platform.txbuf))
     {
-        result = PROT_Write(&platform.txbuf[0], (unsigned)platform.txpos);
+        result = plWrite(&platform.txbuf[0], (unsigned)platform.txpos);
         Assert(result == (int)platform.txpos); /* support/handle partial writes? */
         platform.txpos = 0;
     }
@@ -332,6 +408,12 @@ int PROT_Flush(void)
     return result;
 }
 
+int PROT_Write(const unsigned char *data, unsigned len)
+{
+    PROT_Flush(); /* frames staged before come first */
+    return plWrite(data, len);
+}
+
 void (__interrupt __far *prev_int_1c)();
 
 void __interrupt __far timer_rtn()
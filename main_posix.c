@@ -8,6 +8,10 @@
  *
  */
 
+#if defined(PL_LINUX) && !defined(_GNU_SOURCE)
+  #define _GNU_SOURCE /* sched_setaffinity() */
+#endif
+
 #include <stdio.h>
 #include <stdarg.h> /* va_list, ... */
 #include <poll.h>
@@ -15,42 +19,106 @@
 #include <unistd.h> /* close() */
 //#include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <time.h>
 #include <string.h> /* memset() */
 #include <errno.h>
+#include <signal.h>
 #include <dlfcn.h>
 #include <termios.h> /* POSIX terminal control definitions */
+#include <sched.h>
+#include <sys/mman.h> /* mlockall() */
+#ifdef PL_MAC
+  #include <pthread.h>
+#endif
 
 #include "gcf.h"
+#include "net.h"
 #include "protocol.h"
 #include "u_sstream.h"
 #include "u_mem.h"
 
 #define RX_BUF_SIZE 1024
 #define TX_BUF_SIZE 2048
+#define PL_MAX_SESSIONS 8
+#define MAX_POLL_FDS (PL_MAX_SESSIONS + 12)
+#define LOOP_TIMEOUT 5 /* ms */
 
+#ifdef USE_IO_THREAD
+typedef struct PL_IoThread_t PL_IoThread;
+#endif
+
+/* Connection state per session, GCF_CurrentSession() selects the entry. */
 typedef struct
 {
-    PL_time_t timer;
+    GCF *gcf; /* 0 if unused */
     int fd;
-    unsigned char running;
-    unsigned char rxbuf[RX_BUF_SIZE];
-    unsigned char txbuf[TX_BUF_SIZE];
+    PL_time_t timer;
     unsigned tx_rp;
     unsigned tx_wp;
+#ifdef USE_IO_THREAD
+    PL_IoThread *io;
+#endif
+#ifdef USE_IO_URING
+    int dev;
+#endif
+    unsigned char txbuf[TX_BUF_SIZE];
+} PL_Session;
+
+typedef struct
+{
+    volatile sig_atomic_t running;
+    unsigned char rxbuf[RX_BUF_SIZE];
     GCF *gcf;
+    PL_Session sessions[PL_MAX_SESSIONS];
+
+    /* wakeup latency of timed out waits, measured after PL_SetRealtime() */
+    int rt;
+    unsigned long latCount;
+    unsigned long latLate;  /* > 1 ms */
+    unsigned long long latSum;
+    unsigned long long latMax;
 } PL_Internal;
 
 static PL_Internal platform;
 
+unsigned plControlPollFds(struct pollfd *fds, unsigned max);
+void plControlProcess(GCF *gcf, const struct pollfd *fds, unsigned nfds);
+
+#ifdef USE_IO_URING
+int plUringOpen(void);
+void plUringClose(void);
+int plUringWait(struct pollfd *fds, unsigned nfds, unsigned timeout);
+int plUringAddDevice(int fd);
+void plUringRemoveDevice(int dev);
+int plUringRead(int dev, unsigned char *buf, unsigned max);
+unsigned plUringWrite(int dev, const unsigned char *data, unsigned len);
+#endif
+
+#ifdef USE_IO_THREAD
+PL_IoThread *plIoStart(int fd);
+void plIoStop(PL_IoThread *io);
+int plIoEventFd(PL_IoThread *io);
+unsigned plIoWrite(PL_IoThread *io, const unsigned char *data, unsigned len);
+int plIoRead(PL_IoThread *io, unsigned char *buf, unsigned max);
+#endif
+
+#ifdef USE_WORKER_POOL
+int plPoolStart(void);
+void plPoolStop(void);
+int plPoolFd(void);
+int plPoolSubmit(PL_Job job, void *arg, GCF *gcf, Event event);
+void plPoolProcess(void);
+#endif
+
 #ifdef PL_LINUX
 int plGetLinuxUSBDevices(Device *dev, Device *end);
 int plGetLinuxSerialDevices(Device *dev, Device *end);
 
-#ifdef HAS_LIBGPIOD
-int plResetRaspBeeLibGpiod(void);
-int plResetFtdiLibGpiod(void);
-#endif
+int plResetRaspBeeGpio(void);
+int plResetFtdiGpio(const char *serial);
+void plGpioClose(void);
 
 #endif
 
@@ -104,6 +172,16 @@ PL_time_t PL_Time(void)
     return res;
 }
 
+PL_time_t PL_TimeMicro(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return 0;
+
+    return (unsigned long long)ts.tv_sec * 1000000 + (unsigned long long)ts.tv_nsec / 1000;
+}
+
 void PL_MSleep(unsigned long ms)
 {
     while (ms > 0)
@@ -117,12 +195,13 @@ int PL_ResetFTDI(int num, const char *serialnum)
 {
     (void)num;
     (void)serialnum;
-#ifdef HAS_LIBGPIOD
-    return plResetFtdiLibGpiod();
+#ifdef PL_LINUX
+    if (plResetFtdiGpio(serialnum) == 0)
+        return 0;
 #endif
 
 #ifdef HAS_LIBFTDI
-    return plResetLibFtdi();
+    return plResetLibFtdi(serialnum);
 #endif
 
     return -1;
@@ -130,8 +209,8 @@ int PL_ResetFTDI(int num, const char *serialnum)
 
 int PL_ResetRaspBee(void)
 {
-#ifdef HAS_LIBGPIOD
-    return plResetRaspBeeLibGpiod();
+#ifdef PL_LINUX
+    return plResetRaspBeeGpio();
 #endif
     return -1;
 }
@@ -160,26 +239,60 @@ void PL_Printf(DebugLevel level, const char *format, ...)
     va_end (args);
 }
 
+/* Returns the entry of the calling session, a new one on first use,
+   or 0 if all are taken.
+ */
+static PL_Session *plSession(void)
+{
+    unsigned i;
+    GCF *gcf;
+    PL_Session *s;
+
+    gcf = GCF_CurrentSession();
+    s = 0;
+
+    for (i = 0; i < PL_MAX_SESSIONS; i++)
+    {
+        if (platform.sessions[i].gcf == gcf)
+            return &platform.sessions[i];
+
+        if (!s && platform.sessions[i].gcf == 0)
+            s = &platform.sessions[i];
+    }
+
+    if (s)
+        s->gcf = gcf;
+    else
+        PL_Printf(DBG_DEBUG, "too many sessions\n");
+
+    return s;
+}
+
 GCF_Status PL_Connect(const char *path, PL_Baudrate baudrate)
 {
     PL_Printf(DBG_DEBUG, "PL_Connect\n");
 
     int baudrate1 = 0;
+    PL_Session *s;
 
-    if (platform.fd != 0)
+    s = plSession();
+    if (!s)
+        return GCF_FAILED;
+
+    if (s->fd != 0)
     {
         PL_Printf(DBG_DEBUG, "device already connected %s\n", path);
         return GCF_SUCCESS;
     }
 
-    platform.fd = open(path, O_CLOEXEC | O_RDWR /*| O_NONBLOCK*/);
-    platform.tx_rp = 0;
-    platform.tx_wp = 0;
+    s->fd = open(path, O_CLOEXEC | O_RDWR /*| O_NONBLOCK*/);
+    s->tx_rp = 0;
+    s->tx_wp = 0;
 
-    if (platform.fd < 0)
+    if (s->fd < 0)
     {
         PL_Printf(DBG_DEBUG, "failed to open device %s\n", path);
-        platform.fd = 0;
+        s->fd = 0;
         return GCF_FAILED;
     }
 
@@ -207,24 +320,61 @@ GCF_Status PL_Connect(const char *path, PL_Baudrate baudrate)
 #endif
     }
 
-    plSetupPort(platform.fd, baudrate1);
+    plSetupPort(s->fd, baudrate1);
+
+#ifdef USE_IO_URING
+    s->dev = plUringAddDevice(s->fd);
+    if (s->dev == -1)
+    {
+        close(s->fd);
+        s->fd = 0;
+        return GCF_FAILED;
+    }
+#endif
+
+#ifdef USE_IO_THREAD
+    s->io = plIoStart(s->fd);
+    if (!s->io)
+    {
+        close(s->fd);
+        s->fd = 0;
+        return GCF_FAILED;
+    }
+#endif
 
     PL_Printf(DBG_DEBUG, "connected to %s, baudrate: %d\n", path, baudrate);
 
     return GCF_SUCCESS;
 }
 
-void PL_Disconnect(void)
+static void plDisconnect(PL_Session *s)
 {
-    PL_Printf(DBG_DEBUG, "PL_Disconnect\n");
-    if (platform.fd != 0)
+    if (s->fd != 0)
     {
-        close(platform.fd);
-        platform.fd = 0;
+#ifdef USE_IO_THREAD
+        plIoStop(s->io);
+        s->io = 0;
+#endif
+#ifdef USE_IO_URING
+        plUringRemoveDevice(s->dev);
+        s->dev = -1;
+#endif
+        close(s->fd);
+        s->fd = 0;
     }
-    platform.tx_rp = 0;
-    platform.tx_wp = 0;
-    GCF_HandleEvent(platform.gcf, EV_DISCONNECTED);
+    s->tx_rp = 0;
+    s->tx_wp = 0;
+    GCF_HandleEvent(s->gcf, EV_DISCONNECTED);
+}
+
+void PL_Disconnect(void)
+{
+    PL_Session *s;
+
+    PL_Printf(DBG_DEBUG, "PL_Disconnect\n");
+    s = plSession();
+    if (s)
+        plDisconnect(s);
 }
 
 void PL_ShutDown(void)
@@ -238,7 +388,7 @@ int PL_ReadFile(const char *path, unsigned char *buf, unsigned long buflen)
     int fd;
     int ret;
 
-    Assert(path && buf && buflen >= MAX_GCF_FILE_SIZE);
+    Assert(path && buf && buflen != 0);
 
     ret = -1;
     fd = open(path, O_RDONLY);
@@ -263,14 +413,159 @@ int PL_ReadFile(const char *path, unsigned char *buf, unsigned long buflen)
     return ret;
 }
 
+int PL_WriteFile(const char *path, const unsigned char *data, unsigned long len)
+{
+    int fd;
+    ssize_t n;
+    unsigned long pos;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        PL_Printf(DBG_DEBUG, "failed to open %s, err: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    for (pos = 0; pos < len; )
+    {
+        n = write(fd, &data[pos], len - pos);
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+        {
+            PL_Printf(DBG_DEBUG, "failed to write %s, err: %s\n", path, strerror(errno));
+            break;
+        }
+
+        pos += (unsigned long)n;
+    }
+
+    if (close(fd) == -1)
+    {
+        PL_Printf(DBG_DEBUG, "failed to close %s, err: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return pos == len ? (int)pos : -1;
+}
+
+unsigned long PL_FileStamp(const char *path)
+{
+    unsigned long stamp;
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+        return 0;
+
+    stamp = (unsigned long)st.st_mtime * 2654435761UL;
+#ifdef PL_LINUX
+    stamp ^= (unsigned long)st.st_mtim.tv_nsec;
+#endif
+    stamp ^= (unsigned long)st.st_size;
+
+    return stamp | 1; /* 0 is reserved for unknown */
+}
+
+int PL_ListDir(const char *path, void (*fn)(void *user, const char *name), void *user)
+{
+    int n;
+    DIR *dir;
+    struct dirent *entry;
+
+    dir = opendir(path);
+    if (!dir)
+    {
+        PL_Printf(DBG_DEBUG, "failed to open %s, err: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    n = 0;
+    while ((entry = readdir(dir)) != 0)
+    {
+        if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' ||
+           (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+            continue;
+
+        fn(user, entry->d_name);
+        n++;
+    }
+
+    closedir(dir);
+    return n;
+}
+
+int PL_SetRealtime(PL_SchedPolicy policy, int priority, int cpu)
+{
+    int err;
+    int ret;
+    struct sched_param param;
+
+    ret = 1;
+    platform.rt = 1;
+
+    if (cpu >= 0)
+    {
+#ifdef PL_LINUX
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET((size_t)cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        {
+            PL_Printf(DBG_INFO, "failed to pin to CPU %d: %s\n", cpu, strerror(errno));
+            ret = 0;
+        }
+#else
+        PL_Printf(DBG_INFO, "CPU pinning isn't supported on this platform\n");
+        ret = 0;
+#endif
+    }
+
+    if (policy == PL_SCHED_DEFAULT)
+        return ret;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+#ifdef PL_MAC
+    err = pthread_setschedparam(pthread_self(), policy == PL_SCHED_RR ? SCHED_RR : SCHED_FIFO, &param);
+#else
+    err = sched_setscheduler(0, policy == PL_SCHED_RR ? SCHED_RR : SCHED_FIFO, &param) == -1 ? errno : 0;
+#endif
+
+    if (err != 0)
+    {
+        PL_Printf(DBG_INFO, "real-time scheduling not permitted: %s\n", strerror(err));
+        return 0;
+    }
+
+    /* page faults would undo the gain */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    {
+        PL_Printf(DBG_INFO, "failed to lock memory: %s\n", strerror(errno));
+        ret = 0;
+    }
+
+    return ret;
+}
+
 void PL_SetTimeout(unsigned long ms)
 {
-    platform.timer = PL_Time() + ms;
+    PL_Session *s;
+
+    s = plSession();
+    if (s)
+        s->timer = PL_Time() + ms;
 }
 
 void PL_ClearTimeout(void)
 {
-    platform.timer = 0;
+    PL_Session *s;
+
+    s = plSession();
+    if (s)
+        s->timer = 0;
 }
 
 int PL_GetDevices(Device *devs, unsigned max)
@@ -294,6 +589,28 @@ int PL_GetDevices(Device *devs, unsigned max)
     return result;
 }
 
+void PL_RunJob(PL_Job job, void *arg, Event event)
+{
+    GCF *gcf;
+
+    gcf = GCF_CurrentSession();
+#ifdef USE_WORKER_POOL
+    if (plPoolSubmit(job, arg, gcf, event))
+        return;
+#endif
+    job(arg); /* no pool or all jobs busy */
+    GCF_HandleEvent(gcf, event);
+}
+
+int PL_HasWorkers(void)
+{
+#ifdef USE_WORKER_POOL
+    return plPoolFd() != -1;
+#else
+    return 0;
+#endif
+}
+
 int PROT_Write(const unsigned char *data, unsigned len)
 {
     int result;
@@ -310,45 +627,58 @@ int PROT_Write(const unsigned char *data, unsigned len)
 
 int PROT_Putc(unsigned char ch)
 {
-    if (platform.fd == 0)
+    PL_Session *s;
+
+    s = plSession();
+    if (!s || s->fd == 0)
         return 0;
 
-    platform.txbuf[platform.tx_wp % TX_BUF_SIZE] = ch;
-    platform.tx_wp++;
+    s->txbuf[s->tx_wp % TX_BUF_SIZE] = ch;
+    s->tx_wp++;
 
-    if ((platform.tx_wp % TX_BUF_SIZE) == (platform.tx_rp % TX_BUF_SIZE))
-        platform.tx_rp++; /* overwrite oldest */
+    if ((s->tx_wp % TX_BUF_SIZE) == (s->tx_rp % TX_BUF_SIZE))
+        s->tx_rp++; /* overwrite oldest */
 
     return 1;
 }
 
-int PROT_Flush(void)
+static int plFlush(PL_Session *s)
 {
     int n;
     unsigned pos;
     unsigned len;
     unsigned char buf[512];
 
-    if (platform.fd == 0)
+    if (s->fd == 0)
     {
-        platform.tx_wp = 0;
-        platform.tx_rp = 0;
-        GCF_HandleEvent(platform.gcf, EV_DISCONNECTED);
+        s->tx_wp = 0;
+        s->tx_rp = 0;
+        GCF_HandleEvent(s->gcf, EV_DISCONNECTED);
         return -1;
     }
 
+    if (s->tx_rp == s->tx_wp)
+        return 0;
+
     for (len = 0; len < sizeof(buf); len++)
     {
-        if ((platform.tx_wp % TX_BUF_SIZE) == ((platform.tx_rp + len) % TX_BUF_SIZE))
+        if ((s->tx_wp % TX_BUF_SIZE) == ((s->tx_rp + len) % TX_BUF_SIZE))
             break;
-        buf[len] = platform.txbuf[(platform.tx_rp + len) % TX_BUF_SIZE];
+        buf[len] = s->txbuf[(s->tx_rp + len) % TX_BUF_SIZE];
     }
 
-    gcfDebugHex(platform.gcf, "send", &buf[0], len);
+    gcfDebugHex(s->gcf, "send", &buf[0], len);
 
+#if defined(USE_IO_THREAD)
+    (void)n;
+    pos = plIoWrite(s->io, &buf[0], len); /* the rest is queued again by the main loop */
+#elif defined(USE_IO_URING)
+    (void)n;
+    pos = plUringWrite(s->dev, &buf[0], len); /* submitted with the next wait */
+#else
     for (pos = 0; pos < len;)
     {
-        n = (int)write(platform.fd, &buf[pos], len - pos);
+        n = (int)write(s->fd, &buf[pos], len - pos);
         if (n == -1)
         {
             if (errno == EINTR)
@@ -365,15 +695,30 @@ int PROT_Flush(void)
             break; /* should never happen */
         }
     }
+#endif
 
-    platform.tx_rp += pos;
+    s->tx_rp += pos;
 
     return (int)pos;
 }
 
+int PROT_Flush(void)
+{
+    PL_Session *s;
+
+    s = plSession();
+    if (!s)
+        return -1;
+
+    return plFlush(s);
+}
+
 void UI_GetWinSize(unsigned *w, unsigned *h)
 {
     struct winsize size;
+
+    size.ws_col = 0; /* stay 0 if not a terminal */
+    size.ws_row = 0;
     ioctl(STDOUT_FILENO, TIOCGWINSZ, &size);
 
     *w = size.ws_col;
@@ -396,18 +741,43 @@ void UI_SetCursor(unsigned x, unsigned y)
     PL_Print(buf);
 }
 
+/* Serves the connected devices, sessions which aren't connected get only
+   their timeouts.
+ */
 static int PL_Loop(GCF *gcf)
 {
     int ret;
     int nread;
-    struct pollfd fds;
+    unsigned i;
+    unsigned long long t;
+    PL_time_t now;
+    PL_Session *s;
+    nfds_t nfds;
+    nfds_t ndev;
+    nfds_t net_idx;
+#ifdef USE_WORKER_POOL
+    nfds_t pool_idx;
+#endif
+    nfds_t ctl_idx;
+    nfds_t metrics_idx;
+    int netReady;
+    unsigned writing;
+    int handles[MAX_POLL_FDS];
+    struct pollfd fds[MAX_POLL_FDS];
+    PL_Session *fdSession[PL_MAX_SESSIONS];
 
     memset(&platform, 0, sizeof(platform));
     platform.gcf = gcf;
 
     platform.running = 1;
 
-    fds.events = POLLIN;
+#ifdef USE_IO_URING
+    plUringOpen();
+#endif
+#ifdef USE_WORKER_POOL
+    if (!plPoolStart())
+        PL_Printf(DBG_INFO, "failed to start worker threads, blocking operations run in the main loop\n");
+#endif
 
     GCF_HandleEvent(gcf, EV_PL_STARTED);
 
@@ -415,61 +785,228 @@ static int PL_Loop(GCF *gcf)
     {
         GCF_HandleEvent(gcf, EV_PL_LOOP);
 
+        ndev = 0;
+        for (i = 0; i < PL_MAX_SESSIONS; i++)
+        {
+            s = &platform.sessions[i];
+            if (s->fd == 0)
+                continue;
+
+#if defined(USE_IO_THREAD)
+            fds[ndev].fd = plIoEventFd(s->io);
+#else
+            fds[ndev].fd = s->fd;
+#endif
+            fds[ndev].events = POLLIN;
+            fds[ndev].revents = 0;
+            fdSession[ndev] = s;
+            ndev++;
+        }
+
+#ifndef USE_IO_URING /* the timeout is a ring op */
         /* when no device is connected, poll STDIN, to get poll() timeout */
-        fds.fd = platform.fd != 0 ? platform.fd : STDIN_FILENO;
+        if (ndev == 0)
+        {
+            fds[0].fd = STDIN_FILENO;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            fdSession[0] = 0;
+            ndev = 1;
+        }
+#endif
+        nfds = ndev;
+
+        /* serial, network and control events are served by the same wait */
+        net_idx = 0;
+        fds[nfds].fd = NET_Handle();
+        if (fds[nfds].fd != -1)
+        {
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            net_idx = nfds;
+            nfds++;
+        }
+
+#ifdef USE_WORKER_POOL
+        pool_idx = 0;
+        fds[nfds].fd = plPoolFd();
+        if (fds[nfds].fd != -1)
+        {
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            pool_idx = nfds;
+            nfds++;
+        }
+#endif
+
+        /* metrics scrapes, clients with a partly sent response wait to write */
+        metrics_idx = nfds;
+        ret = (int)NET_MetricsHandles(&handles[0], &writing, (unsigned)(MAX_POLL_FDS - nfds));
+        for (i = 0; i < (unsigned)ret; i++, nfds++)
+        {
+            fds[nfds].fd = handles[i];
+            fds[nfds].events = (writing & (1U << i)) ? POLLIN | POLLOUT : POLLIN;
+            fds[nfds].revents = 0;
+        }
 
-        ret = poll(&fds, 1, 5);
+        ctl_idx = nfds;
+        nfds += plControlPollFds(&fds[nfds], (unsigned)(MAX_POLL_FDS - nfds));
+
+        t = platform.rt ? PL_TimeMicro() : 0;
+
+#ifdef USE_IO_URING
+        ret = plUringWait(&fds[0], (unsigned)nfds, LOOP_TIMEOUT);
+#else
+        ret = poll(&fds[0], nfds, LOOP_TIMEOUT);
+#endif
+
+        if (ret == 0 && platform.rt)
+        {
+            t = PL_TimeMicro() - t;
+            t = t > LOOP_TIMEOUT * 1000 ? t - LOOP_TIMEOUT * 1000 : 0;
+            platform.latCount++;
+            platform.latSum += t;
+            if (t > 1000) platform.latLate++;
+            if (t > platform.latMax) platform.latMax = t;
+        }
 
         if (ret < 0)
         {
+            if (errno == EINTR)
+                continue;
             PL_Printf(DBG_DEBUG, "poll error: %s\n", strerror(errno));
             break;
         }
 
-        if (ret == 0)
+        if (ret > 0)
         {
-            if (platform.timer != 0)
+            for (i = 0; i < ndev; i++)
             {
-                if (platform.timer < PL_Time())
+                s = fdSession[i];
+
+                if (!s) /* STDIN */
                 {
-                    platform.timer = 0;
-                    GCF_HandleEvent(gcf, EV_TIMEOUT);
+                    if (fds[i].revents & POLLIN)
+                    {
+                        nread = (int)read(fds[i].fd, platform.rxbuf, sizeof(platform.rxbuf));
+                        if (nread > 0)
+                            GCF_Received(gcf, platform.rxbuf, nread);
+                    }
+                    continue;
+                }
+
+                if (s->fd == 0) /* disconnected by an earlier event */
+                    continue;
+
+                if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+                {
+                    plDisconnect(s);
+                }
+                else if (fds[i].revents & POLLIN)
+                {
+#if defined(USE_IO_THREAD)
+                    nread = plIoRead(s->io, platform.rxbuf, sizeof(platform.rxbuf));
+#elif defined(USE_IO_URING)
+                    nread = plUringRead(s->dev, platform.rxbuf, sizeof(platform.rxbuf));
+#else
+                    nread = (int)read(s->fd, platform.rxbuf, sizeof(platform.rxbuf));
+#endif
+
+                    if (nread > 0)
+                    {
+                        GCF_Received(s->gcf, platform.rxbuf, nread);
+                    }
+#ifdef USE_IO_THREAD
+                    else if (nread < 0)
+                    {
+                        plDisconnect(s);
+                    }
+#endif
                 }
             }
 
-            continue;
-        }
+            /* one NET_Step() serves the datagram and metrics sockets */
+            netReady = net_idx != 0 && fds[net_idx].revents & POLLIN;
+            for (i = (unsigned)metrics_idx; i < ctl_idx && !netReady; i++)
+                netReady = fds[i].revents != 0;
 
-        if (fds.revents & (POLLHUP | POLLERR | POLLNVAL) && platform.fd != 0)
-        {
-            PL_Disconnect();
-            continue;
-        }
+            if (netReady)
+            {
+                GCF_HandleEvent(gcf, EV_NET_READY);
+            }
 
-        if (fds.revents & POLLIN)
-        {
-            nread = (int)read(fds.fd, platform.rxbuf, sizeof(platform.rxbuf));
+#ifdef USE_WORKER_POOL
+            if (pool_idx != 0 && fds[pool_idx].revents & POLLIN)
+            {
+                plPoolProcess();
+            }
+#endif
 
-            if (nread > 0)
+            plControlProcess(gcf, &fds[ctl_idx], (unsigned)(nfds - ctl_idx));
+
+            for (i = 0; i < PL_MAX_SESSIONS; i++)
             {
-                GCF_Received(gcf, platform.rxbuf, nread);
+                s = &platform.sessions[i];
+                if (s->fd && s->tx_rp != s->tx_wp)
+                    plFlush(s);
             }
         }
 
-        if (platform.fd && platform.tx_rp != platform.tx_wp)
+        now = PL_Time();
+        for (i = 0; i < PL_MAX_SESSIONS; i++)
         {
-            PROT_Flush();
+            s = &platform.sessions[i];
+            if (s->timer != 0 && s->timer < now)
+            {
+                s->timer = 0;
+                GCF_HandleEvent(s->gcf, EV_TIMEOUT);
+            }
         }
     }
 
-    PL_Disconnect();
+    for (i = 0; i < PL_MAX_SESSIONS; i++)
+    {
+        s = &platform.sessions[i];
+        if (s->fd != 0)
+            plDisconnect(s);
+    }
+
+#ifdef USE_IO_URING
+    plUringClose();
+#endif
+#ifdef USE_WORKER_POOL
+    plPoolStop();
+#endif
+#ifdef PL_LINUX
+    plGpioClose();
+#endif
+
+    if (platform.rt && platform.latCount != 0)
+    {
+        PL_Printf(DBG_INFO, "loop wakeup latency: %lu samples, avg %llu us, max %llu us, %lu over 1 ms\n",
+                  platform.latCount, platform.latSum / platform.latCount, platform.latMax, platform.latLate);
+    }
 
     return 1;
 }
 
+/* ends the main loop, so the daemon mode control socket gets cleaned up */
+static void plSignalHandler(int sig)
+{
+    (void)sig;
+    platform.running = 0;
+}
+
 int main(int argc, char *argv[])
 {
     GCF *gcf;
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = plSignalHandler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
     gcf = GCF_Init(argc, argv);
     if (gcf == NULL)
         return 2;
@@ -26,6 +26,7 @@
 #include <stdarg.h>
 
 #include "gcf.h"
+#include "net.h"
 #include "u_sstream.h"
 #include "u_strlen.h"
 
@@ -106,6 +107,31 @@ PL_time_t PL_Time(void)
     return GetTickCount();
 }
 
+PL_time_t PL_TimeMicro(void)
+{
+    if (platform.frequencyValid)
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return (PL_time_t)(now.QuadPart / platform.frequency.QuadPart) * 1000000 +
+               (PL_time_t)(now.QuadPart % platform.frequency.QuadPart) * 1000000 / (PL_time_t)platform.frequency.QuadPart;
+    }
+
+    return (PL_time_t)GetTickCount() * 1000;
+}
+
+/*! Runs \p job right away, there are no worker threads on this platform. */
+void PL_RunJob(PL_Job job, void *arg, Event event)
+{
+    job(arg);
+    GCF_HandleEvent(GCF_CurrentSession(), event);
+}
+
+int PL_HasWorkers(void)
+{
+    return 0;
+}
+
 /*! Lets the programm sleep for \p ms milliseconds. */
 void PL_MSleep(unsigned long ms)
 {
@@ -692,6 +718,104 @@ int PL_ReadFile(const char *path, unsigned char *buf, unsigned long buflen)
     return result;
 }
 
+int PL_WriteFile(const char *path, const unsigned char *data, unsigned long len)
+{
+    HANDLE hFile;
+    int result = -1;
+    DWORD nwritten = 0;
+
+    hFile = CreateFile(path,
+                       GENERIC_WRITE,
+                       0,                     // no sharing
+                       NULL,                  // default security
+                       CREATE_ALWAYS,         // create or truncate
+                       FILE_ATTRIBUTE_NORMAL, // normal file
+                       NULL);                 // no attr. template
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return result;
+    }
+
+    if (WriteFile(hFile, data, (DWORD)len, &nwritten, NULL))
+    {
+        if (nwritten == (DWORD)len)
+        {
+            result = (int)nwritten;
+        }
+    }
+
+    CloseHandle(hFile);
+
+    return result;
+}
+
+unsigned long PL_FileStamp(const char *path)
+{
+    (void)path;
+    return 0; /* unknown, cached files are always reloaded */
+}
+
+int PL_ListDir(const char *path, void (*fn)(void *user, const char *name), void *user)
+{
+    int n;
+    HANDLE hFind;
+    WIN32_FIND_DATAA data;
+    char pattern[MAX_PATH];
+    U_SStream ss;
+
+    U_sstream_init(&ss, pattern, sizeof(pattern));
+    U_sstream_put_str(&ss, path);
+    U_sstream_put_str(&ss, "\\*");
+    if (ss.status != U_SSTREAM_OK)
+        return -1;
+
+    hFind = FindFirstFileA(pattern, &data);
+    if (hFind == INVALID_HANDLE_VALUE)
+        return -1;
+
+    n = 0;
+    do
+    {
+        if (data.cFileName[0] == '.' && (data.cFileName[1] == '\0' ||
+           (data.cFileName[1] == '.' && data.cFileName[2] == '\0')))
+            continue;
+
+        fn(user, data.cFileName);
+        n++;
+    } while (FindNextFileA(hFind, &data));
+
+    FindClose(hFind);
+    return n;
+}
+
+/* The daemon mode control socket isn't supported on this platform. */
+int PL_ControlOpen(const char *path)
+{
+    (void)path;
+    return 0;
+}
+
+int PL_ControlWrite(int client, const char *str)
+{
+    (void)client;
+    (void)str;
+    return 0;
+}
+
+void PL_ControlClose(void)
+{
+}
+
+int PL_SetRealtime(PL_SchedPolicy policy, int priority, int cpu)
+{
+    (void)policy;
+    (void)priority;
+    (void)cpu;
+    PL_Printf(DBG_INFO, "real-time scheduling isn't supported on this platform\n");
+    return 0;
+}
+
 
 void PL_Print(const char *line)
 {
@@ -820,7 +944,7 @@ void UI_SetCursor(unsigned x, unsigned y)
 }
 
 
-int PROT_Write(const unsigned char *data, unsigned len)
+static int plWrite(const unsigned char *data, unsigned len)
 {
     if (len == 0)
         return 0;
@@ -873,7 +997,7 @@ int PROT_Flush(void)
 
     if (platform.txpos != 0 && platform.txpos < sizeof(platform.txbuf))
     {
-        result = PROT_Write(&platform.txbuf[0], (unsigned)platform.txpos);
+        result = plWrite(&platform.txbuf[0], (unsigned)platform.txpos);
         Assert(result == (int)platform.txpos); /* support/handle partial writes? */
         platform.txpos = 0;
     }
@@ -881,6 +1005,12 @@ int PROT_Flush(void)
     return result;
 }
 
+int PROT_Write(const unsigned char *data, unsigned len)
+{
+    PROT_Flush(); /* frames staged before come first */
+    return plWrite(data, len);
+}
+
 static void plInitOutput(void)
 {
     platform.hOut = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -921,6 +1051,13 @@ static void PL_Loop(GCF *gcf)
     BOOL Status;
     while (platform.running)
     {
+        GCF_HandleEvent(gcf, EV_PL_LOOP);
+
+        /* the serial port is read synchronously, the socket can't join a
+           readiness wait, NET_Step() is non-blocking and polls it instead */
+        if (NET_Handle() != -1)
+            GCF_HandleEvent(gcf, EV_NET_READY);
+
         if (platform.fd == INVALID_HANDLE_VALUE)
         {
             Sleep(20);
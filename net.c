@@ -8,47 +8,107 @@
  *
  */
 
-#define MAX_NET_CLIENTS 4
+/* Capacity of the client table, must be a power of two.
+   Can be set via CMake -DNET_MAX_CLIENTS=N */
+#ifndef NET_MAX_CLIENTS
+  #define NET_MAX_CLIENTS 64
+#endif
+
+/* Clients which haven't sent anything for this time (ms) are removed. */
+#ifndef NET_CLIENT_TTL
+  #define NET_CLIENT_TTL (60 * 1000)
+#endif
 
-#include <stdio.h>
+#define NET_CLIENT_SWEEP_INTERVAL 1000
+#define NET_CLIENT_FLAG_SUBSCRIBED 0x01
+#define MAX_NET_BATCHES_PER_STEP 4
+
+/* Metrics endpoint, each scrape gets a HTTP/1.0 response and the
+   connection is closed. Responses are written without blocking, the rest
+   is sent when the socket becomes writable again. */
+#define NET_METRICS_MAX_CLIENTS 4
+#define NET_METRICS_REQUEST_SIZE 1024
+#define NET_METRICS_HEADER_SIZE 128
+#define NET_METRICS_BUF_SIZE 8192
+#define NET_METRICS_CLIENT_TTL 5000 /* ms to send the request and read the response */
 
 #include "u_mem.h"
+#include "u_sstream.h"
+#include "gcf.h"
 #include "net.h"
 
 #ifdef USE_NET
 #include "net_sock.h"
 
+#if (NET_MAX_CLIENTS & (NET_MAX_CLIENTS - 1)) != 0 || NET_MAX_CLIENTS < 4
+  #error "NET_MAX_CLIENTS must be a power of two >= 4"
+#endif
+
+/* Open addressing hash table with linear probing, keyed by
+   address family, address and port. Slots with last_seen == 0 are free.
+ */
 typedef struct NET_Client
 {
     S_Addr addr;
     unsigned short port;
+    unsigned char flags;
+    unsigned hash;
+    PL_time_t last_seen;
 } NET_Client;
 
+typedef struct NET_MetricsClient
+{
+    S_Stream sock;
+    PL_time_t accepted;
+    unsigned len;  /* request bytes, when sending the end of the response */
+    unsigned pos;  /* response bytes sent */
+    unsigned char sending;
+    char buf[NET_METRICS_BUF_SIZE];
+} NET_MetricsClient;
+
 typedef struct NET_State
 {
     S_Udp udp_main;
-    unsigned char rx_buf[1280 + 1];
+    S_UdpBatch rx_batch;
+    S_UdpBatch tx_batch;
+    unsigned tx_slab_used; /* tx_batch slab entries, a slab entry can be shared by several messages */
+
+    int log_peers;
 
+    PL_time_t last_sweep;
     unsigned n_clients;
-    NET_Client clients[MAX_NET_CLIENTS];
+    NET_Client clients[NET_MAX_CLIENTS];
 
+    S_Stream metrics;
+    NET_MetricsClient metrics_clients[NET_METRICS_MAX_CLIENTS];
 } NET_State;
 
 static NET_State net_state;
 
+/* interface is the local address to bind, 0 for any IPv4 interface. */
 int NET_Init(const char *interface, unsigned short port)
 {
     S_Udp *sock;
+    S_Addr addr;
     SOCK_Init();
 
     net_state.n_clients = 0;
+    net_state.last_sweep = 0;
+    U_bzero(&net_state.clients[0], sizeof(net_state.clients));
+
+    U_bzero(&addr, sizeof(addr));
+    addr.af = S_AF_IPV4;
+
+    if (interface && SOCK_AddrFromString(&addr, interface) != 1)
+        goto err1;
 
-    (void)interface; /* TODO */
     sock = &net_state.udp_main;
 
-    if (SOCK_UdpInit(sock, S_AF_IPV4) != 1)
+    if (SOCK_UdpInit(sock, addr.af) != 1)
         goto err1;
 
+    sock->addr = addr;
+
     if (SOCK_UdpBind(sock, port) != 1)
         goto err1;
 
@@ -58,50 +118,363 @@ err1:
     return 0;
 }
 
-static int netCheckNewClient(void)
+static unsigned netAddrLength(const S_Addr *addr)
+{
+    return addr->af == S_AF_IPV4 ? 4 : 16;
+}
+
+static unsigned netHash(const S_Addr *addr, unsigned short port)
 {
     unsigned i;
+    unsigned len;
+    unsigned long h;
+
+    /* FNV-1a */
+    h = 2166136261UL;
+    len = netAddrLength(addr);
+
+    h = ((h ^ addr->af) * 16777619UL) & 0xFFFFFFFF;
+    for (i = 0; i < len; i++)
+        h = ((h ^ addr->data[i]) * 16777619UL) & 0xFFFFFFFF;
+    h = ((h ^ (port & 0xFF)) * 16777619UL) & 0xFFFFFFFF;
+    h = ((h ^ (port >> 8)) * 16777619UL) & 0xFFFFFFFF;
+
+    return (unsigned)h;
+}
+
+static int netClientEquals(const NET_Client *client, const S_Addr *addr, unsigned short port)
+{
     unsigned j;
     unsigned addr_len;
-    S_Udp *sock;
+
+    if (client->port != port || client->addr.af != addr->af)
+        return 0;
+
+    addr_len = netAddrLength(addr);
+    for (j = 0; j < addr_len; j++)
+    {
+        if (client->addr.data[j] != addr->data[j])
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Backward shift deletion keeps probe sequences intact without tombstones. */
+static void netRemoveClient(unsigned i)
+{
+    unsigned j;
+    unsigned home;
+    const unsigned mask = NET_MAX_CLIENTS - 1;
+
+    Assert(net_state.clients[i].last_seen != 0);
+
+    for (j = (i + 1) & mask; net_state.clients[j].last_seen != 0; j = (j + 1) & mask)
+    {
+        home = net_state.clients[j].hash & mask;
+
+        /* move j into the hole at i, if i lies cyclically in [home, j) */
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            net_state.clients[i] = net_state.clients[j];
+            i = j;
+        }
+    }
+
+    net_state.clients[i].last_seen = 0;
+    net_state.n_clients--;
+}
+
+static void netExpireClients(PL_time_t now)
+{
+    unsigned i;
     NET_Client *client;
 
-    sock = &net_state.udp_main;
-    client = &net_state.clients[0];
+    net_state.last_sweep = now;
 
-    for (i = 0; i < net_state.n_clients; i++, client++)
+    for (i = 0; i < NET_MAX_CLIENTS && net_state.n_clients;)
     {
-        if (sock->peer_port == client->port && sock->peer_addr.af == client->addr.af)
+        client = &net_state.clients[i];
+        if (client->last_seen != 0 && client->last_seen + NET_CLIENT_TTL < now)
         {
-            addr_len = (client->addr.af == S_AF_IPV4) ? 4 : 16;
-            for (j = 0; j < addr_len; j++)
-            {
-                if (sock->peer_addr.data[j] != client->addr.data[j])
-                    break;
-            }
+            netRemoveClient(i); /* a later entry may move into slot i, check again */
+            continue;
+        }
+        i++;
+    }
+}
 
-            if (j == addr_len)
-            {
-                // already known TODO refresh ttl
-                return (int)i;
-            }
+static void netEvictOldestClient(void)
+{
+    unsigned i;
+    unsigned oldest;
+
+    oldest = NET_MAX_CLIENTS;
+    for (i = 0; i < NET_MAX_CLIENTS; i++)
+    {
+        if (net_state.clients[i].last_seen == 0)
+            continue;
+
+        if (oldest == NET_MAX_CLIENTS || net_state.clients[i].last_seen < net_state.clients[oldest].last_seen)
+            oldest = i;
+    }
+
+    if (oldest == NET_MAX_CLIENTS)
+        return;
+
+    PL_Printf(DBG_DEBUG, "NET client table full, evict oldest client\n");
+    netRemoveClient(oldest);
+}
+
+/*! Looks up the peer \p addr, \p port and refreshes its TTL, unknown peers are added.
+    \returns the client id which is valid until the next NET_Step().
+ */
+static int netLookupClient(const S_Addr *addr, unsigned short port)
+{
+    unsigned i;
+    unsigned hash;
+    PL_time_t now;
+    NET_Client *client;
+    const unsigned mask = NET_MAX_CLIENTS - 1;
+
+    now = PL_Time();
+    if (now == 0)
+        now = 1; /* 0 marks free slots */
+
+    hash = netHash(addr, port);
+
+    for (i = hash & mask; net_state.clients[i].last_seen != 0; i = (i + 1) & mask)
+    {
+        client = &net_state.clients[i];
+        if (client->hash == hash && netClientEquals(client, addr, port))
+        {
+            client->last_seen = now;
+            return (int)i;
         }
     }
 
-    if (net_state.n_clients < MAX_NET_CLIENTS)
+    /* new client, keep the load factor <= 3/4 for short probe sequences */
+    if (net_state.n_clients >= (NET_MAX_CLIENTS / 4) * 3)
+    {
+        netExpireClients(now);
+
+        if (net_state.n_clients >= (NET_MAX_CLIENTS / 4) * 3)
+            netEvictOldestClient();
+    }
+
+    for (i = hash & mask; net_state.clients[i].last_seen != 0; i = (i + 1) & mask)
     {
-        client = &net_state.clients[net_state.n_clients];
-        client->port = sock->peer_port;
-        U_memcpy(&client->addr, &sock->peer_addr, sizeof(sock->peer_addr));
-        net_state.n_clients++;
-        return (int)net_state.n_clients - 1;
     }
+
+    client = &net_state.clients[i];
+    client->port = port;
+    client->flags = 0;
+    client->hash = hash;
+    client->last_seen = now;
+    U_memcpy(&client->addr, addr, sizeof(*addr));
+    net_state.n_clients++;
+
+    return (int)i;
+}
+
+int NET_MetricsOpen(const char *path, unsigned short port)
+{
+    if (net_state.metrics.state == S_STREAM_STATE_OPEN)
+        return 1; /* the command line is parsed again on retries */
+
+    SOCK_Init();
+    return SOCK_StreamListen(&net_state.metrics, path, port);
+}
+
+unsigned NET_MetricsHandles(int *handles, unsigned *writing, unsigned max)
+{
+    unsigned i;
+    unsigned n;
+    NET_MetricsClient *cl;
+
+    *writing = 0;
+    if (net_state.metrics.state != S_STREAM_STATE_OPEN || max == 0)
+        return 0;
+
+    handles[0] = (int)net_state.metrics.handle;
+    n = 1;
+
+    for (i = 0; i < NET_METRICS_MAX_CLIENTS && n < max; i++)
+    {
+        cl = &net_state.metrics_clients[i];
+        if (cl->sock.state != S_STREAM_STATE_OPEN)
+            continue;
+
+        if (cl->sending)
+            *writing |= 1U << n;
+        handles[n] = (int)cl->sock.handle;
+        n++;
+    }
+
+    return n;
+}
+
+static void netMetricsClose(NET_MetricsClient *cl)
+{
+    SOCK_StreamFree(&cl->sock);
+    cl->len = 0;
+    cl->pos = 0;
+    cl->sending = 0;
+}
+
+/* Puts the response to the request in cl->buf. The body is written behind
+   the space reserved for the header, the header is placed right before it. */
+static void netMetricsRespond(NET_MetricsClient *cl)
+{
+    unsigned len;
+    const char *status;
+    U_SStream ss;
+    char hdr[NET_METRICS_HEADER_SIZE];
+
+    U_sstream_init(&ss, &cl->buf[0], cl->len);
+
+    len = 0;
+    status = "200 OK";
+    if (!U_sstream_starts_with(&ss, "GET "))
+        status = "405 Method Not Allowed";
+    else if (!U_sstream_starts_with(&ss, "GET /metrics") && !U_sstream_starts_with(&ss, "GET / "))
+        status = "404 Not Found";
     else
+        len = NET_Metrics(&cl->buf[NET_METRICS_HEADER_SIZE], NET_METRICS_BUF_SIZE - NET_METRICS_HEADER_SIZE);
+
+    if (len == 0)
     {
-        /* clients exhausted (send error to last client?) */
+        if (status[0] == '2')
+            status = "500 Internal Server Error";
+
+        U_sstream_init(&ss, &cl->buf[NET_METRICS_HEADER_SIZE], NET_METRICS_BUF_SIZE - NET_METRICS_HEADER_SIZE);
+        U_sstream_put_str(&ss, status);
+        U_sstream_put_str(&ss, "\n");
+        len = U_sstream_pos(&ss);
     }
 
-    return -1;
+    U_sstream_init(&ss, &hdr[0], sizeof(hdr));
+    U_sstream_put_str(&ss, "HTTP/1.0 ");
+    U_sstream_put_str(&ss, status);
+    U_sstream_put_str(&ss, "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: ");
+    U_sstream_put_long(&ss, (long)len);
+    U_sstream_put_str(&ss, "\r\nConnection: close\r\n\r\n");
+    Assert(ss.status == U_SSTREAM_OK);
+
+    cl->pos = NET_METRICS_HEADER_SIZE - U_sstream_pos(&ss);
+    cl->len = NET_METRICS_HEADER_SIZE + len;
+    U_memcpy(&cl->buf[cl->pos], &hdr[0], U_sstream_pos(&ss));
+    cl->sending = 1;
+}
+
+static int netMetricsRequestDone(NET_MetricsClient *cl)
+{
+    unsigned i;
+
+    for (i = 1; i < cl->len; i++)
+    {
+        if (cl->buf[i] == '\n' && (cl->buf[i - 1] == '\n' || (i > 2 && cl->buf[i - 1] == '\r' && cl->buf[i - 2] == '\n')))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Closes clients which didn't finish within NET_METRICS_CLIENT_TTL, also
+   those which went silent and never make their socket readable again. */
+static void netMetricsExpire(PL_time_t now)
+{
+    unsigned i;
+    NET_MetricsClient *cl;
+
+    for (i = 0; i < NET_METRICS_MAX_CLIENTS; i++)
+    {
+        cl = &net_state.metrics_clients[i];
+        if (cl->sock.state == S_STREAM_STATE_OPEN && cl->accepted + NET_METRICS_CLIENT_TTL < now)
+            netMetricsClose(cl);
+    }
+}
+
+static void netMetricsStep(PL_time_t now)
+{
+    int n;
+    unsigned i;
+    S_Stream sock;
+    NET_MetricsClient *cl;
+    NET_MetricsClient *oldest;
+
+    if (net_state.metrics.state != S_STREAM_STATE_OPEN)
+        return;
+
+    for (i = 0; i < NET_METRICS_MAX_CLIENTS; i++)
+    {
+        cl = &net_state.metrics_clients[i];
+        if (cl->sock.state != S_STREAM_STATE_OPEN)
+            continue;
+
+        if (!cl->sending)
+        {
+            n = SOCK_StreamRecv(&cl->sock, (unsigned char*)&cl->buf[cl->len], NET_METRICS_REQUEST_SIZE - cl->len);
+            if (n < 0)
+            {
+                netMetricsClose(cl);
+                continue;
+            }
+
+            cl->len += (unsigned)n;
+            if (netMetricsRequestDone(cl))
+            {
+                netMetricsRespond(cl);
+            }
+            else if (cl->len == NET_METRICS_REQUEST_SIZE)
+            {
+                netMetricsClose(cl);
+                continue;
+            }
+        }
+
+        if (cl->sending)
+        {
+            n = SOCK_StreamSend(&cl->sock, (unsigned char*)&cl->buf[cl->pos], cl->len - cl->pos);
+            if (n > 0)
+                cl->pos += (unsigned)n;
+
+            if (n < 0 || cl->pos == cl->len)
+            {
+                netMetricsClose(cl);
+                continue;
+            }
+        }
+
+    }
+
+    netMetricsExpire(now);
+
+    for (;;)
+    {
+        if (SOCK_StreamAccept(&net_state.metrics, &sock) != 1)
+            break;
+
+        oldest = 0;
+        for (i = 0; i < NET_METRICS_MAX_CLIENTS; i++)
+        {
+            cl = &net_state.metrics_clients[i];
+            if (cl->sock.state != S_STREAM_STATE_OPEN)
+                break;
+            if (!oldest || cl->accepted < oldest->accepted)
+                oldest = cl;
+        }
+
+        /* a full table evicts the oldest client, scrapes are short */
+        if (i == NET_METRICS_MAX_CLIENTS)
+        {
+            cl = oldest;
+            netMetricsClose(cl);
+        }
+
+        cl->sock = sock;
+        cl->accepted = now;
+    }
 }
 
 int NET_Step(void)
@@ -111,23 +484,235 @@ int NET_Step(void)
      */
 
     int n;
+    int i;
     int client_id;
+    PL_time_t now;
+    S_UdpMsg *msg;
+    S_UdpBatch *batch;
+    char abuf[64];
+
+    batch = &net_state.rx_batch;
+
+    now = PL_Time();
+    netMetricsStep(now);
+
+    if (net_state.n_clients && net_state.last_sweep + NET_CLIENT_SWEEP_INTERVAL < now)
+    {
+        netExpireClients(now);
+    }
+
+    /* The socket is non-blocking, drain what is queued but limit the
+       number of batches so serial I/O isn't starved by a flood of datagrams. */
+    for (i = 0; i < MAX_NET_BATCHES_PER_STEP; i++)
+    {
+        n = SOCK_UdpRecvBatch(&net_state.udp_main, batch);
+        if (n <= 0)
+            break;
+
+        for (msg = &batch->msg[0]; msg < &batch->msg[batch->count]; msg++)
+        {
+            if (net_state.log_peers && SOCK_AddrToString(&msg->peer_addr, msg->peer_port, abuf, sizeof(abuf)))
+            {
+                PL_Printf(DBG_DEBUG, "UDP peer %s\n", abuf);
+            }
+
+            client_id = netLookupClient(&msg->peer_addr, msg->peer_port);
+            NET_Received(client_id, msg->data, msg->len);
+        }
+
+        if (batch->count < S_UDP_BATCH_SIZE)
+            break;
+    }
+
+    NET_Flush();
+
+    return 1;
+}
+
+static unsigned char *netTxAlloc(unsigned nmsg, const unsigned char *buf, unsigned bufsize)
+{
+    unsigned char *data;
+    S_UdpBatch *batch;
+
+    batch = &net_state.tx_batch;
+
+    if (batch->count + nmsg > S_UDP_BATCH_SIZE || net_state.tx_slab_used == S_UDP_BATCH_SIZE)
+        NET_Flush();
 
-    n = SOCK_UdpRecv(&net_state.udp_main, net_state.rx_buf, sizeof(net_state.rx_buf) - 1);
-    if (n > 0)
+    data = &batch->slab[net_state.tx_slab_used][0];
+    net_state.tx_slab_used++;
+    U_memcpy(data, buf, bufsize);
+
+    return data;
+}
+
+static void netTxAppend(const NET_Client *client, unsigned char *data, unsigned bufsize)
+{
+    S_UdpMsg *msg;
+    S_UdpBatch *batch;
+
+    batch = &net_state.tx_batch;
+    Assert(batch->count < S_UDP_BATCH_SIZE);
+
+    msg = &batch->msg[batch->count];
+    msg->data = data;
+    msg->len = (unsigned short)bufsize;
+    msg->peer_port = client->port;
+    U_memcpy(&msg->peer_addr, &client->addr, sizeof(msg->peer_addr));
+    batch->count++;
+}
+
+int NET_Send(int client_id, const unsigned char *buf, unsigned bufsize)
+{
+    unsigned char *data;
+
+    if (client_id < 0 || client_id >= NET_MAX_CLIENTS || net_state.clients[client_id].last_seen == 0)
+        return 0;
+
+    if (bufsize == 0 || bufsize > S_UDP_MAX_PKG_SIZE)
+        return 0;
+
+    data = netTxAlloc(1, buf, bufsize);
+    netTxAppend(&net_state.clients[client_id], data, bufsize);
+
+    return 1;
+}
+
+int NET_Peer(const char *addr, unsigned short port)
+{
+    S_Addr a;
+    unsigned short nport;
+    unsigned char be[2];
+
+    if (net_state.udp_main.state != S_UDP_STATE_OPEN)
+        return -1;
+
+    if (SOCK_AddrFromString(&a, addr) != 1)
+        return -1;
+
+    /* the sockets layer keeps ports in network byte order */
+    be[0] = (unsigned char)(port >> 8);
+    be[1] = (unsigned char)(port & 0xFF);
+    U_memcpy(&nport, &be[0], sizeof(nport));
+
+    return netLookupClient(&a, nport);
+}
+
+int NET_JoinGroup(const char *maddr)
+{
+    return SOCK_UdpJoinMulticast(&net_state.udp_main, maddr) == 0;
+}
+
+int NET_PeerAddress(int client_id, char *buf, unsigned bufsize)
+{
+    U_SStream ss;
+    NET_Client *client;
+    const unsigned char *nport;
+    char abuf[48];
+
+    if (client_id < 0 || client_id >= NET_MAX_CLIENTS || net_state.clients[client_id].last_seen == 0)
+        return 0;
+
+    client = &net_state.clients[client_id];
+    if (SOCK_AddrToString(&client->addr, 0, abuf, sizeof(abuf)) != 1)
+        return 0;
+
+    U_sstream_init(&ss, buf, bufsize);
+    if (client->addr.af == S_AF_IPV6)
     {
-        client_id = netCheckNewClient();
-        net_state.rx_buf[n] = '\0';
-        NET_Received(client_id, net_state.rx_buf, (unsigned)n);
+        U_sstream_put_str(&ss, "[");
+        U_sstream_put_str(&ss, abuf);
+        U_sstream_put_str(&ss, "]:");
     }
+    else
+    {
+        U_sstream_put_str(&ss, abuf);
+        U_sstream_put_str(&ss, ":");
+    }
+    /* port is kept in network byte order */
+    nport = (const unsigned char*)&client->port;
+    U_sstream_put_long(&ss, (long)nport[0] << 8 | nport[1]);
+
+    return ss.status == U_SSTREAM_OK;
+}
+
+int NET_Subscribe(int client_id)
+{
+    if (client_id < 0 || client_id >= NET_MAX_CLIENTS || net_state.clients[client_id].last_seen == 0)
+        return 0;
 
+    net_state.clients[client_id].flags |= NET_CLIENT_FLAG_SUBSCRIBED;
     return 1;
 }
 
+int NET_Broadcast(const unsigned char *buf, unsigned bufsize)
+{
+    unsigned i;
+    unsigned n;
+    unsigned char *data;
+    NET_Client *client;
+
+    if (net_state.n_clients == 0 || bufsize == 0 || bufsize > S_UDP_MAX_PKG_SIZE)
+        return 0;
+
+    data = 0;
+    n = 0;
+    client = &net_state.clients[0];
+
+    for (i = 0; i < NET_MAX_CLIENTS; i++, client++)
+    {
+        if (client->last_seen == 0 || (client->flags & NET_CLIENT_FLAG_SUBSCRIBED) == 0)
+            continue;
+
+        /* the payload is copied once and referenced by all messages */
+        if (!data || net_state.tx_batch.count == S_UDP_BATCH_SIZE)
+            data = netTxAlloc(1, buf, bufsize);
+
+        netTxAppend(client, data, bufsize);
+        n++;
+    }
+
+    return (int)n;
+}
+
+void NET_Flush(void)
+{
+    if (net_state.tx_batch.count)
+        SOCK_UdpSendBatch(&net_state.udp_main, &net_state.tx_batch);
+
+    net_state.tx_batch.count = 0;
+    net_state.tx_slab_used = 0;
+
+    /* called each loop iteration, idle clients expire without net traffic */
+    if (net_state.metrics.state == S_STREAM_STATE_OPEN)
+        netMetricsExpire(PL_Time());
+}
+
+void NET_SetLogPeers(int enable)
+{
+    net_state.log_peers = enable;
+}
+
+int NET_Handle(void)
+{
+    if (net_state.udp_main.state != S_UDP_STATE_OPEN)
+        return -1;
+
+    return (int)net_state.udp_main.handle;
+}
+
 void NET_Exit(void)
 {
+    unsigned i;
+
+    NET_Flush();
     net_state.n_clients = 0;
+    U_bzero(&net_state.clients[0], sizeof(net_state.clients));
     SOCK_UdpFree(&net_state.udp_main);
+
+    for (i = 0; i < NET_METRICS_MAX_CLIENTS; i++)
+        netMetricsClose(&net_state.metrics_clients[i]);
+    SOCK_StreamFree(&net_state.metrics);
 }
 
 #else
@@ -143,6 +728,77 @@ int NET_Step(void)
     return 0;
 }
 
+int NET_Handle(void)
+{
+    return -1;
+}
+
+int NET_Send(int client_id, const unsigned char *buf, unsigned bufsize)
+{
+    (void)client_id;
+    (void)buf;
+    (void)bufsize;
+    return 0;
+}
+
+int NET_Peer(const char *addr, unsigned short port)
+{
+    (void)addr;
+    (void)port;
+    return -1;
+}
+
+int NET_Subscribe(int client_id)
+{
+    (void)client_id;
+    return 0;
+}
+
+int NET_Broadcast(const unsigned char *buf, unsigned bufsize)
+{
+    (void)buf;
+    (void)bufsize;
+    return 0;
+}
+
+void NET_Flush(void)
+{
+}
+
+int NET_JoinGroup(const char *maddr)
+{
+    (void)maddr;
+    return 0;
+}
+
+int NET_PeerAddress(int client_id, char *buf, unsigned bufsize)
+{
+    (void)client_id;
+    (void)buf;
+    (void)bufsize;
+    return 0;
+}
+
+void NET_SetLogPeers(int enable)
+{
+    (void)enable;
+}
+
+int NET_MetricsOpen(const char *path, unsigned short port)
+{
+    (void)path;
+    (void)port;
+    return 0;
+}
+
+unsigned NET_MetricsHandles(int *handles, unsigned *writing, unsigned max)
+{
+    (void)handles;
+    (void)max;
+    *writing = 0;
+    return 0;
+}
+
 void NET_Exit(void)
 {
 }
@@ -15,7 +15,73 @@ int NET_Init(const char *interface, unsigned short port);
 int NET_Step(void);
 void NET_Exit(void);
 
-/* callback implemented in gcf.c */
+/*! Returns the socket handle which the platform layer adds to its main
+    readiness set, or -1 when networking isn't active.
+
+    When the handle becomes readable the platform generates \c EV_NET_READY.
+ */
+int NET_Handle(void);
+
+/*! Queues a datagram for \p client_id, the queue is sent in one batch
+    by NET_Flush() or when it is full.
+ */
+int NET_Send(int client_id, const unsigned char *buf, unsigned bufsize);
+
+/*! Sends the queued datagrams and expires idle metrics clients,
+    runs at least once per main loop iteration (EV_PL_LOOP).
+ */
+void NET_Flush(void);
+
+/*! Returns the client id of the peer with numeric address \p addr and \p port,
+    the peer is added to the client table if needed. Returns -1 on error.
+ */
+int NET_Peer(const char *addr, unsigned short port);
+
+/*! Marks \p client_id to receive datagrams queued by NET_Broadcast(). */
+int NET_Subscribe(int client_id);
+
+/*! Queues \p buf for all subscribed clients.
+    \returns the number of clients the datagram was queued for.
+ */
+int NET_Broadcast(const unsigned char *buf, unsigned bufsize);
+
+/*! Joins the IPv4 multicast group \p maddr on the listen socket.
+    Datagrams sent to the group and the listen port are received like unicast ones.
+ */
+int NET_JoinGroup(const char *maddr);
+
+/*! Writes the address of \p client_id as "address:port" to \p buf.
+    \returns 1 on success, 0 if the client doesn't exist or \p buf is too small.
+ */
+int NET_PeerAddress(int client_id, char *buf, unsigned bufsize);
+
+/*! Enables logging of each received datagram's peer address (off by default). */
+void NET_SetLogPeers(int enable);
+
+/*! Opens the metrics listener on 127.0.0.1 \p port, or on the Unix domain
+    socket \p path if \p port is 0. Scrapes are answered by NET_Step() with
+    the text written by NET_Metrics(). Returns 1 if the listener is open.
+ */
+int NET_MetricsOpen(const char *path, unsigned short port);
+
+/*! Writes up to \p max handles of the metrics listener and its clients to
+    \p handles, which the platform layer adds to its main readiness set.
+    Bit i of \p writing is set if handles[i] waits to send the rest of a
+    response. When a handle becomes ready the platform generates \c EV_NET_READY.
+    \returns the number of handles.
+ */
+unsigned NET_MetricsHandles(int *handles, unsigned *writing, unsigned max);
+
+/*! Callback implemented in gcf_metrics.c, writes the metrics in Prometheus text
+    format to \p buf. Returns the length, or 0 if \p buf is too small.
+ */
+unsigned NET_Metrics(char *buf, unsigned bufsize);
+
+/*! Callback implemented in gcf.c.
+
+    The \p client_id is only valid until the next NET_Step(), since idle
+    clients expire and the client table may reorder entries.
+ */
 void NET_Received(int client_id, const unsigned char *buf, unsigned bufsize);
 
 #endif /* NET_H */
@@ -5,6 +5,8 @@
 #define S_AF_IPV4  4
 #define S_AF_IPV6  6
 #define S_UDP_MAX_PKG_SIZE 1280
+#define S_UDP_BATCH_SIZE 16
+#define S_STREAM_MAX_PATH 104 /* smallest sun_path, macOS */
 
 typedef int S_Handle;
 
@@ -21,6 +23,12 @@ typedef struct S_Addr
     unsigned  char af;
 } S_Addr;
 
+typedef enum S_StreamState
+{
+    S_STREAM_STATE_INIT = 0,
+    S_STREAM_STATE_OPEN = 1
+} S_StreamState;
+
 typedef struct S_Udp
 {
     S_Addr addr;
@@ -31,6 +39,42 @@ typedef struct S_Udp
     unsigned short port;
 } S_Udp;
 
+/* A stream socket, either listening or accepted.
+   Listeners are bound to loopback TCP or to a Unix domain socket path,
+   which is removed again by SOCK_StreamFree().
+ */
+typedef struct S_Stream
+{
+    S_Handle handle;
+    S_StreamState state;
+    char path[S_STREAM_MAX_PATH];
+} S_Stream;
+
+/* A single datagram in a S_UdpBatch.
+   The port is kept in network byte order, same as S_Udp.peer_port.
+ */
+typedef struct S_UdpMsg
+{
+    S_Addr peer_addr;
+    unsigned short peer_port;
+    unsigned short len;
+    unsigned char *data;
+} S_UdpMsg;
+
+/* Preallocated datagram slab to receive or send up to S_UDP_BATCH_SIZE
+   datagrams with a single system call where supported (recvmmsg/sendmmsg).
+
+   For receiving msg[i].data points into slab[i] and is '\0' terminated.
+   For sending msg[i].data may point to slab[i] or to any caller owned buffer
+   which stays valid until SOCK_UdpSendBatch() returns.
+ */
+typedef struct S_UdpBatch
+{
+    unsigned count;
+    S_UdpMsg msg[S_UDP_BATCH_SIZE];
+    unsigned char slab[S_UDP_BATCH_SIZE][S_UDP_MAX_PKG_SIZE + 1];
+} S_UdpBatch;
+
 int SOCK_Init();
 void SOCK_Free();
 
@@ -38,6 +82,47 @@ int SOCK_UdpInit(S_Udp *udp, int af);
 int SOCK_UdpBind(S_Udp *udp, unsigned short port);
 int SOCK_UdpJoinMulticast(S_Udp *udp, const char *maddr);
 int SOCK_UdpRecv(S_Udp *udp, unsigned char *buf, unsigned bufsize);
+int SOCK_UdpSend(S_Udp *udp, const S_Addr *addr, unsigned short port, const unsigned char *buf, unsigned len);
+
+/*! Receives up to S_UDP_BATCH_SIZE datagrams without blocking.
+    \returns number of datagrams in \p batch, or -1 on error.
+ */
+int SOCK_UdpRecvBatch(S_Udp *udp, S_UdpBatch *batch);
+
+/*! Sends batch->count datagrams.
+    \returns number of datagrams sent, or -1 on error.
+ */
+int SOCK_UdpSendBatch(S_Udp *udp, S_UdpBatch *batch);
+
+/*! Parses a numeric IPv4 or IPv6 address. \returns 1 on success. */
+int SOCK_AddrFromString(S_Addr *addr, const char *str);
+
+/*! Formats \p addr and \p port (network byte order) as "addr port: N",
+    or only the address if \p port is 0.
+ */
+int SOCK_AddrToString(const S_Addr *addr, unsigned short port, char *buf, unsigned bufsize);
 void SOCK_UdpFree(S_Udp *udp);
 
+/*! Listens on 127.0.0.1 \p port, or on the Unix domain socket \p path if
+    \p port is 0. A stale socket at \p path is replaced, other files are not.
+    \returns 1 on success.
+ */
+int SOCK_StreamListen(S_Stream *stream, const char *path, unsigned short port);
+
+/*! Accepts a pending connection on \p listener without blocking.
+    \returns 1 if \p client was accepted, 0 if none is pending, -1 on error.
+ */
+int SOCK_StreamAccept(S_Stream *listener, S_Stream *client);
+
+/*! Receives without blocking.
+    \returns the number of bytes, 0 if nothing is queued, -1 if closed or on error.
+ */
+int SOCK_StreamRecv(S_Stream *stream, unsigned char *buf, unsigned bufsize);
+
+/*! Sends without blocking.
+    \returns the number of bytes sent, 0 if the socket buffer is full, -1 on error.
+ */
+int SOCK_StreamSend(S_Stream *stream, const unsigned char *buf, unsigned len);
+void SOCK_StreamFree(S_Stream *stream);
+
 #endif /* NET_SOCK_H */
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2021-2023 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Stream sockets for local listeners like the metrics endpoint.
+
+   All sockets are non-blocking, they are polled in the platform main loop
+   next to the serial ports and must never stall it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "u_mem.h"
+#include "u_strlen.h"
+#include "net_sock.h"
+
+#ifdef MSG_NOSIGNAL
+  #define S_SEND_FLAGS MSG_NOSIGNAL
+#else
+  #define S_SEND_FLAGS 0 /* macOS, SO_NOSIGPIPE is set per socket */
+#endif
+
+static int sockStreamSetup(int fd)
+{
+#ifdef SO_NOSIGPIPE
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != -1 &&
+           fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+int SOCK_StreamListen(S_Stream *stream, const char *path, unsigned short port)
+{
+    int fd;
+    int yes = 1;
+    unsigned len;
+    struct stat st;
+    struct sockaddr_in addr;
+    struct sockaddr_un addr_un;
+
+    U_bzero(stream, sizeof(*stream));
+    stream->state = S_STREAM_STATE_INIT;
+
+    if (port != 0)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1)
+            return 0;
+
+        U_bzero(&addr, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char*)&yes, sizeof(yes)) < 0 ||
+            bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+            goto err;
+    }
+    else
+    {
+        len = U_strlen(path);
+        if (len == 0 || len >= sizeof(stream->path) || len >= sizeof(addr_un.sun_path))
+            return 0;
+
+        /* remove a stale socket of a previous run, but nothing else */
+        if (lstat(path, &st) == 0)
+        {
+            if (!S_ISSOCK(st.st_mode))
+            {
+                fprintf(stderr, "socket path exists: %s\n", path);
+                return 0;
+            }
+            unlink(path);
+        }
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return 0;
+
+        U_bzero(&addr_un, sizeof(addr_un));
+        addr_un.sun_family = AF_UNIX;
+        U_memcpy(&addr_un.sun_path[0], path, len + 1);
+
+        if (bind(fd, (struct sockaddr*)&addr_un, sizeof(addr_un)) == -1)
+            goto err;
+
+        U_memcpy(&stream->path[0], path, len + 1);
+    }
+
+    if (!sockStreamSetup(fd) || listen(fd, 4) == -1)
+        goto err;
+
+    stream->handle = fd;
+    stream->state = S_STREAM_STATE_OPEN;
+
+    return 1;
+
+err:
+    if (port != 0)
+        fprintf(stderr, "listen on port %u failed: %s\n", (unsigned)port, strerror(errno));
+    else
+        fprintf(stderr, "listen on %s failed: %s\n", path, strerror(errno));
+    close(fd);
+    if (stream->path[0] != '\0')
+        unlink(stream->path);
+    stream->path[0] = '\0';
+    return 0;
+}
+
+int SOCK_StreamAccept(S_Stream *listener, S_Stream *client)
+{
+    int fd;
+
+    if (listener->state != S_STREAM_STATE_OPEN)
+        return -1;
+
+    fd = accept(listener->handle, 0, 0);
+    if (fd == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+            return 0;
+        return -1;
+    }
+
+    if (!sockStreamSetup(fd))
+    {
+        close(fd);
+        return 0;
+    }
+
+    U_bzero(client, sizeof(*client));
+    client->handle = fd;
+    client->state = S_STREAM_STATE_OPEN;
+
+    return 1;
+}
+
+int SOCK_StreamRecv(S_Stream *stream, unsigned char *buf, unsigned bufsize)
+{
+    ssize_t n;
+
+    if (stream->state != S_STREAM_STATE_OPEN)
+        return -1;
+
+    n = recv(stream->handle, buf, bufsize, 0);
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        return -1;
+    }
+
+    if (n == 0) /* closed by peer */
+        return -1;
+
+    return (int)n;
+}
+
+int SOCK_StreamSend(S_Stream *stream, const unsigned char *buf, unsigned len)
+{
+    ssize_t n;
+
+    if (stream->state != S_STREAM_STATE_OPEN)
+        return -1;
+
+    n = send(stream->handle, buf, len, S_SEND_FLAGS);
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        return -1;
+    }
+
+    return (int)n;
+}
+
+void SOCK_StreamFree(S_Stream *stream)
+{
+    if (stream->state == S_STREAM_STATE_OPEN)
+        close(stream->handle);
+
+    if (stream->path[0] != '\0')
+        unlink(stream->path);
+
+    U_bzero(stream, sizeof(*stream));
+    stream->state = S_STREAM_STATE_INIT;
+}
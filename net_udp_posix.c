@@ -16,13 +16,70 @@
 #include <unistd.h>
 
 #include "u_mem.h"
+#include "u_sstream.h"
 #include "net_sock.h"
 
+#if defined(__linux__) || defined(__FreeBSD__)
+  #define S_HAS_MMSG
+#endif
+
+static int sockFromSockaddr(const struct sockaddr_storage *ss, S_Addr *addr, unsigned short *port)
+{
+    const struct sockaddr_in *sa4;
+    const struct sockaddr_in6 *sa6;
+
+    if (ss->ss_family == AF_INET6)
+    {
+        sa6 = (const struct sockaddr_in6*)ss;
+        addr->af = S_AF_IPV6;
+        *port = sa6->sin6_port;
+        U_memcpy(&addr->data[0], &sa6->sin6_addr.s6_addr[0], 16);
+        return 1;
+    }
+    else if (ss->ss_family == AF_INET)
+    {
+        sa4 = (const struct sockaddr_in*)ss;
+        addr->af = S_AF_IPV4;
+        *port = sa4->sin_port;
+        U_memcpy(&addr->data[0], &sa4->sin_addr.s_addr, 4);
+        return 1;
+    }
+
+    return 0;
+}
+
+static socklen_t sockToSockaddr(const S_Addr *addr, unsigned short port, struct sockaddr_storage *ss)
+{
+    struct sockaddr_in *sa4;
+    struct sockaddr_in6 *sa6;
+
+    U_bzero(ss, sizeof(*ss));
+
+    if (addr->af == S_AF_IPV6)
+    {
+        sa6 = (struct sockaddr_in6*)ss;
+        sa6->sin6_family = AF_INET6;
+        sa6->sin6_port = port;
+        U_memcpy(&sa6->sin6_addr.s6_addr[0], &addr->data[0], 16);
+        return sizeof(*sa6);
+    }
+    else if (addr->af == S_AF_IPV4)
+    {
+        sa4 = (struct sockaddr_in*)ss;
+        sa4->sin_family = AF_INET;
+        sa4->sin_port = port;
+        U_memcpy(&sa4->sin_addr.s_addr, &addr->data[0], 4);
+        return sizeof(*sa4);
+    }
+
+    return 0;
+}
+
 int SOCK_UdpInit(S_Udp *udp, int af)
 {
     U_bzero(udp, sizeof(*udp));
     udp->state = S_UDP_STATE_INIT;
-    udp->addr.af = af;
+    udp->addr.af = (unsigned char)af;
 
     if      (af == S_AF_IPV4) af = AF_INET;
     else if (af == S_AF_IPV6) af = AF_INET6;
@@ -37,6 +94,14 @@ int SOCK_UdpInit(S_Udp *udp, int af)
     if (udp->handle == -1)
         return 0;
 
+    /* the handle is polled in the platform main loop, reads must never block */
+    if (fcntl(udp->handle, F_SETFL, fcntl(udp->handle, F_GETFL, 0) | O_NONBLOCK) == -1)
+    {
+        close(udp->handle);
+        udp->handle = 0;
+        return 0;
+    }
+
     udp->state = S_UDP_STATE_OPEN;
 
     return 1;
@@ -62,7 +127,7 @@ int SOCK_UdpBind(S_Udp *udp, unsigned short port)
     {
         U_bzero(&addr, sizeof(addr));
         addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        U_memcpy(&addr.sin_addr.s_addr, &udp->addr.data[0], 4); /* all zero for any interface */
         addr.sin_port = htons(port);
         ret = bind(udp->handle, (struct sockaddr*) &addr, sizeof(addr));
 
@@ -76,7 +141,7 @@ int SOCK_UdpBind(S_Udp *udp, unsigned short port)
     {
         U_bzero(&addr6, sizeof(addr6));
         addr6.sin6_family = AF_INET6;
-        addr6.sin6_addr = in6addr_any;
+        U_memcpy(&addr6.sin6_addr.s6_addr[0], &udp->addr.data[0], 16);
         addr6.sin6_port = htons(port);
         ret = bind(udp->handle, (struct sockaddr*) &addr6, sizeof(addr6));
 
@@ -125,74 +190,269 @@ int SOCK_UdpJoinMulticast(S_Udp *udp, const char *maddr)
     }
 
 err:
-    udp->state = S_UDP_STATE_ERROR;
+    /* the socket stays usable for unicast, e.g. on hosts without multicast route */
     return -1;
 }
 
 int SOCK_UdpRecv(S_Udp *udp, unsigned char *buf, unsigned bufsize)
 {
     ssize_t n;
-    fd_set readfds;
-    struct timeval tv;
     socklen_t addr_len;
-    struct sockaddr_in *sa4;
-    struct sockaddr_in6 *sa6;
     struct sockaddr_storage addr;
-    char abuf[INET6_ADDRSTRLEN];
 
     if (udp->state != S_UDP_STATE_OPEN)
         return -1;
 
-    /* TODO non blocking */
-    tv.tv_sec = 0;
-    tv.tv_usec = 5 * 1000; // 5 msec
-    FD_ZERO(&readfds);
-    FD_SET(udp->handle, &readfds);
-    // don't care about writefds and exceptfds:
-    select(udp->handle+1, &readfds, NULL, NULL, &tv);
-    if (FD_ISSET(udp->handle, &readfds))
+    addr_len = sizeof(addr);
+    n = recvfrom(udp->handle, buf, bufsize, 0, (struct sockaddr*)&addr, &addr_len);
+
+    if (n < 0)
     {
-        addr_len = sizeof(addr);
-        n = recvfrom(udp->handle, buf, bufsize, 0, (struct sockaddr*)&addr, &addr_len);
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
 
-        if (addr.ss_family == AF_INET6)
-        {
-            sa6 = (struct sockaddr_in6*)&addr;
-            udp->peer_addr.af = S_AF_IPV6;
-            udp->peer_port = sa6->sin6_port;
-            U_memcpy(&udp->peer_addr.data[0], &sa6->sin6_addr.s6_addr[0], 16);
-        }
-        else if (addr.ss_family == AF_INET)
+        fprintf(stderr, "UDP error %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (sockFromSockaddr(&addr, &udp->peer_addr, &udp->peer_port) == 0)
+        return -1;
+
+    if (n > 0 && n < (ssize_t)bufsize)
+    {
+        return (int)n;
+    }
+
+    return 0;
+}
+
+int SOCK_UdpSend(S_Udp *udp, const S_Addr *addr, unsigned short port, const unsigned char *buf, unsigned len)
+{
+    ssize_t n;
+    socklen_t addr_len;
+    struct sockaddr_storage ss;
+
+    if (udp->state != S_UDP_STATE_OPEN)
+        return -1;
+
+    addr_len = sockToSockaddr(addr, port, &ss);
+    if (addr_len == 0)
+        return -1;
+
+    n = sendto(udp->handle, buf, len, 0, (struct sockaddr*)&ss, addr_len);
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        return -1;
+    }
+
+    return (int)n;
+}
+
+#ifdef S_HAS_MMSG
+int SOCK_UdpRecvBatch(S_Udp *udp, S_UdpBatch *batch)
+{
+    int i;
+    int n;
+    S_UdpMsg *msg;
+    struct iovec iov[S_UDP_BATCH_SIZE];
+    struct mmsghdr hdr[S_UDP_BATCH_SIZE];
+    struct sockaddr_storage addr[S_UDP_BATCH_SIZE];
+
+    batch->count = 0;
+
+    if (udp->state != S_UDP_STATE_OPEN)
+        return -1;
+
+    for (i = 0; i < S_UDP_BATCH_SIZE; i++)
+    {
+        iov[i].iov_base = &batch->slab[i][0];
+        iov[i].iov_len = S_UDP_MAX_PKG_SIZE;
+        U_bzero(&hdr[i], sizeof(hdr[i]));
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+        hdr[i].msg_hdr.msg_name = &addr[i];
+        hdr[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+    }
+
+    n = recvmmsg(udp->handle, &hdr[0], S_UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+
+    if (n < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+
+        fprintf(stderr, "UDP error %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        msg = &batch->msg[batch->count];
+
+        if (hdr[i].msg_hdr.msg_flags & MSG_TRUNC)
+            continue;
+
+        if (sockFromSockaddr(&addr[i], &msg->peer_addr, &msg->peer_port) == 0)
+            continue;
+
+        msg->data = &batch->slab[i][0];
+        msg->len = (unsigned short)hdr[i].msg_len;
+        msg->data[msg->len] = '\0';
+        batch->count++;
+    }
+
+    return (int)batch->count;
+}
+
+int SOCK_UdpSendBatch(S_Udp *udp, S_UdpBatch *batch)
+{
+    int n;
+    unsigned i;
+    unsigned pos;
+    unsigned sent;
+    struct iovec iov[S_UDP_BATCH_SIZE];
+    struct mmsghdr hdr[S_UDP_BATCH_SIZE];
+    struct sockaddr_storage addr[S_UDP_BATCH_SIZE];
+
+    if (udp->state != S_UDP_STATE_OPEN)
+        return -1;
+
+    if (batch->count > S_UDP_BATCH_SIZE)
+        batch->count = S_UDP_BATCH_SIZE;
+
+    for (i = 0; i < batch->count; i++)
+    {
+        iov[i].iov_base = batch->msg[i].data;
+        iov[i].iov_len = batch->msg[i].len;
+        U_bzero(&hdr[i], sizeof(hdr[i]));
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+        hdr[i].msg_hdr.msg_name = &addr[i];
+        hdr[i].msg_hdr.msg_namelen = sockToSockaddr(&batch->msg[i].peer_addr, batch->msg[i].peer_port, &addr[i]);
+    }
+
+    for (pos = 0, sent = 0; pos < batch->count;)
+    {
+        n = sendmmsg(udp->handle, &hdr[pos], batch->count - pos, MSG_DONTWAIT);
+        if (n < 0)
         {
-            sa4 = (struct sockaddr_in*)&addr;
-            udp->peer_addr.af = S_AF_IPV4;
-            udp->peer_port = sa4->sin_port;
-            U_memcpy(&udp->peer_addr.data[0], &sa4->sin_addr.s_addr, 4);
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break; /* socket buffer full, UDP is lossy anyway, drop the rest */
+
+            /* the error belongs to the datagram at pos, e.g. an unreachable
+               peer, skip it so the remaining peers still get theirs */
+            pos++;
+            continue;
         }
-        else
+        else if (n == 0)
         {
-            return -1;
+            break;
         }
 
-        if (inet_ntop(addr.ss_family, (void*)&udp->peer_addr.data[0], &abuf[0], sizeof(abuf)))
-        {
-            fprintf(stderr, "UDP peer %s port: %u\n", &abuf[0], ntohs(udp->peer_port));
-        }
+        pos += (unsigned)n;
+        sent += (unsigned)n;
+    }
 
-        if (n > 0 && n < (ssize_t)bufsize)
-        {
-            return (int)n;
-        }
-        else if (n < 0)
+    batch->count = 0;
+
+    return (int)sent;
+}
+#else
+int SOCK_UdpRecvBatch(S_Udp *udp, S_UdpBatch *batch)
+{
+    int n;
+    S_UdpMsg *msg;
+
+    batch->count = 0;
+
+    while (batch->count < S_UDP_BATCH_SIZE)
+    {
+        msg = &batch->msg[batch->count];
+        n = SOCK_UdpRecv(udp, &batch->slab[batch->count][0], S_UDP_MAX_PKG_SIZE + 1);
+        if (n < 0)
+            return batch->count ? (int)batch->count : -1;
+        if (n == 0)
+            break;
+
+        msg->data = &batch->slab[batch->count][0];
+        msg->len = (unsigned short)n;
+        msg->data[n] = '\0';
+        msg->peer_port = udp->peer_port;
+        U_memcpy(&msg->peer_addr, &udp->peer_addr, sizeof(msg->peer_addr));
+        batch->count++;
+    }
+
+    return (int)batch->count;
+}
+
+int SOCK_UdpSendBatch(S_Udp *udp, S_UdpBatch *batch)
+{
+    unsigned i;
+    int sent;
+
+    sent = 0;
+    for (i = 0; i < batch->count; i++)
+    {
+        if (SOCK_UdpSend(udp, &batch->msg[i].peer_addr, batch->msg[i].peer_port,
+                         batch->msg[i].data, batch->msg[i].len) > 0)
         {
-            fprintf(stderr, "UDP error %s\n", strerror(errno));
-            return -1;
+            sent++;
         }
     }
 
+    batch->count = 0;
+
+    return sent;
+}
+#endif /* S_HAS_MMSG */
+
+int SOCK_AddrFromString(S_Addr *addr, const char *str)
+{
+    U_bzero(addr, sizeof(*addr));
+
+    if (inet_pton(AF_INET, str, &addr->data[0]) == 1)
+    {
+        addr->af = S_AF_IPV4;
+        return 1;
+    }
+
+    if (inet_pton(AF_INET6, str, &addr->data[0]) == 1)
+    {
+        addr->af = S_AF_IPV6;
+        return 1;
+    }
+
     return 0;
 }
 
+int SOCK_AddrToString(const S_Addr *addr, unsigned short port, char *buf, unsigned bufsize)
+{
+    int af;
+    U_SStream ss;
+    char abuf[INET6_ADDRSTRLEN];
+
+    if      (addr->af == S_AF_IPV4) af = AF_INET;
+    else if (addr->af == S_AF_IPV6) af = AF_INET6;
+    else return 0;
+
+    if (!inet_ntop(af, (const void*)&addr->data[0], &abuf[0], sizeof(abuf)))
+        return 0;
+
+    U_sstream_init(&ss, buf, bufsize);
+    U_sstream_put_str(&ss, &abuf[0]);
+    if (port != 0)
+    {
+        U_sstream_put_str(&ss, " port: ");
+        U_sstream_put_long(&ss, (long)ntohs(port));
+    }
+
+    return ss.status == U_SSTREAM_OK;
+}
+
 void SOCK_UdpFree(S_Udp *udp)
 {
     if (udp->handle)
@@ -127,3 +127,42 @@ void SOCK_UdpFree(S_Udp *udp)
     U_bzero(udp, sizeof(*udp));
     udp->state = S_UDP_STATE_INIT;
 }
+
+/* Stream listeners aren't supported on Windows yet. */
+int SOCK_StreamListen(S_Stream *stream, const char *path, unsigned short port)
+{
+    (void)path;
+    (void)port;
+    U_bzero(stream, sizeof(*stream));
+    stream->state = S_STREAM_STATE_INIT;
+    return 0;
+}
+
+int SOCK_StreamAccept(S_Stream *listener, S_Stream *client)
+{
+    (void)listener;
+    (void)client;
+    return -1;
+}
+
+int SOCK_StreamRecv(S_Stream *stream, unsigned char *buf, unsigned bufsize)
+{
+    (void)stream;
+    (void)buf;
+    (void)bufsize;
+    return -1;
+}
+
+int SOCK_StreamSend(S_Stream *stream, const unsigned char *buf, unsigned len)
+{
+    (void)stream;
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+void SOCK_StreamFree(S_Stream *stream)
+{
+    U_bzero(stream, sizeof(*stream));
+    stream->state = S_STREAM_STATE_INIT;
+}
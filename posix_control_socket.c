@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2021-2023 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Unix domain socket for the daemon mode control interface.
+
+   Clients send '\n' terminated command lines, each line is handed to
+   GCF_ControlReceived(). The sockets are served from the main poll loop
+   via plControlPollFds() and plControlProcess().
+ */
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gcf.h"
+#include "u_mem.h"
+
+#define PL_MAX_CONTROL_CLIENTS 4
+#define PL_CONTROL_LINE_SIZE 1024
+
+#ifdef MSG_NOSIGNAL
+  #define PL_SEND_FLAGS MSG_NOSIGNAL
+#else
+  #define PL_SEND_FLAGS 0 /* macOS, SO_NOSIGPIPE is set per socket */
+#endif
+
+typedef struct
+{
+    int fd;
+    unsigned len;
+    char line[PL_CONTROL_LINE_SIZE];
+} PL_ControlClient;
+
+typedef struct
+{
+    int fd;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    PL_ControlClient clients[PL_MAX_CONTROL_CLIENTS];
+} PL_Control;
+
+static PL_Control plControl;
+
+static int plSetNonBlocking(int fd)
+{
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != -1 &&
+           fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+int PL_ControlOpen(const char *path)
+{
+    int fd;
+    size_t len;
+    struct stat st;
+    struct sockaddr_un addr;
+
+    len = strlen(path);
+    if (plControl.fd != 0 || len == 0 || len >= sizeof(addr.sun_path))
+        return 0;
+
+    /* remove a stale socket of a previous run, but nothing else */
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            PL_Printf(DBG_INFO, "control socket path exists: %s\n", path);
+            return 0;
+        }
+        unlink(path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return 0;
+
+    U_bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    U_memcpy(&addr.sun_path[0], path, len + 1);
+
+    if (!plSetNonBlocking(fd) ||
+        bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(fd, PL_MAX_CONTROL_CLIENTS) == -1)
+    {
+        PL_Printf(DBG_INFO, "failed to open control socket %s: %s\n", path, strerror(errno));
+        close(fd);
+        return 0;
+    }
+
+    plControl.fd = fd;
+    U_memcpy(&plControl.path[0], path, len + 1);
+
+    return 1;
+}
+
+int PL_ControlWrite(int client, const char *str)
+{
+    ssize_t n;
+    size_t pos;
+    size_t len;
+    PL_ControlClient *cl;
+
+    if (client < 0 || client >= PL_MAX_CONTROL_CLIENTS)
+        return 0;
+
+    cl = &plControl.clients[client];
+    if (cl->fd == 0)
+        return 0;
+
+    len = strlen(str);
+    for (pos = 0; pos < len;)
+    {
+        n = send(cl->fd, &str[pos], len - pos, PL_SEND_FLAGS);
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+        {
+            /* Peer is gone or doesn't read. The slot is released on the next
+               poll which reports the hangup, so the id isn't reused meanwhile. */
+            shutdown(cl->fd, SHUT_RDWR);
+            return 0;
+        }
+
+        pos += (size_t)n;
+    }
+
+    return 1;
+}
+
+void PL_ControlClose(void)
+{
+    unsigned i;
+
+    for (i = 0; i < PL_MAX_CONTROL_CLIENTS; i++)
+    {
+        if (plControl.clients[i].fd != 0)
+            close(plControl.clients[i].fd);
+        plControl.clients[i].fd = 0;
+    }
+
+    if (plControl.fd != 0)
+    {
+        close(plControl.fd);
+        unlink(plControl.path);
+        plControl.fd = 0;
+    }
+}
+
+/* Adds the listen and client sockets to \p fds (up to \p max entries).
+   Returns the number of added entries.
+ */
+unsigned plControlPollFds(struct pollfd *fds, unsigned max)
+{
+    unsigned i;
+    unsigned n;
+
+    if (plControl.fd == 0 || max == 0)
+        return 0;
+
+    fds[0].fd = plControl.fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    n = 1;
+
+    for (i = 0; i < PL_MAX_CONTROL_CLIENTS && n < max; i++)
+    {
+        if (plControl.clients[i].fd == 0)
+            continue;
+
+        fds[n].fd = plControl.clients[i].fd;
+        fds[n].events = POLLIN;
+        fds[n].revents = 0;
+        n++;
+    }
+
+    return n;
+}
+
+static void plControlCloseClient(GCF *gcf, int client)
+{
+    close(plControl.clients[client].fd);
+    plControl.clients[client].fd = 0;
+    plControl.clients[client].len = 0;
+    GCF_ControlClosed(gcf, client);
+}
+
+static void plControlAccept(void)
+{
+    int fd;
+    unsigned i;
+
+    for (;;)
+    {
+        fd = accept(plControl.fd, 0, 0);
+        if (fd == -1)
+            return; /* EAGAIN, nothing more queued */
+
+        for (i = 0; i < PL_MAX_CONTROL_CLIENTS; i++)
+        {
+            if (plControl.clients[i].fd == 0)
+                break;
+        }
+
+        if (i == PL_MAX_CONTROL_CLIENTS || !plSetNonBlocking(fd))
+        {
+            close(fd);
+            continue;
+        }
+
+#ifdef SO_NOSIGPIPE
+        {
+            int yes = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+        }
+#endif
+        plControl.clients[i].fd = fd;
+        plControl.clients[i].len = 0;
+    }
+}
+
+/* Reads from client \p i and hands complete lines to the core. */
+static void plControlRead(GCF *gcf, int client)
+{
+    int fd;
+    ssize_t n;
+    unsigned i;
+    unsigned start;
+    PL_ControlClient *cl;
+
+    cl = &plControl.clients[client];
+    fd = cl->fd;
+
+    n = read(fd, &cl->line[cl->len], sizeof(cl->line) - 1 - cl->len);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    if (n <= 0)
+    {
+        plControlCloseClient(gcf, client);
+        return;
+    }
+
+    cl->len += (unsigned)n;
+
+    for (i = 0, start = 0; i < cl->len; i++)
+    {
+        if (cl->line[i] != '\n')
+            continue;
+
+        cl->line[i] = '\0';
+        if (i > start && cl->line[i - 1] == '\r')
+            cl->line[i - 1] = '\0';
+
+        GCF_ControlReceived(gcf, client, &cl->line[start]);
+        start = i + 1;
+
+        if (cl->fd != fd) /* closed meanwhile */
+            return;
+    }
+
+    if (start == 0 && cl->len == sizeof(cl->line) - 1)
+    {
+        PL_ControlWrite(client, "error line too long\n");
+        plControlCloseClient(gcf, client);
+        return;
+    }
+
+    cl->len -= start;
+    if (start != 0 && cl->len != 0)
+        memmove(&cl->line[0], &cl->line[start], cl->len);
+}
+
+/* Serves the sockets after poll(), \p fds are the entries set by plControlPollFds(). */
+void plControlProcess(GCF *gcf, const struct pollfd *fds, unsigned nfds)
+{
+    unsigned i;
+    int client;
+
+    for (i = 1; i < nfds; i++)
+    {
+        if (fds[i].revents == 0)
+            continue;
+
+        for (client = 0; client < PL_MAX_CONTROL_CLIENTS; client++)
+        {
+            if (plControl.clients[client].fd == fds[i].fd)
+                break;
+        }
+
+        if (client == PL_MAX_CONTROL_CLIENTS)
+            continue;
+
+        if (fds[i].revents & POLLIN)
+            plControlRead(gcf, client);
+        else if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+            plControlCloseClient(gcf, client);
+    }
+
+    if (nfds && fds[0].revents & POLLIN)
+        plControlAccept();
+}
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2021-2023 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Serial I/O thread (USE_IO_THREAD), one per connected device.
+
+   The thread only reads and writes the serial port, so it keeps draining the
+   device while the main thread is busy with the state machine, terminal
+   output and logging. Data is exchanged via one single-producer
+   single-consumer ring per direction, each side is signalled through an
+   event fd (eventfd on Linux, a pipe elsewhere) which the other side polls.
+
+     main thread                          I/O thread
+       plIoWrite()  --> tx ring, txEvent -->  write(fd)
+       plIoRead()   <-- rx ring, rxEvent <--  read(fd)
+ */
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef PL_LINUX
+  #include <sys/eventfd.h>
+#endif
+
+#include "gcf.h"
+
+#define PL_IO_RING_SIZE 16384 /* power of two */
+#define PL_IO_RING_MASK (PL_IO_RING_SIZE - 1)
+#define PL_IO_CHUNK_SIZE 512
+#define PL_IO_MAX_THREADS 8
+#define PL_CACHE_LINE 64
+
+/* head is only written by the producer and tail only by the consumer,
+   they are kept on separate cache lines. */
+typedef struct
+{
+    unsigned head;
+    char pad0[PL_CACHE_LINE - sizeof(unsigned)];
+    unsigned tail;
+    char pad1[PL_CACHE_LINE - sizeof(unsigned)];
+    unsigned char buf[PL_IO_RING_SIZE];
+} PL_Ring;
+
+typedef struct
+{
+    int fd[2]; /* read, write end; the same fd for eventfd */
+} PL_Event;
+
+typedef struct PL_IoThread_t
+{
+    int used;
+    int fd;
+    int stop;
+    int hangup;
+    pthread_t thread;
+    PL_Event rxEvent; /* I/O thread -> main thread */
+    PL_Event txEvent; /* main thread -> I/O thread */
+    PL_Ring rx;
+    PL_Ring tx;
+} PL_IoThread;
+
+static PL_IoThread plIo[PL_IO_MAX_THREADS];
+
+/* Appends up to \p len bytes, returns the number of bytes written. */
+static unsigned plRingPush(PL_Ring *r, const unsigned char *data, unsigned len)
+{
+    unsigned i;
+    unsigned head;
+    unsigned space;
+
+    head = r->head;
+    space = PL_IO_RING_SIZE - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+    if (len > space)
+        len = space;
+
+    for (i = 0; i < len; i++)
+        r->buf[(head + i) & PL_IO_RING_MASK] = data[i];
+
+    __atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+/* Removes up to \p max bytes, returns the number of bytes read. */
+static unsigned plRingPop(PL_Ring *r, unsigned char *buf, unsigned max)
+{
+    unsigned i;
+    unsigned tail;
+    unsigned len;
+
+    tail = r->tail;
+    len = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+    if (len > max)
+        len = max;
+
+    for (i = 0; i < len; i++)
+        buf[i] = r->buf[(tail + i) & PL_IO_RING_MASK];
+
+    __atomic_store_n(&r->tail, tail + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+static int plEventOpen(PL_Event *ev)
+{
+#ifdef PL_LINUX
+    ev->fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev->fd[1] = ev->fd[0];
+    return ev->fd[0] != -1;
+#else
+    if (pipe(ev->fd) == -1)
+        return 0;
+
+    fcntl(ev->fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(ev->fd[1], F_SETFL, O_NONBLOCK);
+    fcntl(ev->fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ev->fd[1], F_SETFD, FD_CLOEXEC);
+    return 1;
+#endif
+}
+
+static void plEventClose(PL_Event *ev)
+{
+    if (ev->fd[1] != ev->fd[0])
+        close(ev->fd[1]);
+    close(ev->fd[0]);
+    ev->fd[0] = -1;
+    ev->fd[1] = -1;
+}
+
+static void plEventSignal(PL_Event *ev)
+{
+#ifdef PL_LINUX
+    unsigned long long one = 1;
+    (void)!write(ev->fd[1], &one, sizeof(one));
+#else
+    unsigned char one = 1;
+    (void)!write(ev->fd[1], &one, sizeof(one)); /* a full pipe is signalled already */
+#endif
+}
+
+static void plEventDrain(PL_Event *ev)
+{
+    unsigned char buf[64];
+
+    while (read(ev->fd[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+/* Writes queued tx data before the thread ends, like the synchronous
+   writes without I/O thread would have done. */
+static void plIoFlush(PL_IoThread *io, unsigned char *txbuf, unsigned txpos, unsigned txlen)
+{
+    int n;
+    struct pollfd pfd;
+
+    pfd.fd = io->fd;
+    pfd.events = POLLOUT;
+
+    for (;;)
+    {
+        if (txpos == txlen)
+        {
+            txpos = 0;
+            txlen = plRingPop(&io->tx, txbuf, PL_IO_CHUNK_SIZE);
+            if (txlen == 0)
+                return;
+        }
+
+        if (poll(&pfd, 1, 100) <= 0 || pfd.revents != POLLOUT)
+            return;
+
+        n = (int)write(io->fd, &txbuf[txpos], txlen - txpos);
+        if (n > 0)
+            txpos += (unsigned)n;
+        else if (n < 0 && errno != EAGAIN && errno != EINTR)
+            return;
+    }
+}
+
+static void *plIoThreadMain(void *arg)
+{
+    int n;
+    PL_IoThread *io;
+    unsigned rxlen;     /* read from fd, not yet in rx ring */
+    unsigned txlen;     /* taken from tx ring, not yet written */
+    unsigned txpos;
+    struct pollfd fds[2];
+    unsigned char rxbuf[PL_IO_CHUNK_SIZE];
+    unsigned char txbuf[PL_IO_CHUNK_SIZE];
+
+    io = arg;
+    rxlen = 0;
+    txlen = 0;
+    txpos = 0;
+
+    while (!__atomic_load_n(&io->stop, __ATOMIC_ACQUIRE))
+    {
+        if (txpos == txlen)
+        {
+            txpos = 0;
+            txlen = plRingPop(&io->tx, txbuf, sizeof(txbuf));
+        }
+
+        fds[0].fd = io->fd;
+        fds[0].events = (short)((rxlen == 0 ? POLLIN : 0) | (txpos != txlen ? POLLOUT : 0));
+        fds[0].revents = 0;
+        fds[1].fd = io->txEvent.fd[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        /* a full rx ring is retried shortly, the main thread is busy */
+        n = poll(fds, 2, rxlen != 0 ? 1 : -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+            plEventDrain(&io->txEvent);
+
+        if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+            break;
+
+        if (fds[0].revents & POLLIN)
+        {
+            n = (int)read(io->fd, rxbuf, sizeof(rxbuf));
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+                break;
+
+            if (n > 0)
+                rxlen = (unsigned)n;
+        }
+
+        if (rxlen != 0)
+        {
+            n = (int)plRingPush(&io->rx, rxbuf, rxlen);
+            if (n != 0)
+            {
+                rxlen -= (unsigned)n;
+                if (rxlen != 0)
+                    memmove(&rxbuf[0], &rxbuf[n], rxlen);
+                plEventSignal(&io->rxEvent);
+            }
+        }
+
+        if (txpos != txlen)
+        {
+            n = (int)write(io->fd, &txbuf[txpos], txlen - txpos);
+            if (n > 0)
+                txpos += (unsigned)n;
+            else if (n < 0 && errno != EAGAIN && errno != EINTR)
+                break;
+        }
+    }
+
+    if (__atomic_load_n(&io->stop, __ATOMIC_ACQUIRE))
+        plIoFlush(io, txbuf, txpos, txlen);
+
+    __atomic_store_n(&io->hangup, 1, __ATOMIC_RELEASE);
+    plEventSignal(&io->rxEvent);
+
+    return 0;
+}
+
+/*! Starts an I/O thread for the connected serial port \p fd, returns 0 on failure. */
+PL_IoThread *plIoStart(int fd)
+{
+    unsigned i;
+    PL_IoThread *io;
+
+    io = 0;
+    for (i = 0; i < PL_IO_MAX_THREADS && !io; i++)
+    {
+        if (!plIo[i].used)
+            io = &plIo[i];
+    }
+
+    if (!io)
+        return 0;
+
+    if (!plEventOpen(&io->rxEvent))
+        return 0;
+
+    if (!plEventOpen(&io->txEvent))
+    {
+        plEventClose(&io->rxEvent);
+        return 0;
+    }
+
+    /* the thread must not block in write() while data is waiting to be read */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    io->fd = fd;
+    io->stop = 0;
+    io->hangup = 0;
+    io->rx.head = io->rx.tail = 0;
+    io->tx.head = io->tx.tail = 0;
+
+    if (pthread_create(&io->thread, 0, plIoThreadMain, io) != 0)
+    {
+        PL_Printf(DBG_INFO, "failed to start I/O thread\n");
+        plEventClose(&io->rxEvent);
+        plEventClose(&io->txEvent);
+        return 0;
+    }
+
+    io->used = 1;
+    return io;
+}
+
+/*! Stops and joins the I/O thread after queued tx data is written. */
+void plIoStop(PL_IoThread *io)
+{
+    __atomic_store_n(&io->stop, 1, __ATOMIC_RELEASE);
+    plEventSignal(&io->txEvent);
+    pthread_join(io->thread, 0);
+
+    plEventClose(&io->rxEvent);
+    plEventClose(&io->txEvent);
+    io->used = 0;
+}
+
+/*! Returns the fd to poll for received data or hangup. */
+int plIoEventFd(PL_IoThread *io)
+{
+    return io->rxEvent.fd[0];
+}
+
+/*! Queues \p len bytes for sending, returns the number of queued bytes. */
+unsigned plIoWrite(PL_IoThread *io, const unsigned char *data, unsigned len)
+{
+    len = plRingPush(&io->tx, data, len);
+    if (len != 0)
+        plEventSignal(&io->txEvent);
+    return len;
+}
+
+/*! Reads up to \p max received bytes.
+    \returns the number of bytes, or -1 if the device is gone and everything was read.
+ */
+int plIoRead(PL_IoThread *io, unsigned char *buf, unsigned max)
+{
+    int hangup;
+    unsigned len;
+
+    plEventDrain(&io->rxEvent);
+
+    /* check before popping, so no data pushed before the hangup is missed */
+    hangup = __atomic_load_n(&io->hangup, __ATOMIC_ACQUIRE);
+    len = plRingPop(&io->rx, buf, max);
+
+    if (len == 0 && hangup)
+        return -1;
+
+    if (len == max) /* maybe more, keep the event fd readable */
+        plEventSignal(&io->rxEvent);
+
+    return (int)len;
+}
@@ -12,7 +12,7 @@
 
 #include <ftdi.h>
 
-int plResetLibFtdi()
+int plResetLibFtdi(const char *serialnum)
 {
     int ret;
     struct ftdi_context *ftdi;
@@ -25,7 +25,8 @@ int plResetLibFtdi()
 
     ftdi->module_detach_mode = AUTO_DETACH_REATACH_SIO_MODULE;
 
-    ret = ftdi_usb_open(ftdi, 0x0403, 0x6015);
+    /* only the device being flashed, not the first FT230X found */
+    ret = ftdi_usb_open_desc(ftdi, 0x0403, 0x6015, NULL, serialnum && serialnum[0] ? serialnum : NULL);
     if (ret < 0 && ret != -5)
     {
         fprintf(stderr, "unable to open ftdi device: %d (%s)\n", ret, ftdi_get_error_string(ftdi));
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2021-2023 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* Worker thread pool for blocking platform operations (USE_WORKER_POOL).
+
+   Device enumeration forks udevadm and resolves links, GPIO and FTDI resets
+   sleep and file reads wait on the disk. PL_RunJob() queues such a job and
+   one of the worker threads runs it, so the main thread keeps serving the
+   serial ports of all sessions meanwhile.
+
+   Finished jobs are signalled through an event fd (eventfd on Linux, a pipe
+   elsewhere) which the main loop polls. plPoolProcess() then delivers the
+   completion event to the session which started the job, so all GCF_*
+   calls stay on the main thread.
+
+     main thread                              worker thread
+       plPoolSubmit()  --> queued job -->       job(arg)
+       plPoolProcess() <-- done, event fd <--
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef PL_LINUX
+  #include <sys/eventfd.h>
+#endif
+
+#include "gcf.h"
+
+#define PL_POOL_THREADS 2
+#define PL_POOL_MAX_JOBS 16
+
+typedef enum
+{
+    PL_JOB_FREE,
+    PL_JOB_QUEUED,
+    PL_JOB_RUNNING,
+    PL_JOB_DONE
+} PL_JobState;
+
+typedef struct
+{
+    PL_JobState state;
+    unsigned long order;  /* jobs are started in the order queued */
+    PL_Job job;
+    void *arg;
+    GCF *gcf;
+    Event event;
+} PL_PoolJob;
+
+typedef struct
+{
+    int started;
+    int stop;
+    int fd[2]; /* read, write end; the same fd for eventfd */
+    unsigned long order;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t threads[PL_POOL_THREADS];
+    PL_PoolJob jobs[PL_POOL_MAX_JOBS];
+} PL_Pool;
+
+static PL_Pool plPool;
+
+static void plPoolSignal(void)
+{
+    ssize_t n;
+#ifdef PL_LINUX
+    unsigned long long one = 1;
+    n = write(plPool.fd[1], &one, sizeof(one));
+#else
+    unsigned char one = 1;
+    n = write(plPool.fd[1], &one, sizeof(one));
+#endif
+    (void)n; /* a full pipe is already signalled */
+}
+
+static void *plPoolThread(void *arg)
+{
+    unsigned i;
+    PL_PoolJob *job;
+
+    (void)arg;
+
+    pthread_mutex_lock(&plPool.mutex);
+    for (;;)
+    {
+        job = 0;
+        for (i = 0; i < PL_POOL_MAX_JOBS; i++)
+        {
+            if (plPool.jobs[i].state == PL_JOB_QUEUED && (!job || plPool.jobs[i].order < job->order))
+                job = &plPool.jobs[i];
+        }
+
+        if (!job)
+        {
+            if (plPool.stop)
+                break;
+            pthread_cond_wait(&plPool.cond, &plPool.mutex);
+            continue;
+        }
+
+        job->state = PL_JOB_RUNNING;
+        pthread_mutex_unlock(&plPool.mutex);
+
+        job->job(job->arg);
+
+        pthread_mutex_lock(&plPool.mutex);
+        job->state = PL_JOB_DONE;
+        plPoolSignal();
+    }
+    pthread_mutex_unlock(&plPool.mutex);
+
+    return 0;
+}
+
+/*! Starts the worker threads, returns 1 on success. */
+int plPoolStart(void)
+{
+    unsigned i;
+
+    if (plPool.started)
+        return 1;
+
+#ifdef PL_LINUX
+    plPool.fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    plPool.fd[1] = plPool.fd[0];
+    if (plPool.fd[0] == -1)
+        return 0;
+#else
+    if (pipe(plPool.fd) == -1)
+        return 0;
+    fcntl(plPool.fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(plPool.fd[1], F_SETFL, O_NONBLOCK);
+#endif
+
+    pthread_mutex_init(&plPool.mutex, 0);
+    pthread_cond_init(&plPool.cond, 0);
+
+    for (i = 0; i < PL_POOL_THREADS; i++)
+    {
+        if (pthread_create(&plPool.threads[i], 0, plPoolThread, 0) != 0)
+        {
+            PL_Printf(DBG_DEBUG, "failed to start worker thread\n");
+            break;
+        }
+    }
+
+    plPool.started = (int)i;
+    if (i == 0)
+    {
+        close(plPool.fd[0]);
+        if (plPool.fd[1] != plPool.fd[0])
+            close(plPool.fd[1]);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*! Waits for running and queued jobs and stops the worker threads.
+    Completion events which weren't processed are dropped.
+ */
+void plPoolStop(void)
+{
+    int i;
+
+    if (!plPool.started)
+        return;
+
+    pthread_mutex_lock(&plPool.mutex);
+    plPool.stop = 1;
+    pthread_cond_broadcast(&plPool.cond);
+    pthread_mutex_unlock(&plPool.mutex);
+
+    for (i = 0; i < plPool.started; i++)
+        pthread_join(plPool.threads[i], 0);
+
+    close(plPool.fd[0]);
+    if (plPool.fd[1] != plPool.fd[0])
+        close(plPool.fd[1]);
+
+    pthread_mutex_destroy(&plPool.mutex);
+    pthread_cond_destroy(&plPool.cond);
+    plPool.started = 0;
+}
+
+/*! Returns the fd which becomes readable when jobs have finished, or -1. */
+int plPoolFd(void)
+{
+    return plPool.started ? plPool.fd[0] : -1;
+}
+
+/*! Queues \p job for session \p gcf, returns 0 if the pool isn't running or full. */
+int plPoolSubmit(PL_Job job, void *arg, GCF *gcf, Event event)
+{
+    unsigned i;
+    PL_PoolJob *pj;
+
+    if (!plPool.started)
+        return 0;
+
+    pthread_mutex_lock(&plPool.mutex);
+    for (i = 0; i < PL_POOL_MAX_JOBS; i++)
+    {
+        pj = &plPool.jobs[i];
+        if (pj->state == PL_JOB_FREE)
+        {
+            pj->job = job;
+            pj->arg = arg;
+            pj->gcf = gcf;
+            pj->event = event;
+            pj->order = plPool.order++;
+            pj->state = PL_JOB_QUEUED;
+            pthread_cond_signal(&plPool.cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&plPool.mutex);
+
+    return i < PL_POOL_MAX_JOBS;
+}
+
+/*! Delivers the completion events of finished jobs, called by the main loop
+    when plPoolFd() is readable.
+ */
+void plPoolProcess(void)
+{
+    unsigned i;
+    ssize_t n;
+    GCF *gcf;
+    Event event;
+    PL_PoolJob *pj;
+    unsigned char buf[8];
+
+    do
+    {
+        n = read(plPool.fd[0], buf, sizeof(buf));
+    } while (n > 0 && plPool.fd[1] != plPool.fd[0]);
+
+    for (i = 0; i < PL_POOL_MAX_JOBS; i++)
+    {
+        pj = &plPool.jobs[i];
+
+        pthread_mutex_lock(&plPool.mutex);
+        gcf = 0;
+        event = EV_JOB_DONE;
+        if (pj->state == PL_JOB_DONE)
+        {
+            gcf = pj->gcf;
+            event = pj->event;
+            pj->state = PL_JOB_FREE;
+        }
+        pthread_mutex_unlock(&plPool.mutex);
+
+        /* the event handler may queue the next job */
+        if (gcf)
+            GCF_HandleEvent(gcf, event);
+    }
+}
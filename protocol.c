@@ -17,72 +17,50 @@
 #define T_FR_ESC     (unsigned char)0xDD
 #define ASC_FLAG     0x01
 
+/* Puts \p c escaped, returns the number of bytes. */
+static unsigned protPutEscaped(unsigned char c)
+{
+   if (c == FR_ESC)
+      return (unsigned)(PROT_Putc(FR_ESC) + PROT_Putc(T_FR_ESC));
+
+   if (c == FR_END)
+      return (unsigned)(PROT_Putc(FR_ESC) + PROT_Putc(T_FR_END));
+
+   return (unsigned)PROT_Putc(c);
+}
+
 void PROT_SendFlagged(const unsigned char *data, unsigned len)
 {
-   unsigned char c = 0;
+   PROT_SendFrame(data, len, 0);
+}
+
+/* Frames sent within an event handler are staged and written at once when
+   it returns, unless PROT_URGENT is set.
+ */
+void PROT_SendFrame(const unsigned char *data, unsigned len, unsigned flags)
+{
+   unsigned n = 0;
    unsigned short i = 0;
    unsigned short crc = 0;
 
    /* put an end before the packet */
-   PROT_Putc(FR_END);
+   n += (unsigned)PROT_Putc(FR_END);
 
    while (i < len)
    {
-      c = data[i++];
-      crc += c;
-
-      switch (c)
-      {
-      case FR_ESC:
-         PROT_Putc(FR_ESC);
-         PROT_Putc(T_FR_ESC);
-         break;
-      case FR_END:
-         PROT_Putc(FR_ESC);
-         PROT_Putc(T_FR_END);
-         break;
-      default:
-         PROT_Putc(c);
-         break;
-      }
+      crc += data[i];
+      n += protPutEscaped(data[i++]);
    }
 
-   c = (~crc + 1) & 0xFF;
-   if (c == FR_ESC)
-   {
-      PROT_Putc(FR_ESC);
-      PROT_Putc(T_FR_ESC);
-   }
-   else if (c == FR_END)
-   {
-      PROT_Putc(FR_ESC);
-      PROT_Putc(T_FR_END);
-   }
-   else
-   {
-      PROT_Putc(c);
-   }
-
-   c = ( (~crc + 1) >> 8)   & 0xFF;
-   if (c == FR_ESC)
-   {
-      PROT_Putc(FR_ESC);
-      PROT_Putc(T_FR_ESC);
-   }
-   else if (c == FR_END)
-   {
-      PROT_Putc(FR_ESC);
-      PROT_Putc(T_FR_END);
-   }
-   else
-   {
-      PROT_Putc(c);
-   }
+   n += protPutEscaped((unsigned char)((~crc + 1) & 0xFF));
+   n += protPutEscaped((unsigned char)(((~crc + 1) >> 8) & 0xFF));
 
    /* tie off the packet */
-   PROT_Putc(FR_END);
+   n += (unsigned)PROT_Putc(FR_END);
 
-   PROT_Flush();
+   /* nothing put when disconnected, the flush reports it */
+   if ((flags & PROT_URGENT) || n == 0 || !PROT_Stage(n))
+      PROT_Flush();
 }
 
 void PROT_ReceiveFlagged(PROT_RxState *rx, const unsigned char *data, unsigned len)
@@ -131,6 +109,7 @@ nextTurn:
                }
                else
                {
+                   rx->crcErrors++;
                    PL_Printf(DBG_DEBUG, "invalid CRC\n");
                }
             }
@@ -15,14 +15,23 @@ typedef struct {
     unsigned bufpos;
     unsigned short crc;
     unsigned char escaped;
+    unsigned long crcErrors;
     unsigned char buf[256];
 } PROT_RxState;
 
+#define PROT_URGENT 0x01 /* write right away instead of when the event handler returns */
+
 /* Platform independent declarations. */
 void PROT_SendFlagged(const unsigned char *data, unsigned len);
+void PROT_SendFrame(const unsigned char *data, unsigned len, unsigned flags);
 void PROT_ReceiveFlagged(PROT_RxState *rx, const unsigned char *data, unsigned len);
 void PROT_Packet(const unsigned char *data, unsigned len);
 
+/*! Returns 1 if a frame of \p len encoded bytes is staged and written by the
+    core when the running event handler returns, 0 to write it now.
+ */
+int PROT_Stage(unsigned len);
+
 /*! Platform specific declarations.
     Following functions need to be implemented in the platform layer.
  */
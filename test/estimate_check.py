@@ -0,0 +1,127 @@
+# Compares the upload time predicted by -e with a measured flash.
+#
+# The pty stand-in is slowed down to a serial link: frames take their
+# time on the wire at the emulated baud rate, every response is delayed
+# by a request latency and data is written to flash at 2 ms per 256
+# bytes. A -b benchmark of the stand-in feeds -e, then a 60000 byte V3
+# image is flashed and the time from the update request to the last data
+# request is compared with the estimated upload phase. The device type
+# follows from the name of a symlink to the pty, ttyACM for a ConBee II
+# and ttyAMA for a RaspBee II.
+#
+# The stand-in has no GPIO reset and never disconnects, so its reset
+# phase runs into the UART timeout; only the upload phase is compared.
+# Not run by ctest, a run takes more than a minute.
+#
+# usage: estimate_check.py <GCFFlasher>
+
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+from fakedev import Device, make_gcf, slip_encode
+
+FLASH_US = 2000  # per 256 bytes
+
+
+class SerialDevice(Device):
+
+    def __init__(self, baud, latency):
+        Device.__init__(self, latency=latency)
+        self.baud = baud
+        self.times = {}
+
+    def wire(self, nbytes):
+        time.sleep(nbytes * 10.0 / self.baud)
+
+    def send(self, frame):
+        data = slip_encode(frame)
+        time.sleep(self.latency)
+        self.wire(len(data))
+        os.write(self.master, data)
+
+    def handle(self, f):
+        if not f:
+            return
+        self.wire(len(slip_encode(f)))
+        if f[0] == 0x81 and f[1] == 0x03:
+            self.times['update'] = time.time()
+        elif f[0] == 0x81 and f[1] == 0x84:
+            time.sleep(FLASH_US * 1e-6 * (len(f) - 9) / 256.0)
+            self.times['last'] = time.time()
+        Device.handle(self, f)
+
+
+def run(exe, dev, args):
+    stop = [False]
+
+    def pump():
+        while not stop[0]:
+            dev.poll(0.0005)
+
+    th = threading.Thread(target=pump)
+    th.start()
+    try:
+        p = subprocess.run([exe] + args, stdin=subprocess.PIPE, capture_output=True,
+                           text=True, timeout=120)
+    finally:
+        stop[0] = True
+        th.join()
+    return p.stdout
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: estimate_check.py <GCFFlasher>')
+        return 2
+    exe = sys.argv[1]
+
+    tmp = tempfile.mkdtemp()
+    failed = 0
+    try:
+        fw = os.path.join(tmp, 'fw_0x26780700.gcf')
+        report = os.path.join(tmp, 'bench.json')
+        make_gcf(fw, size=60000)
+
+        for link, baud in (('ttyACM0', 115200), ('ttyAMA0', 38400)):
+            path = os.path.join(tmp, link)
+            for latency in (0.0005, 0.002):
+                dev = SerialDevice(baud, latency)
+                os.symlink(dev.path, path)
+                out = run(exe, dev, ['-d', path, '-b', '0', '-t', '3', '-o', report])
+                rtt = re.search(r'mean (\d+)', out)
+                est = run(exe, dev, ['-d', path, '-f', fw, '-e', report])
+                upload = re.search(r'upload\s+(\d+) ms', est)
+                os.unlink(path)
+                dev.close()
+
+                dev = SerialDevice(baud, latency)
+                os.symlink(dev.path, path)
+                out = run(exe, dev, ['-d', path, '-f', fw, '-t', '60'])
+                os.unlink(path)
+                dev.close()
+
+                if not rtt or not upload or 'last' not in dev.times:
+                    failed += 1
+                    print('%s %6d baud latency %4.1f ms: FAIL' % (link, baud, latency * 1000))
+                    print(out[-1000:])
+                    continue
+
+                estimated = int(upload.group(1))
+                measured = (dev.times['last'] - dev.times['update']) * 1000
+                print('%s %6d baud latency %4.1f ms: rtt %s us, upload estimated %6d ms, measured %6d ms (%+.1f %%)' %
+                      (link, baud, latency * 1000, rtt.group(1), estimated, measured,
+                       (estimated - measured) * 100.0 / measured))
+    finally:
+        shutil.rmtree(tmp)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,140 @@
+# Stand-in for a ConBee II on a pty, for tests without hardware.
+#
+# The firmware answers the version query and the UART reset and then acts
+# as V3 bootloader: it answers the ID request, requests the image in chunks
+# and reports the CRC32 of the received image. Frames are SLIP encoded with
+# the 16-bit checksum of the serial protocol.
+
+import os
+import pty
+import random
+import select
+import struct
+import time
+import tty
+import zlib
+
+END, ESC, ESC_END, ESC_ESC = 0xC0, 0xDB, 0xDC, 0xDD
+
+BTL_VERSION = 0x00000302
+FW_VERSION = 0x26780700
+
+
+def slip_encode(frame):
+    crc = (~sum(frame) + 1) & 0xFFFF
+    frame = bytes(frame) + bytes([crc & 0xFF, crc >> 8])
+    out = bytearray([END])
+    for c in frame:
+        if c == END:
+            out += bytes([ESC, ESC_END])
+        elif c == ESC:
+            out += bytes([ESC, ESC_ESC])
+        else:
+            out.append(c)
+    out.append(END)
+    return bytes(out)
+
+
+def slip_decode(buf):
+    """Returns the frames in buf without their checksum."""
+    frames = []
+    cur = bytearray()
+    esc = False
+    for c in buf:
+        if c == END:
+            if len(cur) > 2:
+                frames.append(bytes(cur[:-2]))
+            cur = bytearray()
+        elif c == ESC:
+            esc = True
+        else:
+            if esc:
+                c = {ESC_END: END, ESC_ESC: ESC}.get(c, c)
+                esc = False
+            cur.append(c)
+    return frames
+
+
+class Device:
+    """A pty whose slave side is passed to GCFFlasher via -d.
+
+    poll() must be called in a loop while GCFFlasher runs, the image
+    received so far is in self.image.
+    """
+
+    def __init__(self, chunk=256, latency=0.0):
+        self.master, self.slave = pty.openpty()
+        tty.setraw(self.master)
+        self.path = os.ttyname(self.slave)
+        self.chunk = chunk
+        self.latency = latency
+        self.rx = b''
+        self.image = bytearray()
+        self.size = 0
+        self.done = False
+
+    def close(self):
+        os.close(self.master)
+        os.close(self.slave)
+
+    def send(self, frame):
+        if self.latency:
+            time.sleep(self.latency)
+        os.write(self.master, slip_encode(frame))
+
+    def request_next(self):
+        offset = len(self.image)
+        if offset >= self.size:
+            crc = zlib.crc32(bytes(self.image)) & 0xFFFFFFFF
+            self.send(bytes([0x81, 0x82]) + struct.pack('<II', BTL_VERSION, crc))
+            self.done = True
+            return
+        n = min(self.chunk, self.size - offset)
+        self.send(bytes([0x81, 0x04]) + struct.pack('<IH', offset, n))
+
+    def handle(self, f):
+        if not f:
+            return
+        if f[0] == 0x0B:    # UART reset, the firmware reboots into the bootloader
+            self.send(bytes([0x0B, f[1], 0, 8, 0, 0x26, 0, 0x26]))
+        elif f[0] == 0x0D:  # firmware version
+            self.send(bytes([0x0D, f[1], 0, 9, 0]) + struct.pack('<I', FW_VERSION))
+        elif f[0] == 0x07:  # device state
+            self.send(bytes([0x07, f[1], 0, 8, 0, 0xAA, 0, 0]))
+        elif f[0] == 0x81 and f[1] == 0x02:  # bootloader ID request
+            self.send(bytes([0x81, 0x82]) + struct.pack('<II', BTL_VERSION, 0))
+        elif f[0] == 0x81 and f[1] == 0x03:  # firmware update request
+            self.size = struct.unpack('<I', f[2:6])[0]
+            self.image = bytearray()
+            self.send(bytes([0x81, 0x83, 0x00]))
+            time.sleep(0.01)
+            self.request_next()
+        elif f[0] == 0x81 and f[1] == 0x84:  # data response
+            offset, n = struct.unpack('<IH', f[3:9])
+            self.image[offset:offset + n] = f[9:9 + n]
+            self.request_next()
+
+    def poll(self, timeout=0.01):
+        r, _, _ = select.select([self.master], [], [], timeout)
+        if not r:
+            return
+        try:
+            self.rx += os.read(self.master, 4096)
+        except OSError:
+            return
+        i = self.rx.rfind(bytes([END]))
+        if i >= 0:
+            frames = slip_decode(self.rx[:i + 1])
+            self.rx = self.rx[i:]
+            for f in frames:
+                self.handle(f)
+
+
+def make_gcf(path, size=20000, file_type=30, address=0x5000):
+    """Writes a GCF file with random content, returns the image data."""
+    rnd = random.Random(1)
+    data = bytes(rnd.getrandbits(8) for _ in range(size))
+    header = struct.pack('<IBIIB', 0xCAFEFEED, file_type, address, size, 0)
+    with open(path, 'wb') as f:
+        f.write(header + data)
+    return data
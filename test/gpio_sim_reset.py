@@ -0,0 +1,139 @@
+# GPIO resets against simulated gpiochips of the gpio-sim kernel module.
+#
+# A RaspBee stand-in on a pty never answers, so the UART reset times out
+# and the RaspBee reset toggles line 17 of a chip labelled like the one
+# of a Raspberry Pi. A ConBee I stand-in must not reset a "ftdi-cbus" chip
+# which belongs to no USB device with its serial number.
+#
+# Needs root and gpio-sim (CONFIG_GPIO_SIM) with configfs mounted,
+# otherwise the test is skipped.
+#
+# usage: gpio_sim_reset.py <GCFFlasher>
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+from fakedev import Device
+
+SKIP = 77
+CONFIGFS = '/sys/kernel/config/gpio-sim'
+
+failed = 0
+
+
+def check(cond, what):
+    global failed
+    print(('PASS ' if cond else 'FAIL ') + what)
+    if not cond:
+        failed += 1
+
+
+def write(path, value):
+    with open(path, 'w') as f:
+        f.write(value)
+
+
+def read(path):
+    with open(path) as f:
+        return f.read().strip()
+
+
+class SimChip:
+    """A live gpio-sim chip with one bank of 32 lines."""
+
+    def __init__(self, name, label):
+        self.dir = os.path.join(CONFIGFS, name)
+        self.bank = os.path.join(self.dir, 'bank0')
+        os.mkdir(self.dir)
+        os.mkdir(self.bank)
+        write(os.path.join(self.bank, 'num_lines'), '32')
+        write(os.path.join(self.bank, 'label'), label)
+        write(os.path.join(self.dir, 'live'), '1')
+        self.sysfs = os.path.join('/sys/devices/platform', read(os.path.join(self.dir, 'dev_name')),
+                                  read(os.path.join(self.bank, 'chip_name')))
+
+    def value(self, line):
+        return read(os.path.join(self.sysfs, 'sim_gpio%d' % line, 'value'))
+
+    def remove(self):
+        write(os.path.join(self.dir, 'live'), '0')
+        os.rmdir(self.bank)
+        os.rmdir(self.dir)
+
+
+def reset(exe, linkname, chip, line):
+    """Runs -r on a hung stand-in, returns the output and the line values seen."""
+    tmp = tempfile.mkdtemp()
+    dev = Device()
+    dev.handle = lambda frame: None  # hung firmware
+    link = os.path.join(tmp, linkname)
+    os.symlink(dev.path, link)
+
+    seen = set()
+    stop = []
+
+    def sample():
+        while not stop:
+            seen.add(chip.value(line))
+            time.sleep(0.002)
+
+    sampler = threading.Thread(target=sample)
+    sampler.start()
+    try:
+        p = subprocess.Popen([exe, '-r', '-d', link, '-x', '3'], stdout=subprocess.PIPE,
+                             stderr=subprocess.STDOUT, universal_newlines=True)
+        t0 = time.time()
+        while p.poll() is None and time.time() - t0 < 20:
+            dev.poll()
+        if p.poll() is None:
+            p.kill()
+        out = p.communicate()[0]
+    finally:
+        stop.append(1)
+        sampler.join()
+        dev.close()
+        shutil.rmtree(tmp)
+
+    return out, seen
+
+
+def main():
+    exe = sys.argv[1]
+
+    if os.geteuid() != 0:
+        print('SKIP needs root')
+        return SKIP
+
+    if not os.path.isdir(CONFIGFS) and shutil.which('modprobe'):
+        subprocess.call(['modprobe', 'gpio-sim'], stderr=subprocess.DEVNULL)
+
+    if not os.path.isdir(CONFIGFS):
+        print('SKIP gpio-sim not available')
+        return SKIP
+
+    chip = SimChip('gcf-raspbee', 'pinctrl-bcm2835')
+    try:
+        out, seen = reset(exe, 'ttyAMA0', chip, 17)
+        check('RaspBee reset done' in out, 'RaspBee reset reported done')
+        check('1' in seen, 'gpio17 was driven high')
+    finally:
+        chip.remove()
+
+    chip = SimChip('gcf-ftdi', 'ftdi-cbus')
+    try:
+        out, seen = reset(exe, 'ttyUSB0', chip, 0)
+        check('FTDI reset done' not in out, 'FTDI reset of another device refused')
+        check(seen == set(['0']), 'CBUS0 was not touched')
+    finally:
+        chip.remove()
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
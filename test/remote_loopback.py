@@ -0,0 +1,97 @@
+# Remote flashing over loopback: a server (-p) and a client (-u) flash the
+# pty stand-in through 127.0.0.1.
+#
+# usage: remote_loopback.py <GCFFlasher>
+
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from fakedev import Device, make_gcf
+
+RF_MAGIC = 0xF5
+RF_OPEN_REQ = 0x01
+RF_OPEN_RSP = 0x81
+RF_STATUS_INVALID = 2
+
+failed = 0
+
+
+def check(cond, what):
+    global failed
+    print(('PASS ' if cond else 'FAIL ') + what)
+    if not cond:
+        failed += 1
+
+
+def free_port():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+def open_request(port, devpath):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.settimeout(2)
+    req = struct.pack('<BBHIH', RF_MAGIC, RF_OPEN_REQ, 1, 20000, 0)
+    req += bytes([len(devpath)]) + devpath.encode() + bytes([6]) + b'fw.gcf'
+    s.sendto(req, ('127.0.0.1', port))
+    try:
+        while True:
+            rsp = s.recv(2048)
+            if len(rsp) > 4 and rsp[1] == RF_OPEN_RSP:
+                return rsp[4]
+    except socket.timeout:
+        return -1
+    finally:
+        s.close()
+
+
+def main():
+    exe = sys.argv[1]
+    tmp = tempfile.mkdtemp()
+    fw = os.path.join(tmp, 'fw_0x26780700.gcf')
+    data = make_gcf(fw)
+    dev = Device()
+    port = free_port()
+
+    server = subprocess.Popen([exe, '-p', str(port), '-d', dev.path],
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        time.sleep(0.3)
+
+        if os.path.exists('/proc/net/udp'):
+            with open('/proc/net/udp') as f:
+                check('0100007F:%04X' % port in f.read(), 'server listens on 127.0.0.1 only')
+
+        check(open_request(port, '/dev/null') == RF_STATUS_INVALID, 'device not served is rejected')
+        check(open_request(port, dev.path[:-1]) == RF_STATUS_INVALID, 'prefix of the served device is rejected')
+
+        client = subprocess.Popen([exe, '-u', '127.0.0.1:%d' % port, '-d', dev.path, '-f', fw],
+                                  stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        t0 = time.time()
+        while client.poll() is None and time.time() - t0 < 60:
+            dev.poll()
+        if client.poll() is None:
+            client.kill()
+            client.wait()
+        check(client.returncode == 0, 'client exit code %s' % client.returncode)
+        check(bytes(dev.image) == data, 'device received the image')
+    finally:
+        server.kill()
+        server.wait()
+        dev.close()
+        shutil.rmtree(tmp)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,89 @@
+# Loop wakeup latency with and without real-time scheduling (-R) under
+# CPU load.
+#
+# Busy-loop hogs are pinned to one CPU and a 20000 byte image is flashed
+# to the pty stand-in with -A pinning the flasher to the same CPU, once
+# with normal scheduling and once with -R. The "loop wakeup latency" line
+# printed at the end is compared. -R needs root or CAP_SYS_NICE, without
+# it the second run falls back to normal scheduling.
+# Not run by ctest, the numbers depend on the host.
+#
+# usage: rt_latency.py <GCFFlasher> [--hogs <n>] [--cpu <cpu>] [--policy <policy>]
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from fakedev import Device, make_gcf
+
+HOG = 'while True: pass'
+
+
+def start_hogs(count, cpu):
+    hogs = []
+    for _ in range(count):
+        hogs.append(subprocess.Popen([sys.executable, '-c', HOG],
+                                     preexec_fn=lambda: os.sched_setaffinity(0, {cpu})))
+    return hogs
+
+
+def flash(exe, fw, data, args):
+    dev = Device()
+    t0 = time.time()
+    p = subprocess.Popen([exe, '-d', dev.path, '-f', fw] + args, stdin=subprocess.PIPE,
+                         stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    while p.poll() is None and time.time() - t0 < 60:
+        dev.poll(0.001)
+    if p.poll() is None:
+        p.kill()
+    out = p.communicate()[0]
+    ok = p.returncode == 0 and bytes(dev.image) == data
+    dev.close()
+
+    lines = [l.strip() for l in out.replace('\r', '\n').splitlines()
+             if 'latency' in l or 'not permitted' in l or 'failed to' in l]
+    return ok, lines
+
+
+def main():
+    args = sys.argv[1:]
+    if not args:
+        print('usage: rt_latency.py <GCFFlasher> [--hogs <n>] [--cpu <cpu>] [--policy <policy>]')
+        return 2
+
+    opt = {'--hogs': '2', '--cpu': '0', '--policy': 'fifo:20'}
+    exe = args.pop(0)
+    while len(args) >= 2 and args[0] in opt:
+        opt[args[0]] = args[1]
+        del args[:2]
+    cpu = int(opt['--cpu'])
+
+    tmp = tempfile.mkdtemp()
+    hogs = start_hogs(int(opt['--hogs']), cpu)
+    failed = 0
+    try:
+        fw = os.path.join(tmp, 'fw_0x26780700.gcf')
+        data = make_gcf(fw)
+
+        for name, extra in (('without -R', ['-A', str(cpu)]),
+                            ('-R ' + opt['--policy'], ['-A', str(cpu), '-R', opt['--policy']])):
+            ok, lines = flash(exe, fw, data, extra)
+            if not ok:
+                failed += 1
+            print('%-14s %s' % (name + ':', 'ok' if ok else 'FAIL'))
+            for l in lines:
+                print('    ' + l)
+    finally:
+        for h in hogs:
+            h.kill()
+            h.wait()
+        shutil.rmtree(tmp)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
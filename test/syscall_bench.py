@@ -0,0 +1,96 @@
+# System calls and CPU time per flash, to compare the poll() main loop
+# with the io_uring backend (-DUSE_IO_URING=ON).
+#
+# Each executable flashes the pty stand-in three times with a 100000 byte
+# image (391 chunks of 256 bytes). The calls are counted by the LD_PRELOAD
+# shim syscall_count.c, which is built with cc into a temporary directory.
+# Not run by ctest, the numbers depend on the host.
+#
+# usage: syscall_bench.py <GCFFlasher> [<GCFFlasher> ...] [--size <bytes>]
+
+import os
+import resource
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from fakedev import Device, make_gcf
+
+RUNS = 3
+
+
+def build_shim(tmp):
+    src = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'syscall_count.c')
+    so = os.path.join(tmp, 'syscall_count.so')
+    subprocess.check_call(['cc', '-O2', '-shared', '-fPIC', '-o', so, src, '-ldl'])
+    return so
+
+
+def flash(exe, shim, fw):
+    dev = Device()
+    env = dict(os.environ, LD_PRELOAD=shim)
+    r0 = resource.getrusage(resource.RUSAGE_CHILDREN)
+    t0 = time.time()
+    # stdin is an idle pipe like a terminal, the poll() loop waits on it
+    # while no device is open and would spin on /dev/null
+    p = subprocess.Popen([exe, '-d', dev.path, '-f', fw], env=env, stdin=subprocess.PIPE,
+                         stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    while p.poll() is None and time.time() - t0 < 60:
+        dev.poll(0.001)
+    if p.poll() is None:
+        p.kill()
+    err = p.communicate()[1]
+    elapsed = time.time() - t0
+    r1 = resource.getrusage(resource.RUSAGE_CHILDREN)
+    image = bytes(dev.image)
+    dev.close()
+
+    counts = {}
+    for line in err.splitlines():
+        if line.startswith('COUNTS'):
+            f = line.split()[1:]
+            counts = dict(zip(f[::2], map(int, f[1::2])))
+    cpu = (r1.ru_utime + r1.ru_stime) - (r0.ru_utime + r0.ru_stime)
+    return p.returncode, image, elapsed, cpu, counts
+
+
+def main():
+    args = sys.argv[1:]
+    size = 100000
+    if '--size' in args:
+        i = args.index('--size')
+        size = int(args[i + 1])
+        del args[i:i + 2]
+    if not args:
+        print('usage: syscall_bench.py <GCFFlasher> [<GCFFlasher> ...] [--size <bytes>]')
+        return 2
+
+    tmp = tempfile.mkdtemp()
+    try:
+        shim = build_shim(tmp)
+        fw = os.path.join(tmp, 'fw_0x26780700.gcf')
+        data = make_gcf(fw, size=size)
+        chunks = (size + 255) // 256
+        failed = 0
+
+        for exe in args:
+            for _ in range(RUNS):
+                rc, image, elapsed, cpu, c = flash(exe, shim, fw)
+                ok = rc == 0 and image == data
+                if not ok:
+                    failed += 1
+                calls = sum(c.get(k, 0) for k in ('poll', 'read', 'write', 'syscall'))
+                print('%s: %s %.2f s, cpu %.3f s, poll %d read %d write %d syscall %d, %.2f per chunk' %
+                      (exe, 'ok' if ok else 'FAIL rc %s' % rc, elapsed, cpu,
+                       c.get('poll', 0), c.get('read', 0), c.get('write', 0),
+                       c.get('syscall', 0), calls / float(chunks)))
+    finally:
+        shutil.rmtree(tmp)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2021-2024 dresden elektronik ingenieurtechnik gmbh.
+ * All rights reserved.
+ *
+ * The software in this package is published under the terms of the BSD
+ * style license a copy of which has been included with this distribution in
+ * the LICENSE.txt file.
+ *
+ */
+
+/* LD_PRELOAD shim for syscall_bench.py, counts the libc calls of the main
+   loop and prints them to stderr at exit:
+
+   COUNTS poll <n> read <n> write <n> syscall <n> ioctl <n>
+
+   The io_uring backend enters the kernel through syscall(), so its
+   io_uring_enter() calls are counted there.
+
+   cc -shared -fPIC -o syscall_count.so syscall_count.c -ldl
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static unsigned long countPoll;
+static unsigned long countRead;
+static unsigned long countWrite;
+static unsigned long countSyscall;
+static unsigned long countIoctl;
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    static int (*next)(struct pollfd*, nfds_t, int);
+
+    if (!next)
+        next = (int (*)(struct pollfd*, nfds_t, int))dlsym(RTLD_NEXT, "poll");
+
+    countPoll++;
+    return next(fds, nfds, timeout);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    static ssize_t (*next)(int, void*, size_t);
+
+    if (!next)
+        next = (ssize_t (*)(int, void*, size_t))dlsym(RTLD_NEXT, "read");
+
+    countRead++;
+    return next(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+    static ssize_t (*next)(int, const void*, size_t);
+
+    if (!next)
+        next = (ssize_t (*)(int, const void*, size_t))dlsym(RTLD_NEXT, "write");
+
+    countWrite++;
+    return next(fd, buf, count);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    static int (*next)(int, unsigned long, ...);
+    va_list ap;
+    void *arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void*);
+    va_end(ap);
+
+    if (!next)
+        next = (int (*)(int, unsigned long, ...))dlsym(RTLD_NEXT, "ioctl");
+
+    countIoctl++;
+    return next(fd, request, arg);
+}
+
+long syscall(long number, ...)
+{
+    static long (*next)(long, ...);
+    va_list ap;
+    long a[6];
+    int i;
+
+    va_start(ap, number);
+    for (i = 0; i < 6; i++)
+        a[i] = va_arg(ap, long);
+    va_end(ap);
+
+    if (!next)
+        next = (long (*)(long, ...))dlsym(RTLD_NEXT, "syscall");
+
+    countSyscall++;
+    return next(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+__attribute__((destructor)) static void printCounts(void)
+{
+    char buf[192];
+    int n;
+
+    n = snprintf(buf, sizeof(buf), "COUNTS poll %lu read %lu write %lu syscall %lu ioctl %lu\n",
+                 countPoll, countRead, countWrite, countSyscall, countIoctl);
+
+    /* write() of the shim would count itself */
+    if (n > 0)
+        (void)((ssize_t (*)(int, const void*, size_t))dlsym(RTLD_NEXT, "write"))(2, buf, (size_t)n);
+}
@@ -0,0 +1,81 @@
+#include "u_slab.h"
+
+void U_slab_init(U_Slab *slab, void *mem, unsigned long blockSize, unsigned count, unsigned short *refs)
+{
+	unsigned i;
+
+	slab->mem = (unsigned char*)mem;
+	slab->blockSize = blockSize;
+	slab->count = count;
+	slab->refs = refs;
+
+	for (i = 0; i < count; i++)
+		refs[i] = 0;
+}
+
+static unsigned U_slab_index(const U_Slab *slab, const void *block)
+{
+	unsigned long offset;
+
+	offset = (unsigned long)((const unsigned char*)block - slab->mem);
+	return (unsigned)(offset / slab->blockSize);
+}
+
+void *U_slab_alloc(U_Slab *slab)
+{
+	unsigned i;
+
+	for (i = 0; i < slab->count; i++)
+	{
+		if (slab->refs[i] == 0)
+		{
+			slab->refs[i] = 1;
+			return &slab->mem[i * slab->blockSize];
+		}
+	}
+
+	return 0;
+}
+
+void U_slab_ref(U_Slab *slab, const void *block)
+{
+	unsigned i;
+
+	i = U_slab_index(slab, block);
+	if (i < slab->count && slab->refs[i] < 0xFFFF)
+		slab->refs[i]++;
+}
+
+unsigned U_slab_unref(U_Slab *slab, const void *block)
+{
+	unsigned i;
+
+	i = U_slab_index(slab, block);
+	if (i >= slab->count || slab->refs[i] == 0)
+		return 0;
+
+	slab->refs[i]--;
+	return slab->refs[i];
+}
+
+unsigned U_slab_refs(const U_Slab *slab, const void *block)
+{
+	unsigned i;
+
+	i = U_slab_index(slab, block);
+	return i < slab->count ? slab->refs[i] : 0;
+}
+
+unsigned U_slab_free_count(const U_Slab *slab)
+{
+	unsigned i;
+	unsigned n;
+
+	for (i = 0, n = 0; i < slab->count; i++)
+	{
+		if (slab->refs[i] == 0)
+			n++;
+	}
+
+	return n;
+}
@@ -0,0 +1,33 @@
+#ifndef U_SLAB_H
+#define U_SLAB_H
+
+/* Pool of fixed-size blocks in caller provided memory.
+
+   Each block has a reference count, a block is free again when the
+   last reference is dropped. There is no dynamic allocation.
+*/
+
+typedef struct U_Slab
+{
+	unsigned char *mem;
+	unsigned long blockSize;
+	unsigned count;
+	unsigned short *refs; /* one per block */
+} U_Slab;
+
+void U_slab_init(U_Slab *slab, void *mem, unsigned long blockSize, unsigned count, unsigned short *refs);
+
+/* Returns a free block with one reference, or 0 if all are used. */
+void *U_slab_alloc(U_Slab *slab);
+
+void U_slab_ref(U_Slab *slab, const void *block);
+
+/* Drops a reference, returns the remaining references of the block. */
+unsigned U_slab_unref(U_Slab *slab, const void *block);
+
+unsigned U_slab_refs(const U_Slab *slab, const void *block);
+
+/* Returns the number of free blocks. */
+unsigned U_slab_free_count(const U_Slab *slab);
+
+#endif /* U_SLAB_H */